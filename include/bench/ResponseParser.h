@@ -0,0 +1,113 @@
+//
+// Created by asujy on 2026/10/19.
+//
+
+#ifndef RESPONSEPARSER_H
+#define RESPONSEPARSER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <strings.h>
+
+/*
+ * 压测/回放工具使用的HTTP响应解析器。
+ * 只解析状态码、Content-Length和Connection: close，响应体只计数不拷贝。
+ */
+class ResponseParser {
+public:
+    static constexpr std::size_t MAX_HEADER_SIZE = 64 * 1024;
+
+    void Reset() {
+        m_header.clear();
+        m_inBody = false;
+        m_bodyLeft = 0;
+        m_status = 0;
+        m_serverClose = false;
+    }
+
+    /*
+     * 每解析完一个响应调用一次onResponse(status, serverClose)，
+     * 回调返回false时停止解析剩余数据。响应格式错误时返回false。
+     */
+    template <typename F>
+    bool Feed(const char* data, std::size_t len, F onResponse) {
+        while (len > 0) {
+            if (m_inBody) {
+                const std::size_t n = static_cast<std::size_t>(
+                    std::min<uint64_t>(m_bodyLeft, len));
+                m_bodyLeft -= n;
+                data += n;
+                len -= n;
+                if (m_bodyLeft == 0) {
+                    m_inBody = false;
+                    if (!onResponse(m_status, m_serverClose)) {
+                        return true;
+                    }
+                }
+                continue;
+            }
+            const std::size_t old = m_header.size();
+            m_header.append(data, len);
+            auto pos = m_header.find("\r\n\r\n", old >= 3 ? old - 3 : 0);
+            if (pos == std::string::npos) {
+                return m_header.size() <= MAX_HEADER_SIZE;
+            }
+            const std::size_t consumed = pos + 4 - old;
+            m_header.resize(pos + 2);
+            ParseHeader();
+            m_header.clear();
+            data += consumed;
+            len -= consumed;
+            if (m_bodyLeft > 0) {
+                m_inBody = true;
+            } else if (!onResponse(m_status, m_serverClose)) {
+                return true;
+            }
+        }
+        return true;
+    }
+
+private:
+    void ParseHeader() {
+        m_status = 0;
+        m_bodyLeft = 0;
+        m_serverClose = false;
+        std::size_t lineStart = 0;
+        bool statusLine = true;
+        while (lineStart < m_header.size()) {
+            std::size_t lineEnd = m_header.find("\r\n", lineStart);
+            if (lineEnd == std::string::npos) {
+                lineEnd = m_header.size();
+            }
+            const char* line = m_header.c_str() + lineStart;
+            const std::size_t lineLen = lineEnd - lineStart;
+            if (statusLine) {
+                const char* space = static_cast<const char*>(std::memchr(line, ' ', lineLen));
+                if (space != nullptr) {
+                    m_status = std::atoi(space + 1);
+                }
+                statusLine = false;
+            } else if (lineLen > 15 && strncasecmp(line, "content-length:", 15) == 0) {
+                m_bodyLeft = std::strtoull(line + 15, nullptr, 10);
+            } else if (lineLen > 11 && strncasecmp(line, "connection:", 11) == 0) {
+                std::string value(line + 11, lineLen - 11);
+                if (value.find("close") != std::string::npos) {
+                    m_serverClose = true;
+                }
+            }
+            lineStart = lineEnd + 2;
+        }
+    }
+
+private:
+    std::string m_header;
+    bool m_inBody{false};
+    uint64_t m_bodyLeft{0};
+    int m_status{0};
+    bool m_serverClose{false};
+};
+
+#endif //RESPONSEPARSER_H
@@ -0,0 +1,50 @@
+//
+// Created by asujy on 2026/10/19.
+//
+
+#ifndef BUNDLE_H
+#define BUNDLE_H
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * 编译期打包进可执行文件的静态资源(cmake -DWEBSERVER_BUNDLE=ON)。
+ * 构建时由bundlegen遍历resources/，为每个文件预先生成200响应的状态行和头部
+ * (不含按配置决定的Cache-Control和按请求决定的Connection)，以及gzip变体，
+ * 并生成URL的完美哈希索引。运行时查找只需两次哈希和一次字符串比较，不分配内存，不读文件。
+ */
+namespace bundle {
+    struct Variant {
+        const char* head;       // 状态行到Content-Type
+        std::size_t headLen;
+        const char* body;       // 为空表示没有该变体
+        std::size_t bodyLen;
+        const char* etag;
+    };
+
+    struct Asset {
+        const char* path;       // 以/开头的URL路径
+        std::size_t pathLen;
+        uint64_t ino;           // 打包时文件的inode和修改时间，ETag与磁盘路径一致
+        uint64_t mtimeNs;
+        Variant identity;
+        Variant gzip;
+    };
+
+    // 生成器和运行时共用的哈希(FNV-1a，seed用于完美哈希的二次散列)
+    inline uint64_t Hash(const char* data, std::size_t len, uint32_t seed) {
+        uint64_t h = 0xcbf29ce484222325ULL ^ (static_cast<uint64_t>(seed) * 0x9E3779B97F4A7C15ULL);
+        for (std::size_t i = 0; i < len; ++i) {
+            h ^= static_cast<unsigned char>(data[i]);
+            h *= 0x100000001b3ULL;
+        }
+        return h ^ (h >> 32);
+    }
+
+    // 未打包或不存在时返回nullptr
+    const Asset* Find(const char* path, std::size_t len);
+    std::size_t Count();
+}
+
+#endif //BUNDLE_H
@@ -0,0 +1,135 @@
+//
+// Created by asujy on 2026/10/19.
+//
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * 流量录制，文件格式:
+ *   8字节魔数"WSCAP01\0"，之后是连续的记录:
+ *   [type:1字节][连接id:varint][时间戳(微秒,单调时钟):varint][长度:varint][数据]
+ *   长度和数据只有DATA记录才有。varint为LEB128编码。
+ * 记录按线程写入各自的无锁环形缓冲区，由后台线程批量落盘，
+ * 因此文件中的记录只在同一线程内有序，回放时需要按时间戳排序。
+ */
+namespace capture {
+    enum class RecordType : uint8_t {
+        OPEN = 1,    // 新连接
+        DATA = 2,    // 一次recv读到的请求数据
+        CLOSE = 3    // 连接关闭
+    };
+
+    constexpr char FILE_MAGIC[8] = {'W', 'S', 'C', 'A', 'P', '0', '1', '\0'};
+
+    struct Record {
+        RecordType type{RecordType::DATA};
+        uint64_t connId{0};
+        uint64_t timestamp{0};  // 微秒
+        std::string data;
+    };
+
+    /* 单生产者单消费者的字节环形缓冲区，空间不足时整条记录丢弃 */
+    class ByteRing {
+    public:
+        explicit ByteRing(std::size_t capacity) : m_capacity(capacity), m_buf(capacity) {}
+
+        // 两段数据作为一条记录一起写入，要么全部写入要么都不写
+        bool Push(const char* header, std::size_t headerLen, const char* data, std::size_t dataLen);
+        // 把当前可读的数据写入文件，返回写入的字节数
+        std::size_t Drain(std::FILE* file);
+
+    private:
+        const std::size_t m_capacity;   // 必须是2的幂
+        std::vector<char> m_buf;
+        // C++11的new不保证64字节对齐，用整个缓存行的填充把两个位置隔开，避免伪共享
+        char m_pad0[64];
+        std::atomic<uint64_t> m_head{0};  // 生产者写入位置
+        char m_pad1[64];
+        std::atomic<uint64_t> m_tail{0};  // 消费者读取位置
+        char m_pad2[64];
+    };
+
+    class Recorder {
+    public:
+        static constexpr std::size_t RING_SIZE = 1 << 22;   // 每个线程4MB
+        static constexpr std::size_t MAX_RECORD_HEADER = 32;
+
+        Recorder(const Recorder&) = delete;
+        Recorder& operator=(const Recorder&) = delete;
+
+        // 单例模式
+        static Recorder& Instance() {
+            static Recorder recorder;
+            return recorder;
+        }
+
+        static bool Enabled() {
+            return m_enabled.load(std::memory_order_relaxed);
+        }
+
+        static uint64_t NextConnId() {
+            return m_nextConnId.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        bool Start(const std::string& file);
+        void Stop();
+
+        void Add(RecordType type, uint64_t connId, const char* data, std::size_t len);
+
+        uint64_t Dropped() const {
+            return m_dropped.load(std::memory_order_relaxed);
+        }
+
+    private:
+        Recorder() = default;
+        ~Recorder() {
+            Stop();
+        }
+        ByteRing& LocalRing();
+        void WriterLoop();
+        void DrainAll();
+
+    private:
+        std::mutex m_mtx;   // 保护m_rings的注册和遍历
+        std::vector<std::unique_ptr<ByteRing>> m_rings;
+        std::FILE* m_file{nullptr};
+        std::thread m_writer;
+        std::atomic<bool> m_stop{false};
+        std::atomic<uint64_t> m_dropped{0};
+        static std::atomic<bool> m_enabled;
+        static std::atomic<uint64_t> m_nextConnId;
+    };
+
+    /* 读取录制文件 */
+    class Reader {
+    public:
+        bool Open(const std::string& file);
+        // 读完或格式错误时返回false
+        bool Next(Record& record);
+
+    private:
+        bool ReadVarint(uint64_t& value);
+
+    private:
+        std::unique_ptr<std::FILE, int(*)(std::FILE*)> m_file{nullptr, std::fclose};
+    };
+
+    // 每次读socket都会调用，没有开始录制时不会把读到的数据拷进录制缓冲区
+    inline void Emit(RecordType type, uint64_t connId, const char* data = nullptr, std::size_t len = 0) {
+        if (Recorder::Enabled()) {
+            Recorder::Instance().Add(type, connId, data, len);
+        }
+    }
+}
+
+#endif //CAPTURE_H
@@ -0,0 +1,127 @@
+//
+// Created by asujy on 2026/10/19.
+//
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ * 一个基于名字的虚拟主机，配置项为vhost.<主机名>.<key>，如 vhost.example.com.root = /srv/example。
+ * Host不匹配任何虚拟主机的请求由默认站点(resources/)处理。
+ */
+struct VirtualHostConfig {
+    std::string name;                 // 主机名(小写)
+    std::vector<std::string> aliases; // alias，逗号分隔的其他主机名
+    std::string root;                 // root，文档根目录，必须设置
+    std::size_t gzipCacheBytes{0};    // gzip_cache_bytes，该站点压缩变体缓存的上限，0表示与gzip_cache_bytes相同
+    bool ownCacheRules{false};        // 设置了cache_control，否则沿用全局规则
+    std::vector<std::pair<std::string, int>> cacheRules;  // cache_control，格式同全局的cache_control
+    std::vector<std::string> headers; // add_header，"Name: value"，可以出现多次，加在该站点的所有响应中
+};
+
+/*
+ * 服务器运行参数。优先级：默认值 < 配置文件 < 命令行。
+ * 配置文件每行一个 key = value，#开头为注释，key与Set()接受的一致。
+ */
+struct ServerConfig {
+    int port{0};                  // port，在0.0.0.0上监听的端口，设置了listen时可以为0
+    // listen，另外的监听地址，如"[::]:9006,unix:/run/webserver.sock"，见SocketAddress::Parse
+    std::vector<std::string> listen;
+    int threadNumber{8};          // threads
+    int maxRequests{10000};       // queue_depth
+    int listenBacklog{8};         // listen_backlog
+    int maxEvents{10000};         // max_events
+    int maxFd{65535};             // max_fd
+    std::size_t readBufferSize{4096};   // read_buffer_size
+    std::size_t writeBufferSize{2048};  // write_buffer_size
+    std::size_t writeBudgetBytes{256 * 1024};  // write_budget_bytes，一次写事件最多写出的字节数，0表示不限制
+    int writeBudgetWrites{16};    // write_budget_writes，一次写事件最多调用writev的次数，0表示不限制
+    uint64_t maxBodySize{0};      // max_body_size，请求体上限，超过时回复413，0表示不限制
+    std::size_t chunkSize{16 * 1024};  // chunk_size，分块响应每块的最大字节数
+    std::string uploadDir{"/tmp"};     // upload_dir，上传的临时文件目录
+    uint64_t maxUploadSize{1024ULL * 1024 * 1024};  // upload_max_size，上传大小上限，0表示不限制
+    std::string uploadPath;       // upload_path，上传端点的前缀，如/upload/，为空时关闭
+    bool http2{true};             // http2，接受以连接前言开头的明文HTTP/2(h2c)
+    uint32_t h2MaxStreams{128};   // h2_max_streams，每个HTTP/2连接的并发流数
+    int tlsPort{0};               // tls_port，HTTPS端口，0表示不监听
+    std::vector<std::string> tlsListen;  // tls_listen，另外的HTTPS监听地址，格式同listen
+    std::string tlsCert;          // tls_cert，PEM证书链
+    std::string tlsKey;           // tls_key，PEM私钥
+    long tlsSessionCache{20480};  // tls_session_cache，服务端会话缓存条目数，0表示只用会话票据
+    long tlsSessionTimeout{300};  // tls_session_timeout，会话有效期(秒)
+    bool ktls{true};              // ktls，内核支持时把TLS加密交给内核
+    // proxy_pass，如"/api/=127.0.0.1:9000 127.0.0.1:9001,/app/=unix:/run/app.sock"，按路径前缀转发给上游
+    std::vector<std::pair<std::string, std::vector<std::string>>> proxyRules;
+    int proxyConnectTimeoutMs{1000};  // proxy_connect_timeout_ms
+    int proxyReadTimeoutMs{30000};    // proxy_read_timeout_ms，上游两次读写之间的最长间隔
+    int proxyIdleTimeout{60};         // proxy_idle_timeout，池中空闲连接的保留时间(秒)
+    int proxyMaxIdle{32};             // proxy_max_idle，每个上游地址最多保留的空闲连接
+    int proxyHealthInterval{5};       // proxy_health_interval，健康检查间隔(秒)，0表示关闭
+    std::string proxyHealthPath;      // proxy_health_path，为空时只检查能否建立连接
+    std::string wsPath;               // ws_path，内置的WebSocket发布/订阅端点，以/结尾，为空时关闭
+    std::size_t wsMaxMessage{1024 * 1024};  // ws_max_message，收到的消息的上限
+    std::size_t wsQueueLimit{256};    // ws_queue_limit，每个连接排队等待发送的消息数
+    bool wsSlowClose{false};          // ws_slow_policy，drop(丢弃最旧的消息)或close(关闭连接)
+    std::string metricsPath{"/metrics"};
+    std::string tracePath{"/debug/trace"};
+    std::string healthPath{"/healthz"};   // health_path，空字符串表示关闭
+    std::string delayPath;        // delay_path，延迟响应的调试端点，如/debug/delay/，为空时关闭
+    std::string captureFile;
+    std::string logFile{"Web.log"};
+    // cache_control，如"/images/=86400,/=60"，按最长路径前缀设置Cache-Control: max-age
+    std::vector<std::pair<std::string, int>> cacheRules;
+    bool gzip{true};              // gzip，按Accept-Encoding返回压缩变体
+    std::size_t gzipCacheBytes{64 * 1024 * 1024};  // gzip_cache_bytes，压缩变体缓存上限
+    int gzipLevel{6};             // gzip_level，1-9
+    std::size_t gzipMinSize{256}; // gzip_min_size，更小的文件不压缩
+    // gzip_types，按扩展名选择要压缩的文件
+    std::vector<std::string> gzipTypes{".html", ".htm", ".css", ".js", ".json", ".txt", ".svg", ".xml"};
+    int reactorCpu{-1};           // reactor_cpu，-1表示不绑核
+    std::vector<int> workerCpus;  // worker_cpus，如"2-5,8"，工作线程轮流绑定
+    bool numa{false};             // 连接和缓冲区从reactor所在NUMA节点分配
+    bool loadShedding{true};      // load_shedding，按队列逗留时间做准入控制
+    int shedTargetMs{5};          // shed_target_ms，可接受的最小队列逗留时间
+    int shedIntervalMs{100};      // shed_interval_ms，统计窗口
+    int maxConnections{0};        // max_connections，超过时新连接直接回复503，0表示max_fd
+    int retryAfter{1};            // retry_after，503/429响应中的Retry-After(秒)
+    int drainTimeout{30};         // drain_timeout，平滑重启或退出时等待现有连接结束的最长时间(秒)
+    // 按客户端IP限流，均为0时关闭
+    int clientConnRate{0};        // client_conn_rate，每秒新建连接数
+    int clientConnBurst{0};       // client_conn_burst，0表示与client_conn_rate相同
+    int clientMaxConns{0};        // client_max_conns，并发连接数
+    int clientRequestRate{0};     // client_request_rate，每秒请求数
+    int clientRequestBurst{0};    // client_request_burst，0表示与client_request_rate相同
+    int clientTableSize{65536};   // client_table_size，限流表项数
+    std::vector<VirtualHostConfig> vhosts;  // 按第一次出现的顺序
+
+    // 设置单个参数，失败时error给出原因
+    bool Set(const std::string& key, const std::string& value, std::string& error);
+    // 解析"key=value"形式的命令行覆盖项
+    bool Override(const std::string& item, std::string& error);
+    bool Load(const std::string& file, std::string& error);
+
+    std::string ToString() const;
+
+private:
+    // key为去掉"vhost."之后的"<主机名>.<key>"
+    bool SetVirtualHost(const std::string& key, const std::string& value, std::string& error);
+};
+
+// 解析"0-3,8,10-11"形式的CPU列表
+bool ParseCpuList(const std::string& text, std::vector<int>& cpus);
+// 解析"/images/=86400,/=60"形式的缓存规则
+bool ParseCacheRules(const std::string& text, std::vector<std::pair<std::string, int>>& rules);
+// 解析"/api/=127.0.0.1:9000 127.0.0.1:9001,/app/=unix:/run/app.sock"形式的转发规则
+bool ParseProxyRules(const std::string& text, std::vector<std::pair<std::string, std::vector<std::string>>>& rules);
+// 解析"[::]:9006,unix:/run/webserver.sock"形式的监听地址列表
+bool ParseListenList(const std::string& text, std::vector<std::string>& addresses);
+// 解析".html,.css,js"形式的扩展名列表，缺少的点号自动补上
+bool ParseExtensionList(const std::string& text, std::vector<std::string>& extensions);
+
+#endif //CONFIG_H
@@ -0,0 +1,44 @@
+//
+// Created by asujy on 2026/10/19.
+//
+
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+#include <cstddef>
+#include <string>
+#include <sys/types.h>
+#include <utility>
+#include <vector>
+
+/*
+ * 平滑重启时把监听socket交给新的进程。
+ * 旧进程fork+exec自己的可执行文件，通过一对Unix域socket用SCM_RIGHTS发送监听fd和对应的地址，
+ * 新进程用同一个socket在开始accept前回复一个字节。监听socket在两个进程间是同一个内核对象，
+ * 交接期间积压队列中的连接不会丢失，也不需要SO_REUSEPORT。
+ * 新进程启动失败时旧进程在channel上读到EOF，继续提供服务。
+ */
+namespace handoff {
+    constexpr const char* ENV_NAME = "WEBSERVER_HANDOFF_FD";  // 新进程中channel的fd
+    constexpr std::size_t MAX_SOCKETS = 64;
+
+    // 监听地址(配置中的写法)和fd
+    using Sockets = std::vector<std::pair<std::string, int>>;
+
+    /*
+     * 旧进程：以args启动exe，发送sockets。成功时返回channel的fd(新进程就绪时可读)和子进程pid，失败时返回-1。
+     * exe应在启动时取得，之后可执行文件可能已被替换。
+     */
+    int Spawn(const std::string& exe, const std::vector<std::string>& args, const Sockets& sockets, pid_t& pid);
+
+    /*
+     * 新进程：接收旧进程发来的监听socket。不是由Spawn启动时channel为-1并返回true；
+     * 接收失败时返回false，新进程应直接退出，旧进程读到EOF后继续服务。
+     */
+    bool Receive(Sockets& sockets, int& channel);
+
+    // 新进程：开始accept前通知旧进程，并关闭channel
+    void Ready(int channel);
+}
+
+#endif //HANDOFF_H
@@ -0,0 +1,56 @@
+//
+// Created by asujy on 2026/10/19.
+//
+
+#ifndef LOADSHEDDER_H
+#define LOADSHEDDER_H
+
+#include <atomic>
+#include <cstdint>
+
+/*
+ * CoDel风格的准入控制。
+ * 工作线程出队时上报请求在队列中的逗留时间(sojourn)，每个interval统计一次最小逗留时间：
+ * 若整个interval内最小值都超过target，说明队列中存在持续的积压(而不是突发)，
+ * 此时按Little定律把队列深度上限收紧到"本interval的出队速率 x target"，
+ * 超出上限的新请求在解析完请求行时被拒绝；一旦最小逗留时间回落到target以下就解除限制。
+ * OnEnqueue只在reactor线程调用，Admit和OnDequeue在工作线程调用，都只是relaxed原子操作，不加锁。
+ */
+class LoadShedder {
+public:
+    LoadShedder(uint64_t targetNs, uint64_t intervalNs, int minLimit)
+        : m_targetNs(targetNs), m_intervalNs(intervalNs),
+          m_minLimit(minLimit > 0 ? minLimit : 1) {}
+
+    LoadShedder(const LoadShedder&) = delete;
+    LoadShedder& operator=(const LoadShedder&) = delete;
+
+    // 是否接纳一个新请求
+    bool Admit() const {
+        const int64_t limit = m_limit.load(std::memory_order_relaxed);
+        return limit == 0 || m_depth.load(std::memory_order_relaxed) < limit;
+    }
+
+    void OnEnqueue() {
+        m_depth.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void OnDequeue(uint64_t sojournNs, uint64_t now);
+
+    // 当前队列深度上限，0表示未限制
+    int64_t Limit() const {
+        return m_limit.load(std::memory_order_relaxed);
+    }
+
+private:
+    const uint64_t m_targetNs;
+    const uint64_t m_intervalNs;
+    const int64_t m_minLimit;   // 上限至少保证所有工作线程有活干
+    std::atomic<int64_t> m_depth{0};
+    std::atomic<int64_t> m_limit{0};
+    std::atomic<uint64_t> m_windowStart{0};
+    std::atomic<uint64_t> m_windowMin{UINT64_MAX};
+    std::atomic<uint64_t> m_windowCount{0};
+};
+
+#endif //LOADSHEDDER_H
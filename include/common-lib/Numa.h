@@ -0,0 +1,56 @@
+//
+// Created by asujy on 2026/10/19.
+//
+
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+// 把当前线程绑定到指定CPU，cpu<0时不做任何事
+bool PinCurrentThread(int cpu);
+
+// CPU所在的NUMA节点，单节点机器或无法获知时返回-1
+int NumaNodeOfCpu(int cpu);
+
+/*
+ * 按NUMA节点分配的内存池，用于连接对象和读写缓冲区。
+ * 每次向系统申请一大块匿名内存并用mbind(MPOL_PREFERRED)绑定到指定节点，
+ * 之后按指针递增分配；内存只在池析构时整体释放。node<0时使用系统默认策略。
+ * 直接走mbind系统调用，不依赖libnuma。
+ */
+class NumaArena {
+public:
+    static constexpr std::size_t CHUNK_SIZE = 64 * 1024 * 1024;
+
+    explicit NumaArena(int node = -1) : m_node(node) {}
+    ~NumaArena();
+
+    NumaArena(const NumaArena&) = delete;
+    NumaArena& operator=(const NumaArena&) = delete;
+
+    // 线程安全，返回的内存已清零
+    void* Allocate(std::size_t size, std::size_t align = 64);
+
+    int Node() const {
+        return m_node;
+    }
+
+private:
+    struct Chunk {
+        char* base;
+        std::size_t size;
+    };
+
+    bool NewChunk(std::size_t size);
+
+private:
+    int m_node{-1};
+    std::mutex m_mtx;
+    std::vector<Chunk> m_chunks;
+    std::size_t m_used{0};  // 最后一块中已分配的字节数
+};
+
+#endif //NUMA_H
@@ -0,0 +1,94 @@
+//
+// Created by asujy on 2026/10/19.
+//
+
+#ifndef RATELIMITER_H
+#define RATELIMITER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+class SocketAddress;
+
+/*
+ * 按客户端源地址(SocketAddress::Key()，IPv6按/64前缀)限流：每秒新建连接数、并发连接数、每秒请求数。
+ * 两个速率限制都是令牌桶，用GCRA实现，每个桶只需一个"理论到达时间"(TAT)。
+ * 状态存放在固定大小的分片组相联哈希表中：地址哈希到某个分片的某一组，
+ * 组内WAYS路，未命中时淘汰组内最久未访问且没有活跃连接的表项(近似LRU)。
+ * 表项被淘汰只会让该客户端的限额重新开始计算，不会误伤其他客户端。
+ * 组内每一路都有活跃连接时不淘汰，新地址直接放行但不计数(UNTRACKED)，
+ * 否则被淘汰客户端的并发计数丢失，之后可以超过并发连接数上限。
+ * now由调用方传入(连接在reactor每次epoll_wait返回后取一次，请求在工作线程解析请求行时取)，
+ * 检查本身只有一次哈希和一次分片锁。
+ */
+class RateLimiter {
+public:
+    struct Options {
+        uint32_t connRate{0};       // 每秒新建连接数，0表示不限制
+        uint32_t connBurst{0};      // 允许的突发连接数，0表示与connRate相同
+        uint32_t maxConns{0};       // 并发连接数，0表示不限制
+        uint32_t requestRate{0};    // 每秒请求数，0表示不限制
+        uint32_t requestBurst{0};   // 允许的突发请求数，0表示与requestRate相同
+        std::size_t entries{65536}; // 表项总数
+    };
+
+    enum class Verdict : int {
+        ALLOW = 0,
+        CONN_RATE,      // 新建连接过快
+        CONN_LIMIT,     // 并发连接数超限
+        REQUEST_RATE,   // 请求过快
+        UNTRACKED       // 组内表项都有活跃连接，放行但不计数，连接关闭时不要ReleaseConnection
+    };
+
+    explicit RateLimiter(const Options& options);
+
+    RateLimiter(const RateLimiter&) = delete;
+    RateLimiter& operator=(const RateLimiter&) = delete;
+
+    // 通过时占用一个并发连接名额，连接关闭时需调用ReleaseConnection
+    Verdict AdmitConnection(const SocketAddress& addr, uint64_t now);
+    void ReleaseConnection(const SocketAddress& addr);
+    Verdict AdmitRequest(const SocketAddress& addr, uint64_t now);
+
+private:
+    static constexpr int SHARD_NUM = 64;
+    static constexpr int WAYS = 8;
+
+    struct Entry {
+        uint64_t key{0};
+        uint32_t conns{0};
+        uint64_t lastSeen{0};   // 0表示空闲表项
+        uint64_t connTat{0};
+        uint64_t requestTat{0};
+    };
+
+    // C++11的new不保证64字节对齐，用一整个缓存行的填充隔开相邻分片，避免伪共享
+    struct Shard {
+        std::mutex mtx;
+        std::vector<Entry> entries;
+        char padding[64];
+    };
+
+    struct Bucket {
+        uint64_t interval{0};   // 每个令牌的时间(ns)，0表示不限制
+        uint64_t tolerance{0};  // 可以提前消费的时间，即(burst - 1) * interval
+    };
+
+    static Bucket MakeBucket(uint32_t rate, uint32_t burst);
+    static bool Conform(uint64_t& tat, const Bucket& bucket, uint64_t now);
+    static bool MoreEvictable(const Entry& a, const Entry& b);
+
+    Shard& ShardOf(uint64_t key, std::size_t& set);
+    Entry* Lookup(Shard& shard, std::size_t set, uint64_t key, uint64_t now, bool create);
+
+private:
+    Bucket m_connBucket;
+    Bucket m_requestBucket;
+    uint32_t m_maxConns{0};
+    std::size_t m_setMask{0};
+    Shard m_shards[SHARD_NUM];
+};
+
+#endif //RATELIMITER_H
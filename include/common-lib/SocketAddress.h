@@ -0,0 +1,66 @@
+//
+// Created by asujy on 2026/10/19.
+//
+
+#ifndef SOCKETADDRESS_H
+#define SOCKETADDRESS_H
+
+#include <cstdint>
+#include <string>
+#include <sys/socket.h>
+
+/*
+ * 与协议族无关的socket地址：IPv4、IPv6或Unix域(文件路径或抽象命名空间)。
+ * 监听地址和accept得到的客户端地址都用它保存。
+ */
+class SocketAddress {
+public:
+    /*
+     * 解析监听地址："a.b.c.d:port"、"[ipv6]:port"、"unix:/path"或"unix:@name"(抽象命名空间)。
+     * 只接受数字地址，不做域名解析。
+     */
+    static bool Parse(const std::string& text, SocketAddress& addr);
+
+    sockaddr* Data() {
+        return reinterpret_cast<sockaddr*>(&m_storage);
+    }
+
+    const sockaddr* Data() const {
+        return reinterpret_cast<const sockaddr*>(&m_storage);
+    }
+
+    socklen_t Length() const {
+        return m_length;
+    }
+
+    // 交给accept/getsockname填写，调用前为缓冲区大小
+    socklen_t* LengthPtr() {
+        m_length = sizeof(m_storage);
+        return &m_length;
+    }
+
+    int Family() const {
+        return m_storage.ss_family;
+    }
+
+    // 文件系统中的Unix域地址(监听结束后需要unlink)
+    bool IsUnixPath() const;
+    const char* UnixPath() const;
+
+    // 客户端的IP(v4映射的IPv6地址写成IPv4)，Unix域为"unix:"
+    std::string Host() const;
+    // 带端口的完整地址，格式与Parse()接受的一致；未命名的Unix域客户端为"unix:"
+    std::string ToString() const;
+
+    /*
+     * 限流用的客户端键。IPv6取/64前缀(同一个站点通常分到同一个/64，按单个地址限流很容易绕过)；
+     * IPv4放进保留的0400::/8中，不会与IPv6前缀相同；Unix域的客户端都是本机进程，共用一个键。
+     */
+    uint64_t Key() const;
+
+private:
+    sockaddr_storage m_storage{};
+    socklen_t m_length{0};
+};
+
+#endif //SOCKETADDRESS_H
@@ -7,30 +7,44 @@
 
 #include <thread>
 #include <list>
+#include <vector>
+#include "common-lib/LoadShedder.h"
+#include "common-lib/Numa.h"
 #include "common-lib/Semaphore.h"
+#include "common-lib/Utils.h"
+#include "metrics/Metrics.h"
+#include "trace/Probes.h"
 
 template <typename T>
 class ThreadPool {
 public:
-    ThreadPool(int threadNumber = 8, int maxRequest = 10000);
+    // cpus非空时第i个工作线程绑定到cpus[i % cpus.size()]
+    ThreadPool(int threadNumber = 8, int maxRequest = 10000,
+               const std::vector<int>& cpus = std::vector<int>());
     ~ThreadPool();
 
     bool Append(T *request);
+
+    // 出入队时向shedder上报队列深度和逗留时间，需在第一次Append前设置
+    void SetLoadShedder(LoadShedder* shedder) {
+        m_shedder = shedder;
+    }
 private:
-    static void* Worker(ThreadPool *pool);
+    static void* Worker(ThreadPool *pool, int cpu);
     void Run();
 private:
     int m_threadNumber{0};
     std::vector<std::thread> m_threads;
     int m_maxRequests{0};
-    std::list<T*> m_workQueue;
+    std::list<std::pair<T*, uint64_t>> m_workQueue;  // 请求及其入队时间
     std::mutex m_queueLocker;
     Semaphore m_queueStat;
     std::atomic<bool> m_stop{false};
+    LoadShedder* m_shedder{nullptr};
 };
 
 template <typename T>
-ThreadPool<T>::ThreadPool(int threadNumber, int maxRequest) :
+ThreadPool<T>::ThreadPool(int threadNumber, int maxRequest, const std::vector<int>& cpus) :
     m_threadNumber(threadNumber), m_maxRequests(maxRequest), m_queueStat(0) {
         if (m_threadNumber <= 0 || m_maxRequests <= 0) {
             LOG_ERROR << "Threadpool constructor: threadNumber and "
@@ -40,8 +54,8 @@ ThreadPool<T>::ThreadPool(int threadNumber, int maxRequest) :
     m_threads.reserve(m_threadNumber);
     for (int i = 0; i < m_threadNumber; ++i) {
         try {
-            m_threads.emplace_back(Worker, this);
-            m_threads.back().detach();
+            const int cpu = cpus.empty() ? -1 : cpus[i % cpus.size()];
+            m_threads.emplace_back(Worker, this, cpu);
             LOG_DEBUG << "create the " << i << "th thread";
         } catch (const std::exception& e) {
             throw std::runtime_error(
@@ -56,6 +70,12 @@ ThreadPool<T>::~ThreadPool() {
     for (int i = 0; i < m_threadNumber; ++i) {
         m_queueStat.Post();
     }
+    // 工作线程处理完队列中剩余的请求后退出，之后才能释放它们引用的连接
+    for (auto& thread : m_threads) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
     std::lock_guard<std::mutex> locker(m_queueLocker);
     if (!m_workQueue.empty()) {
         LOG_ERROR << "threadpool destroyed with" << m_workQueue.size()
@@ -73,18 +93,25 @@ bool ThreadPool<T>::Append(T* request) {
     if (static_cast<int>(m_workQueue.size()) >= m_maxRequests) {
         LOG_WARN << "ThreadPool::Append(): threadpool task queue "
                     "is full (append failed)!!!";
+        metrics::Inc(metrics::Counter::POOL_REJECTED);
         return false;
     }
-    m_workQueue.emplace_back(request);
+    m_workQueue.emplace_back(request, GetMonotonicNanos());
+    metrics::Add(metrics::Gauge::POOL_QUEUE_DEPTH, 1);
+    if (m_shedder != nullptr) {
+        m_shedder->OnEnqueue();
+    }
+    WEBSERVER_PROBE2(pool_append, request, m_workQueue.size());
     m_queueStat.Post();
     return true;
 }
 
 template <typename T>
-void* ThreadPool<T>::Worker(ThreadPool* pool) {
+void* ThreadPool<T>::Worker(ThreadPool* pool, int cpu) {
     if (pool == nullptr) {
         return nullptr;
     }
+    PinCurrentThread(cpu);
     pool->Run();
     return pool;
 }
@@ -98,8 +125,19 @@ void ThreadPool<T>::Run() {
             continue;
         }
 
-        T* request = m_workQueue.front();
+        T* request = m_workQueue.front().first;
+        const uint64_t enqueueTime = m_workQueue.front().second;
         m_workQueue.pop_front();
+        // 处理请求时不持有队列锁，否则所有工作线程会被串行化
+        locker.unlock();
+        const uint64_t now = GetMonotonicNanos();
+        const uint64_t waitTime = now - enqueueTime;
+        metrics::Add(metrics::Gauge::POOL_QUEUE_DEPTH, -1);
+        metrics::Observe(metrics::Histogram::POOL_WAIT_US, waitTime / 1000);
+        WEBSERVER_PROBE2(pool_dequeue, request, waitTime);
+        if (m_shedder != nullptr) {
+            m_shedder->OnDequeue(waitTime, now);
+        }
         if (request != nullptr) {
             request->Process();
         }
@@ -5,8 +5,10 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <cstdint>
 #include <string>
 #include <signal.h>
+#include <ctime>
 
 using SignalHandler = void(*)(int);
 
@@ -14,9 +16,18 @@ void AddSignal(int sig, SignalHandler handler);
 
 std::string GetBasename(const std::string& path);
 std::string GetExecutableDir();
+// 可执行文件的绝对路径，失败时为空
+std::string GetExecutablePath();
 
 void AddFD(int epollfd, int fd, bool oneShot);
 void DelFD(int epollfd, int fd);
 void ModFD(int epollfd, int fd, int ev);
 
+// 单调时钟，单位纳秒
+uint64_t GetMonotonicNanos();
+
+// HTTP-date(RFC 7231 IMF-fixdate)，如"Sun, 06 Nov 1994 08:49:37 GMT"
+std::string FormatHttpDate(std::time_t t);
+bool ParseHttpDate(const char* text, std::time_t& t);
+
 #endif //UTILS_H
@@ -0,0 +1,141 @@
+//
+// Created by asujy on 2026/10/19.
+//
+
+#ifndef DEFERRED_H
+#define DEFERRED_H
+
+#include "http/HttpConn.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace http {
+    /*
+     * 延迟响应。处理函数调用HttpConn::Defer()拿到句柄后返回HTTP_CODE::DEFERRED_REQUEST，
+     * 工作线程随即释放；之后可在任意线程调用Reply()/Fail()完成响应。
+     * 完成的句柄经CompletionQueue交还给reactor，由reactor生成响应并重新注册EPOLLOUT，
+     * 连接本身只在reactor线程和(Process期间的)工作线程上被修改。
+     * 等待期间连接只监听对端关闭，客户端断开时句柄被取消并调用OnCancel注册的回调(在reactor线程)。
+     */
+    class Deferred : public std::enable_shared_from_this<Deferred> {
+    public:
+        Deferred(const Deferred&) = delete;
+        Deferred& operator=(const Deferred&) = delete;
+
+        // 返回200和响应体，contentType需为字符串常量。只有第一次完成生效
+        bool Reply(std::string content, const char* contentType);
+        // 以分块编码返回200，producer之后在reactor线程中调用，见HttpConn::Stream()
+        bool Stream(Producer producer, const char* contentType);
+        // 以错误状态完成，如NO_RESOURCE、INTERNAL_ERROR
+        bool Fail(HTTP_CODE code);
+
+        bool Cancelled() const {
+            return m_cancelled.load(std::memory_order_acquire);
+        }
+
+        // 已经取消时立即调用
+        void OnCancel(std::function<void()> callback);
+
+    private:
+        friend class ::HttpConn;
+        friend class CompletionQueue;
+
+        explicit Deferred(HttpConn* conn) : m_conn(conn) {}
+
+        bool Complete(HTTP_CODE code, std::string content, const char* contentType,
+                      Producer producer = Producer());
+        // Process返回和处理函数完成各调用一次，后到的一方把句柄交给reactor
+        void Release();
+        void Cancel();
+
+    private:
+        HttpConn* m_conn;
+        std::atomic<int> m_holds{2};
+        std::atomic<bool> m_completed{false};
+        std::atomic<bool> m_cancelled{false};
+        std::mutex m_mtx;
+        std::function<void()> m_onCancel;
+        HTTP_CODE m_code{HTTP_CODE::INTERNAL_ERROR};
+        std::string m_content;
+        const char* m_contentType{"text/plain"};
+        Producer m_producer;
+    };
+
+    // 已完成的Deferred，reactor监听Fd()(水平触发)，可读时调用Drain()
+    class CompletionQueue {
+    public:
+        CompletionQueue(const CompletionQueue&) = delete;
+        CompletionQueue& operator=(const CompletionQueue&) = delete;
+
+        // 单例模式
+        static CompletionQueue& Instance() {
+            static CompletionQueue queue;
+            return queue;
+        }
+
+        int Fd() const {
+            return m_eventFd;
+        }
+
+        void Push(std::shared_ptr<Deferred> deferred);
+        // 只在reactor线程调用
+        void Drain();
+
+    private:
+        CompletionQueue();
+        ~CompletionQueue();
+
+    private:
+        int m_eventFd{-1};
+        std::mutex m_mtx;
+        std::vector<std::shared_ptr<Deferred>> m_queue;
+    };
+
+    /*
+     * 到期后在定时线程中完成Deferred，如调试用的延迟响应。
+     * 句柄在到期前被取消(客户端断开)时从队列中移除，不再调用回调。
+     */
+    class DeferredTimer {
+    public:
+        using Callback = std::function<void(Deferred& deferred)>;
+
+        DeferredTimer(const DeferredTimer&) = delete;
+        DeferredTimer& operator=(const DeferredTimer&) = delete;
+
+        // 单例模式
+        static DeferredTimer& Instance() {
+            static DeferredTimer timer;
+            return timer;
+        }
+
+        void After(uint64_t ms, const std::shared_ptr<Deferred>& deferred, Callback callback);
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        DeferredTimer();
+        ~DeferredTimer();
+
+        void Run();
+        void Remove(const Deferred* deferred);
+
+    private:
+        std::mutex m_mtx;
+        std::condition_variable m_cond;
+        std::multimap<Clock::time_point, std::pair<std::shared_ptr<Deferred>, Callback>> m_timers;
+        bool m_stop{false};
+        std::thread m_thread;
+    };
+}
+
+#endif //DEFERRED_H
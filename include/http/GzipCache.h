@@ -0,0 +1,116 @@
+//
+// Created by asujy on 2026/10/19.
+//
+
+#ifndef GZIPCACHE_H
+#define GZIPCACHE_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace http {
+    /*
+     * 静态文件gzip压缩结果的缓存，以(dev, inode, size, mtime)标识文件，按总字节数做LRU淘汰。
+     * 请求路径上只查表：未命中时把文件交给后台线程，本次先返回原文件；
+     * 后台线程优先读取同目录下更新的.gz文件，没有时再用zlib压缩。
+     * 压缩后不比原文件小的也记一个空表项，避免反复压缩。
+     * 默认站点使用Instance()，每个虚拟主机另有一个实例，互不淘汰对方的表项。
+     */
+    class GzipCache {
+    public:
+        using Body = std::shared_ptr<const std::string>;
+
+        struct Options {
+            bool enabled{true};
+            std::size_t maxBytes{64 * 1024 * 1024};
+            int level{6};
+            std::size_t minSize{256};     // 更小的文件不值得压缩
+            std::vector<std::string> extensions{".html", ".htm", ".css", ".js", ".json",
+                                                ".txt", ".svg", ".xml"};
+            int site{-1};                 // metrics中的站点下标，-1表示不按站点统计
+        };
+
+        GzipCache() = default;
+        ~GzipCache();
+
+        GzipCache(const GzipCache&) = delete;
+        GzipCache& operator=(const GzipCache&) = delete;
+
+        // 单例模式
+        static GzipCache& Instance() {
+            static GzipCache cache;
+            return cache;
+        }
+
+        // 需在启动时调用
+        void Configure(const Options& options);
+
+        bool Enabled() const {
+            return m_options.enabled;
+        }
+
+        // 该文件是否有gzip变体(响应需要带Vary: Accept-Encoding)
+        bool Compressible(const std::string& path, const struct stat& st) const;
+
+        // 命中时返回压缩后的内容，否则返回空并在后台准备
+        Body Lookup(const std::string& path, const struct stat& st);
+
+    private:
+        struct Key {
+            uint64_t dev;
+            uint64_t ino;
+            uint64_t size;
+            uint64_t mtimeNs;
+
+            bool operator==(const Key& other) const {
+                return dev == other.dev && ino == other.ino &&
+                    size == other.size && mtimeNs == other.mtimeNs;
+            }
+        };
+
+        struct KeyHash {
+            std::size_t operator()(const Key& key) const {
+                return std::hash<uint64_t>()(key.ino * 0x9E3779B97F4A7C15ULL ^ key.mtimeNs ^ key.dev);
+            }
+        };
+
+        struct Entry {
+            Key key;
+            Body body;      // 为空表示压缩不划算
+        };
+
+        struct Job {
+            Key key;
+            std::string path;
+        };
+
+        static Key KeyOf(const struct stat& st);
+        void WorkerLoop();
+        Body Produce(const Job& job);
+        void Insert(const Key& key, const Body& body);
+
+    private:
+        Options m_options;
+        std::mutex m_mtx;
+        std::condition_variable m_cond;
+        std::list<Entry> m_lru;  // 表头最近使用
+        std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> m_index;
+        std::size_t m_bytes{0};
+        std::deque<Job> m_jobs;
+        std::unordered_set<Key, KeyHash> m_pending;  // 已排队或正在处理
+        std::thread m_worker;
+        bool m_stop{false};
+    };
+}
+
+#endif //GZIPCACHE_H
@@ -0,0 +1,93 @@
+//
+// Created by asujy on 2026/10/19.
+//
+
+#ifndef HPACK_H
+#define HPACK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ * HTTP/2头部压缩(RFC 7541)。解码支持静态表、动态表和Huffman编码；
+ * 编码不使用Huffman，响应中重复出现的头部(Content-Type、Vary等)加入动态表，
+ * 之后的响应只需一个字节的索引。
+ */
+namespace http {
+    namespace hpack {
+        using Header = std::pair<std::string, std::string>;
+
+        // 动态表，新条目在前。条目大小为名字和值的长度加32
+        class DynamicTable {
+        public:
+            explicit DynamicTable(std::size_t maxSize) : m_maxSize(maxSize) {}
+
+            void Add(std::string name, std::string value);
+            void SetMaxSize(std::size_t maxSize);
+
+            std::size_t MaxSize() const {
+                return m_maxSize;
+            }
+
+            std::size_t Count() const {
+                return m_entries.size();
+            }
+
+            // index从0开始，对应HPACK索引62
+            const Header& At(std::size_t index) const {
+                return m_entries[index];
+            }
+
+        private:
+            void Evict(std::size_t limit);
+
+        private:
+            std::deque<Header> m_entries;
+            std::size_t m_size{0};
+            std::size_t m_maxSize;
+        };
+
+        class Decoder {
+        public:
+            // maxSize为本端SETTINGS_HEADER_TABLE_SIZE，对端的表大小更新不能超过它
+            explicit Decoder(std::size_t maxSize = 4096) : m_table(maxSize), m_limit(maxSize) {}
+
+            // 解码一个完整的头部块，出错时返回false(连接错误COMPRESSION_ERROR)
+            bool Decode(const uint8_t* data, std::size_t len, std::vector<Header>& headers);
+
+        private:
+            bool Lookup(uint64_t index, const Header*& header) const;
+
+        private:
+            DynamicTable m_table;
+            std::size_t m_limit;
+        };
+
+        class Encoder {
+        public:
+            Encoder() : m_table(4096) {}
+
+            // 对端SETTINGS_HEADER_TABLE_SIZE变化时调用，下一个头部块开头会带上表大小更新
+            void SetMaxSize(std::size_t maxSize);
+
+            // 开始一个新的头部块
+            void Begin(std::string& out);
+            void EncodeStatus(int status, std::string& out);
+            // name需为小写。indexable为false的头部(如ETag)每次都不同，不进入动态表
+            void Encode(const std::string& name, const std::string& value, bool indexable, std::string& out);
+
+        private:
+            DynamicTable m_table;
+            bool m_sizeUpdate{false};
+        };
+
+        // Huffman解码，出错(填充不合法、含EOS)时返回false
+        bool HuffmanDecode(const uint8_t* data, std::size_t len, std::string& out);
+    }
+}
+
+#endif //HPACK_H
@@ -0,0 +1,132 @@
+//
+// Created by asujy on 2026/10/19.
+//
+
+#ifndef HTTP2SESSION_H
+#define HTTP2SESSION_H
+
+#include "http/HttpConn.h"
+#include "http/Hpack.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <sys/uio.h>
+#include <unordered_map>
+#include <vector>
+
+namespace http {
+    /*
+     * 明文HTTP/2(h2c，prior knowledge)连接。HttpConn在请求行的位置读到连接前言时切换到这里，
+     * 之后读写都转交给会话，线程模型不变：reactor读写socket，工作线程解析帧和处理请求。
+     *
+     * 每个流用一个不绑定socket的HttpConn作为请求上下文，路由、静态文件、Range、gzip、
+     * 打包资源和各种错误响应都沿用HTTP/1.1的代码。ProcessWrite()生成的响应头被转换成
+     * HPACK编码的HEADERS帧，响应体的iovec原样作为DATA帧的负载(文件映射区不拷贝)，
+     * 按流量控制窗口在各个流之间轮流发送。
+     * 暂不支持延迟响应(Defer)，处理函数返回DEFERRED_REQUEST时该流回复500。
+     */
+    class Http2Session {
+    public:
+        static constexpr std::size_t PREFACE_LEN = 24;
+        static constexpr std::size_t MAX_FRAME_SIZE = 16384;   // 本端接收的最大帧(协议默认值)
+
+        struct Options {
+            bool enabled{true};
+            uint32_t maxStreams{128};   // SETTINGS_MAX_CONCURRENT_STREAMS
+        };
+
+        explicit Http2Session(HttpConn& conn);
+        ~Http2Session();
+
+        Http2Session(const Http2Session&) = delete;
+        Http2Session& operator=(const Http2Session&) = delete;
+
+        static void Configure(const Options& options) {
+            m_options = options;
+        }
+
+        static bool Enabled() {
+            return m_options.enabled;
+        }
+
+        // data是否(可能)为连接前言的开头，len不足PREFACE_LEN时只比较已有的部分
+        static bool IsPreface(const char* data, std::size_t len);
+
+        // 连接前言之后已经读进HttpConn缓冲区的字节
+        bool Feed(const char* data, std::size_t len);
+        // reactor线程：把socket中的数据读进输入缓冲区，对端关闭或出错时返回false
+        bool Read();
+        // 输入缓冲区中还没处理的字节
+        std::size_t Buffered() const {
+            return m_inLen;
+        }
+        // 工作线程：处理输入缓冲区中完整的帧，生成要发送的帧
+        void Process();
+        // 写出排队的帧，不超过写预算；fromReactor为false时(工作线程)预算用完也不返回AGAIN
+        WRITE_RESULT Write(bool fromReactor);
+
+    private:
+        struct Stream;
+
+        bool HandleFrame(uint8_t type, uint8_t flags, uint32_t id, const uint8_t* payload, std::size_t len);
+        bool OnData(uint8_t flags, uint32_t id, const uint8_t* payload, std::size_t len);
+        bool OnHeaders(uint8_t flags, uint32_t id, const uint8_t* payload, std::size_t len);
+        bool OnHeaderBlock(uint32_t id, bool endStream);
+        bool OnSettings(uint8_t flags, uint32_t id, const uint8_t* payload, std::size_t len);
+        bool OnWindowUpdate(uint32_t id, const uint8_t* payload, std::size_t len);
+        void StartRequest(Stream& stream, std::vector<hpack::Header>& headers, bool endStream);
+        void Respond(Stream& stream, HTTP_CODE ret);
+
+        Stream* NewStream(uint32_t id);
+        Stream* FindStream(uint32_t id);
+        void ResetStream(uint32_t id, uint32_t error);
+        void CloseStream(Stream& stream);
+        void ReleaseClosed();
+        bool GoAway(uint32_t error);
+
+        void AppendFrame(uint8_t type, uint8_t flags, uint32_t id, const void* payload, std::size_t len);
+        void AppendWindowUpdate(uint32_t id, uint32_t increment);
+        bool Build();
+        bool BuildData(Stream& stream, std::size_t& frames);
+        void Arm(bool wantWrite);
+
+    private:
+        HttpConn& m_conn;
+        std::vector<char> m_in;             // 输入缓冲区，能放下一个最大帧
+        std::size_t m_inLen{0};
+
+        hpack::Decoder m_decoder;
+        hpack::Encoder m_encoder;
+        std::string m_headerBlock;          // HEADERS + CONTINUATION拼接出的头部块
+        uint32_t m_continuationId{0};       // 等待CONTINUATION的流，0表示没有
+        bool m_continuationEnd{false};      // 该HEADERS带END_STREAM
+
+        std::unordered_map<uint32_t, std::unique_ptr<Stream>> m_streams;
+        std::vector<Stream*> m_sending;     // 有响应体待发送的流，轮流发送
+        std::size_t m_next{0};
+        std::vector<std::unique_ptr<Stream>> m_closed;  // 等待排队的帧写完后回收
+        std::vector<std::unique_ptr<Stream>> m_free;    // 复用的流对象(含HttpConn和缓冲区)
+        uint32_t m_lastStreamId{0};
+
+        int64_t m_sendWindow{65535};        // 连接级发送窗口
+        int64_t m_initialWindow{65535};     // 对端SETTINGS_INITIAL_WINDOW_SIZE
+        std::size_t m_peerMaxFrame{MAX_FRAME_SIZE};
+
+        std::string m_out;                  // 待发送的控制帧和HEADERS帧
+        std::string m_sendingOut;           // 正在发送的m_out
+        std::vector<std::array<uint8_t, 9>> m_frameHeaders;  // 本批DATA帧的帧头，容量固定，地址不变
+        std::vector<struct iovec> m_iv;
+        std::size_t m_ivIndex{0};
+
+        bool m_goAway{false};               // 已发送GOAWAY，写完后关闭
+        bool m_peerGoAway{false};           // 对端发送了GOAWAY，现有的流完成后关闭
+        bool m_draining{false};             // 平滑重启时已发送NO_ERROR的GOAWAY，现有的流完成后关闭
+
+        static Options m_options;
+    };
+}
+
+#endif //HTTP2SESSION_H
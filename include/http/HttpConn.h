@@ -5,22 +5,72 @@
 #ifndef HTTPCONN_H
 #define HTTPCONN_H
 
+#include "http/GzipCache.h"
+#include "common-lib/SocketAddress.h"
+
 #include <atomic>
-#include <arpa/inet.h>
-#include <array>
+#include <functional>
+#include <memory>
+#include <string>
 #include <sys/stat.h>
+#include <sys/uio.h>
+#include <utility>
+#include <vector>
+
+class NumaArena;
+class RateLimiter;
+class LoadShedder;
+
+namespace http {
+    class Router;
+    struct RouteParams;
+    class Deferred;
+    class Http2Session;
+    class Proxy;
+    struct Upstream;
+    struct ProxyExchange;
+    class WebSocket;
+    struct WebSocketHandler;
+    struct Site;
+}
+
+namespace tls {
+    class Connection;
+}
+
+namespace bundle {
+    struct Variant;
+    struct Asset;
+}
 
 namespace http {
     namespace status {
+        constexpr const char* SWITCHING_101_TITLE = "Switching Protocols";
         constexpr const char* OK_200_TITLE = "OK";
+        constexpr const char* PARTIAL_206_TITLE = "Partial Content";
+        constexpr const char* NOT_MODIFIED_304_TITLE = "Not Modified";
         constexpr const char* ERROR_400_TITLE = "Bad Request";
         constexpr const char* ERROR_400_FORM = "Your request has bad syntax or is inherently impossible to satisfy.";
         constexpr const char* ERROR_403_TITLE = "Forbidden";
         constexpr const char* ERROR_403_FORM = "You do not have permission to get file from this server.";
         constexpr const char* ERROR_404_TITLE = "Not Found";
         constexpr const char* ERROR_404_FORM = "The requested file was not found on this server.";
+        constexpr const char* ERROR_405_TITLE = "Method Not Allowed";
+        constexpr const char* ERROR_405_FORM = "The requested method is not supported for this resource.";
+        constexpr const char* ERROR_413_TITLE = "Payload Too Large";
+        constexpr const char* ERROR_413_FORM = "The request body is larger than the server is willing to accept.";
+        constexpr const char* ERROR_416_TITLE = "Range Not Satisfiable";
+        constexpr const char* ERROR_416_FORM = "None of the requested ranges overlap the file.";
+        constexpr const char* ERROR_429_TITLE = "Too Many Requests";
+        constexpr const char* ERROR_429_FORM = "You are sending requests too fast, please slow down.";
         constexpr const char* ERROR_500_TITLE = "Internal Error";
         constexpr const char* ERROR_500_FORM = "There was an unusual problem serving the requested file.";
+        constexpr const char* ERROR_502_TITLE = "Bad Gateway";
+        constexpr const char* ERROR_502_FORM = "The upstream server is unreachable or sent an invalid response.";
+        constexpr const char* ERROR_503_TITLE = "Service Unavailable";
+        constexpr const char* ERROR_503_FORM = "The server is overloaded, please retry later.";
+        constexpr const char* ERROR_504_TITLE = "Gateway Timeout";
+        constexpr const char* ERROR_504_FORM = "The upstream server did not respond in time.";
     }
 
     enum class HTTP_METHOD : int {
@@ -34,6 +84,9 @@ namespace http {
         CONNECT
     };
 
+    // 方法名，与请求行中的写法一致
+    const char* MethodName(HTTP_METHOD method);
+
     enum class CHECK_STATE : int {
         CHECK_STATE_REQUESTLINE = 0,
         CHECK_STATE_HEADER,
@@ -54,29 +107,103 @@ namespace http {
         FORBIDDEN_REQUEST,   // 客户端对资源没有足够的访问权限
         FILE_REQUEST,        // 文件请求成功
         INTERNAL_ERROR,      // 服务器内部错误
-        CLOSED_CONNECTION    // 客户端关闭连接
+        CLOSED_CONNECTION,   // 客户端关闭连接
+        DYNAMIC_REQUEST,     // 响应体由服务器动态生成(如/metrics)
+        PARTIAL_REQUEST,     // 文件请求成功，只返回Range指定的部分
+        RANGE_NOT_SATISFIABLE, // Range中没有一个区间落在文件内
+        NOT_MODIFIED,        // 条件请求命中，只返回304头部，不打开文件
+        METHOD_NOT_ALLOWED,  // 路径存在但不支持该方法
+        DEFERRED_REQUEST,    // 处理函数调用了Defer()，响应稍后由Deferred完成
+        PAYLOAD_TOO_LARGE,   // 请求体超过max_body_size
+        STREAM_REQUEST,      // 响应体由Producer逐块生成，以分块编码发送
+        PROXY_REQUEST,       // 处理函数调用了ProxyPass()，请求和响应由reactor在客户端和上游之间转发
+        BAD_GATEWAY,         // 上游不可用或响应不合法
+        GATEWAY_TIMEOUT,     // 上游超时
+        WEBSOCKET_REQUEST,   // 处理函数调用了AcceptWebSocket()，回复101后切换为WebSocket
+        REJECTED             // 请求被限流或过载保护拒绝，由Process()回复预先生成的响应并关闭连接
+    };
+
+    // 请求体的解码状态
+    enum class BODY_STATE : int {
+        LENGTH = 0,     // 按Content-Length接收
+        CHUNK_SIZE,     // 等待块大小行
+        CHUNK_DATA,
+        CHUNK_CRLF,     // 块数据后的CRLF
+        TRAILER,        // 最后一块之后的尾部头部，直到空行
+        DONE
+    };
+
+    /*
+     * 请求体的接收函数。data直接指向读缓冲区，只在调用期间有效。
+     * 返回NO_REQUEST表示继续接收，其他值表示放弃剩余的请求体并以该值响应(之后关闭连接)。
+     * 请求体收完后以(nullptr, 0, true)最后调用一次，返回值即为响应。
+     */
+    using BodySink = std::function<HTTP_CODE(const char* data, std::size_t len, bool last)>;
+
+    /*
+     * 分块响应的数据源，在reactor线程中调用，不能阻塞。
+     * 向buf写入最多size字节并返回写入的字节数，返回0表示结束，负数表示出错(直接关闭连接)。
+     */
+    using Producer = std::function<ssize_t(char* buf, std::size_t size)>;
+
+    // 接收完成的上传，fd已定位到文件开头
+    struct UploadFile {
+        int fd{-1};
+        std::string path;
+        uint64_t size{0};
+    };
+
+    /*
+     * 上传完成后调用，返回值即为响应。返回后fd被关闭、文件被删除，
+     * 需要保留时在其中rename到别处。
+     */
+    using UploadHandler = std::function<HTTP_CODE(const UploadFile& upload)>;
+
+    enum class WRITE_RESULT : int {
+        DONE = 0,   // 发送完毕或遇到EAGAIN(已注册EPOLLOUT)，连接保持
+        AGAIN,      // 本轮写预算用完但socket仍可写，需要调用方稍后再次调用Write()
+        CLOSE,      // 出错或短连接发送完毕，应关闭连接
+        PIPELINED   // 发送完毕，读缓冲区中已有下一个请求，需要调用方交给线程池
     };
 }
 
 class HttpConn {
 public:
-    static constexpr uint32_t READ_BUFFER_SIZE = 4096;
-    static constexpr uint32_t WRITE_BUFFER_SIZE = 2048;
+    static constexpr std::size_t DEFAULT_READ_BUFFER_SIZE = 4096;
+    static constexpr std::size_t DEFAULT_WRITE_BUFFER_SIZE = 2048;
+    static constexpr std::size_t MAX_RANGES = 16;  // 超过时忽略Range，返回整个文件
+    static constexpr std::size_t MIN_BODY_WINDOW = 64;  // 头部之后至少要留给请求体的缓冲区
+    static constexpr std::size_t CHUNK_PREFIX = 18;  // 块大小的十六进制和CRLF
+    static constexpr std::size_t UPLOAD_PIPE_SIZE = 256 * 1024;
+    static constexpr std::size_t UPLOAD_STEP_BYTES = 4 * 1024 * 1024;  // 一次事件最多搬运的上传字节数
 
-    HttpConn() = default;
-    virtual ~HttpConn() = default;
+    HttpConn();
+    virtual ~HttpConn();
 
     // 禁止拷贝构造和拷贝赋值
     HttpConn(const HttpConn&) = delete;
     HttpConn& operator=(const HttpConn&) = delete;
-    HttpConn(HttpConn &&) noexcept = default;
-    HttpConn& operator=(HttpConn &&) noexcept = default;
+    HttpConn(HttpConn &&) noexcept;
+    HttpConn& operator=(HttpConn &&) noexcept;
 
-    void Init(int sockfd, const sockaddr_in &addr);
+    // listener为metrics中监听地址的下标，-1表示不按监听地址统计；
+    // limited表示限流器已为该连接计数，关闭时归还并发名额
+    void Init(int sockfd, const SocketAddress& addr, int listener = -1, bool limited = false);
     void CloseConn();
+    // 在TLS端口上接受的连接，Init之后调用，失败时需关闭连接
+    bool StartTls();
+    // TLS握手还没完成，读写事件交给Handshake()
+    bool IsHandshaking() const;
+    // reactor线程中推进TLS握手，失败时返回false
+    bool Handshake();
 
     bool Read();
-    bool Write();
+    http::WRITE_RESULT Write();
+
+    // 是否在等待下一轮Write()(上次返回AGAIN且之后没有被关闭)
+    bool IsWriteQueued() const {
+        return m_writeQueued;
+    }
 
     static int GetUserCount() {
         return m_user_count.load();
@@ -86,63 +213,347 @@ public:
         m_epollfd.store(fd);
     }
 
+    /*
+     * 设置读写缓冲区大小及分配它们的内存池(arena为空时使用默认内存池)。
+     * 缓冲区在连接槽位第一次使用时分配并一直复用，需在第一个连接建立前调用。
+     */
+    static void SetBuffers(std::size_t readSize, std::size_t writeSize, NumaArena* arena) {
+        m_readBufferSize = readSize;
+        m_writeBufferSize = writeSize;
+        m_arena = arena;
+    }
+
+    // 单次Write()最多写出的字节数和writev次数，0表示不限制
+    static void SetWriteBudget(std::size_t bytes, int writes) {
+        m_writeBudgetBytes = bytes;
+        m_writeBudgetWrites = writes;
+    }
+
+    /*
+     * 请求体上限(0表示不限制)和分块响应每块的最大字节数。
+     * 请求体不整体缓存，边读边交给处理函数，占用的内存只有读缓冲区。
+     */
+    static void SetStreaming(uint64_t maxBodySize, std::size_t chunkSize) {
+        m_maxBodySize = maxBodySize;
+        m_chunkSize = chunkSize;
+    }
+
+    // 上传的临时文件目录和上传大小上限(0表示不限制)，上传路由不受max_body_size限制
+    static void SetUpload(const std::string& dir, uint64_t maxSize) {
+        m_uploadDir = dir;
+        m_maxUploadSize = maxSize;
+    }
+
+    /*
+     * 按路径前缀设置Cache-Control: max-age，最长前缀优先，没有匹配时不发送Cache-Control。
+     * 需在启动时设置，之后只读。
+     */
+    static void SetCacheRules(const std::vector<std::pair<std::string, int>>& rules);
+
+    /*
+     * 设置请求分发的路由，需在启动时设置且已Compile()，之后只读。
+     * 没有设置时所有请求都按路径访问resources/下的文件。
+     */
+    static void SetRouter(const http::Router* router) {
+        m_router = router;
+    }
+
+    // 设置503/429响应中的Retry-After(秒)，并预先生成整个响应
+    static void SetRetryAfter(int seconds);
+
+    // 连接关闭时归还limiter中的并发连接名额；每个请求在解析完请求行时消耗一个令牌
+    static void SetRateLimiter(RateLimiter* limiter) {
+        m_rateLimiter = limiter;
+    }
+
+    // 过载保护，与限流在同一处按请求准入，队列积压时回复503
+    static void SetLoadShedder(const LoadShedder* shedder) {
+        m_shedder = shedder;
+    }
+
+    /*
+     * 平滑重启或退出：之后的响应都不再保持连接，HTTP/2会话发送GOAWAY。
+     * 由reactor在停止accept后调用，随后对每个连接调用Drain()。
+     */
+    static void SetDraining() {
+        m_draining.store(true);
+    }
+
+    static bool IsDraining() {
+        return m_draining.load(std::memory_order_relaxed);
+    }
+
+    // reactor线程：关闭空闲的keep-alive连接，WebSocket发送关闭帧(1001)，其余连接在当前请求完成后关闭
+    void Drain();
+
+    const SocketAddress& GetAddress() const {
+        return m_addr;
+    }
+
+    // 过载(503)或限流(429)时直接回复预先生成的响应并关闭连接
+    void Reject(int status = 503);
+    // 同上，用于还未Init的socket(如accept时连接数已满)
+    static void RejectSocket(int sockfd, int status = 503);
+
+    uint64_t GetRequestId() const {
+        return m_requestId;
+    }
+
     void Process();
 
+    /* 以下供路由的处理函数使用 */
+    http::HTTP_METHOD GetMethod() const {
+        return m_method;
+    }
+
+    // 请求行中的URL，含查询串
+    const char* GetUrl() const {
+        return m_url;
+    }
+
+    // URL中查询串之前的部分的长度
+    std::size_t GetPathLength() const {
+        return m_pathLength;
+    }
+
+    const std::string& GetHost() const {
+        return m_host;
+    }
+
+    // Content-Length，没有或分块编码时为0
+    uint64_t GetContentLength() const {
+        return m_contentLength;
+    }
+
+    bool HasBody() const {
+        return m_chunked || m_contentLength != 0;
+    }
+
+    // 正在接收请求体(此时的读事件不是新请求)
+    bool IsReadingBody() const {
+        return m_checkState == http::CHECK_STATE::CHECK_STATE_CONTENT;
+    }
+
+    // 已切换为HTTP/2，请求在各个流中单独限流
+    bool IsHttp2() const {
+        return m_h2 != nullptr;
+    }
+
+    // 返回200和动态生成的响应体，contentType需为字符串常量
+    http::HTTP_CODE Reply(std::string content, const char* contentType);
+    // 返回resources/下的文件(先查打包进可执行文件的资源)，path以/开头
+    http::HTTP_CODE ServeFile(const char* path, std::size_t len);
+    /*
+     * 边读边把请求体(已去掉分块编码)交给sink，处理函数需直接返回它的返回值。
+     * 没有请求体时立即以last调用sink。处理函数不调用它时请求体被丢弃，响应后关闭连接。
+     */
+    http::HTTP_CODE StreamBody(http::BodySink sink);
+    /*
+     * 把请求体接收到upload_dir下的临时文件，完成后调用handler，处理函数需直接返回它的返回值。
+     * 有Content-Length时，头部之后已读进缓冲区的部分写入文件，其余经管道splice进文件，
+     * 不经过用户态，每个上传占用的内存与大小无关；分块编码的请求体解码后写入。
+     */
+    http::HTTP_CODE ReceiveFile(http::UploadHandler handler);
+    // 以分块编码返回200，响应体由producer逐块生成，contentType需为字符串常量
+    http::HTTP_CODE Stream(http::Producer producer, const char* contentType);
+    // 延迟响应，调用后处理函数需返回DEFERRED_REQUEST，见http/Deferred.h
+    std::shared_ptr<http::Deferred> Defer();
+
+    /*
+     * 把请求转发给upstream(见http/Proxy.h)，处理函数需直接返回它的返回值。
+     * 请求体不经过工作线程，由reactor转发，响应也由reactor写回客户端。
+     */
+    http::HTTP_CODE ProxyPass(http::Upstream* upstream);
+
+    // 正在转发给上游，读写事件交给Proxy::HandleClient()
+    bool IsProxying() const {
+        return m_proxy != nullptr;
+    }
+
+    /*
+     * 把连接升级为WebSocket(见http/WebSocket.h)，处理函数需直接返回它的返回值。
+     * 请求不是合法的升级请求时返回BAD_REQUEST，HTTP/2的流上不支持。
+     */
+    http::HTTP_CODE AcceptWebSocket(http::WebSocketHandler handler);
+
+    // 已切换为WebSocket，读写事件交给HandleWebSocket()
+    bool IsWebSocket() const;
+    // reactor线程：WebSocket连接上的读写事件，需要关闭连接时返回false；dispatch表示需要交给线程池
+    bool HandleWebSocket(uint32_t events, bool& dispatch);
+    // 线程池已满，WebSocket的消息稍后再交给线程池
+    void WebSocketDispatchFailed();
+
+    // 请求头部中name(不区分大小写)的值，去掉首尾空白；没有该头部或HTTP/2的流上返回false
+    bool GetHeader(const char* name, std::string& value) const;
+
+    // reactor线程中由CompletionQueue调用：生成延迟的响应并注册EPOLLOUT
+    void FinishDeferred(const std::shared_ptr<http::Deferred>& deferred);
+
+    // 不经过socket，直接解析内存中的一个完整请求(用于microbench等离线场景)
+    http::HTTP_CODE ParseRequest(const char* data, std::size_t len);
+
 private:
-    void init();
+    // 每个流用一个HttpConn作为请求上下文
+    friend class http::Http2Session;
+    // 转发期间直接读写socket和读缓冲区中的请求头
+    friend class http::Proxy;
+    // 升级后直接读写socket
+    friend class http::WebSocket;
+
+    // keep为读缓冲区开头要保留的字节数(流水线上的下一个请求)
+    void init(std::size_t keep = 0);
+    bool AllocBuffers();
     http::HTTP_CODE ProcessRead();
     bool ProcessWrite(http::HTTP_CODE ret);
+    bool BuildResponse(http::HTTP_CODE ret);
+    void DropBody();
+    static int StatusOf(http::HTTP_CODE ret);
 
     /* ProcessRead() use these functions */
     http::HTTP_CODE ParseRequestLine(char* text);
+    bool AdmitRequest();
     http::HTTP_CODE ParseHeaders(char* text);
-    http::HTTP_CODE ParseContent(char* text);
+    http::HTTP_CODE BeginBody();
+    http::HTTP_CODE ParseBody();
+    http::HTTP_CODE AbortBody(http::HTTP_CODE ret);
+    void SendContinue();
+    http::HTTP_CODE SpliceBody();
+    http::HTTP_CODE FinishBody();
+    http::HTTP_CODE FinishUpload();
+    void CloseUpload();
     http::LINE_STATUS ParseLine();
     char* GetLine() {
-        return m_readBuffer.data() + m_startLine;
+        return m_readBuffer + m_startLine;
     }
     http::HTTP_CODE DoRequest();
+    http::HTTP_CODE OpenFile();
+    http::HTTP_CODE ParseRange();
+    bool IfRangeMatches() const;
+    bool NotModified() const;
+    void MakeETag();
+    http::HTTP_CODE OpenAsset(const bundle::Asset* asset);
+    bool AddAsset();  // 预生成的头部 + Cache-Control/Connection + 响应体
+    static bool AcceptsGzip(const std::string& value);
+    const std::string* CacheControl() const;
+    // 本次请求的站点，还没有分发(如解析出错)时为默认站点
+    const http::Site& GetSite() const;
+    static bool HeaderValue(const std::string& header, std::string& value);
 
     /* ProcessWrite() use these functions */
     bool AddResponse(const char* format, ...);
     bool AddStatusLine(int status, const char* title);
-    bool AddHeader(int contentLength);
-    bool AddContentLength(int contentLength);
+    bool AddHeader(std::size_t contentLength);
+    bool AddContentLength(std::size_t contentLength);
     bool AddContentType();
     bool AddLinger();
     bool AddBlankLine();
     bool AddContent(const char* content);
+    bool AddValidators();  // ETag、Last-Modified、Vary和Cache-Control
+    bool AddRanges();  // 206响应，单个区间直接发送，多个区间组成multipart/byteranges
+    void AddIov(const void* base, std::size_t len);
+    void AdvanceIov(std::size_t bytes);
+    static const std::string& RejectResponse(int status);
+    // TLS中还有已解密的数据时读进缓冲区，返回是否读到了
+    bool ReadPending();
+    // socket读写，TLS连接经过tls::Connection，语义同recv/writev
+    ssize_t Recv(char* buffer, std::size_t len);
+    ssize_t Send(const struct iovec* iov, int count);
+    bool NextChunk();  // 向producer要下一块，重建m_iv
+    http::WRITE_RESULT NextRequest();  // 长连接响应完毕后准备下一个请求
     void Unmap();  // 对内存映射区执行munmap操作
 
 private:
     int m_sockfd = -1;
-    sockaddr_in m_addr{};
+    SocketAddress m_addr;
+    int m_listener{-1};
+    bool m_limited{false};  // 限流器是否为该连接计数
 
     std::size_t m_readIndex{0};
-    std::array<char, READ_BUFFER_SIZE> m_readBuffer;
+    char* m_readBuffer{nullptr};
+    std::size_t m_readSize{0};
     std::size_t m_checkedIndex{0};
     std::size_t m_startLine{0};
+    std::size_t m_headerStart{0};   // 第一个头部在读缓冲区中的位置
 
     char* m_url{nullptr};
     char* m_version{nullptr};
     std::string m_host;
     http::CHECK_STATE m_checkState{http::CHECK_STATE::CHECK_STATE_REQUESTLINE};
     http::HTTP_METHOD m_method{http::HTTP_METHOD::GET};
-    int m_contentLength{0};
+    uint64_t m_contentLength{0};
+    bool m_hasContentLength{false};  // 收到过Content-Length头部
+    bool m_chunked{false};
+    bool m_expectContinue{false};   // Expect: 100-continue，接收请求体前先回复100
     bool m_linger{false};
     std::string m_realFile;
+    std::size_t m_pathLength{0};
+    http::BODY_STATE m_bodyState{http::BODY_STATE::LENGTH};
+    std::size_t m_bodyStart{0};     // 请求体在读缓冲区中的起始位置，之前是请求行和头部
+    std::size_t m_requestEnd{0};    // 请求在读缓冲区中的结束位置，之后是流水线上的下一个请求，0表示未读完
+    uint64_t m_bodyRemaining{0};    // Content-Length或当前块中还没收到的字节数
+    uint64_t m_bodyReceived{0};
+    uint64_t m_bodyLimit{0};        // 本请求的请求体上限，0表示不限制
+    http::BodySink m_bodySink;
+    http::UploadFile m_upload;      // 正在接收的上传
+    http::UploadHandler m_uploadHandler;
+    int m_uploadPipe[2]{-1, -1};    // 有效时请求体由工作线程从socket直接splice进文件
+    uint32_t m_allowed{0};   // 405响应的Allow头部(方法位掩码)
+    int m_rejectStatus{0};   // REJECTED时回复的状态码
+    std::shared_ptr<http::Deferred> m_deferred;  // 等待完成的延迟响应
+    std::shared_ptr<http::ProxyExchange> m_proxy;  // 正在进行的转发
+    std::shared_ptr<http::WebSocket> m_ws;  // 升级后的WebSocket，直到连接槽位被重新使用
+    std::string m_range;     // Range头部原文
+    std::string m_ifRange;   // If-Range头部原文
+    std::string m_ifNoneMatch;
+    std::string m_ifModifiedSince;
+    std::string m_etag;      // 由inode、大小和修改时间生成的强校验值
+    bool m_acceptGzip{false};    // Accept-Encoding允许gzip
+    bool m_compressible{false};  // 该文件有gzip变体，响应需带Vary
+    http::GzipCache::Body m_gzipBody;  // 命中时响应体直接指向缓存中的压缩内容
+    const bundle::Variant* m_asset{nullptr};  // 命中打包资源时选中的变体
+    std::vector<std::pair<uint64_t, uint64_t>> m_ranges;  // 合并后的闭区间[first, last]
 
     std::size_t m_writeIndex = 0;
-    std::array<char, WRITE_BUFFER_SIZE> m_writeBuffer;
+    char* m_writeBuffer{nullptr};
+    std::size_t m_writeSize{0};
     struct stat m_fileStat{};
     char* m_fileAddress{nullptr};  // 资源文件
-    struct iovec m_iv[2];
-    int m_ivCount{0};
-    int m_bytesToSend{0};
-    int m_bytesHaveSend{0};
+    std::string m_dynamicContent;   // 动态生成的响应体
+    const char* m_contentType{"text/html"};
+    std::string m_partHeaders;   // multipart/byteranges各部分的头部和结尾分隔符
+    http::Producer m_producer;   // 分块响应的数据源，发送完最后一块后清空
+    std::vector<char> m_chunkBuffer;  // 分块响应的缓冲区，第一次使用时分配并一直复用
+    std::vector<struct iovec> m_iv;  // 响应头、响应体(文件映射区的若干片段)依次排列
+    std::size_t m_ivIndex{0};    // 第一个还没写完的iovec
+    std::size_t m_bytesToSend{0};
+    std::size_t m_bytesHaveSend{0};
+    bool m_writeQueued{false};
+    bool m_idle{false};          // keep-alive连接在等待下一个请求，只在reactor线程访问
+    const http::Site* m_site{nullptr};  // 按Host选定的站点，DoRequest()中设置
+    uint64_t m_requestStart{0};  // 读到请求第一个字节的时间(ns)
+    uint64_t m_requestId{0};
+    uint64_t m_captureId{0};     // 流量录制中的连接id
+    std::unique_ptr<http::Http2Session> m_h2;  // 读到连接前言后的HTTP/2会话
+    std::unique_ptr<tls::Connection> m_tls;
 
     static std::atomic<int> m_epollfd;
     static std::atomic<int> m_user_count;
+    static const http::Router* m_router;
+    static std::size_t m_readBufferSize;
+    static std::size_t m_writeBufferSize;
+    static NumaArena* m_arena;
+    static std::size_t m_writeBudgetBytes;
+    static int m_writeBudgetWrites;
+    static uint64_t m_maxBodySize;
+    static std::size_t m_chunkSize;
+    static std::string m_uploadDir;
+    static uint64_t m_maxUploadSize;
+    static std::string m_overloadResponse;
+    static std::vector<std::pair<std::string, std::string>> m_cacheRules;  // 前缀和Cache-Control值
+    static std::string m_rateLimitResponse;
+    static RateLimiter* m_rateLimiter;
+    static const LoadShedder* m_shedder;
+    static std::atomic<bool> m_draining;
 };
 
 #endif //HTTPCONN_H
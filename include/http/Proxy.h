@@ -0,0 +1,197 @@
+//
+// Created by asujy on 2026/10/19.
+//
+
+#ifndef PROXY_H
+#define PROXY_H
+
+#include "http/HttpConn.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/socket.h>
+#include <vector>
+
+namespace http {
+    /*
+     * 分块编码的边界扫描，只找出消息在哪里结束，数据原样转发不解码。
+     * 反向代理两个方向的分块消息都经过它，以便在同一个连接上继续发送下一个请求。
+     */
+    class ChunkScanner {
+    public:
+        void Reset();
+        // 返回属于本消息的字节数，结束(Done)后剩下的字节不再消费
+        std::size_t Feed(const char* data, std::size_t len);
+
+        bool Done() const {
+            return m_state == STATE::DONE;
+        }
+
+        bool Bad() const {
+            return m_state == STATE::BAD;
+        }
+
+    private:
+        enum class STATE : int {
+            SIZE = 0,       // 块大小的十六进制数字
+            EXTENSION,      // 块大小之后到行尾
+            DATA,
+            DATA_CR,
+            DATA_LF,
+            TRAILER_START,  // 尾部头部的行首，空行结束
+            TRAILER,
+            LAST_LF,
+            DONE,
+            BAD
+        };
+
+        STATE m_state{STATE::SIZE};
+        uint64_t m_remaining{0};
+        int m_digits{0};
+    };
+
+    struct Upstream;
+    struct ProxyExchange;
+
+    /*
+     * 反向代理。路由的处理函数调用HttpConn::ProxyPass()后，工作线程只生成转发给上游的请求头，
+     * 之后请求体和响应都由reactor转发：上游连接是非阻塞socket，和客户端连接注册在同一个epoll中，
+     * 按上游地址放在连接池里复用，请求之间不重新建立连接。
+     * 明文连接上有Content-Length的请求体和响应体经管道splice，不经过用户态；
+     * TLS连接和分块编码的消息经一个缓冲区转发，分块消息只扫描边界，不解码。
+     * 建立连接失败时换一个地址重试，复用的连接在收到响应前断开时(只对幂等方法)换一个新连接重发。
+     * 开启健康检查时失败的地址被摘除，直到探测成功。
+     * 暂不支持HTTP/2的流和协议升级(101)，分别回复502。
+     */
+    class Proxy {
+    public:
+        static constexpr std::size_t MAX_HEAD_SIZE = 16 * 1024;   // 上游响应头的上限
+        static constexpr std::size_t BUFFER_SIZE = 64 * 1024;     // 不能splice时的转发缓冲区
+        static constexpr std::size_t PIPE_SIZE = 256 * 1024;
+        static constexpr std::size_t STEP_BYTES = 4 * 1024 * 1024;  // 一次事件最多转发的字节数
+        static constexpr int TICK_MS = 100;                        // 检查超时和健康检查的周期
+
+        struct Options {
+            int connectTimeoutMs{1000};   // 建立上游连接的超时
+            int readTimeoutMs{30000};     // 等待上游读写的超时，收到数据后重新计时
+            int idleTimeout{60};          // 池中空闲连接的保留时间(秒)
+            std::size_t maxIdle{32};      // 每个上游地址最多保留的空闲连接
+            int healthInterval{5};        // 健康检查间隔(秒)，0表示不检查，失败的地址也不摘除
+            std::string healthPath;       // 健康检查的路径，为空时只检查能否建立连接
+        };
+
+        Proxy(const Proxy&) = delete;
+        Proxy& operator=(const Proxy&) = delete;
+
+        // 单例模式
+        static Proxy& Instance() {
+            static Proxy proxy;
+            return proxy;
+        }
+
+        // 需在启动时、AddUpstream之前调用
+        void Configure(const Options& options) {
+            m_options = options;
+        }
+
+        /*
+         * 添加一组上游地址，请求在其中轮流分配。地址为host:port、[ipv6]:port或unix:/path，
+         * 启动时解析，失败时返回nullptr。返回值交给HttpConn::ProxyPass()。
+         */
+        Upstream* AddUpstream(const std::vector<std::string>& servers);
+
+        bool Enabled() const {
+            return !m_upstreams.empty();
+        }
+
+        // 注册到reactor的epoll，有上游时在AddUpstream之后调用
+        bool Start(int epollfd);
+
+        // 工作线程把请求转交给reactor时唤醒的eventfd，reactor监听它(水平触发)，可读时调用Drain()
+        int Fd() const {
+            return m_eventFd;
+        }
+
+        // 周期性的timerfd，可读时调用Tick()
+        int TimerFd() const {
+            return m_timerFd;
+        }
+
+        // 以下只在reactor线程调用
+        void Drain();
+        void Tick();
+        // fd是否为上游连接(包括健康检查)
+        bool Owns(int fd) const {
+            return fd >= 0 && static_cast<std::size_t>(fd) < m_peers.size() && m_peers[fd] != nullptr;
+        }
+        void HandleEvent(int fd, uint32_t events);
+        // 正在转发的客户端连接上的读写事件
+        void HandleClient(HttpConn& conn);
+
+    private:
+        friend class ::HttpConn;
+        friend struct Upstream;
+        friend struct ProxyExchange;
+
+        struct Server;
+        struct Peer;
+
+        enum class IO : int {
+            DONE = 0,       // 这个方向转发完毕
+            WAIT,           // 等待socket可读/可写，已经注册好事件
+            YIELD,          // 本轮转发的字节数用完，已经注册客户端事件，稍后继续
+            CLOSED,         // 上游在发出任何响应之前断开
+            FAILED,         // 上游出错或响应不合法
+            CLIENT_GONE     // 客户端断开或出错
+        };
+
+        Proxy();
+        ~Proxy();
+
+        // 工作线程：生成发给上游的请求头，随后由Submit交给reactor
+        HTTP_CODE Prepare(HttpConn& conn, Upstream* upstream);
+        void Submit(std::shared_ptr<ProxyExchange> exchange);
+        // 客户端连接关闭(reactor线程)
+        void Cancel(ProxyExchange& exchange);
+
+        void Begin(const std::shared_ptr<ProxyExchange>& exchange);
+        bool Connect(ProxyExchange& exchange);
+        Server* Pick(ProxyExchange& exchange);
+        Peer* OpenPeer(Server& server, bool& connected);
+        void Advance(ProxyExchange& exchange);
+        IO SendRequest(ProxyExchange& exchange, std::size_t& moved);
+        IO ReadHead(ProxyExchange& exchange);
+        bool ParseHead(ProxyExchange& exchange, std::size_t headLen);
+        IO SendResponse(ProxyExchange& exchange, std::size_t& moved);
+        IO SpliceOut(ProxyExchange& exchange, int from, int to, bool toClient, uint64_t& remaining,
+                     bool untilEof, std::size_t& moved);
+        void ArmClient(ProxyExchange& exchange, int events);
+        bool Retry(ProxyExchange& exchange, bool serverFailed);
+        void Finish(ProxyExchange& exchange);
+        void Fail(ProxyExchange& exchange, HTTP_CODE code);
+        void Detach(ProxyExchange& exchange);
+        void Release(Peer* peer, bool reusable);
+        void ClosePeer(Peer* peer);
+        void MarkFailed(Server& server, const char* reason);
+
+        void StartProbe(Server& server, uint64_t now);
+        void ProbeEvent(Peer& peer, uint32_t events);
+        void EndProbe(Server& server, bool healthy);
+
+    private:
+        Options m_options;
+        std::vector<std::unique_ptr<Upstream>> m_upstreams;
+        int m_epollfd{-1};
+        int m_eventFd{-1};
+        int m_timerFd{-1};
+        std::vector<Peer*> m_peers;      // 按fd索引的上游连接
+        std::vector<std::shared_ptr<ProxyExchange>> m_active;  // 正在转发的请求
+        std::mutex m_mtx;
+        std::vector<std::shared_ptr<ProxyExchange>> m_queue;   // 工作线程交过来的请求
+    };
+}
+
+#endif //PROXY_H
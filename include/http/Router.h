@@ -0,0 +1,122 @@
+//
+// Created by asujy on 2026/10/19.
+//
+
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include "http/HttpConn.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace http {
+    // 路径参数，名字指向路由表，值直接指向请求的URL，不拷贝
+    struct RouteParams {
+        static constexpr int MAX_PARAMS = 8;
+
+        struct Param {
+            const char* name;
+            std::size_t nameLen;
+            const char* value;
+            std::size_t len;
+        };
+
+        Param params[MAX_PARAMS];
+        int count{0};
+
+        // 没有该参数时返回nullptr
+        const Param* Find(const char* name) const;
+        // 拷贝出参数值，没有时返回空字符串
+        std::string Get(const char* name) const;
+    };
+
+    // 按方法和路径分发请求的基数树路由。路径模式支持三种片段：
+    //   静态     /api/health
+    //   参数     /api/users/:id       匹配一个非空的路径段(到下一个/为止)
+    //   通配     /static/*rest        匹配剩余的全部路径(可以为空)，只能出现在最后
+    // 优先级：静态 > 参数 > 通配，不匹配时回溯。
+    // 注册阶段用指针树，Compile()后压平成连续的节点数组和一个字符串池，
+    // 查找只读这两块内存，不分配，可被多个工作线程并发调用。
+    class Router {
+    public:
+        using Handler = std::function<HTTP_CODE(HttpConn&, const RouteParams&)>;
+
+        enum class Result : int {
+            FOUND = 0,
+            NOT_FOUND,
+            METHOD_NOT_ALLOWED  // 路径存在但没有注册该方法
+        };
+
+        struct Match {
+            const Handler* handler{nullptr};
+            uint32_t allowed{0};    // METHOD_NOT_ALLOWED时为该路径已注册方法的位掩码
+            RouteParams params;
+        };
+
+        Router();
+        ~Router();
+
+        Router(const Router&) = delete;
+        Router& operator=(const Router&) = delete;
+
+        // 模式非法或与已有路由冲突时返回false
+        bool Add(HTTP_METHOD method, const std::string& pattern, Handler handler);
+        // 对所有方法生效，方法专属的处理函数优先
+        bool AddAny(const std::string& pattern, Handler handler);
+        // 注册完成后调用，之后不能再Add
+        void Compile();
+
+        Result Find(HTTP_METHOD method, const char* path, std::size_t len, Match& match) const;
+
+        std::size_t NodeCount() const {
+            return m_nodes.size();
+        }
+
+        // 把方法位掩码写成"GET, POST"的形式，用于Allow头部
+        static std::string AllowHeader(uint32_t allowed);
+
+    private:
+        static constexpr int METHOD_NUM = 8;
+        static constexpr uint32_t NO_NODE = 0xFFFFFFFFU;
+
+        struct BuildNode;
+
+        struct Node {
+            uint32_t labelOff{0};   // 静态节点：边上的字节串
+            uint32_t labelLen{0};
+            uint32_t nameOff{0};    // 参数/通配节点：参数名
+            uint32_t nameLen{0};
+            uint32_t firstChild{0}; // 静态子节点在m_nodes中连续存放
+            uint32_t childNum{0};
+            uint32_t paramChild{NO_NODE};
+            uint32_t wildcardChild{NO_NODE};
+            uint32_t route{NO_NODE};
+        };
+
+        struct Route {
+            Handler handlers[METHOD_NUM];
+            Handler any;
+            uint32_t allowed{0};
+        };
+
+        bool Insert(const std::string& pattern, uint32_t& route);
+        static BuildNode* InsertStatic(BuildNode* node, std::string label);
+        void Flatten(uint32_t index, const BuildNode& node);
+        bool MatchNode(uint32_t index, const char* p, const char* end, Match& match,
+                       uint32_t& route) const;
+
+    private:
+        std::unique_ptr<BuildNode> m_root;
+        std::vector<Route> m_routes;
+        std::vector<Node> m_nodes;
+        std::string m_pool;
+        bool m_compiled{false};
+    };
+}
+
+#endif //ROUTER_H
@@ -0,0 +1,100 @@
+//
+// Created by asujy on 2026/10/19.
+//
+
+#ifndef VIRTUALHOST_H
+#define VIRTUALHOST_H
+
+#include "http/GzipCache.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace http {
+    // 把前缀和max-age转成Cache-Control的值，按前缀长度从长到短排列
+    std::vector<std::pair<std::string, std::string>> MakeCacheRules(
+        const std::vector<std::pair<std::string, int>>& rules);
+
+    // 一个站点：静态文件的根目录、压缩变体缓存、Cache-Control规则和附加的响应头部
+    struct Site {
+        std::string name;       // 主机名，也是metrics中的site标签
+        std::string root;       // 文档根目录，不以/结尾
+        bool bundle{false};     // 先查打包进可执行文件的资源(只有默认站点)
+        GzipCache* gzip{nullptr};
+        bool ownCacheRules{false};  // 为false时沿用全局的cache_control
+        std::vector<std::pair<std::string, std::string>> cacheRules;  // 前缀和Cache-Control值，长前缀在前
+        std::string headers;    // 拼好的"Name: value\r\n"，加在每个响应的状态行之后
+        int stats{-1};          // metrics中的下标
+    };
+
+    /*
+     * 基于名字的虚拟主机。启动时把所有主机名(含别名)放进开放寻址的哈希表，之后只读；
+     * 每个请求在分发前按Host头部(HTTP/2为:authority)查一次，忽略大小写、端口和结尾的点，
+     * 边转小写边计算哈希，不拷贝也不分配。没有匹配的站点时使用默认站点(resources/)。
+     */
+    class VirtualHosts {
+    public:
+        struct Options {
+            std::string name;
+            std::vector<std::string> aliases;
+            std::string root;
+            std::size_t gzipCacheBytes{0};  // 0表示与默认站点相同
+            bool ownCacheRules{false};
+            std::vector<std::pair<std::string, int>> cacheRules;  // 前缀和max-age
+            std::vector<std::string> headers;  // "Name: value"
+        };
+
+        VirtualHosts(const VirtualHosts&) = delete;
+        VirtualHosts& operator=(const VirtualHosts&) = delete;
+
+        // 单例模式
+        static VirtualHosts& Instance() {
+            static VirtualHosts hosts;
+            return hosts;
+        }
+
+        /*
+         * 需在启动时(GzipCache::Instance()配置之后)调用一次，gzip为默认站点的压缩选项，各站点沿用并只改上限。
+         * 根目录不存在或主机名重复时返回false。
+         */
+        bool Configure(const std::vector<Options>& sites, const GzipCache::Options& gzip);
+
+        // host为Host头部的值，可以带端口；没有匹配时返回默认站点
+        const Site& Find(const char* host, std::size_t len) const;
+
+        const Site& Default() const {
+            return m_default;
+        }
+
+        std::size_t Count() const {
+            return m_sites.size();
+        }
+
+    private:
+        struct Slot {
+            uint64_t hash{0};
+            const std::string* name{nullptr};  // 为空表示空槽位
+            const Site* site{nullptr};
+        };
+
+        VirtualHosts();
+
+        bool Insert(const std::string& name, const Site* site);
+        static std::size_t HostLength(const char* host, std::size_t len);
+        static uint64_t Hash(const char* host, std::size_t len);
+
+    private:
+        Site m_default;
+        std::vector<std::unique_ptr<Site>> m_sites;
+        std::vector<std::unique_ptr<GzipCache>> m_caches;
+        std::vector<std::string> m_names;   // 小写的主机名，槽位指向这里
+        std::vector<Slot> m_table;          // 容量为2的幂，负载不超过1/2
+        std::size_t m_mask{0};
+    };
+}
+
+#endif //VIRTUALHOST_H
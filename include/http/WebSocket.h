@@ -0,0 +1,215 @@
+//
+// Created by asujy on 2026/10/19.
+//
+
+#ifndef WEBSOCKET_H
+#define WEBSOCKET_H
+
+#include "http/HttpConn.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/uio.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace http {
+    class WebSocket;
+
+    // 回调都可以为空。onMessage在工作线程调用，同一个连接的消息按顺序、不会并发；onClose在reactor线程调用
+    struct WebSocketHandler {
+        std::function<void(const std::shared_ptr<WebSocket>& ws)> onOpen;
+        std::function<void(const std::shared_ptr<WebSocket>& ws, const std::string& message, bool binary)> onMessage;
+        std::function<void(const std::shared_ptr<WebSocket>& ws)> onClose;
+    };
+
+    /*
+     * RFC 6455的WebSocket连接。处理函数调用HttpConn::AcceptWebSocket()后回复101，之后连接切换到这里。
+     * socket的读写和帧的解析都在reactor中完成：客户端的帧边读边去掩码，拼成完整的消息后放进收件箱，
+     * 再把连接交给线程池调用onMessage；收件箱积压太多时暂停读取。
+     * 发送的消息在入队前就组成完整的帧(服务端的帧不加掩码)，是一块只读的共享内存，
+     * 广播时所有订阅者的队列引用同一块内存，由reactor用writev直接写出，不按连接拷贝。
+     * 每个连接的发送队列有上限，消费太慢时按配置丢弃最旧的消息或关闭连接。
+     * Send()/Close()可在任意线程调用。
+     */
+    class WebSocket : public std::enable_shared_from_this<WebSocket> {
+    public:
+        static constexpr std::size_t BUFFER_SIZE = 64 * 1024;  // 输入缓冲区
+        static constexpr std::size_t MAX_IOV = 64;             // 一次writev最多的消息数
+
+        enum class SLOW_POLICY : int {
+            DROP = 0,   // 队列满时丢弃最旧的还没开始发送的消息
+            CLOSE       // 队列满时关闭连接
+        };
+
+        // 状态码见RFC 6455 7.4.1
+        enum class CLOSE_CODE : uint16_t {
+            NORMAL = 1000,
+            GOING_AWAY = 1001,
+            PROTOCOL_ERROR = 1002,
+            UNSUPPORTED = 1003,
+            POLICY_VIOLATION = 1008,
+            TOO_BIG = 1009
+        };
+
+        struct Options {
+            std::size_t maxMessage{1024 * 1024};  // 收到的消息(含分片)的上限，超过时以1009关闭
+            std::size_t queueLimit{256};          // 每个连接排队等待发送的消息数
+            SLOW_POLICY slowPolicy{SLOW_POLICY::DROP};
+        };
+
+        // 组好帧的消息，可以同时放进多个连接的发送队列
+        using Message = std::shared_ptr<const std::string>;
+
+        WebSocket(HttpConn& conn, WebSocketHandler handler, std::string accept);
+        ~WebSocket();
+
+        WebSocket(const WebSocket&) = delete;
+        WebSocket& operator=(const WebSocket&) = delete;
+
+        static void Configure(const Options& options) {
+            m_options = options;
+        }
+
+        // Sec-WebSocket-Key对应的Sec-WebSocket-Accept
+        static std::string AcceptKey(const std::string& key);
+        // 文本或二进制消息组成的单帧消息
+        static Message MakeMessage(const char* data, std::size_t len, bool binary = false);
+
+        // 放进发送队列，连接已关闭或消息被丢弃时返回false
+        bool Send(const Message& message);
+        bool Send(const std::string& text) {
+            return Send(MakeMessage(text.data(), text.size()));
+        }
+        // 发送关闭帧，队列中已有的消息发送完后关闭连接
+        void Close(CLOSE_CODE code = CLOSE_CODE::NORMAL);
+
+        const SocketAddress& GetAddress() const {
+            return m_addr;
+        }
+
+        // 升级请求的URL，含查询串
+        const std::string& GetUrl() const {
+            return m_url;
+        }
+
+    private:
+        friend class ::HttpConn;
+        friend class Broadcast;
+
+        // 工作线程：101响应生成后调用onOpen，data为升级请求之后已经读到的字节
+        void Accepted(const char* data, std::size_t len);
+        // reactor线程：101响应写完，开始收发帧
+        bool Start();
+        bool Started() const {
+            return m_started;
+        }
+        // reactor线程：处理读写事件，需要关闭连接时返回false；dispatch表示需要把连接交给线程池
+        bool HandleEvent(uint32_t events, bool& dispatch);
+        // 线程池已满，稍后再试
+        void DispatchFailed();
+        // 工作线程：把收件箱中的消息交给onMessage
+        void Dispatch();
+        // reactor线程：连接关闭
+        void Shutdown();
+
+        bool Read();
+        void Parse(std::size_t& pos);
+        void OnFrame();
+        void Fail(CLOSE_CODE code);
+        bool Flush();
+        bool EnqueueLocked(const Message& message, bool control);
+        void ArmLocked(bool kick = false);
+        static Message MakeFrame(uint8_t opcode, const char* data, std::size_t len);
+        static void Unmask(char* data, std::size_t len, const uint8_t key[4], std::size_t offset);
+
+    private:
+        HttpConn& m_conn;
+        int m_sockfd;
+        SocketAddress m_addr;
+        std::string m_url;
+        WebSocketHandler m_handler;
+        std::string m_accept;
+
+        /* 以下只在reactor线程访问 */
+        bool m_started{false};
+        bool m_readPaused{false};       // 本轮不再读取(暂停或已收到关闭帧)
+        std::vector<char> m_in;
+        std::size_t m_inLen{0};
+        bool m_inFrame{false};          // 正在读一个帧的负载
+        uint8_t m_opcode{0};
+        bool m_fin{false};
+        uint8_t m_mask[4]{0, 0, 0, 0};
+        uint64_t m_frameRemaining{0};
+        uint64_t m_frameOffset{0};      // 已读的负载字节，决定掩码从哪一位开始
+        std::string m_control;          // 控制帧的负载
+        std::string m_message;          // 正在拼接的分片消息
+        bool m_fragmented{false};
+        bool m_binary{false};
+        std::vector<Message> m_sending; // 正在写出的消息，iovec指向它们的内存
+        std::vector<struct iovec> m_iv;
+        std::size_t m_ivIndex{0};
+
+        /* 以下由m_mtx保护 */
+        std::mutex m_mtx;
+        std::deque<Message> m_queue;    // 还没开始发送的消息
+        bool m_flushing{false};         // m_sending中还有没写完的消息
+        bool m_closed{false};           // 连接已关闭
+        bool m_closing{false};          // 已经排入关闭帧，之后不再接受消息，发送完后关闭
+        bool m_overflow{false};         // 发送队列溢出且策略为CLOSE，socket已shutdown
+        int m_armed{-1};                // 最近注册的事件，事件触发后为-1
+        std::deque<std::pair<std::string, bool>> m_inbox;  // 收到的完整消息和是否为二进制
+        std::size_t m_inboxBytes{0};
+        bool m_dispatching{false};      // 已经交给线程池
+        bool m_paused{false};           // 收件箱积压，暂停读取
+        bool m_accepted{false};         // 已经调用onOpen
+
+        std::vector<std::string> m_topics;  // 订阅的主题，由Broadcast的锁保护
+
+        static Options m_options;
+    };
+
+    /*
+     * 按主题的发布/订阅。Publish()只组一次帧，所有订阅者共享同一块内存。
+     * 连接关闭时自动退订。所有方法可在任意线程调用。
+     */
+    class Broadcast {
+    public:
+        Broadcast(const Broadcast&) = delete;
+        Broadcast& operator=(const Broadcast&) = delete;
+
+        // 单例模式
+        static Broadcast& Instance() {
+            static Broadcast broadcast;
+            return broadcast;
+        }
+
+        void Subscribe(const std::string& topic, const std::shared_ptr<WebSocket>& ws);
+        void Unsubscribe(const std::string& topic, const std::shared_ptr<WebSocket>& ws);
+        // 返回放进了发送队列的订阅者数
+        std::size_t Publish(const std::string& topic, const WebSocket::Message& message);
+        std::size_t Publish(const std::string& topic, const char* data, std::size_t len, bool binary = false) {
+            return Publish(topic, WebSocket::MakeMessage(data, len, binary));
+        }
+        std::size_t Subscribers(const std::string& topic) const;
+
+    private:
+        friend class WebSocket;
+
+        Broadcast() = default;
+        // 连接关闭时退订所有主题
+        void Remove(WebSocket& ws);
+
+    private:
+        mutable std::mutex m_mtx;
+        std::unordered_map<std::string, std::vector<std::shared_ptr<WebSocket>>> m_topics;
+    };
+}
+
+#endif //WEBSOCKET_H
@@ -0,0 +1,69 @@
+//
+// Created by asujy on 2026/10/19.
+//
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "metrics/Metrics.h"
+
+namespace metrics {
+    /*
+     * 单线程使用的对数线性直方图，桶的划分与Registry相同。
+     * 给压测工具用：每个线程各自记录，结束后Merge到一起再算分位数。
+     */
+    class LatencyHistogram {
+    public:
+        LatencyHistogram() : m_buckets(Registry::BUCKET_NUM, 0) {}
+
+        void Record(uint64_t value) {
+            ++m_buckets[Registry::BucketIndex(value)];
+            ++m_count;
+            m_sum += value;
+            if (value > m_max) {
+                m_max = value;
+            }
+            if (m_count == 1 || value < m_min) {
+                m_min = value;
+            }
+        }
+
+        void Merge(const LatencyHistogram& other);
+        void Reset();
+
+        // p取值[0, 100]，返回所在桶的上界
+        uint64_t Percentile(double p) const;
+
+        uint64_t Count() const {
+            return m_count;
+        }
+
+        uint64_t Min() const {
+            return m_min;
+        }
+
+        uint64_t Max() const {
+            return m_max;
+        }
+
+        double Mean() const {
+            return m_count == 0 ? 0.0 : static_cast<double>(m_sum) / m_count;
+        }
+
+        // 非空桶，形如[[上界,计数],...]
+        std::string BucketsJson() const;
+
+    private:
+        std::vector<uint64_t> m_buckets;
+        uint64_t m_count{0};
+        uint64_t m_sum{0};
+        uint64_t m_min{0};
+        uint64_t m_max{0};
+    };
+}
+
+#endif //HISTOGRAM_H
@@ -0,0 +1,221 @@
+//
+// Created by asujy on 2026/10/19.
+//
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace metrics {
+    enum class Counter : int {
+        ACCEPTS = 0,         // accept成功的连接数
+        BYTES_READ,          // 从socket读取的字节数
+        BYTES_WRITTEN,       // 写入socket的字节数
+        CACHE_HITS,          // 内容缓存命中
+        CACHE_MISSES,        // 内容缓存未命中
+        WRITE_EAGAIN,        // 写响应时遇到EAGAIN的次数
+        WRITE_YIELDS,        // 写预算用完让出reactor的次数
+        POOL_REJECTED,       // 线程池队列已满被丢弃的请求
+        CAPTURE_DROPPED,     // 录制缓冲区已满丢弃的记录
+        SHED_REQUESTS,       // 过载时直接回复503的请求
+        SHED_CONNECTIONS,    // 连接数超限时回复503并关闭的连接
+        RATE_LIMITED_CONN_RATE,     // 单个客户端新建连接过快被拒绝
+        RATE_LIMITED_CONN_LIMIT,    // 单个客户端并发连接数超限被拒绝
+        RATE_LIMITED_REQUESTS,      // 单个客户端请求过快被拒绝
+        RATE_LIMIT_UNTRACKED,       // 限流表中没有可淘汰的表项，未计数直接放行
+        BUNDLE_HITS,                // 由打包进可执行文件的资源响应
+        DEFERRED_CANCELLED,         // 延迟响应完成前客户端断开
+        UPLOADS,                    // 完整接收到临时文件的上传
+        UPLOAD_SPLICED_BYTES,       // 经splice从socket直接写进文件的字节数
+        H2_SESSIONS,                // 升级为HTTP/2的连接
+        H2_STREAMS,                 // HTTP/2连接上的请求流
+        TLS_HANDSHAKES,             // 完成的TLS握手
+        TLS_RESUMED,                // 其中恢复会话(会话缓存或票据)的握手
+        TLS_HANDSHAKE_FAILURES,     // 失败的TLS握手
+        KTLS_SEND,                  // 发送方向启用了kTLS的连接
+        PROXY_REQUESTS,             // 转发给上游的请求
+        PROXY_CONNECTS,             // 新建的上游连接
+        PROXY_REUSED,               // 复用连接池中空闲连接的请求
+        PROXY_RETRIES,              // 换一个上游地址或连接重试的请求
+        PROXY_ERRORS,               // 以502/504结束或中途断开的转发
+        PROXY_SPLICED_BYTES,        // 经splice在客户端和上游之间直接转发的字节数
+        WS_UPGRADES,                // 升级为WebSocket的连接
+        WS_MESSAGES_IN,             // 收到的WebSocket消息
+        WS_MESSAGES_OUT,            // 发出的WebSocket帧
+        WS_DROPPED,                 // 发送队列满时丢弃的消息
+        WS_SLOW_CLOSED,             // 发送队列溢出被关闭的连接
+        COUNTER_NUM
+    };
+
+    enum class Gauge : int {
+        ACTIVE_CONNECTIONS = 0,
+        POOL_QUEUE_DEPTH,
+        GZIP_CACHE_BYTES,       // gzip变体缓存占用的字节数
+        DEFERRED_PENDING,       // 等待完成的延迟响应
+        PROXY_IDLE_CONNECTIONS, // 连接池中的空闲上游连接
+        WS_CONNECTIONS,         // 打开的WebSocket连接
+        GAUGE_NUM
+    };
+
+    enum class Histogram : int {
+        POOL_WAIT_US = 0,    // 请求在线程池队列中的等待时间
+        REQUEST_US,          // 从读到请求到响应发送完毕的时间
+        HISTOGRAM_NUM
+    };
+
+    // 按监听地址分别统计，以listener标签输出
+    enum class ListenerStat : int {
+        ACCEPTS = 0,    // accept成功的连接
+        REJECTED,       // 因连接数或限流被拒绝的连接
+        CONNECTIONS,    // 当前打开的连接
+        LISTENER_STAT_NUM
+    };
+
+    // 按虚拟主机分别统计，以site标签输出
+    enum class SiteStat : int {
+        REQUESTS = 0,   // 分发到该站点的请求
+        CACHE_HITS,     // 该站点压缩变体缓存的命中
+        CACHE_MISSES,
+        CACHE_BYTES,    // 该站点压缩变体缓存占用的字节
+        SITE_STAT_NUM
+    };
+
+    /*
+     * 按线程分片的计数器和对数线性直方图(HDR风格)。
+     * 每个线程首次使用时绑定一个分片，递增只做relaxed原子操作，不加锁；
+     * 抓取时(Render)再把所有分片累加起来。
+     */
+    class Registry {
+    public:
+        static constexpr int SHARD_NUM = 32;
+        static constexpr int SUB_BUCKET_BITS = 3;   // 每个2的幂区间再分8份，相对误差<12.5%
+        static constexpr int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+        static constexpr int BUCKET_NUM = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+        static constexpr int MAX_LISTENERS = 16;
+        static constexpr int MAX_SITES = 32;
+
+        Registry(const Registry&) = delete;
+        Registry& operator=(const Registry&) = delete;
+
+        // 单例模式
+        static Registry& Instance() {
+            static Registry registry;
+            return registry;
+        }
+
+        void Add(Counter counter, uint64_t n = 1) {
+            LocalShard().counters[static_cast<int>(counter)]
+                .fetch_add(n, std::memory_order_relaxed);
+        }
+
+        void Add(Gauge gauge, int64_t delta) {
+            LocalShard().gauges[static_cast<int>(gauge)]
+                .fetch_add(delta, std::memory_order_relaxed);
+        }
+
+        void Observe(Histogram histogram, uint64_t value) {
+            Shard& shard = LocalShard();
+            const int h = static_cast<int>(histogram);
+            shard.buckets[h][BucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+            shard.sums[h].fetch_add(value, std::memory_order_relaxed);
+        }
+
+        void RecordStatus(int status);
+
+        // 启动时(开始处理连接前)注册一个监听地址，返回统计用的下标，超过MAX_LISTENERS时返回-1
+        int AddListener(const std::string& name);
+
+        void Add(int listener, ListenerStat stat, int64_t delta) {
+            if (listener >= 0) {
+                m_listeners[listener].values[static_cast<int>(stat)].fetch_add(delta, std::memory_order_relaxed);
+            }
+        }
+
+        // 启动时注册一个虚拟主机，返回统计用的下标，超过MAX_SITES时返回-1
+        int AddSite(const std::string& name);
+
+        // 每个请求都会更新，和计数器一样按线程分片
+        void Add(int site, SiteStat stat, int64_t delta) {
+            if (site >= 0) {
+                LocalShard().sites[site][static_cast<int>(stat)].fetch_add(delta, std::memory_order_relaxed);
+            }
+        }
+
+        // 生成Prometheus文本格式
+        std::string Render() const;
+
+        static int BucketIndex(uint64_t value) {
+            if (value < static_cast<uint64_t>(SUB_BUCKETS)) {
+                return static_cast<int>(value);
+            }
+            const int exp = 63 - __builtin_clzll(value);
+            return (exp - SUB_BUCKET_BITS + 1) * SUB_BUCKETS +
+                static_cast<int>((value >> (exp - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1));
+        }
+
+        // 桶内能落入的最大值
+        static uint64_t BucketUpperBound(int index);
+
+    private:
+        Registry() = default;
+
+        static constexpr int STATUS_NUM = 13;  // 最后一个槽位统计其他状态码
+        static const int STATUS_CODES[STATUS_NUM - 1];
+
+        struct alignas(64) Shard {
+            std::atomic<uint64_t> counters[static_cast<int>(Counter::COUNTER_NUM)]{};
+            std::atomic<int64_t> gauges[static_cast<int>(Gauge::GAUGE_NUM)]{};
+            std::atomic<uint64_t> statuses[STATUS_NUM]{};
+            std::atomic<uint64_t> sums[static_cast<int>(Histogram::HISTOGRAM_NUM)]{};
+            std::atomic<uint64_t> buckets[static_cast<int>(Histogram::HISTOGRAM_NUM)][BUCKET_NUM]{};
+            std::atomic<int64_t> sites[MAX_SITES][static_cast<int>(SiteStat::SITE_STAT_NUM)]{};
+        };
+
+        Shard& LocalShard() {
+            static thread_local Shard* shard =
+                &m_shards[m_nextShard.fetch_add(1, std::memory_order_relaxed) % SHARD_NUM];
+            return *shard;
+        }
+
+        // 连接的建立和关闭远少于请求，不分片
+        struct alignas(64) Listener {
+            std::string name;
+            std::atomic<int64_t> values[static_cast<int>(ListenerStat::LISTENER_STAT_NUM)]{};
+        };
+
+        uint64_t SumCounter(int index) const;
+
+    private:
+        Shard m_shards[SHARD_NUM];
+        std::atomic<unsigned int> m_nextShard{0};
+        Listener m_listeners[MAX_LISTENERS];
+        int m_listenerCount{0};
+        std::string m_sites[MAX_SITES];
+        int m_siteCount{0};
+    };
+
+    inline void Inc(Counter counter, uint64_t n = 1) {
+        Registry::Instance().Add(counter, n);
+    }
+
+    inline void Add(Gauge gauge, int64_t delta) {
+        Registry::Instance().Add(gauge, delta);
+    }
+
+    inline void Observe(Histogram histogram, uint64_t value) {
+        Registry::Instance().Observe(histogram, value);
+    }
+
+    inline void Add(int listener, ListenerStat stat, int64_t delta = 1) {
+        Registry::Instance().Add(listener, stat, delta);
+    }
+
+    inline void Add(int site, SiteStat stat, int64_t delta = 1) {
+        Registry::Instance().Add(site, stat, delta);
+    }
+}
+
+#endif //METRICS_H
@@ -0,0 +1,121 @@
+//
+// Created by asujy on 2026/10/19.
+//
+
+#ifndef TLS_H
+#define TLS_H
+
+#include <openssl/ssl.h>
+
+#include <cstddef>
+#include <string>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <vector>
+
+/*
+ * 基于OpenSSL的TLS终结。握手由reactor在socket可读/可写时推进，不阻塞；
+ * 会话缓存和会话票据密钥属于进程内唯一的SSL_CTX，所有连接共享，恢复会话只需一个往返。
+ * 内核支持时握手后把加密交给内核(kTLS)，之后响应直接writev到socket，
+ * 文件映射区和明文连接一样不经过用户态加密。
+ */
+namespace tls {
+    struct Options {
+        std::string cert;                  // PEM证书链
+        std::string key;                   // PEM私钥
+        long sessionCacheSize{20480};      // 服务端会话缓存条目数，0表示只用会话票据
+        long sessionTimeout{300};          // 会话(和票据)有效期，秒
+        bool ktls{true};                   // 内核支持时启用kTLS
+        std::vector<std::string> alpn;     // 按优先级排列的ALPN协议，如h2、http/1.1
+    };
+
+    class Context {
+    public:
+        Context(const Context&) = delete;
+        Context& operator=(const Context&) = delete;
+
+        // 单例模式
+        static Context& Instance() {
+            static Context context;
+            return context;
+        }
+
+        // 加载证书和私钥，需在启动时调用，失败时返回false
+        bool Configure(const Options& options);
+
+        bool Enabled() const {
+            return m_ctx != nullptr;
+        }
+
+        SSL_CTX* Get() const {
+            return m_ctx;
+        }
+
+    private:
+        Context() = default;
+        ~Context();
+
+        static int SelectAlpn(SSL* ssl, const unsigned char** out, unsigned char* outLen,
+                              const unsigned char* in, unsigned int inLen, void* arg);
+
+    private:
+        SSL_CTX* m_ctx{nullptr};
+        std::string m_alpn;   // ALPN wire格式(长度前缀)
+    };
+
+    enum class HANDSHAKE : int {
+        DONE = 0,
+        WANT_READ,
+        WANT_WRITE,
+        FAILED
+    };
+
+    // 一个连接的TLS状态，读写接口和recv/writev一致：出错返回-1并设置errno，EAGAIN表示稍后重试
+    class Connection {
+    public:
+        static constexpr std::size_t RECORD_SIZE = 16384;
+
+        explicit Connection(int fd);
+        ~Connection();
+
+        Connection(const Connection&) = delete;
+        Connection& operator=(const Connection&) = delete;
+
+        bool Valid() const {
+            return m_ssl != nullptr;
+        }
+
+        bool Handshaking() const {
+            return !m_established;
+        }
+
+        HANDSHAKE Handshake();
+
+        ssize_t Read(char* buffer, std::size_t len);
+        // 未启用kTLS时把iovec拷进一个记录大小的缓冲区加密，返回写出的字节数
+        ssize_t Writev(const struct iovec* iov, int count);
+        // 连接自己的短消息(如100 Continue)，和Writev的数据互不影响，发不出去时返回false
+        bool Send(const char* data, std::size_t len);
+        // SSL内部已解密但还没读走的字节，这部分数据不会再触发EPOLLIN
+        std::size_t Pending() const;
+        // 协商出的ALPN协议，没有时为空
+        std::string Alpn() const;
+        // 尽力发送close_notify，不等待对端
+        void Shutdown();
+
+    private:
+        ssize_t Flush();
+        ssize_t Fail(int ret);
+
+    private:
+        SSL* m_ssl{nullptr};
+        int m_fd{-1};
+        bool m_established{false};
+        bool m_ktlsSend{false};
+        std::vector<char> m_record;     // 等待SSL_write重试的明文，重试时必须原样传入
+        std::size_t m_pending{0};
+        bool m_pendingOwn{false};       // 待重试的是Send()的数据，不属于Writev的调用方
+    };
+}
+
+#endif //TLS_H
@@ -0,0 +1,39 @@
+//
+// Created by asujy on 2026/10/19.
+//
+
+#ifndef PROBES_H
+#define PROBES_H
+
+/*
+ * USDT静态探针，provider为webserver，例如:
+ *   bpftrace -e 'usdt:./webserver:webserver:write_eagain { @[arg0] = count(); }'
+ * 没有被附加时探针只是一条nop指令；找不到sys/sdt.h时整个宏为空，参数也不会被求值。
+ *
+ * 探针列表(参数依次为arg0, arg1, arg2):
+ *   accept(fd)                      main()中accept成功
+ *   conn_init(fd)                   HttpConn::Init()
+ *   read(fd, bytes, total)          Read()完成，本次读到的字节数和缓冲区中的总字节数
+ *   pool_append(task, depth)        ThreadPool::Append()成功，入队后的队列长度
+ *   pool_dequeue(task, wait_ns)     工作线程取出请求，在队列中等待的时间
+ *   process_read(fd, http_code)     ProcessRead()的返回值
+ *   file_open(fd, http_code, size)  DoRequest()打开并映射文件
+ *   write_partial(fd, bytes, left)  writev()写出一部分
+ *   write_eagain(fd, sent, left)    writev()遇到EAGAIN
+ *   write_yield(fd, sent, left)     本轮写预算用完，让出reactor
+ *   write_complete(fd, total)       响应发送完毕
+ *   close(fd)                       CloseConn()
+ *   reject(fd, status)              过载(503)或限流(429)时直接回复
+ */
+#ifdef WEBSERVER_HAVE_SDT
+#include <sys/sdt.h>
+#define WEBSERVER_PROBE1(name, a1) DTRACE_PROBE1(webserver, name, a1)
+#define WEBSERVER_PROBE2(name, a1, a2) DTRACE_PROBE2(webserver, name, a1, a2)
+#define WEBSERVER_PROBE3(name, a1, a2, a3) DTRACE_PROBE3(webserver, name, a1, a2, a3)
+#else
+#define WEBSERVER_PROBE1(name, a1) do {} while (0)
+#define WEBSERVER_PROBE2(name, a1, a2) do {} while (0)
+#define WEBSERVER_PROBE3(name, a1, a2, a3) do {} while (0)
+#endif
+
+#endif //PROBES_H
@@ -0,0 +1,113 @@
+//
+// Created by asujy on 2026/10/19.
+//
+
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace trace {
+    enum class Event : uint8_t {
+        REQUEST_BEGIN = 0,   // 请求开始(读到第一个字节)
+        READ,                // 一次Read()完成，arg为本次读到的字节数
+        ENQUEUE,             // 放入线程池队列
+        DEQUEUE,             // 工作线程取出请求
+        PARSE,               // ProcessRead()结束，arg为HTTP_CODE
+        FILE_OPEN_BEGIN,     // DoRequest()中stat/open/mmap开始
+        FILE_OPEN_END,       // arg为文件大小
+        FIRST_BYTE,          // 第一次成功写出响应
+        WRITE_EAGAIN,        // 写响应遇到EAGAIN，arg为已发送字节数
+        LAST_BYTE,           // 响应发送完毕，arg为总字节数
+        EVENT_NUM
+    };
+
+    struct Record {
+        uint64_t ts;         // 单调时钟，纳秒
+        uint64_t requestId;
+        int64_t arg;
+        Event event;
+    };
+
+    /*
+     * 每个线程一个环形缓冲区，只有所属线程写入，写满后覆盖最旧的记录。
+     * 导出时不加锁读取，正在被覆盖的最旧几条记录可能不完整，可以接受。
+     */
+    class Ring {
+    public:
+        static constexpr uint64_t CAPACITY = 1 << 14;
+
+        explicit Ring(long tid) : m_tid(tid), m_records(CAPACITY) {}
+
+        void Push(const Record& record) {
+            const uint64_t head = m_head.load(std::memory_order_relaxed);
+            m_records[head & (CAPACITY - 1)] = record;
+            m_head.store(head + 1, std::memory_order_release);
+        }
+
+        void Snapshot(std::vector<Record>& out) const;
+
+        long Tid() const {
+            return m_tid;
+        }
+
+    private:
+        const long m_tid;
+        std::vector<Record> m_records;
+        std::atomic<uint64_t> m_head{0};
+    };
+
+    class Tracer {
+    public:
+        Tracer(const Tracer&) = delete;
+        Tracer& operator=(const Tracer&) = delete;
+
+        // 单例模式
+        static Tracer& Instance() {
+            static Tracer tracer;
+            return tracer;
+        }
+
+        static bool Enabled() {
+            return m_enabled.load(std::memory_order_relaxed);
+        }
+
+        static void SetEnabled(bool enabled) {
+            m_enabled.store(enabled, std::memory_order_relaxed);
+        }
+
+        static uint64_t NextRequestId() {
+            return m_nextRequestId.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void Add(Event event, uint64_t requestId, int64_t arg);
+
+        // 导出所有线程的记录，Chrome trace-event JSON格式，可直接用Perfetto打开
+        std::string DumpJson();
+        bool DumpToFile(const std::string& file);
+
+    private:
+        Tracer() = default;
+        Ring& LocalRing();
+
+    private:
+        std::mutex m_mtx;   // 只保护m_rings的注册和遍历
+        std::vector<std::unique_ptr<Ring>> m_rings;
+        static std::atomic<bool> m_enabled;
+        static std::atomic<uint64_t> m_nextRequestId;
+    };
+
+    // 埋点分布在读、排队、解析、写各阶段，SIGUSR2关闭追踪时不取单例也不访问线程的环形缓冲区
+    inline void Emit(Event event, uint64_t requestId, int64_t arg = 0) {
+        if (Tracer::Enabled()) {
+            Tracer::Instance().Add(event, requestId, arg);
+        }
+    }
+}
+
+#endif //TRACER_H
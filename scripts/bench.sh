@@ -0,0 +1,28 @@
+#!/usr/bin/env bash
+#
+# 在本地启动webserver并跑完所有压测场景，结果写成JSON方便跨提交对比
+# 用法: bench.sh <webserver> <webbench> [output.json] [webbench的其他参数...]
+#
+
+set -euo pipefail
+
+SERVER=${1:?webserver path}
+BENCH=${2:?webbench path}
+OUTPUT=${3:-bench-results.json}
+shift $(( $# < 3 ? $# : 3 ))
+PORT=${BENCH_PORT:-19006}
+
+"$SERVER" "$PORT" >/dev/null 2>&1 &
+SERVER_PID=$!
+trap 'kill $SERVER_PID 2>/dev/null || true' EXIT
+
+# 等待端口可连接
+for _ in $(seq 50); do
+    if (exec 3<>/dev/tcp/127.0.0.1/"$PORT") 2>/dev/null; then
+        break
+    fi
+    sleep 0.1
+done
+
+"$BENCH" -p "$PORT" -s all -o "$OUTPUT" "$@"
+echo "results written to $OUTPUT"
@@ -0,0 +1,16 @@
+#!/usr/bin/env bash
+#
+# 生成本地测试用的自签名证书(ECDSA P-256)，CN和subjectAltName为localhost/127.0.0.1
+# 用法: tls-cert.sh [输出目录]，之后 -o tls_port=9443 -o tls_cert=<目录>/cert.pem -o tls_key=<目录>/key.pem
+#
+
+set -euo pipefail
+
+DIR=${1:-.}
+mkdir -p "$DIR"
+
+openssl req -x509 -newkey ec -pkeyopt ec_paramgen_curve:prime256v1 -nodes -days 365 \
+    -subj "/CN=localhost" -addext "subjectAltName=DNS:localhost,IP:127.0.0.1" \
+    -keyout "$DIR/key.pem" -out "$DIR/cert.pem" 2>/dev/null
+chmod 600 "$DIR/key.pem"
+echo "wrote $DIR/cert.pem and $DIR/key.pem"
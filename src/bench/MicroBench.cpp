@@ -0,0 +1,436 @@
+//
+// Created by asujy on 2026/10/19.
+//
+
+/*
+ * microbench: 组件级性能测试
+ *   每个用例先预热，再重复若干轮，每轮执行固定次数的操作，
+ *   报告每次操作耗时的中位数/分位数；能打开perf_event时同时给出每次操作的CPU周期数，
+ *   否则在x86上退化为rdtsc计数。
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <ftw.h>
+#include <getopt.h>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "common-lib/Utils.h"
+#include "common-lib/Semaphore.h"
+#include "common-lib/RateLimiter.h"
+#include "common-lib/SocketAddress.h"
+#include "log/Logger.h"
+#include "common-lib/ThreadPool.h"
+#include "http/HttpConn.h"
+#include "http/Router.h"
+
+namespace {
+    /* 周期计数器：优先perf_event_open，其次rdtsc */
+    class CycleCounter {
+    public:
+        CycleCounter() {
+            struct perf_event_attr attr{};
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.size = sizeof(attr);
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            attr.disabled = 0;
+            attr.inherit = 1;        // 统计之后创建的线程
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            m_fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+
+        ~CycleCounter() {
+            if (m_fd != -1) {
+                close(m_fd);
+            }
+        }
+
+        CycleCounter(const CycleCounter&) = delete;
+        CycleCounter& operator=(const CycleCounter&) = delete;
+
+        const char* Source() const {
+            if (m_fd != -1) {
+                return "perf";
+            }
+#if defined(__x86_64__) || defined(__i386__)
+            return "tsc";
+#else
+            return "none";
+#endif
+        }
+
+        uint64_t Read() const {
+            if (m_fd != -1) {
+                uint64_t value = 0;
+                if (read(m_fd, &value, sizeof(value)) == sizeof(value)) {
+                    return value;
+                }
+                return 0;
+            }
+#if defined(__x86_64__) || defined(__i386__)
+            return __builtin_ia32_rdtsc();
+#else
+            return 0;
+#endif
+        }
+
+    private:
+        int m_fd{-1};
+    };
+
+    struct Options {
+        int warmup{2};
+        int repetitions{15};
+        std::string filter;
+        std::string output;     // JSON输出文件
+        std::vector<std::string> corpus;  // -r: 录制的原始请求文件
+    };
+
+    struct Result {
+        std::string name;
+        uint64_t ops{0};
+        double median{0};     // ns/op
+        double p10{0};
+        double p90{0};
+        double min{0};
+        double max{0};
+        double cycles{0};     // cycles/op，取中位数那一轮
+    };
+
+    class Runner {
+    public:
+        explicit Runner(const Options& options) : m_options(options) {}
+
+        // fn(ops)执行ops次操作
+        template <typename F>
+        void Run(const std::string& name, uint64_t ops, F fn);
+
+        std::string ToJson() const;
+
+    private:
+        const Options& m_options;
+        CycleCounter m_cycles;
+        std::vector<Result> m_results;
+    };
+
+    template <typename F>
+    void Runner::Run(const std::string& name, uint64_t ops, F fn) {
+        if (!m_options.filter.empty() && name.find(m_options.filter) == std::string::npos) {
+            return;
+        }
+        for (int i = 0; i < m_options.warmup; ++i) {
+            fn(ops);
+        }
+        std::vector<std::pair<double, double>> samples;  // (ns/op, cycles/op)
+        for (int i = 0; i < m_options.repetitions; ++i) {
+            const uint64_t c0 = m_cycles.Read();
+            const uint64_t t0 = GetMonotonicNanos();
+            fn(ops);
+            const uint64_t t1 = GetMonotonicNanos();
+            const uint64_t c1 = m_cycles.Read();
+            samples.emplace_back(static_cast<double>(t1 - t0) / ops,
+                static_cast<double>(c1 - c0) / ops);
+        }
+        std::sort(samples.begin(), samples.end());
+        auto at = [&samples](double q) {
+            return samples[static_cast<std::size_t>(q * (samples.size() - 1) + 0.5)].first;
+        };
+        Result result;
+        result.name = name;
+        result.ops = ops;
+        result.median = at(0.5);
+        result.p10 = at(0.1);
+        result.p90 = at(0.9);
+        result.min = samples.front().first;
+        result.max = samples.back().first;
+        result.cycles = samples[samples.size() / 2].second;
+        m_results.push_back(result);
+        std::cerr << std::left << std::setw(40) << name << std::right << std::fixed
+            << std::setprecision(1) << std::setw(12) << result.median << " ns/op"
+            << std::setw(12) << result.cycles << ' ' << m_cycles.Source() << "/op"
+            << "  [p10 " << result.p10 << ", p90 " << result.p90 << "]" << std::endl;
+    }
+
+    std::string Runner::ToJson() const {
+        std::ostringstream oss;
+        oss << "{\"cycle_source\":\"" << m_cycles.Source() << "\",\"warmup\":"
+            << m_options.warmup << ",\"repetitions\":" << m_options.repetitions
+            << ",\"results\":[";
+        for (std::size_t i = 0; i < m_results.size(); ++i) {
+            const Result& r = m_results[i];
+            oss << (i == 0 ? "" : ",") << "{\"name\":\"" << r.name << "\",\"ops\":" << r.ops
+                << ",\"ns_per_op\":{\"median\":" << r.median << ",\"p10\":" << r.p10
+                << ",\"p90\":" << r.p90 << ",\"min\":" << r.min << ",\"max\":" << r.max
+                << "},\"cycles_per_op\":" << r.cycles << '}';
+        }
+        oss << "]}";
+        return oss.str();
+    }
+
+    /* ---------- HttpConn::ProcessRead ---------- */
+
+    const char* const BUILTIN_CORPUS[][2] = {
+        {"curl", "GET /index.html HTTP/1.1\r\nHost: 127.0.0.1:9006\r\n"
+                 "User-Agent: curl/8.0\r\nAccept: */*\r\n\r\n"},
+        {"browser", "GET /images/image1.jpeg HTTP/1.1\r\nHost: example.com\r\n"
+                    "Connection: keep-alive\r\n"
+                    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 "
+                    "(KHTML, like Gecko) Chrome/120.0 Safari/537.36\r\n"
+                    "Accept: image/avif,image/webp,image/apng,image/*,*/*;q=0.8\r\n"
+                    "Accept-Encoding: gzip, deflate, br\r\n"
+                    "Accept-Language: en-US,en;q=0.9,zh-CN;q=0.8\r\n"
+                    "Referer: http://example.com/index.html\r\n\r\n"},
+        {"absolute-url", "GET http://127.0.0.1:9006/index.html HTTP/1.1\r\n"
+                         "Host: 127.0.0.1:9006\r\nConnection: keep-alive\r\n\r\n"},
+        {"not-found", "GET /no-such-file.html HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n"},
+        {"bad-method", "BREW /pot HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n"},
+    };
+
+    void BenchParser(Runner& runner, const Options& options) {
+        std::vector<std::pair<std::string, std::string>> corpus;
+        for (const auto& entry : BUILTIN_CORPUS) {
+            corpus.emplace_back(entry[0], entry[1]);
+        }
+        for (const auto& file : options.corpus) {
+            std::ifstream ifs(file, std::ios::binary);
+            std::string data((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+            if (!data.empty()) {
+                corpus.emplace_back(GetBasename(file), data);
+            }
+        }
+        std::unique_ptr<HttpConn> conn(new HttpConn);
+        for (const auto& entry : corpus) {
+            const std::string& request = entry.second;
+            runner.Run("parse/" + entry.first, 5000, [&](uint64_t ops) {
+                for (uint64_t i = 0; i < ops; ++i) {
+                    conn->ParseRequest(request.data(), request.size());
+                }
+            });
+        }
+    }
+
+    /* ---------- LogStream / Logger ---------- */
+
+    int RemoveEntry(const char* path, const struct stat*, int, struct FTW*) {
+        return remove(path);
+    }
+
+    void BenchLogger(Runner& runner) {
+        std::unique_ptr<LogStream> stream(new LogStream("/dev/null"));
+        runner.Run("logstream/append+flushline", 200000, [&](uint64_t ops) {
+            for (uint64_t i = 0; i < ops; ++i) {
+                *stream << "GET /index.html " << static_cast<int>(i) << '\n';
+                stream->FlushLine();
+            }
+        });
+
+        const int threadCounts[] = {1, 2, 4, 8, 16, 32};
+        for (int threads : threadCounts) {
+            runner.Run("logger/LOG_INFO/threads=" + std::to_string(threads), 64000,
+                [threads](uint64_t ops) {
+                    std::vector<std::thread> workers;
+                    const uint64_t perThread = ops / threads;
+                    for (int t = 0; t < threads; ++t) {
+                        workers.emplace_back([perThread]() {
+                            for (uint64_t i = 0; i < perThread; ++i) {
+                                LOG_INFO << "microbench line " << static_cast<unsigned long long>(i);
+                            }
+                        });
+                    }
+                    for (auto& worker : workers) {
+                        worker.join();
+                    }
+                });
+        }
+    }
+
+    /* ---------- ThreadPool / Semaphore ---------- */
+
+    struct PingTask {
+        Semaphore done{0};
+        void Process() {
+            done.Post();
+        }
+    };
+
+    void BenchThreadPool(Runner& runner) {
+        // 工作线程是detach的，线程池不能析构，直接泄漏
+        static ThreadPool<PingTask>* pool = new ThreadPool<PingTask>();
+        PingTask task;
+        runner.Run("threadpool/append->process", 20000, [&](uint64_t ops) {
+            for (uint64_t i = 0; i < ops; ++i) {
+                pool->Append(&task);
+                task.done.Wait();
+            }
+        });
+
+        const int batch = 64;
+        std::unique_ptr<PingTask[]> tasks(new PingTask[batch]);
+        runner.Run("threadpool/append-batch64", 64 * 500, [&](uint64_t ops) {
+            for (uint64_t i = 0; i < ops; i += batch) {
+                for (int j = 0; j < batch; ++j) {
+                    pool->Append(&tasks[j]);
+                }
+                for (int j = 0; j < batch; ++j) {
+                    tasks[j].done.Wait();
+                }
+            }
+        });
+    }
+
+    void BenchSemaphore(Runner& runner) {
+        runner.Run("semaphore/post+wait", 1000000, [](uint64_t ops) {
+            Semaphore sem(0);
+            for (uint64_t i = 0; i < ops; ++i) {
+                sem.Post();
+                sem.Wait();
+            }
+        });
+
+        // 两个线程乒乓，一次操作是一次单向交接(往返的一半)
+        runner.Run("semaphore/handoff", 50000, [](uint64_t ops) {
+            Semaphore ping(0);
+            Semaphore pong(0);
+            const uint64_t rounds = ops / 2;
+            std::thread peer([&]() {
+                for (uint64_t i = 0; i < rounds; ++i) {
+                    ping.Wait();
+                    pong.Post();
+                }
+            });
+            for (uint64_t i = 0; i < rounds; ++i) {
+                ping.Post();
+                pong.Wait();
+            }
+            peer.join();
+        });
+    }
+
+    void BenchRateLimiter(Runner& runner) {
+        RateLimiter::Options limits;
+        limits.connRate = 1000000;
+        limits.maxConns = 1000000;
+        limits.requestRate = 1000000000;
+        RateLimiter limiter(limits);
+        // 同一地址反复命中，以及4096个地址轮流访问(每次都要在组内查找)
+        runner.Run("ratelimiter/request/hot", 1000000, [&](uint64_t ops) {
+            SocketAddress addr;
+            SocketAddress::Parse("10.0.0.1:80", addr);
+            for (uint64_t i = 0; i < ops; ++i) {
+                limiter.AdmitRequest(addr, i + 1);
+            }
+        });
+        std::vector<SocketAddress> clients(4096);
+        for (std::size_t i = 0; i < clients.size(); ++i) {
+            SocketAddress::Parse("10.0." + std::to_string(i >> 8) + "." + std::to_string(i & 255) + ":80", clients[i]);
+        }
+        runner.Run("ratelimiter/request/4096-clients", 1000000, [&](uint64_t ops) {
+            for (uint64_t i = 0; i < ops; ++i) {
+                limiter.AdmitRequest(clients[i & 4095], i + 1);
+            }
+        });
+        runner.Run("ratelimiter/connection+release", 1000000, [&](uint64_t ops) {
+            for (uint64_t i = 0; i < ops; ++i) {
+                const SocketAddress& addr = clients[i & 4095];
+                limiter.AdmitConnection(addr, i + 1);
+                limiter.ReleaseConnection(addr);
+            }
+        });
+    }
+
+    void BenchRouter(Runner& runner) {
+        http::Router router;
+        const auto handler = [](HttpConn&, const http::RouteParams&) {
+            return http::HTTP_CODE::NO_RESOURCE;
+        };
+        router.Add(http::HTTP_METHOD::GET, "/metrics", handler);
+        router.Add(http::HTTP_METHOD::GET, "/debug/trace", handler);
+        router.Add(http::HTTP_METHOD::GET, "/healthz", handler);
+        for (int i = 0; i < 64; ++i) {
+            router.Add(http::HTTP_METHOD::GET, "/api/v1/resource" + std::to_string(i) + "/:id", handler);
+        }
+        router.Add(http::HTTP_METHOD::GET, "/api/v1/users/:id/posts/:post", handler);
+        router.Add(http::HTTP_METHOD::GET, "/*path", handler);
+        router.Compile();
+        const std::vector<std::pair<std::string, std::string>> paths = {
+            {"static", "/healthz"},
+            {"params", "/api/v1/users/12345/posts/678"},
+            {"wildcard", "/images/image1.jpeg"},
+        };
+        for (const auto& entry : paths) {
+            const std::string& path = entry.second;
+            runner.Run("router/" + entry.first, 1000000, [&](uint64_t ops) {
+                http::Router::Match match;
+                for (uint64_t i = 0; i < ops; ++i) {
+                    router.Find(http::HTTP_METHOD::GET, path.data(), path.size(), match);
+                }
+            });
+        }
+    }
+
+    void Usage(const char* name) {
+        std::cout << "Usage: " << name << " [options]\n"
+            "  -w n       warmup repetitions (default 2)\n"
+            "  -n n       measured repetitions (default 15)\n"
+            "  -f text    only run benchmarks whose name contains text\n"
+            "  -r file    add a raw HTTP request file to the parser corpus, may be repeated\n"
+            "  -o file    write JSON results to file\n";
+    }
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    int opt = 0;
+    while ((opt = getopt(argc, argv, "w:n:f:r:o:h")) != -1) {
+        switch (opt) {
+            case 'w': options.warmup = std::max(0, std::atoi(optarg)); break;
+            case 'n': options.repetitions = std::max(1, std::atoi(optarg)); break;
+            case 'f': options.filter = optarg; break;
+            case 'r': options.corpus.push_back(optarg); break;
+            case 'o': options.output = optarg; break;
+            default:
+                Usage(argv[0]);
+                return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    // 日志写到临时目录(日志会按行数滚动出新文件)，结束后删除
+    char dirTemplate[] = "/tmp/microbench.XXXXXX";
+    const char* logDir = mkdtemp(dirTemplate);
+    if (logDir == nullptr) {
+        std::cerr << "mkdtemp failed: " << std::strerror(errno) << std::endl;
+        return EXIT_FAILURE;
+    }
+    Logger::Config(std::string(logDir) + "/bench.log");
+
+    Runner runner(options);
+    BenchParser(runner, options);
+    BenchLogger(runner);
+    BenchThreadPool(runner);
+    BenchSemaphore(runner);
+    BenchRateLimiter(runner);
+    BenchRouter(runner);
+
+    Logger::Stream().FlushAll();
+    nftw(logDir, RemoveEntry, 16, FTW_DEPTH | FTW_PHYS);
+
+    if (!options.output.empty()) {
+        std::ofstream ofs(options.output);
+        ofs << runner.ToJson() << std::endl;
+    }
+    return EXIT_SUCCESS;
+}
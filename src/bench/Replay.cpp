@@ -0,0 +1,553 @@
+//
+// Created by asujy on 2026/10/19.
+//
+
+/*
+ * webreplay: 回放webserver -C录制的流量
+ *   每条录制的连接按原始的建连时间和请求间隔重新发起，-s可以整体加速/减速。
+ *   一个数据块里出现几个"\r\n\r\n"就认为发出了几个请求，收到对应数量的响应后
+ *   才会发送下一个包含新请求的数据块，和原始客户端一问一答的行为保持一致。
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <getopt.h>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <queue>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "bench/ResponseParser.h"
+#include "capture/Capture.h"
+#include "common-lib/Utils.h"
+#include "metrics/Histogram.h"
+
+namespace {
+    constexpr int MAX_EVENT_NUMBER = 1024;
+    constexpr std::size_t READ_BUFFER_SIZE = 64 * 1024;
+    constexpr uint64_t NANOS_PER_MILLI = 1000000ULL;
+
+    struct Options {
+        std::string host{"127.0.0.1"};
+        int port{0};
+        std::string file;
+        double speed{1.0};       // 回放速率倍数，0表示不等待录制的时间间隔
+        int threads{1};
+        int duration{0};         // 最长回放时间(秒)，0表示不限制
+        int timeoutMs{5000};
+        std::string output;
+    };
+
+    struct Chunk {
+        uint64_t offset{0};   // 相对会话开始的时间(微秒)
+        std::string data;
+        int requests{0};      // 本块中结束的请求数
+    };
+
+    struct Session {
+        uint64_t start{0};    // 相对录制开始的时间(微秒)
+        uint64_t closeAt{0};  // 相对会话开始，0表示没有录到关闭
+        std::vector<Chunk> chunks;
+    };
+
+    struct Stats {
+        metrics::LatencyHistogram latency;  // 微秒
+        uint64_t sessions{0};
+        uint64_t requests{0};
+        uint64_t responses{0};
+        uint64_t errors{0};
+        uint64_t timeouts{0};
+        uint64_t bytes{0};
+        std::map<int, uint64_t> statuses;
+
+        void Merge(const Stats& other) {
+            latency.Merge(other.latency);
+            sessions += other.sessions;
+            requests += other.requests;
+            responses += other.responses;
+            errors += other.errors;
+            timeouts += other.timeouts;
+            bytes += other.bytes;
+            for (const auto& kv : other.statuses) {
+                statuses[kv.first] += kv.second;
+            }
+        }
+    };
+
+    bool LoadSessions(const std::string& file, std::vector<Session>& sessions) {
+        capture::Reader reader;
+        if (!reader.Open(file)) {
+            std::cerr << "can not open capture file " << file << std::endl;
+            return false;
+        }
+        struct Raw {
+            uint64_t open{0};
+            uint64_t close{0};
+            std::vector<std::pair<uint64_t, std::string>> data;
+        };
+        std::map<uint64_t, Raw> raws;
+        capture::Record record;
+        while (reader.Next(record)) {
+            Raw& raw = raws[record.connId];
+            switch (record.type) {
+                case capture::RecordType::OPEN: raw.open = record.timestamp; break;
+                case capture::RecordType::CLOSE: raw.close = record.timestamp; break;
+                case capture::RecordType::DATA:
+                    raw.data.emplace_back(record.timestamp, record.data);
+                    break;
+            }
+        }
+
+        uint64_t origin = UINT64_MAX;
+        for (auto& kv : raws) {
+            Raw& raw = kv.second;
+            // 各线程的记录在文件中是分批写入的，需要按时间戳重新排序
+            std::stable_sort(raw.data.begin(), raw.data.end(),
+                [](const std::pair<uint64_t, std::string>& a, const std::pair<uint64_t, std::string>& b) {
+                    return a.first < b.first;
+                });
+            if (raw.open == 0 && !raw.data.empty()) {
+                raw.open = raw.data.front().first;
+            }
+            if (raw.open != 0) {
+                origin = std::min(origin, raw.open);
+            }
+        }
+        for (auto& kv : raws) {
+            Raw& raw = kv.second;
+            if (raw.data.empty()) {
+                continue;
+            }
+            Session session;
+            session.start = raw.open - origin;
+            session.closeAt = raw.close > raw.open ? raw.close - raw.open : 0;
+            std::string tail;   // 上一块末尾3个字节，用于识别跨块的"\r\n\r\n"
+            for (auto& entry : raw.data) {
+                Chunk chunk;
+                chunk.offset = entry.first > raw.open ? entry.first - raw.open : 0;
+                chunk.data = std::move(entry.second);
+                const std::string scan = tail + chunk.data;
+                for (auto pos = scan.find("\r\n\r\n"); pos != std::string::npos;
+                     pos = scan.find("\r\n\r\n", pos + 4)) {
+                    ++chunk.requests;
+                }
+                tail = scan.size() > 3 ? scan.substr(scan.size() - 3) : scan;
+                session.chunks.push_back(std::move(chunk));
+            }
+            sessions.push_back(std::move(session));
+        }
+        std::sort(sessions.begin(), sessions.end(), [](const Session& a, const Session& b) {
+            return a.start < b.start;
+        });
+        return true;
+    }
+
+    class Replayer {
+    public:
+        Replayer(const Options& options, std::vector<const Session*> sessions) :
+            m_options(options), m_sessions(std::move(sessions)), m_states(m_sessions.size()) {}
+
+        Replayer(const Replayer&) = delete;
+        Replayer& operator=(const Replayer&) = delete;
+
+        void Run(uint64_t begin, uint64_t deadline);
+
+        const Stats& GetStats() const {
+            return m_stats;
+        }
+
+    private:
+        enum class Action : int { CONNECT = 0, SEND, CLOSE };
+
+        struct State {
+            int fd{-1};
+            bool connected{false};
+            bool finished{false};
+            std::size_t nextChunk{0};
+            std::string out;
+            std::size_t outOffset{0};
+            std::deque<uint64_t> inflight;   // 请求发出的时间
+            ResponseParser parser;
+        };
+
+        using Timer = std::tuple<uint64_t, std::size_t, Action>;
+
+        uint64_t Due(uint64_t offsetMicros) const {
+            if (m_options.speed <= 0) {
+                return m_begin;
+            }
+            return m_begin + static_cast<uint64_t>(offsetMicros * 1000 / m_options.speed);
+        }
+
+        void Connect(std::size_t index);
+        void Finish(std::size_t index, bool error);
+        void TrySend(std::size_t index, uint64_t now);
+        bool Flush(std::size_t index);
+        void OnReadable(std::size_t index);
+        void ScheduleNext(std::size_t index);
+
+    private:
+        const Options& m_options;
+        std::vector<const Session*> m_sessions;
+        std::vector<State> m_states;
+        std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> m_timers;
+        int m_epollfd{-1};
+        uint64_t m_begin{0};
+        std::size_t m_active{0};
+        sockaddr_in m_address{};
+        Stats m_stats;
+    };
+
+    void Replayer::Run(uint64_t begin, uint64_t deadline) {
+        m_begin = begin;
+        m_address.sin_family = AF_INET;
+        m_address.sin_port = htons(m_options.port);
+        inet_pton(AF_INET, m_options.host.c_str(), &m_address.sin_addr);
+        m_epollfd = epoll_create1(EPOLL_CLOEXEC);
+        for (std::size_t i = 0; i < m_sessions.size(); ++i) {
+            m_timers.emplace(Due(m_sessions[i]->start), i, Action::CONNECT);
+        }
+        m_active = m_sessions.size();
+
+        epoll_event events[MAX_EVENT_NUMBER];
+        while (m_active > 0) {
+            uint64_t now = GetMonotonicNanos();
+            if (deadline != 0 && now >= deadline) {
+                break;
+            }
+            while (!m_timers.empty() && std::get<0>(m_timers.top()) <= now) {
+                const Timer timer = m_timers.top();
+                m_timers.pop();
+                const std::size_t index = std::get<1>(timer);
+                switch (std::get<2>(timer)) {
+                    case Action::CONNECT: Connect(index); break;
+                    case Action::SEND: TrySend(index, now); break;
+                    case Action::CLOSE: Finish(index, false); break;
+                }
+            }
+
+            const uint64_t timeout = static_cast<uint64_t>(m_options.timeoutMs) * NANOS_PER_MILLI;
+            for (std::size_t i = 0; i < m_states.size(); ++i) {
+                State& state = m_states[i];
+                if (!state.finished && !state.inflight.empty() &&
+                    now > state.inflight.front() && now - state.inflight.front() > timeout) {
+                    m_stats.timeouts += state.inflight.size();
+                    Finish(i, true);
+                }
+            }
+
+            int waitMs = 100;
+            if (!m_timers.empty()) {
+                const uint64_t next = std::get<0>(m_timers.top());
+                waitMs = next <= now ? 0 : static_cast<int>(
+                    std::min<uint64_t>(100, (next - now + NANOS_PER_MILLI - 1) / NANOS_PER_MILLI));
+            }
+            int number = epoll_wait(m_epollfd, events, MAX_EVENT_NUMBER, waitMs);
+            if (number < 0 && errno != EINTR) {
+                break;
+            }
+            for (int i = 0; i < number; ++i) {
+                const std::size_t index = events[i].data.u32;
+                State& state = m_states[index];
+                if (state.finished || state.fd == -1) {
+                    continue;
+                }
+                if (!state.connected) {
+                    int err = 0;
+                    socklen_t len = sizeof(err);
+                    getsockopt(state.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+                    if (err != 0 || (events[i].events & (EPOLLERR | EPOLLHUP))) {
+                        Finish(index, true);
+                        continue;
+                    }
+                    state.connected = true;
+                    ScheduleNext(index);
+                    continue;
+                }
+                if (events[i].events & EPOLLIN) {
+                    OnReadable(index);
+                }
+                if (!state.finished && (events[i].events & EPOLLOUT) && !Flush(index)) {
+                    Finish(index, true);
+                }
+            }
+        }
+        for (std::size_t i = 0; i < m_states.size(); ++i) {
+            if (!m_states[i].finished && m_states[i].fd != -1) {
+                close(m_states[i].fd);
+            }
+        }
+        close(m_epollfd);
+    }
+
+    void Replayer::Connect(std::size_t index) {
+        State& state = m_states[index];
+        ++m_stats.sessions;
+        state.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (state.fd == -1) {
+            Finish(index, true);
+            return;
+        }
+        int one = 1;
+        setsockopt(state.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if (connect(state.fd, reinterpret_cast<sockaddr*>(&m_address), sizeof(m_address)) == -1 &&
+            errno != EINPROGRESS) {
+            Finish(index, true);
+            return;
+        }
+        epoll_event event{};
+        event.data.u32 = static_cast<uint32_t>(index);
+        event.events = EPOLLIN | EPOLLOUT;
+        epoll_ctl(m_epollfd, EPOLL_CTL_ADD, state.fd, &event);
+    }
+
+    void Replayer::Finish(std::size_t index, bool error) {
+        State& state = m_states[index];
+        if (state.finished) {
+            return;
+        }
+        if (error) {
+            ++m_stats.errors;
+        }
+        if (state.fd != -1) {
+            epoll_ctl(m_epollfd, EPOLL_CTL_DEL, state.fd, nullptr);
+            close(state.fd);
+            state.fd = -1;
+        }
+        state.finished = true;
+        --m_active;
+    }
+
+    void Replayer::ScheduleNext(std::size_t index) {
+        State& state = m_states[index];
+        const Session& session = *m_sessions[index];
+        if (state.nextChunk < session.chunks.size()) {
+            m_timers.emplace(Due(session.start + session.chunks[state.nextChunk].offset),
+                index, Action::SEND);
+        } else if (state.inflight.empty()) {
+            // 数据都已发出且响应都已收到，保持连接到录制中的关闭时间
+            m_timers.emplace(std::max(Due(session.start + session.closeAt), GetMonotonicNanos()),
+                index, Action::CLOSE);
+        }
+    }
+
+    void Replayer::TrySend(std::size_t index, uint64_t now) {
+        State& state = m_states[index];
+        const Session& session = *m_sessions[index];
+        if (state.finished || state.nextChunk >= session.chunks.size()) {
+            return;
+        }
+        const Chunk& chunk = session.chunks[state.nextChunk];
+        if (now < Due(session.start + chunk.offset)) {
+            return;   // 重复调度的定时器提前到期，以正确的那个为准
+        }
+        if (chunk.requests > 0 && !state.inflight.empty()) {
+            return;   // 等前面的响应收完，OnReadable里会重新调度
+        }
+        state.out += chunk.data;
+        for (int i = 0; i < chunk.requests; ++i) {
+            state.inflight.push_back(now);
+        }
+        m_stats.requests += static_cast<uint64_t>(chunk.requests);
+        ++state.nextChunk;
+        if (!Flush(index)) {
+            Finish(index, true);
+            return;
+        }
+        if (state.inflight.empty()) {
+            ScheduleNext(index);
+        }
+    }
+
+    bool Replayer::Flush(std::size_t index) {
+        State& state = m_states[index];
+        while (state.outOffset < state.out.size()) {
+            ssize_t n = send(state.fd, state.out.data() + state.outOffset,
+                state.out.size() - state.outOffset, MSG_NOSIGNAL);
+            if (n == -1) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    break;
+                }
+                return false;
+            }
+            state.outOffset += static_cast<std::size_t>(n);
+        }
+        if (state.outOffset == state.out.size()) {
+            state.out.clear();
+            state.outOffset = 0;
+        }
+        epoll_event event{};
+        event.data.u32 = static_cast<uint32_t>(index);
+        event.events = EPOLLIN | (state.out.empty() ? 0 : static_cast<uint32_t>(EPOLLOUT));
+        epoll_ctl(m_epollfd, EPOLL_CTL_MOD, state.fd, &event);
+        return true;
+    }
+
+    void Replayer::OnReadable(std::size_t index) {
+        char buffer[READ_BUFFER_SIZE];
+        State& state = m_states[index];
+        while (!state.finished) {
+            ssize_t n = recv(state.fd, buffer, sizeof(buffer), 0);
+            if (n == -1) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    return;
+                }
+                Finish(index, true);
+                return;
+            }
+            if (n == 0) {
+                // 服务器关闭了连接，没发完的数据不再回放
+                const bool complete = state.inflight.empty() &&
+                    state.nextChunk >= m_sessions[index]->chunks.size();
+                Finish(index, !complete);
+                return;
+            }
+            m_stats.bytes += static_cast<uint64_t>(n);
+            const bool ok = state.parser.Feed(buffer, static_cast<std::size_t>(n),
+                [&](int status, bool) {
+                    if (state.inflight.empty()) {
+                        return false;
+                    }
+                    const uint64_t now = GetMonotonicNanos();
+                    m_stats.latency.Record((now - state.inflight.front()) / 1000);
+                    state.inflight.pop_front();
+                    ++m_stats.responses;
+                    ++m_stats.statuses[status];
+                    if (state.inflight.empty()) {
+                        ScheduleNext(index);
+                    }
+                    return true;
+                });
+            if (!ok) {
+                Finish(index, true);
+                return;
+            }
+        }
+    }
+
+    std::string ToJson(const Options& options, const Stats& stats, double seconds) {
+        std::ostringstream oss;
+        oss << "{\"capture\":\"" << options.file << "\",\"speed\":" << options.speed
+            << ",\"duration_s\":" << seconds
+            << ",\"sessions\":" << stats.sessions
+            << ",\"requests\":" << stats.requests
+            << ",\"responses\":" << stats.responses
+            << ",\"errors\":" << stats.errors
+            << ",\"timeouts\":" << stats.timeouts
+            << ",\"bytes\":" << stats.bytes
+            << ",\"status\":{";
+        bool first = true;
+        for (const auto& kv : stats.statuses) {
+            oss << (first ? "" : ",") << '"' << kv.first << "\":" << kv.second;
+            first = false;
+        }
+        const metrics::LatencyHistogram& h = stats.latency;
+        oss << "},\"latency_us\":{\"min\":" << h.Min()
+            << ",\"mean\":" << h.Mean()
+            << ",\"p50\":" << h.Percentile(50)
+            << ",\"p90\":" << h.Percentile(90)
+            << ",\"p99\":" << h.Percentile(99)
+            << ",\"p999\":" << h.Percentile(99.9)
+            << ",\"max\":" << h.Max()
+            << "},\"histogram_us\":" << h.BucketsJson() << '}';
+        return oss.str();
+    }
+
+    void Usage(const char* name) {
+        std::cout << "Usage: " << name << " -p port -f capture_file [options]\n"
+            "  -H host      server address (default 127.0.0.1)\n"
+            "  -p port      server port\n"
+            "  -f file      capture file recorded by webserver -C\n"
+            "  -s speed     replay rate multiplier, 0 = ignore recorded gaps (default 1)\n"
+            "  -t threads   client threads (default 1)\n"
+            "  -d seconds   stop after this many seconds (default: until done)\n"
+            "  -T ms        response timeout (default 5000)\n"
+            "  -o file      write JSON results to file (default stdout)\n";
+    }
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    int opt = 0;
+    while ((opt = getopt(argc, argv, "H:p:f:s:t:d:T:o:h")) != -1) {
+        switch (opt) {
+            case 'H': options.host = optarg; break;
+            case 'p': options.port = std::atoi(optarg); break;
+            case 'f': options.file = optarg; break;
+            case 's': options.speed = std::atof(optarg); break;
+            case 't': options.threads = std::max(1, std::atoi(optarg)); break;
+            case 'd': options.duration = std::atoi(optarg); break;
+            case 'T': options.timeoutMs = std::atoi(optarg); break;
+            case 'o': options.output = optarg; break;
+            default:
+                Usage(argv[0]);
+                return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (options.port <= 0 || options.file.empty()) {
+        Usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<Session> sessions;
+    if (!LoadSessions(options.file, sessions)) {
+        return EXIT_FAILURE;
+    }
+    std::cerr << "loaded " << sessions.size() << " sessions from " << options.file << std::endl;
+
+    // 会话按建连时间轮流分给各线程
+    std::vector<std::vector<const Session*>> parts(options.threads);
+    for (std::size_t i = 0; i < sessions.size(); ++i) {
+        parts[i % parts.size()].push_back(&sessions[i]);
+    }
+    std::vector<std::unique_ptr<Replayer>> replayers;
+    for (auto& part : parts) {
+        replayers.emplace_back(new Replayer(options, std::move(part)));
+    }
+
+    const uint64_t begin = GetMonotonicNanos();
+    const uint64_t deadline = options.duration > 0 ?
+        begin + static_cast<uint64_t>(options.duration) * 1000 * NANOS_PER_MILLI : 0;
+    std::vector<std::thread> threads;
+    for (auto& replayer : replayers) {
+        threads.emplace_back(&Replayer::Run, replayer.get(), begin, deadline);
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    const double seconds = static_cast<double>(GetMonotonicNanos() - begin) / 1e9;
+
+    Stats total;
+    for (const auto& replayer : replayers) {
+        total.Merge(replayer->GetStats());
+    }
+    std::cerr << total.sessions << " sessions, " << total.responses << "/" << total.requests
+        << " responses in " << seconds << "s, errors " << total.errors
+        << ", timeouts " << total.timeouts << ", p50 " << total.latency.Percentile(50)
+        << "us, p99 " << total.latency.Percentile(99) << "us" << std::endl;
+
+    const std::string json = ToJson(options, total, seconds);
+    if (options.output.empty()) {
+        std::cout << json << std::endl;
+    } else {
+        std::ofstream ofs(options.output);
+        ofs << json << std::endl;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,630 @@
+//
+// Created by asujy on 2026/10/19.
+//
+
+/*
+ * webbench: 基于epoll的多线程HTTP压测工具
+ *   闭环模式: 每个连接始终保持pipeline个请求在途
+ *   开环模式(-r): 按固定速率发请求，延迟从"计划发送时间"算起，
+ *                 服务器变慢时排队的时间也会被计入(修正coordinated omission)
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <ftw.h>
+#include <getopt.h>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "bench/ResponseParser.h"
+#include "common-lib/Utils.h"
+#include "metrics/Histogram.h"
+
+namespace {
+    constexpr int MAX_EVENT_NUMBER = 1024;
+    constexpr std::size_t READ_BUFFER_SIZE = 64 * 1024;
+    constexpr uint64_t NANOS_PER_SECOND = 1000000000ULL;
+    constexpr uint64_t NANOS_PER_MILLI = 1000000ULL;
+
+    struct Options {
+        std::string host{"127.0.0.1"};
+        int port{0};
+        int threads{2};
+        int connections{64};
+        int duration{10};          // 秒
+        bool keepAlive{true};
+        int pipeline{1};
+        double rate{0};            // 总请求数/秒，0表示闭环
+        int timeoutMs{5000};
+        std::string resourceDir;   // -a: 请求该目录下的所有文件
+        std::vector<std::string> urls;
+        std::string scenario;
+        std::string output;        // JSON输出文件，空表示stdout
+    };
+
+    struct Stats {
+        metrics::LatencyHistogram latency;  // 微秒
+        uint64_t requests{0};
+        uint64_t errors{0};
+        uint64_t timeouts{0};
+        uint64_t connects{0};
+        uint64_t bytes{0};
+        std::map<int, uint64_t> statuses;
+
+        void Merge(const Stats& other) {
+            latency.Merge(other.latency);
+            requests += other.requests;
+            errors += other.errors;
+            timeouts += other.timeouts;
+            connects += other.connects;
+            bytes += other.bytes;
+            for (const auto& kv : other.statuses) {
+                statuses[kv.first] += kv.second;
+            }
+        }
+    };
+
+    struct InflightRequest {
+        uint64_t intended;  // 计划发送时间
+        uint64_t sent;      // 实际发送时间，用于判断超时
+    };
+
+    struct Connection {
+        int fd{-1};
+        bool connected{false};
+        std::string out;
+        std::size_t outOffset{0};
+        std::deque<InflightRequest> inflight;
+        ResponseParser parser;
+        bool broken{false};
+    };
+
+    class Worker {
+    public:
+        Worker(const Options& options, int id, int connections, double rate) :
+            m_options(options), m_id(id), m_conns(connections), m_rate(rate) {}
+
+        Worker(const Worker&) = delete;
+        Worker& operator=(const Worker&) = delete;
+
+        void Run(uint64_t deadline);
+
+        const Stats& GetStats() const {
+            return m_stats;
+        }
+
+    private:
+        bool Connect(std::size_t index);
+        void Close(std::size_t index, bool reconnect);
+        bool SendRequest(std::size_t index, uint64_t intended);
+        bool Flush(std::size_t index);
+        bool OnReadable(std::size_t index);
+        bool Consume(std::size_t index, const char* data, std::size_t len, bool& closeAfter);
+        void Complete(std::size_t index, int status, bool close);
+        void UpdateEvents(std::size_t index);
+        void Dispatch(uint64_t now, uint64_t deadline);
+        void CheckTimeouts(uint64_t now);
+        const std::string& NextRequest();
+
+    private:
+        const Options& m_options;
+        const int m_id;
+        std::vector<Connection> m_conns;
+        const double m_rate;
+        int m_epollfd{-1};
+        std::vector<std::string> m_requests;
+        std::size_t m_nextUrl{0};
+        std::deque<uint64_t> m_pending;  // 开环模式下已到计划时间但还没发出的请求
+        std::size_t m_cursor{0};
+        uint64_t m_deadline{0};
+        sockaddr_in m_address{};
+        Stats m_stats;
+    };
+
+    void Worker::Run(uint64_t deadline) {
+        m_deadline = deadline;
+        m_address.sin_family = AF_INET;
+        m_address.sin_port = htons(m_options.port);
+        inet_pton(AF_INET, m_options.host.c_str(), &m_address.sin_addr);
+
+        std::string hostHeader = m_options.host + ":" + std::to_string(m_options.port);
+        for (const auto& url : m_options.urls) {
+            m_requests.push_back("GET " + url + " HTTP/1.1\r\nHost: " + hostHeader +
+                "\r\nConnection: " + (m_options.keepAlive ? "keep-alive" : "close") + "\r\n\r\n");
+        }
+        // 各线程从不同位置开始轮询URL列表
+        m_nextUrl = static_cast<std::size_t>(m_id) % m_requests.size();
+
+        m_epollfd = epoll_create1(EPOLL_CLOEXEC);
+        for (std::size_t i = 0; i < m_conns.size(); ++i) {
+            Connect(i);
+        }
+
+        const bool openLoop = m_rate > 0;
+        const uint64_t interval = openLoop ?
+            static_cast<uint64_t>(NANOS_PER_SECOND / m_rate) : 0;
+        uint64_t nextSend = GetMonotonicNanos();
+        uint64_t lastTimeoutCheck = nextSend;
+        epoll_event events[MAX_EVENT_NUMBER];
+
+        while (true) {
+            uint64_t now = GetMonotonicNanos();
+            if (now >= m_deadline) {
+                break;
+            }
+            if (openLoop) {
+                while (nextSend <= now) {
+                    m_pending.push_back(nextSend);
+                    nextSend += interval;
+                }
+                Dispatch(now, m_deadline);
+            }
+            if (now - lastTimeoutCheck > 100 * NANOS_PER_MILLI) {
+                CheckTimeouts(now);
+                lastTimeoutCheck = now;
+            }
+
+            uint64_t wake = std::min(m_deadline, now + 100 * NANOS_PER_MILLI);
+            if (openLoop && m_pending.empty()) {
+                wake = std::min(wake, nextSend);
+            }
+            int timeout = static_cast<int>((wake - now + NANOS_PER_MILLI - 1) / NANOS_PER_MILLI);
+            if (openLoop && !m_pending.empty()) {
+                timeout = std::min(timeout, 1);
+            }
+            int number = epoll_wait(m_epollfd, events, MAX_EVENT_NUMBER, timeout);
+            if (number < 0 && errno != EINTR) {
+                std::cerr << "epoll_wait failed: " << std::strerror(errno) << std::endl;
+                break;
+            }
+            for (int i = 0; i < number; ++i) {
+                const std::size_t index = events[i].data.u32;
+                Connection& conn = m_conns[index];
+                if (conn.fd == -1) {
+                    continue;
+                }
+                if (!conn.connected) {
+                    int err = 0;
+                    socklen_t len = sizeof(err);
+                    getsockopt(conn.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+                    if (err != 0 || (events[i].events & (EPOLLERR | EPOLLHUP))) {
+                        ++m_stats.errors;
+                        Close(index, true);
+                        continue;
+                    }
+                    conn.connected = true;
+                    ++m_stats.connects;
+                    bool ok = true;
+                    for (int p = 0; !openLoop && ok && p < m_options.pipeline; ++p) {
+                        ok = SendRequest(index, GetMonotonicNanos());
+                    }
+                    if (!ok) {
+                        ++m_stats.errors;
+                        Close(index, true);
+                        continue;
+                    }
+                    UpdateEvents(index);
+                    continue;
+                }
+                if (events[i].events & EPOLLIN) {
+                    if (!OnReadable(index)) {
+                        continue;
+                    }
+                }
+                if (events[i].events & EPOLLOUT) {
+                    if (!Flush(index)) {
+                        ++m_stats.errors;
+                        Close(index, true);
+                        continue;
+                    }
+                }
+                if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                    m_stats.errors += m_conns[index].inflight.size();
+                    Close(index, true);
+                }
+            }
+        }
+
+        for (std::size_t i = 0; i < m_conns.size(); ++i) {
+            Close(i, false);
+        }
+        close(m_epollfd);
+    }
+
+    bool Worker::Connect(std::size_t index) {
+        Connection& conn = m_conns[index];
+        conn = Connection();
+        conn.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (conn.fd == -1) {
+            ++m_stats.errors;
+            return false;
+        }
+        int one = 1;
+        setsockopt(conn.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        int ret = connect(conn.fd, reinterpret_cast<sockaddr*>(&m_address), sizeof(m_address));
+        if (ret == -1 && errno != EINPROGRESS) {
+            ++m_stats.errors;
+            close(conn.fd);
+            conn.fd = -1;
+            return false;
+        }
+        epoll_event event{};
+        event.data.u32 = static_cast<uint32_t>(index);
+        event.events = EPOLLOUT | EPOLLIN;
+        epoll_ctl(m_epollfd, EPOLL_CTL_ADD, conn.fd, &event);
+        return true;
+    }
+
+    void Worker::Close(std::size_t index, bool reconnect) {
+        Connection& conn = m_conns[index];
+        if (conn.fd != -1) {
+            epoll_ctl(m_epollfd, EPOLL_CTL_DEL, conn.fd, nullptr);
+            close(conn.fd);
+            conn.fd = -1;
+        }
+        if (reconnect && GetMonotonicNanos() < m_deadline) {
+            Connect(index);
+        }
+    }
+
+    const std::string& Worker::NextRequest() {
+        const std::string& request = m_requests[m_nextUrl];
+        m_nextUrl = (m_nextUrl + 1) % m_requests.size();
+        return request;
+    }
+
+    bool Worker::SendRequest(std::size_t index, uint64_t intended) {
+        Connection& conn = m_conns[index];
+        conn.out += NextRequest();
+        conn.inflight.push_back(InflightRequest{intended, GetMonotonicNanos()});
+        return Flush(index);
+    }
+
+    bool Worker::Flush(std::size_t index) {
+        Connection& conn = m_conns[index];
+        while (conn.outOffset < conn.out.size()) {
+            ssize_t n = send(conn.fd, conn.out.data() + conn.outOffset,
+                conn.out.size() - conn.outOffset, MSG_NOSIGNAL);
+            if (n == -1) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    break;
+                }
+                return false;
+            }
+            conn.outOffset += static_cast<std::size_t>(n);
+        }
+        if (conn.outOffset == conn.out.size()) {
+            conn.out.clear();
+            conn.outOffset = 0;
+        }
+        UpdateEvents(index);
+        return true;
+    }
+
+    void Worker::UpdateEvents(std::size_t index) {
+        Connection& conn = m_conns[index];
+        epoll_event event{};
+        event.data.u32 = static_cast<uint32_t>(index);
+        event.events = EPOLLIN | (conn.out.empty() ? 0 : static_cast<uint32_t>(EPOLLOUT));
+        epoll_ctl(m_epollfd, EPOLL_CTL_MOD, conn.fd, &event);
+    }
+
+    bool Worker::OnReadable(std::size_t index) {
+        char buffer[READ_BUFFER_SIZE];
+        while (true) {
+            Connection& conn = m_conns[index];
+            ssize_t n = recv(conn.fd, buffer, sizeof(buffer), 0);
+            if (n == -1) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    return true;
+                }
+                m_stats.errors += conn.inflight.size();
+                Close(index, true);
+                return false;
+            }
+            if (n == 0) {
+                // 服务器关闭连接，还没收到响应的请求记为错误
+                m_stats.errors += conn.inflight.size();
+                Close(index, true);
+                return false;
+            }
+            m_stats.bytes += static_cast<uint64_t>(n);
+            bool closeAfter = false;
+            if (!Consume(index, buffer, static_cast<std::size_t>(n), closeAfter)) {
+                ++m_stats.errors;
+                Close(index, true);
+                return false;
+            }
+            if (closeAfter) {
+                Close(index, true);
+                return false;
+            }
+        }
+    }
+
+    bool Worker::Consume(std::size_t index, const char* data, std::size_t len, bool& closeAfter) {
+        Connection& conn = m_conns[index];
+        bool unexpected = false;
+        bool ok = conn.parser.Feed(data, len, [&](int status, bool serverClose) {
+            if (conn.inflight.empty()) {
+                unexpected = true;   // 收到了没有请求对应的响应
+                return false;
+            }
+            const bool close = serverClose || !m_options.keepAlive;
+            Complete(index, status, close);
+            closeAfter = close || conn.broken;
+            return !closeAfter;
+        });
+        return ok && !unexpected;
+    }
+
+    void Worker::Complete(std::size_t index, int status, bool close) {
+        Connection& conn = m_conns[index];
+        const uint64_t now = GetMonotonicNanos();
+        const InflightRequest request = conn.inflight.front();
+        conn.inflight.pop_front();
+        m_stats.latency.Record((now - request.intended) / 1000);
+        ++m_stats.requests;
+        ++m_stats.statuses[status];
+
+        if (m_rate <= 0 && !close && now < m_deadline) {
+            if (!SendRequest(index, now)) {
+                // 发送失败，由Consume()关闭并重连
+                ++m_stats.errors;
+                conn.broken = true;
+            }
+        }
+    }
+
+    void Worker::Dispatch(uint64_t now, uint64_t deadline) {
+        const std::size_t count = m_conns.size();
+        while (!m_pending.empty() && now < deadline) {
+            bool sent = false;
+            for (std::size_t n = 0; n < count; ++n) {
+                const std::size_t index = (m_cursor + n) % count;
+                Connection& conn = m_conns[index];
+                if (conn.fd != -1 && conn.connected &&
+                    static_cast<int>(conn.inflight.size()) < m_options.pipeline &&
+                    (m_options.keepAlive || conn.inflight.empty())) {
+                    m_cursor = index + 1;
+                    const uint64_t intended = m_pending.front();
+                    m_pending.pop_front();
+                    if (!SendRequest(index, intended)) {
+                        ++m_stats.errors;
+                        Close(index, true);
+                    }
+                    sent = true;
+                    break;
+                }
+            }
+            if (!sent) {
+                // 所有连接都忙，请求留在队列里，其等待时间会计入延迟
+                break;
+            }
+        }
+    }
+
+    void Worker::CheckTimeouts(uint64_t now) {
+        const uint64_t timeout = static_cast<uint64_t>(m_options.timeoutMs) * NANOS_PER_MILLI;
+        for (std::size_t i = 0; i < m_conns.size(); ++i) {
+            Connection& conn = m_conns[i];
+            if (conn.fd != -1 && !conn.inflight.empty() &&
+                now > conn.inflight.front().sent &&
+                now - conn.inflight.front().sent > timeout) {
+                m_stats.timeouts += conn.inflight.size();
+                Close(i, true);
+            }
+        }
+    }
+
+    std::vector<std::string>* g_walkUrls = nullptr;
+    std::size_t g_walkPrefix = 0;
+
+    int CollectFile(const char* path, const struct stat*, int type, struct FTW*) {
+        if (type == FTW_F) {
+            g_walkUrls->push_back(std::string(path).substr(g_walkPrefix));
+        }
+        return 0;
+    }
+
+    std::vector<std::string> CollectResources(const std::string& dir) {
+        std::vector<std::string> urls;
+        g_walkUrls = &urls;
+        g_walkPrefix = dir.size();
+        nftw(dir.c_str(), CollectFile, 16, FTW_PHYS);
+        std::sort(urls.begin(), urls.end());
+        return urls;
+    }
+
+    bool ApplyScenario(const std::string& name, Options& options) {
+        if (name == "small") {
+            options.urls = {"/index.html"};
+        } else if (name == "image") {
+            options.urls = {"/images/image1.jpeg"};
+        } else if (name == "404") {
+            options.urls = {"/no-such-file.html"};
+        } else if (name == "churn") {
+            options.urls = {"/index.html"};
+            options.keepAlive = false;
+        } else if (name == "mix") {
+            if (options.resourceDir.empty()) {
+                options.resourceDir = GetExecutableDir() + "/../resources";
+            }
+            options.urls = CollectResources(options.resourceDir);
+        } else {
+            return false;
+        }
+        options.scenario = name;
+        return true;
+    }
+
+    std::string ToJson(const Options& options, const Stats& stats, double seconds) {
+        std::ostringstream oss;
+        oss << "{\"scenario\":\"" << (options.scenario.empty() ? "custom" : options.scenario)
+            << "\",\"host\":\"" << options.host << "\",\"port\":" << options.port
+            << ",\"threads\":" << options.threads
+            << ",\"connections\":" << options.connections
+            << ",\"keep_alive\":" << (options.keepAlive ? "true" : "false")
+            << ",\"pipeline\":" << options.pipeline
+            << ",\"rate\":" << options.rate
+            << ",\"duration_s\":" << seconds
+            << ",\"requests\":" << stats.requests
+            << ",\"errors\":" << stats.errors
+            << ",\"timeouts\":" << stats.timeouts
+            << ",\"connects\":" << stats.connects
+            << ",\"bytes\":" << stats.bytes
+            << ",\"throughput_rps\":" << (seconds > 0 ? stats.requests / seconds : 0)
+            << ",\"throughput_mbps\":" << (seconds > 0 ? stats.bytes * 8 / seconds / 1e6 : 0)
+            << ",\"status\":{";
+        bool first = true;
+        for (const auto& kv : stats.statuses) {
+            oss << (first ? "" : ",") << '"' << kv.first << "\":" << kv.second;
+            first = false;
+        }
+        const metrics::LatencyHistogram& h = stats.latency;
+        oss << "},\"latency_us\":{\"min\":" << h.Min()
+            << ",\"mean\":" << h.Mean()
+            << ",\"p50\":" << h.Percentile(50)
+            << ",\"p90\":" << h.Percentile(90)
+            << ",\"p99\":" << h.Percentile(99)
+            << ",\"p999\":" << h.Percentile(99.9)
+            << ",\"max\":" << h.Max()
+            << "},\"histogram_us\":" << h.BucketsJson() << '}';
+        return oss.str();
+    }
+
+    std::string RunOnce(const Options& options) {
+        std::vector<std::unique_ptr<Worker>> workers;
+        const int threads = std::max(1, std::min(options.threads, options.connections));
+        for (int i = 0; i < threads; ++i) {
+            int conns = options.connections / threads + (i < options.connections % threads ? 1 : 0);
+            workers.emplace_back(new Worker(options, i, conns, options.rate / threads));
+        }
+
+        const uint64_t start = GetMonotonicNanos();
+        const uint64_t deadline = start + static_cast<uint64_t>(options.duration) * NANOS_PER_SECOND;
+        std::vector<std::thread> pool;
+        for (auto& worker : workers) {
+            pool.emplace_back(&Worker::Run, worker.get(), deadline);
+        }
+        for (auto& t : pool) {
+            t.join();
+        }
+        const double seconds = static_cast<double>(GetMonotonicNanos() - start) / NANOS_PER_SECOND;
+
+        Stats total;
+        for (const auto& worker : workers) {
+            total.Merge(worker->GetStats());
+        }
+        std::cerr << (options.scenario.empty() ? "custom" : options.scenario) << ": "
+            << total.requests << " requests in " << seconds << "s, "
+            << (seconds > 0 ? total.requests / seconds : 0) << " req/s, errors "
+            << total.errors << ", timeouts " << total.timeouts
+            << ", p50 " << total.latency.Percentile(50) << "us, p99 "
+            << total.latency.Percentile(99) << "us, max " << total.latency.Max() << "us"
+            << std::endl;
+        return ToJson(options, total, seconds);
+    }
+
+    void Usage(const char* name) {
+        std::cout << "Usage: " << name << " -p port [options]\n"
+            "  -H host          server address (default 127.0.0.1)\n"
+            "  -p port          server port\n"
+            "  -t threads       client threads (default 2)\n"
+            "  -c connections   concurrent connections (default 64)\n"
+            "  -d seconds       test duration (default 10)\n"
+            "  -k 0|1           keep-alive (default 1)\n"
+            "  -P depth         pipelining depth per connection (default 1)\n"
+            "  -r rate          open-loop mode, total requests per second\n"
+            "  -T ms            response timeout (default 5000)\n"
+            "  -u url           request url, may be repeated (default /index.html)\n"
+            "  -a dir           request every file under dir\n"
+            "  -s scenario      small | image | 404 | churn | mix | all\n"
+            "  -o file          write JSON results to file (default stdout)\n";
+    }
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    int opt = 0;
+    while ((opt = getopt(argc, argv, "H:p:t:c:d:k:P:r:T:u:a:s:o:h")) != -1) {
+        switch (opt) {
+            case 'H': options.host = optarg; break;
+            case 'p': options.port = std::atoi(optarg); break;
+            case 't': options.threads = std::atoi(optarg); break;
+            case 'c': options.connections = std::atoi(optarg); break;
+            case 'd': options.duration = std::atoi(optarg); break;
+            case 'k': options.keepAlive = std::atoi(optarg) != 0; break;
+            case 'P': options.pipeline = std::max(1, std::atoi(optarg)); break;
+            case 'r': options.rate = std::atof(optarg); break;
+            case 'T': options.timeoutMs = std::atoi(optarg); break;
+            case 'u': options.urls.push_back(optarg); break;
+            case 'a': options.resourceDir = optarg; break;
+            case 's': options.scenario = optarg; break;
+            case 'o': options.output = optarg; break;
+            default:
+                Usage(argv[0]);
+                return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (options.port <= 0 || options.connections <= 0 || options.duration <= 0) {
+        Usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (!options.resourceDir.empty() && options.scenario.empty()) {
+        options.urls = CollectResources(options.resourceDir);
+    }
+
+    std::vector<std::string> results;
+    if (options.scenario == "all") {
+        const char* scenarios[] = {"small", "image", "404", "churn"};
+        for (const char* name : scenarios) {
+            Options scenario = options;
+            ApplyScenario(name, scenario);
+            results.push_back(RunOnce(scenario));
+        }
+    } else {
+        if (!options.scenario.empty() && !ApplyScenario(options.scenario, options)) {
+            std::cerr << "unknown scenario: " << options.scenario << std::endl;
+            return EXIT_FAILURE;
+        }
+        if (options.urls.empty()) {
+            options.urls.push_back("/index.html");
+        }
+        results.push_back(RunOnce(options));
+    }
+
+    std::string json;
+    if (results.size() == 1) {
+        json = results[0];
+    } else {
+        json = "[";
+        for (std::size_t i = 0; i < results.size(); ++i) {
+            json += (i == 0 ? "" : ",") + results[i];
+        }
+        json += "]";
+    }
+    if (options.output.empty()) {
+        std::cout << json << std::endl;
+    } else {
+        std::ofstream ofs(options.output);
+        ofs << json << std::endl;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,41 @@
+//
+// Created by asujy on 2026/10/19.
+//
+
+#include "bundle/Bundle.h"
+
+#include <cstring>
+
+// 以下由bundlegen生成
+namespace bundle {
+    namespace generated {
+        extern const Asset g_assets[];
+        extern const std::size_t g_assetNum;
+        extern const uint32_t g_seeds[];
+        extern const std::size_t g_bucketMask;
+        extern const uint32_t g_slots[];
+        extern const std::size_t g_slotMask;
+    }
+
+    const Asset* Find(const char* path, std::size_t len) {
+        using namespace generated;
+        if (g_assetNum == 0) {
+            return nullptr;
+        }
+        const uint32_t seed = g_seeds[Hash(path, len, 0) & g_bucketMask];
+        const uint32_t idx = g_slots[Hash(path, len, seed) & g_slotMask];
+        if (idx >= g_assetNum) {
+            return nullptr;
+        }
+        // 完美哈希只保证已知路径不冲突，未知路径仍需比较一次
+        const Asset& asset = g_assets[idx];
+        if (asset.pathLen != len || std::memcmp(asset.path, path, len) != 0) {
+            return nullptr;
+        }
+        return &asset;
+    }
+
+    std::size_t Count() {
+        return generated::g_assetNum;
+    }
+}
@@ -0,0 +1,354 @@
+//
+// Created by asujy on 2026/10/19.
+//
+
+/*
+ * bundlegen: 把静态资源目录打包成C++源文件
+ *   bundlegen <output.cpp> [resources_dir]
+ *   不给目录时生成空的资源包。每个文件的200响应头部、gzip变体和ETag都在这里算好，
+ *   URL索引用"哈希-位移"法生成最小完美哈希：先按第一次哈希分桶，
+ *   从最大的桶开始为每个桶找一个seed，使桶内所有路径二次哈希后落在互不冲突的空槽里。
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+#include <zlib.h>
+
+#include "bundle/Bundle.h"
+#include "common-lib/Utils.h"
+
+namespace {
+    struct File {
+        std::string path;   // URL路径
+        std::string data;
+        struct stat st;
+    };
+
+    struct Variant {
+        std::string etag;
+        std::size_t headOffset{0};
+        std::size_t headLen{0};
+        std::size_t bodyOffset{0};
+        std::size_t bodyLen{0};
+        bool present{false};
+    };
+
+    bool ReadFile(const std::string& file, std::string& data) {
+        std::ifstream in(file, std::ios::binary);
+        if (!in) {
+            return false;
+        }
+        std::ostringstream oss;
+        oss << in.rdbuf();
+        data = oss.str();
+        return true;
+    }
+
+    bool Walk(const std::string& dir, const std::string& prefix, std::vector<File>& files) {
+        DIR* d = opendir(dir.c_str());
+        if (d == nullptr) {
+            std::cerr << "bundlegen: cannot open " << dir << std::endl;
+            return false;
+        }
+        bool ok = true;
+        while (struct dirent* entry = readdir(d)) {
+            const std::string name = entry->d_name;
+            if (name == "." || name == "..") {
+                continue;
+            }
+            const std::string full = dir + "/" + name;
+            File file;
+            if (stat(full.c_str(), &file.st) < 0) {
+                continue;
+            }
+            if (S_ISDIR(file.st.st_mode)) {
+                ok = Walk(full, prefix + "/" + name, files) && ok;
+            } else if (S_ISREG(file.st.st_mode)) {
+                file.path = prefix + "/" + name;
+                if (!ReadFile(full, file.data)) {
+                    std::cerr << "bundlegen: cannot read " << full << std::endl;
+                    ok = false;
+                    continue;
+                }
+                files.push_back(file);
+            }
+        }
+        closedir(d);
+        return ok;
+    }
+
+    bool Gzip(const std::string& in, std::string& out) {
+        z_stream zs{};
+        if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+            return false;
+        }
+        out.resize(deflateBound(&zs, in.size()));
+        zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+        zs.avail_in = static_cast<uInt>(in.size());
+        zs.next_out = reinterpret_cast<Bytef*>(&out[0]);
+        zs.avail_out = static_cast<uInt>(out.size());
+        const int ret = deflate(&zs, Z_FINISH);
+        out.resize(zs.total_out);
+        deflateEnd(&zs);
+        return ret == Z_STREAM_END;
+    }
+
+    // 与HttpConn::MakeETag的格式一致
+    std::string MakeETag(const struct stat& st, bool gzip) {
+        char buf[64];
+        std::snprintf(buf, sizeof(buf), "\"%llx-%llx-%llx%s\"",
+            static_cast<unsigned long long>(st.st_ino),
+            static_cast<unsigned long long>(st.st_size),
+            static_cast<unsigned long long>(st.st_mtim.tv_sec) * 1000000000ULL +
+                static_cast<unsigned long long>(st.st_mtim.tv_nsec),
+            gzip ? "-gz" : "");
+        return buf;
+    }
+
+    std::string MakeHead(const File& file, const std::string& etag, bool compressible,
+                         bool gzip, std::size_t contentLength) {
+        std::string head = "HTTP/1.1 200 OK\r\nAccept-Ranges: bytes\r\n";
+        head += "ETag: " + etag + "\r\n";
+        head += "Last-Modified: " + FormatHttpDate(file.st.st_mtime) + "\r\n";
+        if (compressible) {
+            head += "Vary: Accept-Encoding\r\n";
+        }
+        if (gzip) {
+            head += "Content-Encoding: gzip\r\n";
+        }
+        head += "Content-Length: " + std::to_string(contentLength) + "\r\n";
+        head += "Content-Type:text/html\r\n";
+        return head;
+    }
+
+    std::size_t RoundUpPow2(std::size_t n) {
+        std::size_t p = 1;
+        while (p < n) {
+            p <<= 1;
+        }
+        return p;
+    }
+
+    // 为每个桶找seed，失败(理论上不会发生)返回false
+    bool BuildPerfectHash(const std::vector<File>& files, std::vector<uint32_t>& seeds,
+                          std::vector<uint32_t>& slots) {
+        const std::size_t slotNum = RoundUpPow2(files.size());
+        const std::size_t bucketNum = RoundUpPow2((files.size() + 1) / 2);
+        seeds.assign(bucketNum, 0);
+        slots.assign(slotNum, static_cast<uint32_t>(files.size()));
+        std::vector<std::vector<uint32_t>> buckets(bucketNum);
+        for (std::size_t i = 0; i < files.size(); ++i) {
+            const File& f = files[i];
+            buckets[bundle::Hash(f.path.data(), f.path.size(), 0) & (bucketNum - 1)].push_back(
+                static_cast<uint32_t>(i));
+        }
+        std::vector<std::size_t> order(bucketNum);
+        for (std::size_t b = 0; b < bucketNum; ++b) {
+            order[b] = b;
+        }
+        std::stable_sort(order.begin(), order.end(), [&buckets](std::size_t a, std::size_t b) {
+            return buckets[a].size() > buckets[b].size();
+        });
+        for (std::size_t b : order) {
+            if (buckets[b].empty()) {
+                break;
+            }
+            bool placed = false;
+            for (uint32_t seed = 1; seed < 10000000 && !placed; ++seed) {
+                std::vector<std::size_t> taken;
+                placed = true;
+                for (uint32_t idx : buckets[b]) {
+                    const File& f = files[idx];
+                    const std::size_t s = bundle::Hash(f.path.data(), f.path.size(), seed) & (slotNum - 1);
+                    if (slots[s] != files.size() ||
+                        std::find(taken.begin(), taken.end(), s) != taken.end()) {
+                        placed = false;
+                        break;
+                    }
+                    taken.push_back(s);
+                }
+                if (placed) {
+                    for (std::size_t i = 0; i < taken.size(); ++i) {
+                        slots[taken[i]] = buckets[b][i];
+                    }
+                    seeds[b] = seed;
+                }
+            }
+            if (!placed) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // 八进制转义统一写三位，避免和后面的数字字符连在一起
+    void WriteLiteral(std::ostream& out, const std::string& data) {
+        out << "    \"";
+        std::size_t column = 0;
+        for (unsigned char ch : data) {
+            if (column >= 96) {
+                out << "\"\n    \"";
+                column = 0;
+            }
+            if (ch >= 0x20 && ch < 0x7f && ch != '\\' && ch != '"' && ch != '?') {
+                out << ch;
+                column += 1;
+            } else {
+                char buf[8];
+                std::snprintf(buf, sizeof(buf), "\\%03o", ch);
+                out << buf;
+                column += 4;
+            }
+        }
+        out << "\"";
+    }
+
+    std::string Quote(const std::string& s) {
+        std::string q = "\"";
+        for (char ch : s) {
+            if (ch == '\\' || ch == '"') {
+                q += '\\';
+            }
+            q += ch;
+        }
+        return q + "\"";
+    }
+
+    void WriteVariant(std::ostream& out, const Variant& v) {
+        if (!v.present) {
+            out << "{nullptr, 0, nullptr, 0, nullptr}";
+            return;
+        }
+        out << "{g_data + " << v.headOffset << ", " << v.headLen << ", g_data + " << v.bodyOffset
+            << ", " << v.bodyLen << ", " << Quote(v.etag) << "}";
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <output.cpp> [resources_dir]" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::vector<File> files;
+    if (argc > 2 && !Walk(argv[2], "", files)) {
+        return EXIT_FAILURE;
+    }
+    // 输出与readdir的顺序无关，内容不变时生成的文件也不变
+    std::sort(files.begin(), files.end(), [](const File& a, const File& b) { return a.path < b.path; });
+
+    std::string data;
+    std::vector<Variant> identities(files.size());
+    std::vector<Variant> gzips(files.size());
+    std::size_t gzipBytes = 0;
+    for (std::size_t i = 0; i < files.size(); ++i) {
+        const File& file = files[i];
+        // 压缩后至少小10%才保留gzip变体，图片等已压缩的格式不值得多占一份空间
+        std::string compressed;
+        const bool compressible = file.data.size() >= 256 && Gzip(file.data, compressed) &&
+            compressed.size() * 10 < file.data.size() * 9;
+        Variant& identity = identities[i];
+        identity.present = true;
+        identity.etag = MakeETag(file.st, false);
+        const std::string head = MakeHead(file, identity.etag, compressible, false, file.data.size());
+        identity.headOffset = data.size();
+        identity.headLen = head.size();
+        data += head;
+        identity.bodyOffset = data.size();
+        identity.bodyLen = file.data.size();
+        data += file.data;
+        if (compressible) {
+            Variant& gz = gzips[i];
+            gz.present = true;
+            gz.etag = MakeETag(file.st, true);
+            const std::string gzHead = MakeHead(file, gz.etag, true, true, compressed.size());
+            gz.headOffset = data.size();
+            gz.headLen = gzHead.size();
+            data += gzHead;
+            gz.bodyOffset = data.size();
+            gz.bodyLen = compressed.size();
+            data += compressed;
+            gzipBytes += compressed.size();
+        }
+    }
+
+    std::vector<uint32_t> seeds;
+    std::vector<uint32_t> slots;
+    if (!files.empty() && !BuildPerfectHash(files, seeds, slots)) {
+        std::cerr << "bundlegen: failed to build perfect hash" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (files.empty()) {
+        // 数组不能为空，各放一个不会命中的元素
+        seeds.assign(1, 0);
+        slots.assign(1, 0);
+    }
+
+    const std::string output = argv[1];
+    const std::string tmp = output + ".tmp";
+    std::ofstream out(tmp, std::ios::binary);
+    if (!out) {
+        std::cerr << "bundlegen: cannot write " << tmp << std::endl;
+        return EXIT_FAILURE;
+    }
+    out << "// Generated by bundlegen, do not edit.\n\n"
+        << "#include \"bundle/Bundle.h\"\n\n"
+        << "namespace bundle {\n"
+        << "namespace generated {\n"
+        << "extern const Asset g_assets[];\n"
+        << "extern const std::size_t g_assetNum;\n"
+        << "extern const uint32_t g_seeds[];\n"
+        << "extern const std::size_t g_bucketMask;\n"
+        << "extern const uint32_t g_slots[];\n"
+        << "extern const std::size_t g_slotMask;\n\n"
+        << "namespace {\n"
+        << "const char g_data[] =\n";
+    WriteLiteral(out, data);
+    out << ";\n}\n\n"
+        << "const Asset g_assets[] = {\n";
+    for (std::size_t i = 0; i < files.size(); ++i) {
+        out << "    {" << Quote(files[i].path) << ", " << files[i].path.size() << ", "
+            << static_cast<unsigned long long>(files[i].st.st_ino) << "ULL, "
+            << static_cast<unsigned long long>(files[i].st.st_mtim.tv_sec) * 1000000000ULL +
+                static_cast<unsigned long long>(files[i].st.st_mtim.tv_nsec) << "ULL,\n        ";
+        WriteVariant(out, identities[i]);
+        out << ",\n        ";
+        WriteVariant(out, gzips[i]);
+        out << "},\n";
+    }
+    if (files.empty()) {
+        out << "    {\"\", 0, 0, 0, {nullptr, 0, nullptr, 0, nullptr}, {nullptr, 0, nullptr, 0, nullptr}},\n";
+    }
+    out << "};\n"
+        << "const std::size_t g_assetNum = " << files.size() << ";\n"
+        << "const uint32_t g_seeds[] = {";
+    for (std::size_t i = 0; i < seeds.size(); ++i) {
+        out << (i % 16 == 0 ? "\n    " : " ") << seeds[i] << "U,";
+    }
+    out << "\n};\n"
+        << "const std::size_t g_bucketMask = " << seeds.size() - 1 << ";\n"
+        << "const uint32_t g_slots[] = {";
+    for (std::size_t i = 0; i < slots.size(); ++i) {
+        out << (i % 16 == 0 ? "\n    " : " ") << slots[i] << "U,";
+    }
+    out << "\n};\n"
+        << "const std::size_t g_slotMask = " << slots.size() - 1 << ";\n"
+        << "}\n"
+        << "}\n";
+    out.close();
+    if (!out || std::rename(tmp.c_str(), output.c_str()) != 0) {
+        std::cerr << "bundlegen: cannot write " << output << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "bundlegen: " << files.size() << " assets, " << data.size() << " bytes ("
+              << gzipBytes << " gzip)" << std::endl;
+    return EXIT_SUCCESS;
+}
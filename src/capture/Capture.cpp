@@ -0,0 +1,194 @@
+//
+// Created by asujy on 2026/10/19.
+//
+
+#include "capture/Capture.h"
+#include "common-lib/Utils.h"
+#include "log/Logger.h"
+#include "metrics/Metrics.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace capture {
+    constexpr std::size_t Recorder::RING_SIZE;
+    constexpr std::size_t Recorder::MAX_RECORD_HEADER;
+
+    std::atomic<bool> Recorder::m_enabled{false};
+    std::atomic<uint64_t> Recorder::m_nextConnId{1};
+
+    namespace {
+        std::size_t PutVarint(char* buf, uint64_t value) {
+            std::size_t n = 0;
+            while (value >= 0x80) {
+                buf[n++] = static_cast<char>((value & 0x7f) | 0x80);
+                value >>= 7;
+            }
+            buf[n++] = static_cast<char>(value);
+            return n;
+        }
+    }
+
+    bool ByteRing::Push(const char* header, std::size_t headerLen,
+                        const char* data, std::size_t dataLen) {
+        const uint64_t head = m_head.load(std::memory_order_relaxed);
+        const uint64_t tail = m_tail.load(std::memory_order_acquire);
+        if (m_capacity - (head - tail) < headerLen + dataLen) {
+            return false;
+        }
+        uint64_t pos = head;
+        const char* segments[2] = {header, data};
+        const std::size_t lengths[2] = {headerLen, dataLen};
+        for (int s = 0; s < 2; ++s) {
+            if (lengths[s] == 0) {
+                continue;
+            }
+            const std::size_t offset = pos & (m_capacity - 1);
+            const std::size_t first = std::min(lengths[s], m_capacity - offset);
+            std::memcpy(m_buf.data() + offset, segments[s], first);
+            std::memcpy(m_buf.data(), segments[s] + first, lengths[s] - first);
+            pos += lengths[s];
+        }
+        m_head.store(pos, std::memory_order_release);
+        return true;
+    }
+
+    std::size_t ByteRing::Drain(std::FILE* file) {
+        const uint64_t tail = m_tail.load(std::memory_order_relaxed);
+        const uint64_t head = m_head.load(std::memory_order_acquire);
+        const std::size_t len = static_cast<std::size_t>(head - tail);
+        if (len == 0) {
+            return 0;
+        }
+        const std::size_t offset = tail & (m_capacity - 1);
+        const std::size_t first = std::min(len, m_capacity - offset);
+        std::fwrite(m_buf.data() + offset, 1, first, file);
+        std::fwrite(m_buf.data(), 1, len - first, file);
+        m_tail.store(head, std::memory_order_release);
+        return len;
+    }
+
+    bool Recorder::Start(const std::string& file) {
+        if (m_file != nullptr) {
+            return false;
+        }
+        m_file = std::fopen(file.c_str(), "wb");
+        if (m_file == nullptr) {
+            LOG_ERROR << "open capture file " << file << " failed: " << std::strerror(errno);
+            return false;
+        }
+        std::fwrite(FILE_MAGIC, 1, sizeof(FILE_MAGIC), m_file);
+        m_stop.store(false);
+        m_writer = std::thread(&Recorder::WriterLoop, this);
+        m_enabled.store(true);
+        LOG_INFO << "capturing traffic to " << file;
+        return true;
+    }
+
+    void Recorder::Stop() {
+        if (m_file == nullptr) {
+            return;
+        }
+        m_enabled.store(false);
+        m_stop.store(true);
+        if (m_writer.joinable()) {
+            m_writer.join();
+        }
+        DrainAll();
+        std::fclose(m_file);
+        m_file = nullptr;
+    }
+
+    ByteRing& Recorder::LocalRing() {
+        static thread_local ByteRing* ring = nullptr;
+        if (ring == nullptr) {
+            std::lock_guard<std::mutex> locker(m_mtx);
+            m_rings.emplace_back(new ByteRing(RING_SIZE));
+            ring = m_rings.back().get();
+        }
+        return *ring;
+    }
+
+    void Recorder::Add(RecordType type, uint64_t connId, const char* data, std::size_t len) {
+        char header[MAX_RECORD_HEADER];
+        std::size_t n = 0;
+        header[n++] = static_cast<char>(type);
+        n += PutVarint(header + n, connId);
+        n += PutVarint(header + n, GetMonotonicNanos() / 1000);
+        if (type == RecordType::DATA) {
+            n += PutVarint(header + n, len);
+        } else {
+            len = 0;
+        }
+        if (!LocalRing().Push(header, n, data, len)) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            metrics::Inc(metrics::Counter::CAPTURE_DROPPED);
+        }
+    }
+
+    void Recorder::DrainAll() {
+        std::lock_guard<std::mutex> locker(m_mtx);
+        for (auto& ring : m_rings) {
+            ring->Drain(m_file);
+        }
+        std::fflush(m_file);
+    }
+
+    void Recorder::WriterLoop() {
+        while (!m_stop.load()) {
+            DrainAll();
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+
+    bool Reader::Open(const std::string& file) {
+        m_file.reset(std::fopen(file.c_str(), "rb"));
+        if (!m_file) {
+            return false;
+        }
+        char magic[sizeof(FILE_MAGIC)];
+        return std::fread(magic, 1, sizeof(magic), m_file.get()) == sizeof(magic) &&
+            std::memcmp(magic, FILE_MAGIC, sizeof(magic)) == 0;
+    }
+
+    bool Reader::ReadVarint(uint64_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            const int c = std::fgetc(m_file.get());
+            if (c == EOF) {
+                return false;
+            }
+            value |= static_cast<uint64_t>(c & 0x7f) << shift;
+            if ((c & 0x80) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool Reader::Next(Record& record) {
+        if (!m_file) {
+            return false;
+        }
+        const int type = std::fgetc(m_file.get());
+        if (type < static_cast<int>(RecordType::OPEN) || type > static_cast<int>(RecordType::CLOSE)) {
+            return false;
+        }
+        record.type = static_cast<RecordType>(type);
+        if (!ReadVarint(record.connId) || !ReadVarint(record.timestamp)) {
+            return false;
+        }
+        record.data.clear();
+        if (record.type == RecordType::DATA) {
+            uint64_t len = 0;
+            if (!ReadVarint(len) || len > (1 << 20)) {
+                return false;
+            }
+            record.data.resize(static_cast<std::size_t>(len));
+            if (len > 0 && std::fread(&record.data[0], 1, record.data.size(), m_file.get()) != len) {
+                return false;
+            }
+        }
+        return true;
+    }
+}
@@ -0,0 +1,539 @@
+//
+// Created by asujy on 2026/10/19.
+//
+
+#include "common-lib/Config.h"
+#include "common-lib/SocketAddress.h"
+
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <fstream>
+#include <sched.h>
+#include <sstream>
+
+namespace {
+    std::string Trim(const std::string& s) {
+        const auto begin = s.find_first_not_of(" \t\r\n");
+        if (begin == std::string::npos) {
+            return {};
+        }
+        const auto end = s.find_last_not_of(" \t\r\n");
+        return s.substr(begin, end - begin + 1);
+    }
+
+    bool ParseInt(const std::string& text, long minValue, long maxValue, long& value) {
+        if (text.empty()) {
+            return false;
+        }
+        char* end = nullptr;
+        errno = 0;
+        value = std::strtol(text.c_str(), &end, 10);
+        return errno == 0 && *end == '\0' && value >= minValue && value <= maxValue;
+    }
+
+    bool ParseBool(const std::string& text, bool& value) {
+        if (text == "1" || text == "on" || text == "true" || text == "yes") {
+            value = true;
+            return true;
+        }
+        if (text == "0" || text == "off" || text == "false" || text == "no") {
+            value = false;
+            return true;
+        }
+        return false;
+    }
+
+    std::string JoinCpus(const std::vector<int>& cpus) {
+        std::string s;
+        for (std::size_t i = 0; i < cpus.size(); ++i) {
+            if (i > 0) {
+                s += ',';
+            }
+            s += std::to_string(cpus[i]);
+        }
+        return s.empty() ? "-" : s;
+    }
+
+    std::string JoinStrings(const std::vector<std::string>& items) {
+        std::string s;
+        for (std::size_t i = 0; i < items.size(); ++i) {
+            if (i > 0) {
+                s += ',';
+            }
+            s += items[i];
+        }
+        return s.empty() ? "-" : s;
+    }
+}
+
+bool ParseCpuList(const std::string& text, std::vector<int>& cpus) {
+    cpus.clear();
+    std::istringstream iss(text);
+    std::string item;
+    while (std::getline(iss, item, ',')) {
+        item = Trim(item);
+        long first = 0;
+        long last = 0;
+        const auto dash = item.find('-');
+        if (dash == std::string::npos) {
+            if (!ParseInt(item, 0, CPU_SETSIZE - 1, first)) {
+                return false;
+            }
+            last = first;
+        } else if (!ParseInt(Trim(item.substr(0, dash)), 0, CPU_SETSIZE - 1, first) ||
+                   !ParseInt(Trim(item.substr(dash + 1)), 0, CPU_SETSIZE - 1, last) ||
+                   first > last) {
+            return false;
+        }
+        for (long cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(static_cast<int>(cpu));
+        }
+    }
+    return !cpus.empty();
+}
+
+bool ParseCacheRules(const std::string& text, std::vector<std::pair<std::string, int>>& rules) {
+    rules.clear();
+    std::istringstream iss(text);
+    std::string item;
+    while (std::getline(iss, item, ',')) {
+        item = Trim(item);
+        if (item.empty()) {
+            continue;
+        }
+        const auto eq = item.rfind('=');
+        long maxAge = 0;
+        if (eq == std::string::npos || item[0] != '/' ||
+            !ParseInt(Trim(item.substr(eq + 1)), 0, INT_MAX, maxAge)) {
+            return false;
+        }
+        rules.emplace_back(Trim(item.substr(0, eq)), static_cast<int>(maxAge));
+    }
+    return true;
+}
+
+bool ParseProxyRules(const std::string& text, std::vector<std::pair<std::string, std::vector<std::string>>>& rules) {
+    rules.clear();
+    std::istringstream iss(text);
+    std::string item;
+    while (std::getline(iss, item, ',')) {
+        item = Trim(item);
+        if (item.empty()) {
+            continue;
+        }
+        // 前缀中不会有'='，地址(unix:/path)中可能有
+        const auto eq = item.find('=');
+        if (eq == std::string::npos) {
+            return false;
+        }
+        const std::string prefix = Trim(item.substr(0, eq));
+        if (prefix.empty() || prefix.front() != '/' || prefix.back() != '/') {
+            return false;
+        }
+        std::vector<std::string> servers;
+        std::istringstream list(item.substr(eq + 1));
+        std::string server;
+        while (list >> server) {
+            servers.push_back(server);
+        }
+        if (servers.empty()) {
+            return false;
+        }
+        rules.emplace_back(prefix, std::move(servers));
+    }
+    return true;
+}
+
+bool ParseListenList(const std::string& text, std::vector<std::string>& addresses) {
+    addresses.clear();
+    std::istringstream iss(text);
+    std::string item;
+    while (std::getline(iss, item, ',')) {
+        item = Trim(item);
+        if (item.empty()) {
+            continue;
+        }
+        SocketAddress addr;
+        if (!SocketAddress::Parse(item, addr)) {
+            return false;
+        }
+        addresses.push_back(item);
+    }
+    return true;
+}
+
+bool ParseExtensionList(const std::string& text, std::vector<std::string>& extensions) {
+    extensions.clear();
+    std::istringstream iss(text);
+    std::string item;
+    while (std::getline(iss, item, ',')) {
+        item = Trim(item);
+        if (item.empty()) {
+            continue;
+        }
+        if (item[0] != '.') {
+            item.insert(0, 1, '.');
+        }
+        extensions.push_back(item);
+    }
+    return true;
+}
+
+bool ServerConfig::Set(const std::string& key, const std::string& value, std::string& error) {
+    long n = 0;
+    bool ok = true;
+    if (key == "port") {
+        ok = ParseInt(value, 1, 65535, n);
+        port = static_cast<int>(n);
+    } else if (key == "threads") {
+        ok = ParseInt(value, 1, 1024, n);
+        threadNumber = static_cast<int>(n);
+    } else if (key == "queue_depth") {
+        ok = ParseInt(value, 1, INT_MAX, n);
+        maxRequests = static_cast<int>(n);
+    } else if (key == "listen_backlog") {
+        ok = ParseInt(value, 1, INT_MAX, n);
+        listenBacklog = static_cast<int>(n);
+    } else if (key == "max_events") {
+        ok = ParseInt(value, 1, INT_MAX, n);
+        maxEvents = static_cast<int>(n);
+    } else if (key == "max_fd") {
+        ok = ParseInt(value, 16, 16 * 1024 * 1024, n);
+        maxFd = static_cast<int>(n);
+    } else if (key == "read_buffer_size") {
+        // 至少要放得下请求行和头部
+        ok = ParseInt(value, 512, 64 * 1024 * 1024, n);
+        readBufferSize = static_cast<std::size_t>(n);
+    } else if (key == "write_buffer_size") {
+        ok = ParseInt(value, 512, 64 * 1024 * 1024, n);
+        writeBufferSize = static_cast<std::size_t>(n);
+    } else if (key == "write_budget_bytes") {
+        ok = ParseInt(value, 0, LONG_MAX, n);
+        writeBudgetBytes = static_cast<std::size_t>(n);
+    } else if (key == "write_budget_writes") {
+        ok = ParseInt(value, 0, INT_MAX, n);
+        writeBudgetWrites = static_cast<int>(n);
+    } else if (key == "max_body_size") {
+        ok = ParseInt(value, 0, LONG_MAX, n);
+        maxBodySize = static_cast<uint64_t>(n);
+    } else if (key == "chunk_size") {
+        ok = ParseInt(value, 256, 16 * 1024 * 1024, n);
+        chunkSize = static_cast<std::size_t>(n);
+    } else if (key == "upload_dir") {
+        ok = !value.empty();
+        uploadDir = value;
+    } else if (key == "upload_max_size") {
+        ok = ParseInt(value, 0, LONG_MAX, n);
+        maxUploadSize = static_cast<uint64_t>(n);
+    } else if (key == "upload_path") {
+        ok = value.empty() || value[0] == '/';
+        uploadPath = value;
+    } else if (key == "http2") {
+        ok = ParseBool(value, http2);
+    } else if (key == "h2_max_streams") {
+        ok = ParseInt(value, 1, 65536, n);
+        h2MaxStreams = static_cast<uint32_t>(n);
+    } else if (key == "listen") {
+        ok = ParseListenList(value, listen);
+    } else if (key == "tls_listen") {
+        ok = ParseListenList(value, tlsListen);
+    } else if (key == "tls_port") {
+        ok = ParseInt(value, 0, 65535, n);
+        tlsPort = static_cast<int>(n);
+    } else if (key == "tls_cert") {
+        tlsCert = value;
+    } else if (key == "tls_key") {
+        tlsKey = value;
+    } else if (key == "tls_session_cache") {
+        ok = ParseInt(value, 0, 1 << 24, n);
+        tlsSessionCache = n;
+    } else if (key == "tls_session_timeout") {
+        ok = ParseInt(value, 1, 7 * 24 * 3600, n);
+        tlsSessionTimeout = n;
+    } else if (key == "ktls") {
+        ok = ParseBool(value, ktls);
+    } else if (key == "proxy_pass") {
+        ok = ParseProxyRules(value, proxyRules);
+    } else if (key == "proxy_connect_timeout_ms") {
+        ok = ParseInt(value, 1, 600000, n);
+        proxyConnectTimeoutMs = static_cast<int>(n);
+    } else if (key == "proxy_read_timeout_ms") {
+        ok = ParseInt(value, 1, 3600000, n);
+        proxyReadTimeoutMs = static_cast<int>(n);
+    } else if (key == "proxy_idle_timeout") {
+        ok = ParseInt(value, 1, 3600, n);
+        proxyIdleTimeout = static_cast<int>(n);
+    } else if (key == "proxy_max_idle") {
+        ok = ParseInt(value, 0, 65536, n);
+        proxyMaxIdle = static_cast<int>(n);
+    } else if (key == "proxy_health_interval") {
+        ok = ParseInt(value, 0, 3600, n);
+        proxyHealthInterval = static_cast<int>(n);
+    } else if (key == "proxy_health_path") {
+        ok = value.empty() || value[0] == '/';
+        proxyHealthPath = value;
+    } else if (key == "ws_path") {
+        ok = value.empty() || (value[0] == '/' && value.back() == '/');
+        wsPath = value;
+    } else if (key == "ws_max_message") {
+        ok = ParseInt(value, 125, 1L << 30, n);
+        wsMaxMessage = static_cast<std::size_t>(n);
+    } else if (key == "ws_queue_limit") {
+        ok = ParseInt(value, 1, 1 << 20, n);
+        wsQueueLimit = static_cast<std::size_t>(n);
+    } else if (key == "ws_slow_policy") {
+        ok = value == "drop" || value == "close";
+        wsSlowClose = value == "close";
+    } else if (key == "metrics_path") {
+        metricsPath = value;
+    } else if (key == "trace_path") {
+        tracePath = value;
+    } else if (key == "health_path") {
+        healthPath = value;
+    } else if (key == "delay_path") {
+        ok = value.empty() || value[0] == '/';
+        delayPath = value;
+    } else if (key == "capture_file") {
+        captureFile = value;
+    } else if (key == "cache_control") {
+        ok = ParseCacheRules(value, cacheRules);
+    } else if (key == "gzip") {
+        ok = ParseBool(value, gzip);
+    } else if (key == "gzip_cache_bytes") {
+        ok = ParseInt(value, 0, LONG_MAX, n);
+        gzipCacheBytes = static_cast<std::size_t>(n);
+    } else if (key == "gzip_level") {
+        ok = ParseInt(value, 1, 9, n);
+        gzipLevel = static_cast<int>(n);
+    } else if (key == "gzip_min_size") {
+        ok = ParseInt(value, 0, LONG_MAX, n);
+        gzipMinSize = static_cast<std::size_t>(n);
+    } else if (key == "gzip_types") {
+        ok = ParseExtensionList(value, gzipTypes);
+    } else if (key == "log_file") {
+        ok = !value.empty();
+        logFile = value;
+    } else if (key == "reactor_cpu") {
+        ok = ParseInt(value, -1, CPU_SETSIZE - 1, n);
+        reactorCpu = static_cast<int>(n);
+    } else if (key == "worker_cpus") {
+        if (value.empty() || value == "-") {
+            workerCpus.clear();
+        } else {
+            ok = ParseCpuList(value, workerCpus);
+        }
+    } else if (key == "numa") {
+        ok = ParseBool(value, numa);
+    } else if (key == "load_shedding") {
+        ok = ParseBool(value, loadShedding);
+    } else if (key == "shed_target_ms") {
+        ok = ParseInt(value, 1, 60 * 1000, n);
+        shedTargetMs = static_cast<int>(n);
+    } else if (key == "shed_interval_ms") {
+        ok = ParseInt(value, 1, 60 * 1000, n);
+        shedIntervalMs = static_cast<int>(n);
+    } else if (key == "max_connections") {
+        ok = ParseInt(value, 0, INT_MAX, n);
+        maxConnections = static_cast<int>(n);
+    } else if (key == "retry_after") {
+        ok = ParseInt(value, 0, 24 * 3600, n);
+        retryAfter = static_cast<int>(n);
+    } else if (key == "drain_timeout") {
+        ok = ParseInt(value, 0, 24 * 3600, n);
+        drainTimeout = static_cast<int>(n);
+    } else if (key == "client_conn_rate") {
+        ok = ParseInt(value, 0, 1000000000, n);
+        clientConnRate = static_cast<int>(n);
+    } else if (key == "client_conn_burst") {
+        ok = ParseInt(value, 0, 1000000000, n);
+        clientConnBurst = static_cast<int>(n);
+    } else if (key == "client_max_conns") {
+        ok = ParseInt(value, 0, INT_MAX, n);
+        clientMaxConns = static_cast<int>(n);
+    } else if (key == "client_request_rate") {
+        ok = ParseInt(value, 0, 1000000000, n);
+        clientRequestRate = static_cast<int>(n);
+    } else if (key == "client_request_burst") {
+        ok = ParseInt(value, 0, 1000000000, n);
+        clientRequestBurst = static_cast<int>(n);
+    } else if (key == "client_table_size") {
+        ok = ParseInt(value, 1, 64 * 1024 * 1024, n);
+        clientTableSize = static_cast<int>(n);
+    } else if (key.compare(0, 6, "vhost.") == 0) {
+        return SetVirtualHost(key.substr(6), value, error);
+    } else {
+        error = "unknown key '" + key + "'";
+        return false;
+    }
+    if (!ok) {
+        error = "invalid value '" + value + "' for '" + key + "'";
+    }
+    return ok;
+}
+
+bool ServerConfig::SetVirtualHost(const std::string& key, const std::string& value, std::string& error) {
+    // 主机名中有点号，最后一段才是配置项
+    const auto dot = key.rfind('.');
+    if (dot == std::string::npos || dot == 0) {
+        error = "expected vhost.<host>.<key>, got 'vhost." + key + "'";
+        return false;
+    }
+    std::string name = key.substr(0, dot);
+    for (auto& ch : name) {
+        ch = static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
+    }
+    const std::string item = key.substr(dot + 1);
+    VirtualHostConfig* host = nullptr;
+    for (auto& vhost : vhosts) {
+        if (vhost.name == name) {
+            host = &vhost;
+            break;
+        }
+    }
+    if (host == nullptr) {
+        vhosts.emplace_back();
+        host = &vhosts.back();
+        host->name = name;
+    }
+
+    long n = 0;
+    bool ok = true;
+    if (item == "root") {
+        ok = !value.empty();
+        host->root = value;
+    } else if (item == "alias") {
+        host->aliases.clear();
+        std::istringstream iss(value);
+        std::string alias;
+        while (std::getline(iss, alias, ',')) {
+            alias = Trim(alias);
+            if (!alias.empty()) {
+                host->aliases.push_back(alias);
+            }
+        }
+    } else if (item == "gzip_cache_bytes") {
+        ok = ParseInt(value, 0, LONG_MAX, n);
+        host->gzipCacheBytes = static_cast<std::size_t>(n);
+    } else if (item == "cache_control") {
+        ok = ParseCacheRules(value, host->cacheRules);
+        host->ownCacheRules = true;
+    } else if (item == "add_header") {
+        // 头部中不能有换行，名字非空
+        const auto colon = value.find(':');
+        ok = colon != std::string::npos && colon > 0 && value.find_first_of("\r\n") == std::string::npos;
+        if (ok) {
+            host->headers.push_back(value);
+        }
+    } else {
+        error = "unknown key 'vhost." + key + "'";
+        return false;
+    }
+    if (!ok) {
+        error = "invalid value '" + value + "' for 'vhost." + key + "'";
+    }
+    return ok;
+}
+
+bool ServerConfig::Override(const std::string& item, std::string& error) {
+    const auto eq = item.find('=');
+    if (eq == std::string::npos) {
+        error = "expected key=value, got '" + item + "'";
+        return false;
+    }
+    return Set(Trim(item.substr(0, eq)), Trim(item.substr(eq + 1)), error);
+}
+
+bool ServerConfig::Load(const std::string& file, std::string& error) {
+    std::ifstream in(file);
+    if (!in) {
+        error = "cannot open config file " + file;
+        return false;
+    }
+    std::string line;
+    int lineNo = 0;
+    while (std::getline(in, line)) {
+        ++lineNo;
+        const auto hash = line.find('#');
+        if (hash != std::string::npos) {
+            line.erase(hash);
+        }
+        line = Trim(line);
+        if (line.empty()) {
+            continue;
+        }
+        if (!Override(line, error)) {
+            error = file + ":" + std::to_string(lineNo) + ": " + error;
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string ServerConfig::ToString() const {
+    std::ostringstream oss;
+    oss << "port=" << port
+        << " threads=" << threadNumber
+        << " queue_depth=" << maxRequests
+        << " listen_backlog=" << listenBacklog
+        << " max_events=" << maxEvents
+        << " max_fd=" << maxFd
+        << " read_buffer_size=" << readBufferSize
+        << " write_buffer_size=" << writeBufferSize
+        << " write_budget_bytes=" << writeBudgetBytes
+        << " write_budget_writes=" << writeBudgetWrites
+        << " max_body_size=" << maxBodySize
+        << " chunk_size=" << chunkSize
+        << " upload_dir=" << uploadDir
+        << " upload_max_size=" << maxUploadSize
+        << " upload_path=" << uploadPath
+        << " http2=" << (http2 ? "on" : "off")
+        << " h2_max_streams=" << h2MaxStreams
+        << " listen=" << JoinStrings(listen)
+        << " tls_port=" << tlsPort
+        << " tls_listen=" << JoinStrings(tlsListen)
+        << " tls_cert=" << tlsCert
+        << " tls_key=" << tlsKey
+        << " tls_session_cache=" << tlsSessionCache
+        << " tls_session_timeout=" << tlsSessionTimeout
+        << " ktls=" << (ktls ? "on" : "off")
+        << " proxy_pass=" << proxyRules.size()
+        << " proxy_connect_timeout_ms=" << proxyConnectTimeoutMs
+        << " proxy_read_timeout_ms=" << proxyReadTimeoutMs
+        << " proxy_idle_timeout=" << proxyIdleTimeout
+        << " proxy_max_idle=" << proxyMaxIdle
+        << " proxy_health_interval=" << proxyHealthInterval
+        << " proxy_health_path=" << proxyHealthPath
+        << " ws_path=" << wsPath
+        << " ws_max_message=" << wsMaxMessage
+        << " ws_queue_limit=" << wsQueueLimit
+        << " ws_slow_policy=" << (wsSlowClose ? "close" : "drop")
+        << " reactor_cpu=" << reactorCpu
+        << " worker_cpus=" << JoinCpus(workerCpus)
+        << " numa=" << (numa ? "on" : "off")
+        << " cache_rules=" << cacheRules.size()
+        << " gzip=" << (gzip ? "on" : "off")
+        << " gzip_cache_bytes=" << gzipCacheBytes
+        << " gzip_level=" << gzipLevel
+        << " gzip_min_size=" << gzipMinSize
+        << " gzip_types=" << gzipTypes.size()
+        << " load_shedding=" << (loadShedding ? "on" : "off")
+        << " shed_target_ms=" << shedTargetMs
+        << " shed_interval_ms=" << shedIntervalMs
+        << " max_connections=" << maxConnections
+        << " retry_after=" << retryAfter
+        << " drain_timeout=" << drainTimeout
+        << " client_conn_rate=" << clientConnRate
+        << " client_conn_burst=" << clientConnBurst
+        << " client_max_conns=" << clientMaxConns
+        << " client_request_rate=" << clientRequestRate
+        << " client_request_burst=" << clientRequestBurst
+        << " client_table_size=" << clientTableSize;
+    std::vector<std::string> names;
+    for (const auto& vhost : vhosts) {
+        names.push_back(vhost.name);
+    }
+    oss << " vhosts=" << JoinStrings(names);
+    return oss.str();
+}
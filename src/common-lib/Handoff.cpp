@@ -0,0 +1,201 @@
+//
+// Created by asujy on 2026/10/19.
+//
+
+#include "common-lib/Handoff.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "log/Logger.h"
+
+extern char** environ;
+
+namespace {
+    constexpr std::size_t MAX_NAMES = 16 * 1024;  // 地址列表的最大长度
+
+    void ClearCloexec(int fd) {
+        const int flags = fcntl(fd, F_GETFD);
+        if (flags != -1) {
+            fcntl(fd, F_SETFD, flags & ~FD_CLOEXEC);
+        }
+    }
+}
+
+namespace handoff {
+    int Spawn(const std::string& exe, const std::vector<std::string>& args, const Sockets& sockets, pid_t& pid) {
+        if (exe.empty() || sockets.empty() || sockets.size() > MAX_SOCKETS) {
+            LOG_ERROR << "handoff: nothing to hand off or executable unknown";
+            return -1;
+        }
+        std::string names;
+        for (const auto& socket : sockets) {
+            names += socket.first;
+            names += '\n';
+        }
+        if (names.size() > MAX_NAMES) {
+            LOG_ERROR << "handoff: listener list too long";
+            return -1;
+        }
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == -1) {
+            LOG_ERROR << "handoff: socketpair failed: " << strerror(errno);
+            return -1;
+        }
+
+        // fork之后子进程只调用异步信号安全的函数，参数和环境变量都提前准备好
+        const std::string channelEnv = std::string(ENV_NAME) + "=" + std::to_string(fds[1]);
+        std::vector<char*> argv;
+        for (const auto& arg : args) {
+            argv.push_back(const_cast<char*>(arg.c_str()));
+        }
+        argv.push_back(nullptr);
+        const std::string prefix = std::string(ENV_NAME) + "=";
+        std::vector<char*> envp;
+        for (char** env = environ; env != nullptr && *env != nullptr; ++env) {
+            if (std::strncmp(*env, prefix.c_str(), prefix.size()) != 0) {
+                envp.push_back(*env);
+            }
+        }
+        envp.push_back(const_cast<char*>(channelEnv.c_str()));
+        envp.push_back(nullptr);
+        struct rlimit limit{};
+        const int maxFd = getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY ?
+            static_cast<int>(limit.rlim_cur) : 65536;
+
+        pid = fork();
+        if (pid == -1) {
+            LOG_ERROR << "handoff: fork failed: " << strerror(errno);
+            close(fds[0]);
+            close(fds[1]);
+            return -1;
+        }
+        if (pid == 0) {
+            // 客户端连接等都不能留给新进程，监听socket随后从channel收到
+            ClearCloexec(fds[1]);
+            for (int fd = 3; fd < maxFd; ++fd) {
+                if (fd != fds[1]) {
+                    close(fd);
+                }
+            }
+            execve(exe.c_str(), argv.data(), envp.data());
+            _exit(127);
+        }
+        close(fds[1]);
+
+        std::vector<char> control(CMSG_SPACE(sizeof(int) * sockets.size()), 0);
+        struct iovec iov{};
+        iov.iov_base = &names[0];
+        iov.iov_len = names.size();
+        struct msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.data();
+        msg.msg_controllen = control.size();
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * sockets.size());
+        int* data = reinterpret_cast<int*>(CMSG_DATA(cmsg));
+        for (std::size_t i = 0; i < sockets.size(); ++i) {
+            data[i] = sockets[i].second;
+        }
+        ssize_t n = 0;
+        do {
+            n = sendmsg(fds[0], &msg, MSG_NOSIGNAL);
+        } while (n == -1 && errno == EINTR);
+        if (n != static_cast<ssize_t>(names.size())) {
+            // 子进程没能收到监听socket，会在Receive失败后退出
+            LOG_ERROR << "handoff: send listeners to pid " << pid << " failed: " << strerror(errno);
+            close(fds[0]);
+            return -1;
+        }
+        LOG_INFO << "handoff: started pid " << pid << " with " << sockets.size() << " listeners";
+        return fds[0];
+    }
+
+    bool Receive(Sockets& sockets, int& channel) {
+        sockets.clear();
+        channel = -1;
+        const char* env = std::getenv(ENV_NAME);
+        if (env == nullptr) {
+            return true;
+        }
+        channel = std::atoi(env);
+        unsetenv(ENV_NAME);
+        if (channel < 3) {
+            LOG_ERROR << "handoff: bad " << ENV_NAME;
+            channel = -1;
+            return false;
+        }
+        fcntl(channel, F_SETFD, FD_CLOEXEC);
+
+        std::vector<char> names(MAX_NAMES);
+        std::vector<char> control(CMSG_SPACE(sizeof(int) * MAX_SOCKETS), 0);
+        struct iovec iov{};
+        iov.iov_base = names.data();
+        iov.iov_len = names.size();
+        struct msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.data();
+        msg.msg_controllen = control.size();
+        ssize_t n = 0;
+        do {
+            n = recvmsg(channel, &msg, MSG_CMSG_CLOEXEC);
+        } while (n == -1 && errno == EINTR);
+        if (n <= 0 || (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC))) {
+            LOG_ERROR << "handoff: receive listeners failed: " << (n < 0 ? strerror(errno) : "truncated or closed");
+            close(channel);
+            channel = -1;
+            return false;
+        }
+        std::vector<int> fds;
+        for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+                const std::size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                const int* data = reinterpret_cast<const int*>(CMSG_DATA(cmsg));
+                fds.insert(fds.end(), data, data + count);
+            }
+        }
+        // 地址与fd按顺序一一对应，数量不一致时全部放弃
+        std::vector<std::string> list;
+        std::size_t start = 0;
+        for (std::size_t i = 0; i < static_cast<std::size_t>(n); ++i) {
+            if (names[i] == '\n') {
+                list.emplace_back(names.data() + start, i - start);
+                start = i + 1;
+            }
+        }
+        if (list.size() != fds.size()) {
+            LOG_ERROR << "handoff: got " << fds.size() << " fds for " << list.size() << " listeners";
+            for (int fd : fds) {
+                close(fd);
+            }
+            close(channel);
+            channel = -1;
+            return false;
+        }
+        for (std::size_t i = 0; i < fds.size(); ++i) {
+            sockets.emplace_back(list[i], fds[i]);
+        }
+        LOG_INFO << "handoff: received " << sockets.size() << " listeners from pid " << getppid();
+        return true;
+    }
+
+    void Ready(int channel) {
+        if (channel < 0) {
+            return;
+        }
+        const char ready = 1;
+        if (write(channel, &ready, 1) != 1) {
+            LOG_ERROR << "handoff: notify old process failed: " << strerror(errno);
+        }
+        close(channel);
+    }
+}
@@ -0,0 +1,47 @@
+//
+// Created by asujy on 2026/10/19.
+//
+
+#include "common-lib/LoadShedder.h"
+#include "log/Logger.h"
+
+void LoadShedder::OnDequeue(uint64_t sojournNs, uint64_t now) {
+    m_depth.fetch_sub(1, std::memory_order_relaxed);
+    m_windowCount.fetch_add(1, std::memory_order_relaxed);
+    uint64_t current = m_windowMin.load(std::memory_order_relaxed);
+    while (sojournNs < current &&
+           !m_windowMin.compare_exchange_weak(current, sojournNs, std::memory_order_relaxed)) {
+    }
+
+    uint64_t start = m_windowStart.load(std::memory_order_relaxed);
+    if (start == 0) {
+        m_windowStart.compare_exchange_strong(start, now, std::memory_order_relaxed);
+        return;
+    }
+    // 只有抢到窗口的线程负责结算
+    if (now - start < m_intervalNs ||
+        !m_windowStart.compare_exchange_strong(start, now, std::memory_order_relaxed)) {
+        return;
+    }
+    const uint64_t minSojourn = m_windowMin.exchange(UINT64_MAX, std::memory_order_relaxed);
+    const uint64_t count = m_windowCount.exchange(0, std::memory_order_relaxed);
+    const int64_t oldLimit = m_limit.load(std::memory_order_relaxed);
+    int64_t limit = 0;
+    if (minSojourn != UINT64_MAX && minSojourn > m_targetNs) {
+        // L = λW：按实测出队速率算出能在target内排空的队列长度
+        const uint64_t elapsed = now - start;
+        limit = static_cast<int64_t>(count * m_targetNs / elapsed);
+        if (limit < m_minLimit) {
+            limit = m_minLimit;
+        }
+    }
+    m_limit.store(limit, std::memory_order_relaxed);
+    if ((oldLimit == 0) != (limit == 0)) {
+        if (limit != 0) {
+            LOG_WARN << "overloaded: min queue sojourn " << minSojourn / 1000
+                << "us, shedding above queue depth " << limit;
+        } else {
+            LOG_INFO << "overload cleared, min queue sojourn " << minSojourn / 1000 << "us";
+        }
+    }
+}
@@ -0,0 +1,99 @@
+//
+// Created by asujy on 2026/10/19.
+//
+
+#include "common-lib/Numa.h"
+#include "log/Logger.h"
+
+#include <cstring>
+#include <dirent.h>
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+constexpr std::size_t NumaArena::CHUNK_SIZE;
+
+bool PinCurrentThread(int cpu) {
+    if (cpu < 0) {
+        return true;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    const int ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (ret != 0) {
+        LOG_ERROR << "pin thread to cpu " << cpu << " failed: " << std::strerror(ret);
+        return false;
+    }
+    return true;
+}
+
+int NumaNodeOfCpu(int cpu) {
+    if (cpu < 0) {
+        return -1;
+    }
+    // /sys/devices/system/cpu/cpuN/下有一个nodeM的链接
+    const std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+    DIR* dir = opendir(path.c_str());
+    if (dir == nullptr) {
+        return -1;
+    }
+    int node = -1;
+    while (struct dirent* entry = readdir(dir)) {
+        if (std::strncmp(entry->d_name, "node", 4) == 0 &&
+            entry->d_name[4] >= '0' && entry->d_name[4] <= '9') {
+            node = std::atoi(entry->d_name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+NumaArena::~NumaArena() {
+    for (const auto& chunk : m_chunks) {
+        munmap(chunk.base, chunk.size);
+    }
+}
+
+bool NumaArena::NewChunk(std::size_t size) {
+    const std::size_t page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    size = (size + page - 1) / page * page;
+    void* base = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) {
+        LOG_ERROR << "NumaArena: mmap " << size << " bytes failed: " << std::strerror(errno);
+        return false;
+    }
+    if (m_node >= 0) {
+        // 页面在首次访问时才真正分配，mbind之后无论哪个线程先访问都落在该节点上
+        const unsigned long maxNode = sizeof(unsigned long) * 8;
+        if (m_node < static_cast<int>(maxNode)) {
+            const unsigned long mask = 1UL << m_node;
+            if (syscall(SYS_mbind, base, size, MPOL_PREFERRED, &mask, maxNode, 0) == -1) {
+                LOG_WARN << "NumaArena: mbind to node " << m_node << " failed: "
+                    << std::strerror(errno);
+            }
+        }
+    }
+    m_chunks.push_back(Chunk{static_cast<char*>(base), size});
+    m_used = 0;
+    return true;
+}
+
+void* NumaArena::Allocate(std::size_t size, std::size_t align) {
+    std::lock_guard<std::mutex> locker(m_mtx);
+    std::size_t offset = (m_used + align - 1) / align * align;
+    if (m_chunks.empty() || offset + size > m_chunks.back().size) {
+        if (!NewChunk(size > CHUNK_SIZE ? size : CHUNK_SIZE)) {
+            return nullptr;
+        }
+        offset = 0;
+    }
+    m_used = offset + size;
+    return m_chunks.back().base + offset;
+}
@@ -0,0 +1,143 @@
+//
+// Created by asujy on 2026/10/19.
+//
+
+#include "common-lib/RateLimiter.h"
+#include "common-lib/SocketAddress.h"
+
+constexpr int RateLimiter::SHARD_NUM;
+constexpr int RateLimiter::WAYS;
+
+RateLimiter::RateLimiter(const Options& options)
+    : m_connBucket(MakeBucket(options.connRate, options.connBurst)),
+      m_requestBucket(MakeBucket(options.requestRate, options.requestBurst)),
+      m_maxConns(options.maxConns) {
+    // 每个分片的组数取2的幂
+    std::size_t sets = 1;
+    while (sets * SHARD_NUM * WAYS < options.entries) {
+        sets <<= 1;
+    }
+    m_setMask = sets - 1;
+    for (auto& shard : m_shards) {
+        shard.entries.resize(sets * WAYS);
+    }
+}
+
+RateLimiter::Bucket RateLimiter::MakeBucket(uint32_t rate, uint32_t burst) {
+    Bucket bucket;
+    if (rate == 0) {
+        return bucket;
+    }
+    if (burst == 0) {
+        burst = rate;
+    }
+    bucket.interval = 1000000000ULL / rate;
+    bucket.tolerance = bucket.interval * (burst - 1);
+    return bucket;
+}
+
+bool RateLimiter::Conform(uint64_t& tat, const Bucket& bucket, uint64_t now) {
+    if (bucket.interval == 0) {
+        return true;
+    }
+    if (tat < now) {
+        tat = now;
+    }
+    if (tat - now > bucket.tolerance) {
+        return false;
+    }
+    tat += bucket.interval;
+    return true;
+}
+
+// 淘汰顺序：空闲表项 > 没有活跃连接的表项 > 最久未访问的表项
+bool RateLimiter::MoreEvictable(const Entry& a, const Entry& b) {
+    if ((a.lastSeen == 0) != (b.lastSeen == 0)) {
+        return a.lastSeen == 0;
+    }
+    if ((a.conns == 0) != (b.conns == 0)) {
+        return a.conns == 0;
+    }
+    return a.lastSeen < b.lastSeen;
+}
+
+RateLimiter::Shard& RateLimiter::ShardOf(uint64_t key, std::size_t& set) {
+    const uint64_t h = (key ^ (key >> 32)) * 0x9E3779B97F4A7C15ULL;
+    set = static_cast<std::size_t>(h >> 6) & m_setMask;
+    return m_shards[h >> 58];
+}
+
+RateLimiter::Entry* RateLimiter::Lookup(Shard& shard, std::size_t set, uint64_t key,
+                                        uint64_t now, bool create) {
+    Entry* ways = &shard.entries[set * WAYS];
+    Entry* victim = nullptr;
+    for (int i = 0; i < WAYS; ++i) {
+        Entry& entry = ways[i];
+        if (entry.lastSeen != 0 && entry.key == key) {
+            return &entry;
+        }
+        if (!create) {
+            continue;
+        }
+        if (victim == nullptr || MoreEvictable(entry, *victim)) {
+            victim = &entry;
+        }
+    }
+    // 淘汰顺序最靠前的表项仍有活跃连接时，说明整组都有连接，淘汰会丢失其并发计数
+    if (victim != nullptr && victim->lastSeen != 0 && victim->conns > 0) {
+        return nullptr;
+    }
+    if (victim != nullptr) {
+        *victim = Entry();
+        victim->key = key;
+        victim->lastSeen = now;
+    }
+    return victim;
+}
+
+RateLimiter::Verdict RateLimiter::AdmitConnection(const SocketAddress& addr, uint64_t now) {
+    const uint64_t key = addr.Key();
+    std::size_t set = 0;
+    Shard& shard = ShardOf(key, set);
+    std::lock_guard<std::mutex> locker(shard.mtx);
+    Entry* entry = Lookup(shard, set, key, now, true);
+    if (entry == nullptr) {
+        return Verdict::UNTRACKED;
+    }
+    entry->lastSeen = now;
+    if (m_maxConns != 0 && entry->conns >= m_maxConns) {
+        return Verdict::CONN_LIMIT;
+    }
+    if (!Conform(entry->connTat, m_connBucket, now)) {
+        return Verdict::CONN_RATE;
+    }
+    entry->conns += 1;
+    return Verdict::ALLOW;
+}
+
+void RateLimiter::ReleaseConnection(const SocketAddress& addr) {
+    const uint64_t key = addr.Key();
+    std::size_t set = 0;
+    Shard& shard = ShardOf(key, set);
+    std::lock_guard<std::mutex> locker(shard.mtx);
+    Entry* entry = Lookup(shard, set, key, 0, false);
+    if (entry != nullptr && entry->conns > 0) {
+        entry->conns -= 1;
+    }
+}
+
+RateLimiter::Verdict RateLimiter::AdmitRequest(const SocketAddress& addr, uint64_t now) {
+    if (m_requestBucket.interval == 0) {
+        return Verdict::ALLOW;
+    }
+    const uint64_t key = addr.Key();
+    std::size_t set = 0;
+    Shard& shard = ShardOf(key, set);
+    std::lock_guard<std::mutex> locker(shard.mtx);
+    Entry* entry = Lookup(shard, set, key, now, true);
+    if (entry == nullptr) {
+        return Verdict::UNTRACKED;
+    }
+    entry->lastSeen = now;
+    return Conform(entry->requestTat, m_requestBucket, now) ? Verdict::ALLOW : Verdict::REQUEST_RATE;
+}
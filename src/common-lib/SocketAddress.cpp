@@ -0,0 +1,160 @@
+//
+// Created by asujy on 2026/10/19.
+//
+
+#include "common-lib/SocketAddress.h"
+
+#include <arpa/inet.h>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/in.h>
+#include <sys/un.h>
+
+namespace {
+    constexpr uint64_t IPV4_KEY_PREFIX = 0x04ULL << 56;
+    constexpr uint64_t UNIX_KEY = 0x01ULL << 56;
+
+    bool ParsePort(const std::string& text, uint16_t& port) {
+        if (text.empty() || text.size() > 5 || text.find_first_not_of("0123456789") != std::string::npos) {
+            return false;
+        }
+        const long value = std::strtol(text.c_str(), nullptr, 10);
+        if (value < 1 || value > 65535) {
+            return false;
+        }
+        port = static_cast<uint16_t>(value);
+        return true;
+    }
+
+    const sockaddr_un* AsUnix(const sockaddr* addr) {
+        return reinterpret_cast<const sockaddr_un*>(addr);
+    }
+}
+
+bool SocketAddress::Parse(const std::string& text, SocketAddress& addr) {
+    addr = SocketAddress();
+    if (text.compare(0, 5, "unix:") == 0) {
+        const std::string path = text.substr(5);
+        sockaddr_un* un = reinterpret_cast<sockaddr_un*>(&addr.m_storage);
+        if (path.empty() || path.size() >= sizeof(un->sun_path) || (path[0] != '/' && path[0] != '@')) {
+            return false;
+        }
+        un->sun_family = AF_UNIX;
+        if (path[0] == '@') {
+            // 抽象命名空间：sun_path以'\0'开头，长度不含结尾的'\0'
+            std::memcpy(un->sun_path + 1, path.data() + 1, path.size() - 1);
+            addr.m_length = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + path.size());
+        } else {
+            std::memcpy(un->sun_path, path.c_str(), path.size() + 1);
+            addr.m_length = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + path.size() + 1);
+        }
+        return true;
+    }
+
+    const auto colon = text.rfind(':');
+    uint16_t port = 0;
+    if (colon == std::string::npos || !ParsePort(text.substr(colon + 1), port)) {
+        return false;
+    }
+    std::string host = text.substr(0, colon);
+    if (host.size() >= 2 && host.front() == '[' && host.back() == ']') {
+        host = host.substr(1, host.size() - 2);
+        sockaddr_in6* in6 = reinterpret_cast<sockaddr_in6*>(&addr.m_storage);
+        if (inet_pton(AF_INET6, host.c_str(), &in6->sin6_addr) != 1) {
+            return false;
+        }
+        in6->sin6_family = AF_INET6;
+        in6->sin6_port = htons(port);
+        addr.m_length = sizeof(sockaddr_in6);
+        return true;
+    }
+    sockaddr_in* in = reinterpret_cast<sockaddr_in*>(&addr.m_storage);
+    if (inet_pton(AF_INET, host.c_str(), &in->sin_addr) != 1) {
+        return false;
+    }
+    in->sin_family = AF_INET;
+    in->sin_port = htons(port);
+    addr.m_length = sizeof(sockaddr_in);
+    return true;
+}
+
+bool SocketAddress::IsUnixPath() const {
+    return Family() == AF_UNIX && m_length > offsetof(sockaddr_un, sun_path) &&
+        AsUnix(Data())->sun_path[0] != '\0';
+}
+
+const char* SocketAddress::UnixPath() const {
+    return AsUnix(Data())->sun_path;
+}
+
+std::string SocketAddress::Host() const {
+    char text[INET6_ADDRSTRLEN] = {0};
+    switch (Family()) {
+        case AF_INET:
+            inet_ntop(AF_INET, &reinterpret_cast<const sockaddr_in*>(Data())->sin_addr, text, sizeof(text));
+            return text;
+        case AF_INET6: {
+            const in6_addr& addr = reinterpret_cast<const sockaddr_in6*>(Data())->sin6_addr;
+            if (IN6_IS_ADDR_V4MAPPED(&addr)) {
+                inet_ntop(AF_INET, addr.s6_addr + 12, text, sizeof(text));
+            } else {
+                inet_ntop(AF_INET6, &addr, text, sizeof(text));
+            }
+            return text;
+        }
+        case AF_UNIX:
+            return "unix:";
+        default:
+            return "-";
+    }
+}
+
+std::string SocketAddress::ToString() const {
+    switch (Family()) {
+        case AF_INET:
+            return Host() + ":" + std::to_string(ntohs(reinterpret_cast<const sockaddr_in*>(Data())->sin_port));
+        case AF_INET6: {
+            char text[INET6_ADDRSTRLEN] = {0};
+            const sockaddr_in6* in6 = reinterpret_cast<const sockaddr_in6*>(Data());
+            inet_ntop(AF_INET6, &in6->sin6_addr, text, sizeof(text));
+            return std::string("[") + text + "]:" + std::to_string(ntohs(in6->sin6_port));
+        }
+        case AF_UNIX: {
+            const std::size_t pathLen = m_length > offsetof(sockaddr_un, sun_path) ?
+                m_length - offsetof(sockaddr_un, sun_path) : 0;
+            if (pathLen == 0) {
+                return "unix:";
+            }
+            const char* path = UnixPath();
+            if (path[0] == '\0') {
+                return "unix:@" + std::string(path + 1, pathLen - 1);
+            }
+            return std::string("unix:") + path;
+        }
+        default:
+            return "-";
+    }
+}
+
+uint64_t SocketAddress::Key() const {
+    switch (Family()) {
+        case AF_INET:
+            return IPV4_KEY_PREFIX | ntohl(reinterpret_cast<const sockaddr_in*>(Data())->sin_addr.s_addr);
+        case AF_INET6: {
+            const in6_addr& addr = reinterpret_cast<const sockaddr_in6*>(Data())->sin6_addr;
+            if (IN6_IS_ADDR_V4MAPPED(&addr)) {
+                uint32_t v4 = 0;
+                std::memcpy(&v4, addr.s6_addr + 12, sizeof(v4));
+                return IPV4_KEY_PREFIX | ntohl(v4);
+            }
+            uint64_t prefix = 0;
+            for (int i = 0; i < 8; ++i) {
+                prefix = (prefix << 8) | addr.s6_addr[i];
+            }
+            return prefix;
+        }
+        default:
+            return UNIX_KEY;
+    }
+}
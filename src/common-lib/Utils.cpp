@@ -6,6 +6,7 @@
 #include <sys/epoll.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <time.h>
 
 #include "common-lib/Utils.h"
 #include "log/Logger.h"
@@ -86,16 +87,45 @@ void ModFD(int epollfd, int fd, int ev) {
 }
 
 std::string GetExecutableDir() {
+    std::string dirPath = GetExecutablePath();
+    auto lastSlashPos = dirPath.find_last_of('/');
+    if (lastSlashPos == std::string::npos) {
+        return {};
+    }
+    return dirPath.substr(0, lastSlashPos);
+}
+
+std::string GetExecutablePath() {
     char path[PATH_MAX] = {0};
-    ssize_t count = readlink("/proc/self/exe", path, PATH_MAX);
-    if (count != -1) {
-        path[count] = '\0';
-        std::string dirPath(path);
-        auto lastSlashPos = dirPath.find_last_of('/');
-        if (lastSlashPos == std::string::npos) {
-            return {};
-        }
-        return dirPath.substr(0, lastSlashPos);
+    ssize_t count = readlink("/proc/self/exe", path, PATH_MAX - 1);
+    if (count == -1) {
+        return {};
+    }
+    path[count] = '\0';
+    return path;
+}
+
+uint64_t GetMonotonicNanos() {
+    struct timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL +
+        static_cast<uint64_t>(ts.tv_nsec);
+}
+
+std::string FormatHttpDate(std::time_t t) {
+    struct tm tm{};
+    gmtime_r(&t, &tm);
+    char buf[32];
+    const std::size_t len = std::strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return std::string(buf, len);
+}
+
+bool ParseHttpDate(const char* text, std::time_t& t) {
+    struct tm tm{};
+    const char* end = strptime(text, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if (end == nullptr || *end != '\0') {
+        return false;
     }
-    return {};
+    t = timegm(&tm);
+    return true;
 }
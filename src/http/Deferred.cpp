@@ -0,0 +1,167 @@
+//
+// Created by asujy on 2026/10/19.
+//
+
+#include "http/Deferred.h"
+#include "log/Logger.h"
+
+#include <cerrno>
+#include <cstring>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace http {
+    bool Deferred::Complete(HTTP_CODE code, std::string content, const char* contentType,
+                            Producer producer) {
+        if (m_completed.exchange(true, std::memory_order_acq_rel)) {
+            return false;
+        }
+        m_code = code;
+        m_content = std::move(content);
+        m_contentType = contentType;
+        m_producer = std::move(producer);
+        // 已取消的句柄仍交给reactor，由它丢弃，保证Release的计数对齐
+        Release();
+        return !Cancelled();
+    }
+
+    bool Deferred::Reply(std::string content, const char* contentType) {
+        return Complete(HTTP_CODE::DYNAMIC_REQUEST, std::move(content), contentType);
+    }
+
+    bool Deferred::Stream(Producer producer, const char* contentType) {
+        return Complete(HTTP_CODE::STREAM_REQUEST, std::string(), contentType, std::move(producer));
+    }
+
+    bool Deferred::Fail(HTTP_CODE code) {
+        return Complete(code, std::string(), "text/plain");
+    }
+
+    void Deferred::Release() {
+        if (m_holds.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            CompletionQueue::Instance().Push(shared_from_this());
+        }
+    }
+
+    void Deferred::OnCancel(std::function<void()> callback) {
+        {
+            std::lock_guard<std::mutex> locker(m_mtx);
+            if (!Cancelled()) {
+                m_onCancel = std::move(callback);
+                return;
+            }
+        }
+        callback();
+    }
+
+    void Deferred::Cancel() {
+        std::function<void()> callback;
+        {
+            std::lock_guard<std::mutex> locker(m_mtx);
+            m_cancelled.store(true, std::memory_order_release);
+            callback.swap(m_onCancel);
+        }
+        if (callback) {
+            callback();
+        }
+    }
+
+    CompletionQueue::CompletionQueue() {
+        m_eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (m_eventFd < 0) {
+            LOG_ERROR << "eventfd failed: " << std::strerror(errno);
+        }
+    }
+
+    CompletionQueue::~CompletionQueue() {
+        if (m_eventFd >= 0) {
+            close(m_eventFd);
+        }
+    }
+
+    void CompletionQueue::Push(std::shared_ptr<Deferred> deferred) {
+        bool wasEmpty = false;
+        {
+            std::lock_guard<std::mutex> locker(m_mtx);
+            wasEmpty = m_queue.empty();
+            m_queue.push_back(std::move(deferred));
+        }
+        // 队列非空时reactor必然还会再Drain一次，不用重复唤醒
+        if (wasEmpty) {
+            const uint64_t one = 1;
+            ssize_t ret = write(m_eventFd, &one, sizeof(one));
+            (void)ret;
+        }
+    }
+
+    void CompletionQueue::Drain() {
+        uint64_t count = 0;
+        ssize_t ret = read(m_eventFd, &count, sizeof(count));
+        (void)ret;
+        std::vector<std::shared_ptr<Deferred>> ready;
+        {
+            std::lock_guard<std::mutex> locker(m_mtx);
+            ready.swap(m_queue);
+        }
+        for (const auto& deferred : ready) {
+            deferred->m_conn->FinishDeferred(deferred);
+        }
+    }
+
+    DeferredTimer::DeferredTimer() : m_thread(&DeferredTimer::Run, this) {}
+
+    DeferredTimer::~DeferredTimer() {
+        {
+            std::lock_guard<std::mutex> locker(m_mtx);
+            m_stop = true;
+        }
+        m_cond.notify_one();
+        m_thread.join();
+    }
+
+    void DeferredTimer::After(uint64_t ms, const std::shared_ptr<Deferred>& deferred, Callback callback) {
+        {
+            std::lock_guard<std::mutex> locker(m_mtx);
+            const Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(ms);
+            m_timers.emplace(deadline, std::make_pair(deferred, std::move(callback)));
+        }
+        m_cond.notify_one();
+        // 在reactor线程中调用，已经取消时立即调用；不能持有m_mtx
+        const Deferred* key = deferred.get();
+        deferred->OnCancel([this, key]() {
+            Remove(key);
+        });
+    }
+
+    void DeferredTimer::Remove(const Deferred* deferred) {
+        std::lock_guard<std::mutex> locker(m_mtx);
+        for (auto it = m_timers.begin(); it != m_timers.end(); ++it) {
+            if (it->second.first.get() == deferred) {
+                m_timers.erase(it);
+                LOG_DEBUG << "deferred timer cancelled";
+                return;
+            }
+        }
+    }
+
+    void DeferredTimer::Run() {
+        std::unique_lock<std::mutex> locker(m_mtx);
+        while (!m_stop) {
+            if (m_timers.empty()) {
+                m_cond.wait(locker);
+                continue;
+            }
+            const Clock::time_point deadline = m_timers.begin()->first;
+            if (Clock::now() < deadline) {
+                m_cond.wait_until(locker, deadline);
+                continue;
+            }
+            std::pair<std::shared_ptr<Deferred>, Callback> timer = std::move(m_timers.begin()->second);
+            m_timers.erase(m_timers.begin());
+            // 回调中完成句柄，放开锁以免与OnCancel的回调互相等待
+            locker.unlock();
+            timer.second(*timer.first);
+            locker.lock();
+        }
+    }
+}
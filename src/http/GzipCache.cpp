@@ -0,0 +1,176 @@
+//
+// Created by asujy on 2026/10/19.
+//
+
+#include "http/GzipCache.h"
+#include "log/Logger.h"
+#include "metrics/Metrics.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace http {
+    namespace {
+        bool ReadFile(const std::string& path, std::string& data) {
+            const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                return false;
+            }
+            char buf[64 * 1024];
+            ssize_t n = 0;
+            data.clear();
+            while ((n = read(fd, buf, sizeof(buf))) > 0) {
+                data.append(buf, static_cast<std::size_t>(n));
+            }
+            close(fd);
+            return n == 0;
+        }
+
+        bool Compress(const char* data, std::size_t len, int level, std::string& out) {
+            z_stream zs{};
+            // windowBits加16输出gzip格式
+            if (deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+                return false;
+            }
+            out.resize(deflateBound(&zs, len));
+            zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+            zs.avail_in = static_cast<uInt>(len);
+            zs.next_out = reinterpret_cast<Bytef*>(&out[0]);
+            zs.avail_out = static_cast<uInt>(out.size());
+            const int ret = deflate(&zs, Z_FINISH);
+            out.resize(zs.total_out);
+            deflateEnd(&zs);
+            return ret == Z_STREAM_END;
+        }
+    }
+
+    GzipCache::~GzipCache() {
+        {
+            std::lock_guard<std::mutex> locker(m_mtx);
+            m_stop = true;
+        }
+        m_cond.notify_all();
+        if (m_worker.joinable()) {
+            m_worker.join();
+        }
+    }
+
+    void GzipCache::Configure(const Options& options) {
+        std::lock_guard<std::mutex> locker(m_mtx);
+        m_options = options;
+    }
+
+    GzipCache::Key GzipCache::KeyOf(const struct stat& st) {
+        Key key;
+        key.dev = static_cast<uint64_t>(st.st_dev);
+        key.ino = static_cast<uint64_t>(st.st_ino);
+        key.size = static_cast<uint64_t>(st.st_size);
+        key.mtimeNs = static_cast<uint64_t>(st.st_mtim.tv_sec) * 1000000000ULL +
+            static_cast<uint64_t>(st.st_mtim.tv_nsec);
+        return key;
+    }
+
+    bool GzipCache::Compressible(const std::string& path, const struct stat& st) const {
+        if (!m_options.enabled || static_cast<std::size_t>(st.st_size) < m_options.minSize ||
+            static_cast<std::size_t>(st.st_size) > m_options.maxBytes) {
+            return false;
+        }
+        for (const auto& ext : m_options.extensions) {
+            if (path.size() >= ext.size() &&
+                strcasecmp(path.c_str() + path.size() - ext.size(), ext.c_str()) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    GzipCache::Body GzipCache::Lookup(const std::string& path, const struct stat& st) {
+        const Key key = KeyOf(st);
+        std::lock_guard<std::mutex> locker(m_mtx);
+        auto it = m_index.find(key);
+        if (it != m_index.end()) {
+            m_lru.splice(m_lru.begin(), m_lru, it->second);
+            metrics::Inc(metrics::Counter::CACHE_HITS);
+            metrics::Add(m_options.site, metrics::SiteStat::CACHE_HITS);
+            return it->second->body;
+        }
+        metrics::Inc(metrics::Counter::CACHE_MISSES);
+        metrics::Add(m_options.site, metrics::SiteStat::CACHE_MISSES);
+        if (m_pending.insert(key).second) {
+            m_jobs.push_back(Job{key, path});
+            if (!m_worker.joinable()) {
+                m_worker = std::thread(&GzipCache::WorkerLoop, this);
+            }
+            m_cond.notify_one();
+        }
+        return nullptr;
+    }
+
+    void GzipCache::WorkerLoop() {
+        std::unique_lock<std::mutex> locker(m_mtx);
+        while (true) {
+            m_cond.wait(locker, [this]() { return m_stop || !m_jobs.empty(); });
+            if (m_stop) {
+                return;
+            }
+            Job job = m_jobs.front();
+            m_jobs.pop_front();
+            locker.unlock();
+            Body body = Produce(job);
+            locker.lock();
+            Insert(job.key, body);
+            m_pending.erase(job.key);
+        }
+    }
+
+    GzipCache::Body GzipCache::Produce(const Job& job) {
+        // 文件在排队期间被修改过就放弃，下次请求会以新的标识重新提交
+        struct stat st{};
+        if (stat(job.path.c_str(), &st) < 0 || !(KeyOf(st) == job.key)) {
+            return nullptr;
+        }
+        std::shared_ptr<std::string> out(new std::string);
+        struct stat gzSt{};
+        const std::string gzPath = job.path + ".gz";
+        if (stat(gzPath.c_str(), &gzSt) == 0 && S_ISREG(gzSt.st_mode) &&
+            gzSt.st_mtime >= st.st_mtime && ReadFile(gzPath, *out)) {
+            LOG_INFO << "gzip variant of " << job.path << " loaded from " << gzPath;
+        } else {
+            std::string data;
+            if (!ReadFile(job.path, data) ||
+                !Compress(data.data(), data.size(), m_options.level, *out)) {
+                LOG_WARN << "gzip " << job.path << " failed";
+                return nullptr;
+            }
+        }
+        if (out->size() >= static_cast<std::size_t>(st.st_size)) {
+            return nullptr;
+        }
+        out->shrink_to_fit();
+        return out;
+    }
+
+    void GzipCache::Insert(const Key& key, const Body& body) {
+        if (m_index.find(key) != m_index.end()) {
+            return;
+        }
+        const std::size_t size = body ? body->size() : 0;
+        m_lru.push_front(Entry{key, body});
+        m_index[key] = m_lru.begin();
+        m_bytes += size;
+        metrics::Add(metrics::Gauge::GZIP_CACHE_BYTES, static_cast<int64_t>(size));
+        metrics::Add(m_options.site, metrics::SiteStat::CACHE_BYTES, static_cast<int64_t>(size));
+        // 空表项也占一个槽位，按每项至少64字节计，防止表无限增长
+        while (m_bytes > m_options.maxBytes || m_lru.size() * 64 > m_options.maxBytes) {
+            const Entry& victim = m_lru.back();
+            const std::size_t victimSize = victim.body ? victim.body->size() : 0;
+            m_bytes -= victimSize;
+            metrics::Add(metrics::Gauge::GZIP_CACHE_BYTES, -static_cast<int64_t>(victimSize));
+            metrics::Add(m_options.site, metrics::SiteStat::CACHE_BYTES, -static_cast<int64_t>(victimSize));
+            m_index.erase(victim.key);
+            m_lru.pop_back();
+        }
+    }
+}
@@ -0,0 +1,440 @@
+//
+// Created by asujy on 2026/10/19.
+//
+
+#include "http/Hpack.h"
+
+#include <algorithm>
+
+namespace http {
+    namespace hpack {
+        namespace {
+            struct StaticEntry {
+                const char* name;
+                const char* value;
+            };
+
+            // RFC 7541 附录A，下标加1为HPACK索引
+            const StaticEntry STATIC_TABLE[] = {
+        {":authority", ""},
+        {":method", "GET"},
+        {":method", "POST"},
+        {":path", "/"},
+        {":path", "/index.html"},
+        {":scheme", "http"},
+        {":scheme", "https"},
+        {":status", "200"},
+        {":status", "204"},
+        {":status", "206"},
+        {":status", "304"},
+        {":status", "400"},
+        {":status", "404"},
+        {":status", "500"},
+        {"accept-charset", ""},
+        {"accept-encoding", "gzip, deflate"},
+        {"accept-language", ""},
+        {"accept-ranges", ""},
+        {"accept", ""},
+        {"access-control-allow-origin", ""},
+        {"age", ""},
+        {"allow", ""},
+        {"authorization", ""},
+        {"cache-control", ""},
+        {"content-disposition", ""},
+        {"content-encoding", ""},
+        {"content-language", ""},
+        {"content-length", ""},
+        {"content-location", ""},
+        {"content-range", ""},
+        {"content-type", ""},
+        {"cookie", ""},
+        {"date", ""},
+        {"etag", ""},
+        {"expect", ""},
+        {"expires", ""},
+        {"from", ""},
+        {"host", ""},
+        {"if-match", ""},
+        {"if-modified-since", ""},
+        {"if-none-match", ""},
+        {"if-range", ""},
+        {"if-unmodified-since", ""},
+        {"last-modified", ""},
+        {"link", ""},
+        {"location", ""},
+        {"max-forwards", ""},
+        {"proxy-authenticate", ""},
+        {"proxy-authorization", ""},
+        {"range", ""},
+        {"referer", ""},
+        {"refresh", ""},
+        {"retry-after", ""},
+        {"server", ""},
+        {"set-cookie", ""},
+        {"strict-transport-security", ""},
+        {"transfer-encoding", ""},
+        {"user-agent", ""},
+        {"vary", ""},
+        {"via", ""},
+        {"www-authenticate", ""},
+            };
+            constexpr std::size_t STATIC_NUM = sizeof(STATIC_TABLE) / sizeof(STATIC_TABLE[0]);
+
+            struct HuffmanCode {
+                uint32_t code;
+                uint8_t bits;
+            };
+
+            // RFC 7541 附录B，下标为符号，256为EOS
+            const HuffmanCode HUFFMAN_CODES[] = {
+        {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28},
+        {0xfffffe4, 28}, {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28},
+        {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+        {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28},
+        {0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28},
+        {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+        {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28},
+        {0xffffff8, 28}, {0xffffff9, 28}, {0xffffffa, 28}, {0xffffffb, 28},
+        {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+        {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11},
+        {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11},
+        {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+        {0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6},
+        {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6},
+        {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+        {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10},
+        {0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7},
+        {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+        {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7},
+        {0x67, 7}, {0x68, 7}, {0x69, 7}, {0x6a, 7},
+        {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+        {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7},
+        {0xfc, 8}, {0x73, 7}, {0xfd, 8}, {0x1ffb, 13},
+        {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+        {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5},
+        {0x24, 6}, {0x5, 5}, {0x25, 6}, {0x26, 6},
+        {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+        {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5},
+        {0x2b, 6}, {0x76, 7}, {0x2c, 6}, {0x8, 5},
+        {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+        {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15},
+        {0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28},
+        {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+        {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23},
+        {0x3fffd6, 22}, {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23},
+        {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+        {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23},
+        {0xffffee, 24}, {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23},
+        {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+        {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24},
+        {0x3fffda, 22}, {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22},
+        {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+        {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24},
+        {0x1fffdf, 21}, {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23},
+        {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+        {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23},
+        {0xfffea, 20}, {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22},
+        {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+        {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19},
+        {0x3fffe7, 22}, {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25},
+        {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+        {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25},
+        {0x7fff2, 19}, {0x1fffe3, 21}, {0x3ffffe6, 26}, {0x7ffffe0, 27},
+        {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+        {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26},
+        {0xffffffd, 28}, {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27},
+        {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+        {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23},
+        {0x3fffea, 22}, {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25},
+        {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+        {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26},
+        {0x7ffffe7, 27}, {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27},
+        {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+        {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26},
+        {0x3fffffff, 30},
+            };
+
+            // 由码表生成的二叉解码树，叶子节点的sym为符号
+            struct HuffmanTree {
+                struct Node {
+                    int16_t child[2]{-1, -1};
+                    int16_t sym{-1};
+                };
+                std::vector<Node> nodes;
+
+                HuffmanTree() {
+                    nodes.reserve(512);
+                    nodes.emplace_back();
+                    for (int sym = 0; sym <= 256; ++sym) {
+                        std::size_t node = 0;
+                        for (int bit = HUFFMAN_CODES[sym].bits - 1; bit >= 0; --bit) {
+                            const int b = (HUFFMAN_CODES[sym].code >> bit) & 1;
+                            if (nodes[node].child[b] < 0) {
+                                nodes[node].child[b] = static_cast<int16_t>(nodes.size());
+                                nodes.emplace_back();
+                            }
+                            node = static_cast<std::size_t>(nodes[node].child[b]);
+                        }
+                        nodes[node].sym = static_cast<int16_t>(sym);
+                    }
+                }
+            };
+
+            constexpr std::size_t ENTRY_OVERHEAD = 32;
+
+            bool DecodeInt(const uint8_t*& p, const uint8_t* end, int prefix, uint64_t& value) {
+                if (p >= end) {
+                    return false;
+                }
+                const uint8_t mask = static_cast<uint8_t>((1U << prefix) - 1);
+                value = *p++ & mask;
+                if (value < mask) {
+                    return true;
+                }
+                for (int shift = 0; p < end && shift <= 28; shift += 7) {
+                    const uint8_t b = *p++;
+                    value += static_cast<uint64_t>(b & 0x7F) << shift;
+                    if ((b & 0x80) == 0) {
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            bool DecodeString(const uint8_t*& p, const uint8_t* end, std::string& out) {
+                if (p >= end) {
+                    return false;
+                }
+                const bool huffman = (*p & 0x80) != 0;
+                uint64_t len = 0;
+                if (!DecodeInt(p, end, 7, len) || len > static_cast<uint64_t>(end - p)) {
+                    return false;
+                }
+                const std::size_t n = static_cast<std::size_t>(len);
+                bool ok = true;
+                if (huffman) {
+                    out.clear();
+                    ok = HuffmanDecode(p, n, out);
+                } else {
+                    out.assign(reinterpret_cast<const char*>(p), n);
+                }
+                p += n;
+                return ok;
+            }
+
+            void EncodeInt(uint8_t flags, int prefix, uint64_t value, std::string& out) {
+                const uint64_t mask = (1U << prefix) - 1;
+                if (value < mask) {
+                    out.push_back(static_cast<char>(flags | value));
+                    return;
+                }
+                out.push_back(static_cast<char>(flags | mask));
+                value -= mask;
+                while (value >= 0x80) {
+                    out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+                    value >>= 7;
+                }
+                out.push_back(static_cast<char>(value));
+            }
+
+            void EncodeString(const std::string& value, std::string& out) {
+                EncodeInt(0x00, 7, value.size(), out);
+                out += value;
+            }
+        }
+
+        bool HuffmanDecode(const uint8_t* data, std::size_t len, std::string& out) {
+            static const HuffmanTree tree;
+            std::size_t node = 0;
+            int pending = 0;        // 上一个符号之后的比特数
+            bool allOnes = true;
+            for (std::size_t i = 0; i < len; ++i) {
+                for (int bit = 7; bit >= 0; --bit) {
+                    const int b = (data[i] >> bit) & 1;
+                    const int16_t next = tree.nodes[node].child[b];
+                    if (next < 0) {
+                        return false;
+                    }
+                    node = static_cast<std::size_t>(next);
+                    ++pending;
+                    allOnes = allOnes && b == 1;
+                    const int16_t sym = tree.nodes[node].sym;
+                    if (sym >= 0) {
+                        if (sym == 256) {
+                            return false;
+                        }
+                        out.push_back(static_cast<char>(sym));
+                        node = 0;
+                        pending = 0;
+                        allOnes = true;
+                    }
+                }
+            }
+            // 结尾只能是不超过7位的EOS前缀(全1)
+            return pending <= 7 && allOnes;
+        }
+
+        void DynamicTable::Add(std::string name, std::string value) {
+            const std::size_t size = name.size() + value.size() + ENTRY_OVERHEAD;
+            if (size > m_maxSize) {
+                // 比整个表还大的条目使表清空，本身也不加入
+                Evict(0);
+                return;
+            }
+            Evict(m_maxSize - size);
+            m_size += size;
+            m_entries.emplace_front(std::move(name), std::move(value));
+        }
+
+        void DynamicTable::SetMaxSize(std::size_t maxSize) {
+            m_maxSize = maxSize;
+            Evict(maxSize);
+        }
+
+        void DynamicTable::Evict(std::size_t limit) {
+            while (m_size > limit && !m_entries.empty()) {
+                const Header& last = m_entries.back();
+                m_size -= last.first.size() + last.second.size() + ENTRY_OVERHEAD;
+                m_entries.pop_back();
+            }
+        }
+
+        bool Decoder::Lookup(uint64_t index, const Header*& header) const {
+            static const std::vector<Header> staticHeaders = [] {
+                std::vector<Header> headers;
+                for (const auto& entry : STATIC_TABLE) {
+                    headers.emplace_back(entry.name, entry.value);
+                }
+                return headers;
+            }();
+            if (index == 0) {
+                return false;
+            }
+            if (index <= STATIC_NUM) {
+                header = &staticHeaders[static_cast<std::size_t>(index - 1)];
+                return true;
+            }
+            index -= STATIC_NUM + 1;
+            if (index >= m_table.Count()) {
+                return false;
+            }
+            header = &m_table.At(static_cast<std::size_t>(index));
+            return true;
+        }
+
+        bool Decoder::Decode(const uint8_t* data, std::size_t len, std::vector<Header>& headers) {
+            const uint8_t* p = data;
+            const uint8_t* end = data + len;
+            while (p < end) {
+                const uint8_t b = *p;
+                uint64_t index = 0;
+                const Header* entry = nullptr;
+                if (b & 0x80) {
+                    // 索引
+                    if (!DecodeInt(p, end, 7, index) || !Lookup(index, entry)) {
+                        return false;
+                    }
+                    headers.push_back(*entry);
+                    continue;
+                }
+                if ((b & 0xE0) == 0x20) {
+                    // 动态表大小更新
+                    if (!DecodeInt(p, end, 5, index) || index > m_limit) {
+                        return false;
+                    }
+                    m_table.SetMaxSize(static_cast<std::size_t>(index));
+                    continue;
+                }
+                // 字面值：01为加入动态表，0000为不加入，0001为永不加入
+                const bool indexing = (b & 0x40) != 0;
+                if (!DecodeInt(p, end, indexing ? 6 : 4, index)) {
+                    return false;
+                }
+                Header header;
+                if (index != 0) {
+                    if (!Lookup(index, entry)) {
+                        return false;
+                    }
+                    header.first = entry->first;
+                } else if (!DecodeString(p, end, header.first)) {
+                    return false;
+                }
+                if (!DecodeString(p, end, header.second)) {
+                    return false;
+                }
+                if (indexing) {
+                    m_table.Add(header.first, header.second);
+                }
+                headers.push_back(std::move(header));
+            }
+            return true;
+        }
+
+        void Encoder::SetMaxSize(std::size_t maxSize) {
+            // 本端只用到4096字节，对端允许更大时也不扩大
+            maxSize = std::min<std::size_t>(maxSize, 4096);
+            if (maxSize != m_table.MaxSize()) {
+                m_table.SetMaxSize(maxSize);
+                m_sizeUpdate = true;
+            }
+        }
+
+        void Encoder::Begin(std::string& out) {
+            if (m_sizeUpdate) {
+                EncodeInt(0x20, 5, m_table.MaxSize(), out);
+                m_sizeUpdate = false;
+            }
+        }
+
+        void Encoder::EncodeStatus(int status, std::string& out) {
+            // 静态表中的:status
+            static const int STATUS_INDEX[][2] = {
+                {200, 8}, {204, 9}, {206, 10}, {304, 11}, {400, 12}, {404, 13}, {500, 14}
+            };
+            for (const auto& item : STATUS_INDEX) {
+                if (item[0] == status) {
+                    EncodeInt(0x80, 7, static_cast<uint64_t>(item[1]), out);
+                    return;
+                }
+            }
+            Encode(":status", std::to_string(status), true, out);
+        }
+
+        void Encoder::Encode(const std::string& name, const std::string& value, bool indexable,
+                             std::string& out) {
+            std::size_t nameIndex = 0;
+            for (std::size_t i = 0; i < m_table.Count(); ++i) {
+                const Header& entry = m_table.At(i);
+                if (entry.first == name) {
+                    if (entry.second == value) {
+                        EncodeInt(0x80, 7, STATIC_NUM + 1 + i, out);
+                        return;
+                    }
+                    if (nameIndex == 0) {
+                        nameIndex = STATIC_NUM + 1 + i;
+                    }
+                }
+            }
+            for (std::size_t i = 0; i < STATIC_NUM; ++i) {
+                if (name == STATIC_TABLE[i].name) {
+                    if (value == STATIC_TABLE[i].value) {
+                        EncodeInt(0x80, 7, i + 1, out);
+                        return;
+                    }
+                    nameIndex = i + 1;
+                    break;
+                }
+            }
+            const bool indexing = indexable &&
+                name.size() + value.size() + ENTRY_OVERHEAD <= m_table.MaxSize();
+            EncodeInt(indexing ? 0x40 : 0x00, indexing ? 6 : 4, nameIndex, out);
+            if (nameIndex == 0) {
+                EncodeString(name, out);
+            }
+            EncodeString(value, out);
+            if (indexing) {
+                m_table.Add(name, value);
+            }
+        }
+    }
+}
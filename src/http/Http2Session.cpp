@@ -0,0 +1,924 @@
+//
+// Created by asujy on 2026/10/19.
+//
+
+#include "http/Http2Session.h"
+#include "log/Logger.h"
+#include "common-lib/Utils.h"
+#include "common-lib/RateLimiter.h"
+#include "metrics/Metrics.h"
+#include "trace/Tracer.h"
+#include "capture/Capture.h"
+
+#include <sys/epoll.h>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+
+namespace http {
+    namespace {
+        const char PREFACE[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+        constexpr uint8_t FRAME_DATA = 0x0;
+        constexpr uint8_t FRAME_HEADERS = 0x1;
+        constexpr uint8_t FRAME_PRIORITY = 0x2;
+        constexpr uint8_t FRAME_RST_STREAM = 0x3;
+        constexpr uint8_t FRAME_SETTINGS = 0x4;
+        constexpr uint8_t FRAME_PUSH_PROMISE = 0x5;
+        constexpr uint8_t FRAME_PING = 0x6;
+        constexpr uint8_t FRAME_GOAWAY = 0x7;
+        constexpr uint8_t FRAME_WINDOW_UPDATE = 0x8;
+        constexpr uint8_t FRAME_CONTINUATION = 0x9;
+
+        constexpr uint8_t FLAG_END_STREAM = 0x1;
+        constexpr uint8_t FLAG_ACK = 0x1;
+        constexpr uint8_t FLAG_END_HEADERS = 0x4;
+        constexpr uint8_t FLAG_PADDED = 0x8;
+        constexpr uint8_t FLAG_PRIORITY = 0x20;
+
+        constexpr uint32_t ERR_NO_ERROR = 0x0;
+        constexpr uint32_t ERR_PROTOCOL = 0x1;
+        constexpr uint32_t ERR_INTERNAL = 0x2;
+        constexpr uint32_t ERR_FLOW_CONTROL = 0x3;
+        constexpr uint32_t ERR_STREAM_CLOSED = 0x5;
+        constexpr uint32_t ERR_FRAME_SIZE = 0x6;
+        constexpr uint32_t ERR_REFUSED_STREAM = 0x7;
+        constexpr uint32_t ERR_COMPRESSION = 0x9;
+        constexpr uint32_t ERR_ENHANCE_YOUR_CALM = 0xb;
+
+        constexpr uint16_t SETTINGS_HEADER_TABLE_SIZE = 0x1;
+        constexpr uint16_t SETTINGS_ENABLE_PUSH = 0x2;
+        constexpr uint16_t SETTINGS_MAX_CONCURRENT_STREAMS = 0x3;
+        constexpr uint16_t SETTINGS_INITIAL_WINDOW_SIZE = 0x4;
+        constexpr uint16_t SETTINGS_MAX_FRAME_SIZE = 0x5;
+
+        constexpr int64_t MAX_WINDOW = 0x7FFFFFFF;
+        constexpr std::size_t MAX_HEADER_BLOCK = 64 * 1024;
+        constexpr std::size_t MAX_SEND_FRAME = 64 * 1024;   // 对端允许更大的帧时本端最多发送的DATA帧
+        constexpr std::size_t MAX_BATCH_FRAMES = 64;        // 一次writev最多带的DATA帧
+        constexpr std::size_t MAX_FREE_STREAMS = 16;
+
+        uint32_t ReadU32(const uint8_t* p) {
+            return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+                (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+        }
+
+        void WriteU32(uint8_t* p, uint32_t value) {
+            p[0] = static_cast<uint8_t>(value >> 24);
+            p[1] = static_cast<uint8_t>(value >> 16);
+            p[2] = static_cast<uint8_t>(value >> 8);
+            p[3] = static_cast<uint8_t>(value);
+        }
+
+        void PutFrameHeader(uint8_t* h, std::size_t len, uint8_t type, uint8_t flags, uint32_t id) {
+            h[0] = static_cast<uint8_t>(len >> 16);
+            h[1] = static_cast<uint8_t>(len >> 8);
+            h[2] = static_cast<uint8_t>(len);
+            h[3] = type;
+            h[4] = flags;
+            WriteU32(h + 5, id & 0x7FFFFFFFU);
+        }
+
+        bool StripPadding(uint8_t flags, const uint8_t*& payload, std::size_t& len) {
+            if ((flags & FLAG_PADDED) == 0) {
+                return true;
+            }
+            if (len < 1 || payload[0] >= len) {
+                return false;
+            }
+            len -= static_cast<std::size_t>(payload[0]) + 1;
+            ++payload;
+            return true;
+        }
+
+        // HTTP/2中禁止出现的逐跳头部
+        bool ConnectionSpecific(const std::string& name) {
+            return name == "connection" || name == "keep-alive" || name == "proxy-connection" ||
+                name == "transfer-encoding" || name == "upgrade";
+        }
+
+        // 每个响应都不同的头部不进入HPACK动态表，免得挤掉可复用的条目
+        bool Indexable(const std::string& name) {
+            return name != "etag" && name != "last-modified" && name != "content-length" &&
+                name != "content-range" && name != "date";
+        }
+    }
+
+    constexpr std::size_t Http2Session::PREFACE_LEN;
+    constexpr std::size_t Http2Session::MAX_FRAME_SIZE;
+    Http2Session::Options Http2Session::m_options;
+
+    struct Http2Session::Stream {
+        uint32_t id{0};
+        std::unique_ptr<HttpConn> conn;   // 请求上下文，不绑定socket
+        std::vector<char> readBuffer;     // conn的读缓冲区，存放URL
+        std::vector<char> writeBuffer;    // conn的写缓冲区，存放ProcessWrite生成的响应头
+        std::vector<char> chunk;          // producer生成的DATA负载
+        int64_t sendWindow{0};
+        bool receiving{false};            // 请求体正交给处理函数
+        bool remoteClosed{false};         // 已收到END_STREAM
+        bool chunkQueued{false};          // chunk在本批帧中，写完前不能再调用producer
+        bool reset{false};                // 已发送RST_STREAM
+    };
+
+    bool Http2Session::IsPreface(const char* data, std::size_t len) {
+        return std::memcmp(data, PREFACE, std::min(len, PREFACE_LEN)) == 0;
+    }
+
+    Http2Session::Http2Session(HttpConn& conn) : m_conn(conn) {
+        m_in.resize(std::max<std::size_t>(2 * (9 + MAX_FRAME_SIZE), conn.m_readSize));
+        m_frameHeaders.reserve(MAX_BATCH_FRAMES);
+        metrics::Inc(metrics::Counter::H2_SESSIONS);
+
+        uint8_t settings[6];
+        settings[0] = 0;
+        settings[1] = static_cast<uint8_t>(SETTINGS_MAX_CONCURRENT_STREAMS);
+        WriteU32(settings + 2, m_options.maxStreams);
+        AppendFrame(FRAME_SETTINGS, 0, 0, settings, sizeof(settings));
+    }
+
+    Http2Session::~Http2Session() {
+        m_sending.clear();
+        for (auto& item : m_streams) {
+            m_closed.push_back(std::move(item.second));
+        }
+        m_streams.clear();
+        ReleaseClosed();
+    }
+
+    bool Http2Session::Feed(const char* data, std::size_t len) {
+        if (len > m_in.size() - m_inLen) {
+            return false;
+        }
+        std::memcpy(m_in.data() + m_inLen, data, len);
+        m_inLen += len;
+        return true;
+    }
+
+    bool Http2Session::Read() {
+        // 缓冲区满时等工作线程处理完再读
+        while (m_inLen < m_in.size()) {
+            const ssize_t n = m_conn.Recv(m_in.data() + m_inLen, m_in.size() - m_inLen);
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    break;
+                }
+                return false;
+            } else if (n == 0) {
+                return false;
+            }
+            capture::Emit(capture::RecordType::DATA, m_conn.m_captureId,
+                m_in.data() + m_inLen, static_cast<std::size_t>(n));
+            metrics::Inc(metrics::Counter::BYTES_READ, static_cast<uint64_t>(n));
+            m_inLen += static_cast<std::size_t>(n);
+        }
+        return true;
+    }
+
+    void Http2Session::Process() {
+        std::size_t pos = 0;
+        while (!m_goAway && m_inLen - pos >= 9) {
+            const uint8_t* p = reinterpret_cast<const uint8_t*>(m_in.data()) + pos;
+            const std::size_t len = (static_cast<std::size_t>(p[0]) << 16) |
+                (static_cast<std::size_t>(p[1]) << 8) | p[2];
+            if (len > MAX_FRAME_SIZE) {
+                GoAway(ERR_FRAME_SIZE);
+                break;
+            }
+            if (m_inLen - pos < 9 + len) {
+                break;
+            }
+            pos += 9 + len;
+            if (!HandleFrame(p[3], p[4], ReadU32(p + 5) & 0x7FFFFFFFU, p + 9, len)) {
+                break;
+            }
+        }
+        std::memmove(m_in.data(), m_in.data() + pos, m_inLen - pos);
+        m_inLen -= pos;
+        if (!m_goAway && !m_draining && HttpConn::IsDraining()) {
+            // 平滑重启：已经收到的流照常完成，之后的流由客户端在新连接上重试
+            uint8_t payload[8];
+            WriteU32(payload, m_lastStreamId);
+            WriteU32(payload + 4, ERR_NO_ERROR);
+            AppendFrame(FRAME_GOAWAY, 0, 0, payload, sizeof(payload));
+            m_draining = true;
+        }
+    }
+
+    bool Http2Session::HandleFrame(uint8_t type, uint8_t flags, uint32_t id,
+                                   const uint8_t* payload, std::size_t len) {
+        if (m_continuationId != 0 && (type != FRAME_CONTINUATION || id != m_continuationId)) {
+            return GoAway(ERR_PROTOCOL);
+        }
+        switch (type) {
+            case FRAME_DATA:
+                return OnData(flags, id, payload, len);
+            case FRAME_HEADERS:
+                return OnHeaders(flags, id, payload, len);
+            case FRAME_PRIORITY:
+                // 不做优先级调度，各流轮流发送
+                if (id == 0) {
+                    return GoAway(ERR_PROTOCOL);
+                }
+                if (len != 5) {
+                    ResetStream(id, ERR_FRAME_SIZE);
+                }
+                return true;
+            case FRAME_RST_STREAM: {
+                if (id == 0 || id > m_lastStreamId) {
+                    return GoAway(ERR_PROTOCOL);
+                }
+                if (len != 4) {
+                    return GoAway(ERR_FRAME_SIZE);
+                }
+                Stream* stream = FindStream(id);
+                if (stream != nullptr) {
+                    stream->reset = true;
+                    CloseStream(*stream);
+                }
+                return true;
+            }
+            case FRAME_SETTINGS:
+                return OnSettings(flags, id, payload, len);
+            case FRAME_PUSH_PROMISE:
+                return GoAway(ERR_PROTOCOL);
+            case FRAME_PING:
+                if (id != 0) {
+                    return GoAway(ERR_PROTOCOL);
+                }
+                if (len != 8) {
+                    return GoAway(ERR_FRAME_SIZE);
+                }
+                if ((flags & FLAG_ACK) == 0) {
+                    AppendFrame(FRAME_PING, FLAG_ACK, 0, payload, len);
+                }
+                return true;
+            case FRAME_GOAWAY:
+                if (id != 0) {
+                    return GoAway(ERR_PROTOCOL);
+                }
+                m_peerGoAway = true;
+                return true;
+            case FRAME_WINDOW_UPDATE:
+                return OnWindowUpdate(id, payload, len);
+            case FRAME_CONTINUATION:
+                if (m_continuationId == 0) {
+                    return GoAway(ERR_PROTOCOL);
+                }
+                if (m_headerBlock.size() + len > MAX_HEADER_BLOCK) {
+                    return GoAway(ERR_ENHANCE_YOUR_CALM);
+                }
+                m_headerBlock.append(reinterpret_cast<const char*>(payload), len);
+                if (flags & FLAG_END_HEADERS) {
+                    const uint32_t streamId = m_continuationId;
+                    m_continuationId = 0;
+                    return OnHeaderBlock(streamId, m_continuationEnd);
+                }
+                return true;
+            default:
+                // 未知类型的帧直接忽略
+                return true;
+        }
+    }
+
+    bool Http2Session::OnData(uint8_t flags, uint32_t id, const uint8_t* payload, std::size_t len) {
+        if (id == 0) {
+            return GoAway(ERR_PROTOCOL);
+        }
+        const std::size_t frameLen = len;
+        if (!StripPadding(flags, payload, len)) {
+            return GoAway(ERR_PROTOCOL);
+        }
+        // 数据交给处理函数后立即归还窗口，请求体不在会话中积压
+        if (frameLen > 0) {
+            AppendWindowUpdate(0, static_cast<uint32_t>(frameLen));
+        }
+        Stream* stream = FindStream(id);
+        if (stream == nullptr || stream->remoteClosed) {
+            if (id > m_lastStreamId) {
+                return GoAway(ERR_PROTOCOL);
+            }
+            if (stream != nullptr) {
+                ResetStream(id, ERR_STREAM_CLOSED);
+            }
+            return true;
+        }
+        const bool end = (flags & FLAG_END_STREAM) != 0;
+        if (end) {
+            stream->remoteClosed = true;
+        } else if (frameLen > 0) {
+            AppendWindowUpdate(id, static_cast<uint32_t>(frameLen));
+        }
+        if (!stream->receiving) {
+            return true;
+        }
+        HttpConn& conn = *stream->conn;
+        if (conn.m_bodyLimit != 0 && conn.m_bodyReceived + len > conn.m_bodyLimit) {
+            Respond(*stream, conn.AbortBody(HTTP_CODE::PAYLOAD_TOO_LARGE));
+            return true;
+        }
+        if (len > 0) {
+            conn.m_bodyReceived += len;
+            const HTTP_CODE ret = conn.m_bodySink(reinterpret_cast<const char*>(payload), len, false);
+            if (ret != HTTP_CODE::NO_REQUEST) {
+                Respond(*stream, conn.AbortBody(ret));
+                return true;
+            }
+        }
+        if (end) {
+            Respond(*stream, conn.FinishBody());
+        }
+        return true;
+    }
+
+    bool Http2Session::OnHeaders(uint8_t flags, uint32_t id, const uint8_t* payload, std::size_t len) {
+        if (id == 0 || (id & 1) == 0) {
+            return GoAway(ERR_PROTOCOL);
+        }
+        if (!StripPadding(flags, payload, len)) {
+            return GoAway(ERR_PROTOCOL);
+        }
+        if (flags & FLAG_PRIORITY) {
+            if (len < 5) {
+                return GoAway(ERR_FRAME_SIZE);
+            }
+            payload += 5;
+            len -= 5;
+        }
+        m_headerBlock.assign(reinterpret_cast<const char*>(payload), len);
+        if ((flags & FLAG_END_HEADERS) == 0) {
+            m_continuationId = id;
+            m_continuationEnd = (flags & FLAG_END_STREAM) != 0;
+            return true;
+        }
+        return OnHeaderBlock(id, (flags & FLAG_END_STREAM) != 0);
+    }
+
+    bool Http2Session::OnHeaderBlock(uint32_t id, bool endStream) {
+        // 即使要拒绝这个流也必须先解码，保持动态表与对端同步
+        std::vector<hpack::Header> headers;
+        const bool decoded = m_decoder.Decode(reinterpret_cast<const uint8_t*>(m_headerBlock.data()),
+            m_headerBlock.size(), headers);
+        m_headerBlock.clear();
+        if (!decoded) {
+            return GoAway(ERR_COMPRESSION);
+        }
+
+        Stream* stream = FindStream(id);
+        if (stream != nullptr) {
+            // 请求体之后的尾部头部，内容忽略
+            if (stream->remoteClosed || !endStream) {
+                ResetStream(id, ERR_PROTOCOL);
+                return true;
+            }
+            stream->remoteClosed = true;
+            if (stream->receiving) {
+                Respond(*stream, stream->conn->FinishBody());
+            }
+            return true;
+        }
+        if (id <= m_lastStreamId) {
+            return GoAway(ERR_STREAM_CLOSED);
+        }
+        m_lastStreamId = id;
+        if (m_peerGoAway || m_draining) {
+            return true;
+        }
+        if (m_streams.size() >= m_options.maxStreams) {
+            ResetStream(id, ERR_REFUSED_STREAM);
+            return true;
+        }
+        RateLimiter* limiter = HttpConn::m_rateLimiter;
+        if (limiter != nullptr) {
+            const RateLimiter::Verdict verdict = limiter->AdmitRequest(m_conn.m_addr, GetMonotonicNanos());
+            if (verdict == RateLimiter::Verdict::UNTRACKED) {
+                metrics::Inc(metrics::Counter::RATE_LIMIT_UNTRACKED);
+            } else if (verdict != RateLimiter::Verdict::ALLOW) {
+                metrics::Inc(metrics::Counter::RATE_LIMITED_REQUESTS);
+                ResetStream(id, ERR_ENHANCE_YOUR_CALM);
+                return true;
+            }
+        }
+        StartRequest(*NewStream(id), headers, endStream);
+        return true;
+    }
+
+    /*
+     * 伪头部转换成请求行，普通头部按"name: value"交给HttpConn::ParseHeaders()，
+     * 之后和HTTP/1.1一样经DoRequest()分发。
+     */
+    void Http2Session::StartRequest(Stream& stream, std::vector<hpack::Header>& headers, bool endStream) {
+        HttpConn& conn = *stream.conn;
+        conn.init();
+        conn.m_requestStart = GetMonotonicNanos();
+        conn.m_requestId = trace::Tracer::NextRequestId();
+        conn.m_linger = true;
+        trace::Emit(trace::Event::REQUEST_BEGIN, conn.m_requestId, m_conn.m_sockfd);
+        metrics::Inc(metrics::Counter::H2_STREAMS);
+        stream.remoteClosed = endStream;
+
+        std::string method;
+        std::string path;
+        std::string authority;
+        bool malformed = false;
+        bool regular = false;
+        HTTP_CODE parsed = HTTP_CODE::NO_REQUEST;
+        for (auto& header : headers) {
+            const std::string& name = header.first;
+            if (!name.empty() && name[0] == ':') {
+                if (regular) {
+                    malformed = true;
+                } else if (name == ":method") {
+                    method = header.second;
+                } else if (name == ":path") {
+                    path = header.second;
+                } else if (name == ":authority") {
+                    authority = header.second;
+                } else if (name != ":scheme") {
+                    malformed = true;
+                }
+                continue;
+            }
+            regular = true;
+            if (std::any_of(name.begin(), name.end(), [](char c) { return c >= 'A' && c <= 'Z'; }) ||
+                ConnectionSpecific(name) || (name == "te" && header.second != "trailers")) {
+                malformed = true;
+                continue;
+            }
+            std::string line = name + ": " + header.second;
+            if (conn.ParseHeaders(&line[0]) == HTTP_CODE::BAD_REQUEST) {
+                parsed = HTTP_CODE::BAD_REQUEST;
+            }
+        }
+        if (malformed || method.empty() || path.empty()) {
+            ResetStream(stream.id, ERR_PROTOCOL);
+            return;
+        }
+
+        int m = 0;
+        for (; m <= static_cast<int>(HTTP_METHOD::CONNECT); ++m) {
+            if (method == MethodName(static_cast<HTTP_METHOD>(m))) {
+                break;
+            }
+        }
+        if (m > static_cast<int>(HTTP_METHOD::CONNECT) || path[0] != '/') {
+            parsed = HTTP_CODE::BAD_REQUEST;
+        } else {
+            conn.m_method = static_cast<HTTP_METHOD>(m);
+        }
+        stream.readBuffer.assign(path.begin(), path.end());
+        stream.readBuffer.push_back('\0');
+        conn.m_readBuffer = stream.readBuffer.data();
+        conn.m_readSize = stream.readBuffer.size();
+        conn.m_url = conn.m_readBuffer;
+        if (!authority.empty()) {
+            conn.m_host = authority;
+        }
+        // 请求体由DATA帧分隔，按分块编码处理(不splice)
+        conn.m_chunked = !endStream;
+        if (endStream) {
+            conn.m_contentLength = 0;
+        }
+        if (parsed == HTTP_CODE::BAD_REQUEST) {
+            Respond(stream, HTTP_CODE::BAD_REQUEST);
+            return;
+        }
+
+        HTTP_CODE ret = conn.DoRequest();
+        if (!endStream) {
+            if (ret == HTTP_CODE::NO_REQUEST && conn.m_bodySink) {
+                conn.m_bodyLimit = conn.m_upload.fd != -1 ? HttpConn::m_maxUploadSize : HttpConn::m_maxBodySize;
+                stream.receiving = true;
+                return;
+            }
+            ret = conn.AbortBody(ret == HTTP_CODE::NO_REQUEST ? HTTP_CODE::INTERNAL_ERROR : ret);
+        }
+        Respond(stream, ret);
+    }
+
+    /*
+     * ProcessWrite()生成的HTTP/1.1响应头在m_iv开头(打包资源时跨越多个iovec)，
+     * 解析出状态码和各头部重新用HPACK编码，之后的iovec就是响应体。
+     */
+    void Http2Session::Respond(Stream& stream, HTTP_CODE ret) {
+        HttpConn& conn = *stream.conn;
+        stream.receiving = false;
+        if (conn.m_deferred) {
+            LOG_WARN << "deferred responses are not supported on HTTP/2 streams";
+            conn.m_deferred.reset();
+            ret = HTTP_CODE::INTERNAL_ERROR;
+        }
+        if (ret == HTTP_CODE::NO_REQUEST || ret == HTTP_CODE::CLOSED_CONNECTION ||
+            ret == HTTP_CODE::DEFERRED_REQUEST) {
+            ret = HTTP_CODE::INTERNAL_ERROR;
+        }
+        trace::Emit(trace::Event::PARSE, conn.m_requestId, static_cast<int64_t>(ret));
+        if (!conn.ProcessWrite(ret)) {
+            ResetStream(stream.id, ERR_INTERNAL);
+            return;
+        }
+
+        std::string head;
+        std::size_t headLen = 0;
+        for (std::size_t i = conn.m_ivIndex; i < conn.m_iv.size() && headLen == 0; ++i) {
+            const std::size_t before = head.size();
+            head.append(static_cast<const char*>(conn.m_iv[i].iov_base), conn.m_iv[i].iov_len);
+            const std::size_t end = head.find("\r\n\r\n", before >= 3 ? before - 3 : 0);
+            if (end != std::string::npos) {
+                headLen = end + 4;
+                head.resize(end + 2);
+            }
+        }
+        if (headLen == 0 || head.size() < 12) {
+            ResetStream(stream.id, ERR_INTERNAL);
+            return;
+        }
+        conn.AdvanceIov(headLen);
+        conn.m_bytesToSend -= headLen;
+
+        std::string block;
+        m_encoder.Begin(block);
+        m_encoder.EncodeStatus(std::atoi(head.c_str() + 9), block);
+        std::size_t pos = head.find("\r\n") + 2;
+        while (pos < head.size()) {
+            const std::size_t eol = head.find("\r\n", pos);
+            const std::size_t colon = head.find(':', pos);
+            if (colon < eol) {
+                std::string name = head.substr(pos, colon - pos);
+                for (auto& ch : name) {
+                    ch = static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
+                }
+                std::size_t begin = head.find_first_not_of(" \t", colon + 1);
+                begin = std::min(begin, eol);
+                if (!ConnectionSpecific(name)) {
+                    m_encoder.Encode(name, head.substr(begin, eol - begin), Indexable(name), block);
+                }
+            }
+            pos = eol + 2;
+        }
+
+        const bool hasBody = conn.m_bytesToSend > 0 || conn.m_producer;
+        std::size_t offset = 0;
+        bool first = true;
+        do {
+            const std::size_t n = std::min(block.size() - offset, m_peerMaxFrame);
+            uint8_t flags = offset + n == block.size() ? FLAG_END_HEADERS : 0;
+            if (first && !hasBody) {
+                flags |= FLAG_END_STREAM;
+            }
+            AppendFrame(first ? FRAME_HEADERS : FRAME_CONTINUATION, flags, stream.id, block.data() + offset, n);
+            offset += n;
+            first = false;
+        } while (offset < block.size());
+
+        if (hasBody) {
+            m_sending.push_back(&stream);
+        } else {
+            CloseStream(stream);
+        }
+    }
+
+    bool Http2Session::OnSettings(uint8_t flags, uint32_t id, const uint8_t* payload, std::size_t len) {
+        if (id != 0) {
+            return GoAway(ERR_PROTOCOL);
+        }
+        if (flags & FLAG_ACK) {
+            return len == 0 || GoAway(ERR_FRAME_SIZE);
+        }
+        if (len % 6 != 0) {
+            return GoAway(ERR_FRAME_SIZE);
+        }
+        for (std::size_t i = 0; i < len; i += 6) {
+            const uint16_t key = static_cast<uint16_t>((payload[i] << 8) | payload[i + 1]);
+            const uint32_t value = ReadU32(payload + i + 2);
+            switch (key) {
+                case SETTINGS_HEADER_TABLE_SIZE:
+                    m_encoder.SetMaxSize(value);
+                    break;
+                case SETTINGS_ENABLE_PUSH:
+                    if (value > 1) {
+                        return GoAway(ERR_PROTOCOL);
+                    }
+                    break;
+                case SETTINGS_INITIAL_WINDOW_SIZE: {
+                    if (value > MAX_WINDOW) {
+                        return GoAway(ERR_FLOW_CONTROL);
+                    }
+                    // 已有流的窗口按差值调整，可以变成负数
+                    const int64_t delta = static_cast<int64_t>(value) - m_initialWindow;
+                    m_initialWindow = value;
+                    for (auto& item : m_streams) {
+                        item.second->sendWindow += delta;
+                        if (item.second->sendWindow > MAX_WINDOW) {
+                            return GoAway(ERR_FLOW_CONTROL);
+                        }
+                    }
+                    break;
+                }
+                case SETTINGS_MAX_FRAME_SIZE:
+                    if (value < MAX_FRAME_SIZE || value > 0xFFFFFF) {
+                        return GoAway(ERR_PROTOCOL);
+                    }
+                    m_peerMaxFrame = std::min<std::size_t>(value, MAX_SEND_FRAME);
+                    break;
+                default:
+                    break;
+            }
+        }
+        AppendFrame(FRAME_SETTINGS, FLAG_ACK, 0, nullptr, 0);
+        return true;
+    }
+
+    bool Http2Session::OnWindowUpdate(uint32_t id, const uint8_t* payload, std::size_t len) {
+        if (len != 4) {
+            return GoAway(ERR_FRAME_SIZE);
+        }
+        const uint32_t increment = ReadU32(payload) & 0x7FFFFFFFU;
+        if (id == 0) {
+            if (increment == 0) {
+                return GoAway(ERR_PROTOCOL);
+            }
+            m_sendWindow += increment;
+            return m_sendWindow <= MAX_WINDOW || GoAway(ERR_FLOW_CONTROL);
+        }
+        Stream* stream = FindStream(id);
+        if (stream == nullptr) {
+            return id <= m_lastStreamId || GoAway(ERR_PROTOCOL);
+        }
+        if (increment == 0) {
+            ResetStream(id, ERR_PROTOCOL);
+            return true;
+        }
+        stream->sendWindow += increment;
+        if (stream->sendWindow > MAX_WINDOW) {
+            ResetStream(id, ERR_FLOW_CONTROL);
+        }
+        return true;
+    }
+
+    Http2Session::Stream* Http2Session::NewStream(uint32_t id) {
+        std::unique_ptr<Stream> stream;
+        if (!m_free.empty()) {
+            stream = std::move(m_free.back());
+            m_free.pop_back();
+        } else {
+            // 流对象连同HttpConn和缓冲区一起复用，不从连接的内存池分配
+            stream.reset(new Stream);
+            stream->conn.reset(new HttpConn);
+            stream->readBuffer.resize(1);
+            stream->writeBuffer.resize(HttpConn::m_writeBufferSize);
+        }
+        HttpConn& conn = *stream->conn;
+        conn.m_readBuffer = stream->readBuffer.data();
+        conn.m_readSize = stream->readBuffer.size();
+        conn.m_writeBuffer = stream->writeBuffer.data();
+        conn.m_writeSize = stream->writeBuffer.size();
+        stream->id = id;
+        stream->sendWindow = m_initialWindow;
+        stream->receiving = false;
+        stream->remoteClosed = false;
+        stream->chunkQueued = false;
+        stream->reset = false;
+        Stream* raw = stream.get();
+        m_streams[id] = std::move(stream);
+        return raw;
+    }
+
+    Http2Session::Stream* Http2Session::FindStream(uint32_t id) {
+        const auto it = m_streams.find(id);
+        return it == m_streams.end() ? nullptr : it->second.get();
+    }
+
+    void Http2Session::ResetStream(uint32_t id, uint32_t error) {
+        uint8_t payload[4];
+        WriteU32(payload, error);
+        AppendFrame(FRAME_RST_STREAM, 0, id, payload, sizeof(payload));
+        Stream* stream = FindStream(id);
+        if (stream != nullptr) {
+            stream->reset = true;
+            CloseStream(*stream);
+        }
+    }
+
+    // 流结束后移出m_streams，对象等已排队的帧写完后在ReleaseClosed()中回收
+    void Http2Session::CloseStream(Stream& stream) {
+        stream.receiving = false;
+        if (!stream.reset && !stream.remoteClosed) {
+            // 响应已经完整发出，通知对端不必再发送请求体
+            uint8_t payload[4];
+            WriteU32(payload, ERR_NO_ERROR);
+            AppendFrame(FRAME_RST_STREAM, 0, stream.id, payload, sizeof(payload));
+        }
+        const auto sending = std::find(m_sending.begin(), m_sending.end(), &stream);
+        if (sending != m_sending.end()) {
+            if (static_cast<std::size_t>(sending - m_sending.begin()) < m_next) {
+                --m_next;
+            }
+            m_sending.erase(sending);
+        }
+        const auto it = m_streams.find(stream.id);
+        if (it != m_streams.end()) {
+            m_closed.push_back(std::move(it->second));
+            m_streams.erase(it);
+        }
+    }
+
+    void Http2Session::ReleaseClosed() {
+        for (auto& stream : m_closed) {
+            HttpConn& conn = *stream->conn;
+            if (conn.m_requestStart != 0) {
+                metrics::Observe(metrics::Histogram::REQUEST_US,
+                    (GetMonotonicNanos() - conn.m_requestStart) / 1000);
+                trace::Emit(trace::Event::LAST_BYTE, conn.m_requestId, 0);
+                conn.m_requestStart = 0;
+            }
+            conn.Unmap();
+            conn.CloseConn();
+            conn.m_dynamicContent.clear();
+            if (m_free.size() < MAX_FREE_STREAMS) {
+                m_free.push_back(std::move(stream));
+            }
+        }
+        m_closed.clear();
+    }
+
+    bool Http2Session::GoAway(uint32_t error) {
+        uint8_t payload[8];
+        WriteU32(payload, m_lastStreamId);
+        WriteU32(payload + 4, error);
+        AppendFrame(FRAME_GOAWAY, 0, 0, payload, sizeof(payload));
+        m_goAway = true;
+        LOG_WARN << "http2 connection error " << error << ", sending GOAWAY";
+        return false;
+    }
+
+    void Http2Session::AppendFrame(uint8_t type, uint8_t flags, uint32_t id, const void* payload,
+                                   std::size_t len) {
+        uint8_t header[9];
+        PutFrameHeader(header, len, type, flags, id);
+        m_out.append(reinterpret_cast<const char*>(header), sizeof(header));
+        if (len > 0) {
+            m_out.append(static_cast<const char*>(payload), len);
+        }
+    }
+
+    void Http2Session::AppendWindowUpdate(uint32_t id, uint32_t increment) {
+        uint8_t payload[4];
+        WriteU32(payload, increment);
+        AppendFrame(FRAME_WINDOW_UPDATE, 0, id, payload, sizeof(payload));
+    }
+
+    /*
+     * 上一批帧全部写完后才组装下一批：先是控制帧和HEADERS帧，再按窗口轮流给每个流生成DATA帧。
+     * DATA帧的负载直接引用各流响应体的iovec，帧头放在容量固定的m_frameHeaders中。
+     */
+    bool Http2Session::Build() {
+        ReleaseClosed();
+        m_iv.clear();
+        m_ivIndex = 0;
+        m_frameHeaders.clear();
+        for (auto* stream : m_sending) {
+            stream->chunkQueued = false;
+        }
+        m_sendingOut.clear();
+        m_sendingOut.swap(m_out);
+        if (!m_sendingOut.empty()) {
+            m_iv.push_back({&m_sendingOut[0], m_sendingOut.size()});
+        }
+
+        std::size_t frames = 0;
+        bool progress = true;
+        while (progress && frames < MAX_BATCH_FRAMES && !m_sending.empty()) {
+            progress = false;
+            for (std::size_t n = m_sending.size(); n > 0 && !m_sending.empty() && frames < MAX_BATCH_FRAMES; --n) {
+                if (m_next >= m_sending.size()) {
+                    m_next = 0;
+                }
+                Stream& stream = *m_sending[m_next];
+                const std::size_t before = frames;
+                const bool done = BuildData(stream, frames);
+                progress = progress || frames > before;
+                if (done) {
+                    CloseStream(stream);
+                } else {
+                    ++m_next;
+                }
+            }
+        }
+        // 发送期间生成的RST_STREAM等留到下一批
+        return m_ivIndex < m_iv.size();
+    }
+
+    // 给一个流生成至多一个DATA帧，返回该流是否已经发送完毕(或已被重置)
+    bool Http2Session::BuildData(Stream& stream, std::size_t& frames) {
+        HttpConn& conn = *stream.conn;
+        const int64_t window = std::min(m_sendWindow, stream.sendWindow);
+        std::size_t len = 0;
+        bool end = false;
+        if (conn.m_producer) {
+            if (stream.chunkQueued || window <= 0) {
+                return false;
+            }
+            const std::size_t size = std::min<std::size_t>(static_cast<std::size_t>(window), m_peerMaxFrame);
+            if (stream.chunk.size() < m_peerMaxFrame) {
+                stream.chunk.resize(m_peerMaxFrame);
+            }
+            const ssize_t n = conn.m_producer(stream.chunk.data(), size);
+            if (n < 0 || static_cast<std::size_t>(n) > size) {
+                LOG_WARN << "stream producer failed: " << n;
+                conn.m_producer = nullptr;
+                ResetStream(stream.id, ERR_INTERNAL);
+                return false;
+            }
+            len = static_cast<std::size_t>(n);
+            end = len == 0;
+            if (end) {
+                conn.m_producer = nullptr;
+            }
+            m_frameHeaders.emplace_back();
+            PutFrameHeader(m_frameHeaders.back().data(), len, FRAME_DATA, end ? FLAG_END_STREAM : 0, stream.id);
+            m_iv.push_back({m_frameHeaders.back().data(), 9});
+            if (len > 0) {
+                m_iv.push_back({stream.chunk.data(), len});
+                stream.chunkQueued = true;
+            }
+        } else {
+            len = static_cast<std::size_t>(std::min<uint64_t>(
+                std::min<int64_t>(std::max<int64_t>(window, 0), static_cast<int64_t>(m_peerMaxFrame)),
+                conn.m_bytesToSend));
+            if (len == 0) {
+                return false;
+            }
+            end = len == conn.m_bytesToSend;
+            m_frameHeaders.emplace_back();
+            PutFrameHeader(m_frameHeaders.back().data(), len, FRAME_DATA, end ? FLAG_END_STREAM : 0, stream.id);
+            m_iv.push_back({m_frameHeaders.back().data(), 9});
+            std::size_t left = len;
+            for (std::size_t i = conn.m_ivIndex; left > 0 && i < conn.m_iv.size(); ++i) {
+                const std::size_t take = std::min(left, conn.m_iv[i].iov_len);
+                if (take > 0) {
+                    m_iv.push_back({conn.m_iv[i].iov_base, take});
+                    left -= take;
+                }
+            }
+            conn.AdvanceIov(len);
+            conn.m_bytesToSend -= len;
+        }
+        m_sendWindow -= static_cast<int64_t>(len);
+        stream.sendWindow -= static_cast<int64_t>(len);
+        ++frames;
+        return end;
+    }
+
+    WRITE_RESULT Http2Session::Write(bool fromReactor) {
+        std::size_t budgetBytes = 0;
+        int budgetWrites = 0;
+        while (m_ivIndex < m_iv.size() || Build()) {
+            const std::size_t count = std::min<std::size_t>(m_iv.size() - m_ivIndex, IOV_MAX);
+            const ssize_t n = m_conn.Send(m_iv.data() + m_ivIndex, static_cast<int>(count));
+            if (n < 0) {
+                if (errno == EAGAIN) {
+                    metrics::Inc(metrics::Counter::WRITE_EAGAIN);
+                    Arm(true);
+                    return WRITE_RESULT::DONE;
+                }
+                return WRITE_RESULT::CLOSE;
+            }
+            metrics::Inc(metrics::Counter::BYTES_WRITTEN, static_cast<uint64_t>(n));
+            for (std::size_t left = static_cast<std::size_t>(n); left > 0 && m_ivIndex < m_iv.size(); ) {
+                struct iovec& iov = m_iv[m_ivIndex];
+                if (left < iov.iov_len) {
+                    iov.iov_base = static_cast<char*>(iov.iov_base) + left;
+                    iov.iov_len -= left;
+                    break;
+                }
+                left -= iov.iov_len;
+                ++m_ivIndex;
+            }
+
+            budgetBytes += static_cast<std::size_t>(n);
+            ++budgetWrites;
+            if ((HttpConn::m_writeBudgetBytes != 0 && budgetBytes >= HttpConn::m_writeBudgetBytes) ||
+                (HttpConn::m_writeBudgetWrites != 0 && budgetWrites >= HttpConn::m_writeBudgetWrites)) {
+                metrics::Inc(metrics::Counter::WRITE_YIELDS);
+                if (fromReactor) {
+                    return WRITE_RESULT::AGAIN;
+                }
+                Arm(true);
+                return WRITE_RESULT::DONE;
+            }
+        }
+        if (m_goAway || ((m_peerGoAway || m_draining) && m_streams.empty())) {
+            return WRITE_RESULT::CLOSE;
+        }
+        // 没有可发送的数据(或窗口已用完)，等对端的请求或WINDOW_UPDATE
+        Arm(false);
+        return WRITE_RESULT::DONE;
+    }
+
+    void Http2Session::Arm(bool wantWrite) {
+        ModFD(HttpConn::m_epollfd.load(), m_conn.m_sockfd, EPOLLIN | (wantWrite ? static_cast<int>(EPOLLOUT) : 0));
+    }
+}
@@ -5,20 +5,163 @@
 #include "http/HttpConn.h"
 #include "log/Logger.h"
 #include "common-lib/Utils.h"
+#include "metrics/Metrics.h"
+#include "trace/Tracer.h"
+#include "trace/Probes.h"
+#include "capture/Capture.h"
+#include "common-lib/Numa.h"
+#include "common-lib/RateLimiter.h"
+#include "common-lib/LoadShedder.h"
+#include "http/GzipCache.h"
+#include "bundle/Bundle.h"
+#include "http/Router.h"
+#include "http/Deferred.h"
+#include "http/Http2Session.h"
+#include "http/Proxy.h"
+#include "http/WebSocket.h"
+#include "http/VirtualHost.h"
+#include "tls/Tls.h"
 
 #include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <sys/uio.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/mman.h>
 #include <cstdarg>
+#include <cstring>
+#include <algorithm>
+#include <climits>
+#include <cctype>
+#include <cstdlib>
+#include <cerrno>
 
 std::atomic<int> HttpConn::m_epollfd{-1};
 std::atomic<int> HttpConn::m_user_count{0};
+const http::Router* HttpConn::m_router{nullptr};
+constexpr std::size_t HttpConn::DEFAULT_READ_BUFFER_SIZE;
+constexpr std::size_t HttpConn::DEFAULT_WRITE_BUFFER_SIZE;
+constexpr std::size_t HttpConn::CHUNK_PREFIX;
+constexpr std::size_t HttpConn::UPLOAD_PIPE_SIZE;
+std::size_t HttpConn::m_readBufferSize{HttpConn::DEFAULT_READ_BUFFER_SIZE};
+std::size_t HttpConn::m_writeBufferSize{HttpConn::DEFAULT_WRITE_BUFFER_SIZE};
+NumaArena* HttpConn::m_arena{nullptr};
+std::size_t HttpConn::m_writeBudgetBytes{256 * 1024};
+int HttpConn::m_writeBudgetWrites{16};
+uint64_t HttpConn::m_maxBodySize{0};
+std::size_t HttpConn::m_chunkSize{16 * 1024};
+std::string HttpConn::m_uploadDir{"/tmp"};
+uint64_t HttpConn::m_maxUploadSize{0};
+std::string HttpConn::m_overloadResponse;
+std::vector<std::pair<std::string, std::string>> HttpConn::m_cacheRules;
+std::string HttpConn::m_rateLimitResponse;
+RateLimiter* HttpConn::m_rateLimiter{nullptr};
+const LoadShedder* HttpConn::m_shedder{nullptr};
+std::atomic<bool> HttpConn::m_draining{false};
 
-void HttpConn::Init(int sockfd, const sockaddr_in &addr) {
+namespace {
+    std::string MakeRejectResponse(int status, const char* title, const char* form, int retryAfter) {
+        return "HTTP/1.1 " + std::to_string(status) + " " + title + "\r\n" +
+            "Content-Length:" + std::to_string(std::strlen(form)) + "\r\n" +
+            "Content-Type:text/plain\r\n" +
+            "Retry-After:" + std::to_string(retryAfter) + "\r\n" +
+            "Connection:close\r\n\r\n" + form;
+    }
+
+    // 路径中有".."段时可能跳出站点的根目录(URL不做百分号解码，%2e%2e只是普通文件名)
+    bool EscapesRoot(const char* path, std::size_t len) {
+        std::size_t start = 0;
+        for (std::size_t i = 0; i <= len; ++i) {
+            if (i == len || path[i] == '/') {
+                if (i - start == 2 && path[start] == '.' && path[start + 1] == '.') {
+                    return true;
+                }
+                start = i + 1;
+            }
+        }
+        return false;
+    }
+}
+
+void HttpConn::SetCacheRules(const std::vector<std::pair<std::string, int>>& rules) {
+    m_cacheRules = http::MakeCacheRules(rules);
+}
+
+void HttpConn::SetRetryAfter(int seconds) {
+    m_overloadResponse = MakeRejectResponse(503, http::status::ERROR_503_TITLE,
+        http::status::ERROR_503_FORM, seconds);
+    m_rateLimitResponse = MakeRejectResponse(429, http::status::ERROR_429_TITLE,
+        http::status::ERROR_429_FORM, seconds);
+}
+
+const std::string& HttpConn::RejectResponse(int status) {
+    if (m_overloadResponse.empty()) {
+        SetRetryAfter(1);
+    }
+    return status == 429 ? m_rateLimitResponse : m_overloadResponse;
+}
+
+void HttpConn::RejectSocket(int sockfd, int status) {
+    const std::string& response = RejectResponse(status);
+    // 响应很短，一次send发不完就直接放弃
+    ::send(sockfd, response.data(), response.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+    metrics::Inc(metrics::Counter::BYTES_WRITTEN, response.size());
+    metrics::Registry::Instance().RecordStatus(status);
+    WEBSERVER_PROBE2(reject, sockfd, status);
+}
+
+void HttpConn::Reject(int status) {
+    if (m_sockfd == -1) {
+        return;
+    }
+    if (m_tls) {
+        // 响应需要加密，握手还没完成时直接关闭
+        const std::string& response = RejectResponse(status);
+        if (!m_tls->Handshaking() && m_tls->Send(response.data(), response.size())) {
+            metrics::Inc(metrics::Counter::BYTES_WRITTEN, response.size());
+        }
+        metrics::Registry::Instance().RecordStatus(status);
+    } else {
+        RejectSocket(m_sockfd, status);
+    }
+    trace::Emit(trace::Event::LAST_BYTE, m_requestId, status);
+    CloseConn();
+}
+
+bool HttpConn::AllocBuffers() {
+    if (m_readBuffer != nullptr) {
+        return true;
+    }
+    static NumaArena defaultArena;
+    NumaArena* arena = m_arena != nullptr ? m_arena : &defaultArena;
+    char* readBuffer = static_cast<char*>(arena->Allocate(m_readBufferSize));
+    char* writeBuffer = static_cast<char*>(arena->Allocate(m_writeBufferSize));
+    if (readBuffer == nullptr || writeBuffer == nullptr) {
+        LOG_ERROR << "allocate connection buffers failed";
+        return false;
+    }
+    m_readBuffer = readBuffer;
+    m_readSize = m_readBufferSize;
+    m_writeBuffer = writeBuffer;
+    m_writeSize = m_writeBufferSize;
+    return true;
+}
+
+void HttpConn::Init(int sockfd, const SocketAddress& addr, int listener, bool limited) {
+    if (!AllocBuffers()) {
+        if (m_rateLimiter != nullptr && limited) {
+            m_rateLimiter->ReleaseConnection(addr);
+        }
+        close(sockfd);
+        return;
+    }
     m_sockfd = sockfd;
     m_addr = addr;
+    m_listener = listener;
+    m_limited = limited;
+    m_ws.reset();
+    m_idle = false;
 
     // 设置端口复用
     int reuse = 1;
@@ -29,44 +172,177 @@ void HttpConn::Init(int sockfd, const sockaddr_in &addr) {
     }
     AddFD(m_epollfd.load(), m_sockfd, true);
     m_user_count += 1;
+    metrics::Add(metrics::Gauge::ACTIVE_CONNECTIONS, 1);
+    metrics::Add(m_listener, metrics::ListenerStat::CONNECTIONS, 1);
+    WEBSERVER_PROBE1(conn_init, m_sockfd);
+    if (capture::Recorder::Enabled()) {
+        m_captureId = capture::Recorder::NextConnId();
+        capture::Emit(capture::RecordType::OPEN, m_captureId);
+    }
     init();
 }
 
-void HttpConn::init() {
+bool HttpConn::StartTls() {
+    if (m_sockfd == -1) {
+        return false;
+    }
+    m_tls.reset(new tls::Connection(m_sockfd));
+    // 每个记录单独write，关闭Nagle，免得最后一个不满的记录等对端的延迟ACK
+    int nodelay = 1;
+    setsockopt(m_sockfd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    return m_tls->Valid();
+}
+
+bool HttpConn::IsHandshaking() const {
+    return m_tls && m_tls->Handshaking();
+}
+
+bool HttpConn::Handshake() {
+    switch (m_tls->Handshake()) {
+        case tls::HANDSHAKE::DONE:
+        case tls::HANDSHAKE::WANT_READ:
+            // 握手完成后客户端可能已经发出了请求，重新注册时会立即触发
+            ModFD(m_epollfd.load(), m_sockfd, EPOLLIN);
+            return true;
+        case tls::HANDSHAKE::WANT_WRITE:
+            ModFD(m_epollfd.load(), m_sockfd, EPOLLOUT);
+            return true;
+        default:
+            return false;
+    }
+}
+
+void HttpConn::init(std::size_t keep) {
     m_url = nullptr;
     m_version = nullptr;
     m_checkState = http::CHECK_STATE::CHECK_STATE_REQUESTLINE;
     m_method = http::HTTP_METHOD::GET;
-    m_readIndex = 0;
+    m_readIndex = keep;
     m_writeIndex = 0;
     m_checkedIndex = 0;
     m_startLine = 0;
-    m_readBuffer.fill('\0');
-    m_writeBuffer.fill('\0');
+    m_headerStart = 0;
+    std::memset(m_readBuffer + keep, '\0', m_readSize - keep);
+    std::memset(m_writeBuffer, '\0', m_writeSize);
     m_linger = false;
     m_contentLength = 0;
+    m_hasContentLength = false;
+    m_chunked = false;
+    m_expectContinue = false;
     m_host.clear();
     m_realFile.clear();
+    m_pathLength = 0;
+    m_bodyState = http::BODY_STATE::LENGTH;
+    m_bodyStart = 0;
+    m_requestEnd = 0;
+    m_bodyRemaining = 0;
+    m_bodyReceived = 0;
+    m_bodyLimit = 0;
+    m_bodySink = nullptr;
+    CloseUpload();
+    m_producer = nullptr;
+    m_allowed = 0;
     m_bytesToSend = 0;
     m_bytesHaveSend = 0;
+    m_dynamicContent.clear();
+    m_range.clear();
+    m_ifRange.clear();
+    m_ifNoneMatch.clear();
+    m_ifModifiedSince.clear();
+    m_etag.clear();
+    m_acceptGzip = false;
+    m_compressible = false;
+    m_gzipBody.reset();
+    m_asset = nullptr;
+    m_ranges.clear();
+    m_partHeaders.clear();
+    m_iv.clear();
+    m_ivIndex = 0;
+    m_contentType = "text/html";
+    m_requestStart = 0;
+    m_requestId = 0;
+    m_site = nullptr;
+}
+
+// m_h2的类型在这里才完整
+HttpConn::HttpConn() = default;
+HttpConn::~HttpConn() = default;
+HttpConn::HttpConn(HttpConn &&) noexcept = default;
+HttpConn& HttpConn::operator=(HttpConn &&) noexcept = default;
+
+void HttpConn::Drain() {
+    if (m_sockfd == -1) {
+        return;
+    }
+    if (IsWebSocket()) {
+        m_ws->Close(http::WebSocket::CLOSE_CODE::GOING_AWAY);
+    } else if (m_idle) {
+        // 刚accept还没有请求的连接不在这里关闭，免得丢掉已经在路上的第一个请求
+        CloseConn();
+    }
 }
 
 void HttpConn::CloseConn() {
+    if (m_ws) {
+        // 排队中的Dispatch()看到已关闭后直接返回，m_ws留到槽位被重新使用
+        m_ws->Shutdown();
+    }
+    if (m_deferred) {
+        // 客户端在响应完成前断开，之后到达的完成结果会被FinishDeferred丢弃
+        std::shared_ptr<http::Deferred> deferred;
+        deferred.swap(m_deferred);
+        metrics::Add(metrics::Gauge::DEFERRED_PENDING, -1);
+        metrics::Inc(metrics::Counter::DEFERRED_CANCELLED);
+        deferred->Cancel();
+    }
+    if (m_proxy) {
+        // 转发中途断开，关闭上游连接
+        std::shared_ptr<http::ProxyExchange> proxy;
+        proxy.swap(m_proxy);
+        http::Proxy::Instance().Cancel(*proxy);
+    }
+    m_bodySink = nullptr;
+    CloseUpload();
+    m_producer = nullptr;
+    m_h2.reset();
+    if (m_tls) {
+        m_tls->Shutdown();
+        m_tls.reset();
+    }
     if (m_sockfd != -1) {
+        WEBSERVER_PROBE1(close, m_sockfd);
+        m_writeQueued = false;
+        capture::Emit(capture::RecordType::CLOSE, m_captureId);
         DelFD(m_epollfd.load(), m_sockfd);
         m_sockfd = -1;
         m_user_count -= 1;
+        metrics::Add(metrics::Gauge::ACTIVE_CONNECTIONS, -1);
+        metrics::Add(m_listener, metrics::ListenerStat::CONNECTIONS, -1);
+        if (m_rateLimiter != nullptr && m_limited) {
+            m_rateLimiter->ReleaseConnection(m_addr);
+        }
     }
 }
 
 bool HttpConn::Read() {
-    if (m_readIndex >= READ_BUFFER_SIZE) {
-        return false;
+    m_idle = false;
+    // 上传的请求体由工作线程直接从socket搬进文件
+    if (m_uploadPipe[0] != -1) {
+        return true;
+    }
+    if (m_h2) {
+        return m_h2->Read();
+    }
+    // 留一个字节放结尾的'\0'
+    if (m_readIndex + 1 >= m_readSize) {
+        // 请求体由工作线程消费后会腾出空间，剩余的数据等重新注册EPOLLIN后再读
+        return IsReadingBody();
     }
     ssize_t bytesRead{0};
-    while (true) {
-        bytesRead = ::recv(m_sockfd, m_readBuffer.data() + m_readIndex,
-            READ_BUFFER_SIZE - m_readIndex, 0);
+    const std::size_t startIndex = m_readIndex;
+    (void)startIndex;  // 只在USDT探针中使用，没有sys/sdt.h时探针为空
+    while (m_readIndex + 1 < m_readSize) {
+        bytesRead = Recv(m_readBuffer + m_readIndex, m_readSize - 1 - m_readIndex);
         if (bytesRead == -1) {
             if (errno == EAGAIN || errno == EWOULDBLOCK) {
                 // 非阻塞模式下无数据可读
@@ -77,16 +353,22 @@ bool HttpConn::Read() {
             // 对方关闭连接
             return false;
         }
+        if (m_requestStart == 0) {
+            m_requestStart = GetMonotonicNanos();
+            m_requestId = trace::Tracer::NextRequestId();
+            trace::Emit(trace::Event::REQUEST_BEGIN, m_requestId, m_sockfd);
+        }
+        capture::Emit(capture::RecordType::DATA, m_captureId,
+            m_readBuffer + m_readIndex, static_cast<std::size_t>(bytesRead));
         m_readIndex += static_cast<std::size_t>(bytesRead);
+        metrics::Inc(metrics::Counter::BYTES_READ, static_cast<uint64_t>(bytesRead));
+        trace::Emit(trace::Event::READ, m_requestId, bytesRead);
     }
 
-    if (m_readIndex < READ_BUFFER_SIZE) {
-        m_readBuffer[m_readIndex] = '\0';
-    } else {
-        m_readBuffer[READ_BUFFER_SIZE - 1] = '\0';
-    }
+    m_readBuffer[m_readIndex] = '\0';
+    WEBSERVER_PROBE3(read, m_sockfd, m_readIndex - startIndex, m_readIndex);
 
-    LOG_INFO << "读取到了数据: " << m_readBuffer.data();
+    LOG_INFO << "读取到了数据: " << m_readBuffer;
     return true;
 }
 
@@ -131,13 +413,18 @@ http::HTTP_CODE HttpConn::ParseRequestLine(char *text) {
     }
     *m_url++ = '\0';
 
-    /* 目前仅支持GET */
+    // 方法是否支持由路由决定，这里只排除不认识的方法
     char* method = text;
-    if (strcasecmp(method, "GET") == 0) {
-        m_method = http::HTTP_METHOD::GET;
-    } else {
+    int m = 0;
+    for (; m <= static_cast<int>(http::HTTP_METHOD::CONNECT); ++m) {
+        if (strcasecmp(method, http::MethodName(static_cast<http::HTTP_METHOD>(m))) == 0) {
+            break;
+        }
+    }
+    if (m > static_cast<int>(http::HTTP_METHOD::CONNECT)) {
         return http::HTTP_CODE::BAD_REQUEST;
     }
+    m_method = static_cast<http::HTTP_METHOD>(m);
 
     /* 目前仅支持 HTTP/1.1 */
     m_version = std::strpbrk(m_url, " \t");
@@ -158,13 +445,37 @@ http::HTTP_CODE HttpConn::ParseRequestLine(char *text) {
     }
 
     m_checkState = http::CHECK_STATE::CHECK_STATE_HEADER;
+    m_headerStart = m_checkedIndex;
     return http::HTTP_CODE::NO_REQUEST;
 }
 
+/*
+ * 每个请求在请求行解析完成时准入一次：头部分几次到达不会重复计算，
+ * 一次读到的多个流水线请求也各自计算。HTTP/2的请求由会话按流准入。
+ */
+bool HttpConn::AdmitRequest() {
+    if (m_rateLimiter != nullptr) {
+        const RateLimiter::Verdict verdict = m_rateLimiter->AdmitRequest(m_addr, GetMonotonicNanos());
+        if (verdict == RateLimiter::Verdict::UNTRACKED) {
+            metrics::Inc(metrics::Counter::RATE_LIMIT_UNTRACKED);
+        } else if (verdict != RateLimiter::Verdict::ALLOW) {
+            metrics::Inc(metrics::Counter::RATE_LIMITED_REQUESTS);
+            m_rejectStatus = 429;
+            return false;
+        }
+    }
+    if (m_shedder != nullptr && !m_shedder->Admit()) {
+        metrics::Inc(metrics::Counter::SHED_REQUESTS);
+        m_rejectStatus = 503;
+        return false;
+    }
+    return true;
+}
+
 http::HTTP_CODE HttpConn::ParseHeaders(char *text) {
     std::string headerText(text);
     if(headerText.empty()) {
-        if (m_contentLength != 0) {
+        if (m_chunked || m_contentLength != 0) {
             m_checkState = http::CHECK_STATE::CHECK_STATE_CONTENT;
             return http::HTTP_CODE::NO_REQUEST;
         }
@@ -182,22 +493,43 @@ http::HTTP_CODE HttpConn::ParseHeaders(char *text) {
             auto firstNonWs = value.find_first_not_of(" \t");
             if (firstNonWs != std::string::npos) {
                 value.erase(0, firstNonWs + 1 + 1 );
-                if (value.find("keep-alive") == 0) {
+                if (value.find("keep-alive") == 0 && !IsDraining()) {
                     m_linger = true;
                     LOG_INFO << "connection: keep-alive";
                 }
             }
         }
-    } else if (lowerText.find("content-length") == 0) {
-        auto colonPos = lowerText.find(":");
-        if (colonPos != std::string::npos) {
-            std::string value = headerText.substr(colonPos + 1);
-            auto firstNonWs = value.find_first_not_of(" \t");
-            if (firstNonWs != std::string::npos) {
-                value = value.substr(firstNonWs);
-                m_contentLength = std::stoi(value);
-                LOG_INFO << "content-length: " << m_contentLength;
-            }
+    } else if (lowerText.find("content-length:") == 0) {
+        std::string value;
+        HeaderValue(headerText, value);
+        char* end = nullptr;
+        errno = 0;
+        const uint64_t length = std::strtoull(value.c_str(), &end, 10);
+        if (value.empty() || !std::isdigit(static_cast<unsigned char>(value[0])) ||
+            *end != '\0' || errno == ERANGE) {
+            return http::HTTP_CODE::BAD_REQUEST;
+        }
+        // 多个取值不同的Content-Length无法确定请求体的边界(RFC 9112 6.3)
+        if (m_hasContentLength && length != m_contentLength) {
+            LOG_WARN << "conflicting content-length: " << m_contentLength << " and " << length;
+            return http::HTTP_CODE::BAD_REQUEST;
+        }
+        m_contentLength = length;
+        m_hasContentLength = true;
+        LOG_INFO << "content-length: " << m_contentLength;
+    } else if (lowerText.find("expect:") == 0) {
+        std::string value;
+        HeaderValue(lowerText, value);
+        m_expectContinue = value == "100-continue";
+    } else if (lowerText.find("transfer-encoding:") == 0) {
+        // 只支持chunked，同时出现时忽略Content-Length
+        std::string value;
+        HeaderValue(lowerText, value);
+        if (value == "chunked") {
+            m_chunked = true;
+        } else if (value != "identity") {
+            LOG_WARN << "unsupported transfer-encoding: " << value;
+            return http::HTTP_CODE::BAD_REQUEST;
         }
     } else if (lowerText.find("host") == 0) {
         // 处理Host头部字段
@@ -210,37 +542,707 @@ http::HTTP_CODE HttpConn::ParseHeaders(char *text) {
                 LOG_INFO << "host: " << m_host;
             }
         }
+    } else if (lowerText.find("range:") == 0) {
+        HeaderValue(headerText, m_range);
+    } else if (lowerText.find("if-range:") == 0) {
+        HeaderValue(headerText, m_ifRange);
+    } else if (lowerText.find("if-none-match:") == 0) {
+        HeaderValue(headerText, m_ifNoneMatch);
+    } else if (lowerText.find("if-modified-since:") == 0) {
+        HeaderValue(headerText, m_ifModifiedSince);
+    } else if (lowerText.find("accept-encoding:") == 0) {
+        std::string value;
+        HeaderValue(lowerText, value);
+        m_acceptGzip = AcceptsGzip(value);
     } else {
         LOG_ERROR << "oop! unknow header: " << lowerText;
     }
     return http::HTTP_CODE::NO_REQUEST;
 }
 
+// 取出"Name: value"中去掉首尾空白的value
+bool HttpConn::HeaderValue(const std::string& header, std::string& value) {
+    const auto colonPos = header.find(':');
+    if (colonPos == std::string::npos) {
+        return false;
+    }
+    const auto begin = header.find_first_not_of(" \t", colonPos + 1);
+    if (begin == std::string::npos) {
+        value.clear();
+        return true;
+    }
+    const auto end = header.find_last_not_of(" \t");
+    value = header.substr(begin, end - begin + 1);
+    return true;
+}
+
 /*
- * 没有真正解析HTTP请求的消息体，只是判断它是否被完整的读入了
+ * 头部解析完成后立即分发请求，不等请求体。处理函数调用StreamBody()时请求体边读边交给它；
+ * 没有调用时直接以返回值响应，剩余的请求体不再读取，响应后关闭连接。
  */
-http::HTTP_CODE HttpConn::ParseContent(char* text) {
-    if (text == nullptr) {
+http::HTTP_CODE HttpConn::BeginBody() {
+    m_bodyStart = m_checkedIndex;
+    if (m_readSize - m_bodyStart < MIN_BODY_WINDOW) {
+        m_linger = false;
         return http::HTTP_CODE::BAD_REQUEST;
     }
-    if (m_readIndex >= (m_contentLength + m_checkedIndex)) {
-        text[m_contentLength] = '\0';
-        LOG_INFO << "请求体：" << text;
-        return http::HTTP_CODE::GET_REQUEST;
+    m_bodyState = m_chunked ? http::BODY_STATE::CHUNK_SIZE : http::BODY_STATE::LENGTH;
+    m_bodyRemaining = m_chunked ? 0 : m_contentLength;
+
+    const http::HTTP_CODE ret = DoRequest();
+    if (ret == http::HTTP_CODE::PROXY_REQUEST && m_proxy) {
+        // 请求体由reactor直接转发给上游
+        if (!m_chunked && m_maxBodySize != 0 && m_contentLength > m_maxBodySize) {
+            m_proxy.reset();
+            return AbortBody(http::HTTP_CODE::PAYLOAD_TOO_LARGE);
+        }
+        if (m_expectContinue && m_readIndex == m_bodyStart) {
+            SendContinue();
+        }
+        return ret;
+    }
+    if (ret != http::HTTP_CODE::NO_REQUEST || !m_bodySink) {
+        return AbortBody(ret == http::HTTP_CODE::NO_REQUEST ? http::HTTP_CODE::INTERNAL_ERROR : ret);
+    }
+    m_bodyLimit = m_upload.fd != -1 ? m_maxUploadSize : m_maxBodySize;
+    if (!m_chunked && m_bodyLimit != 0 && m_contentLength > m_bodyLimit) {
+        return AbortBody(http::HTTP_CODE::PAYLOAD_TOO_LARGE);
+    }
+    // 客户端在等待确认，请求被拒绝时上面已经直接响应，不会发送请求体
+    if (m_expectContinue && m_readIndex == m_bodyStart) {
+        SendContinue();
     }
+    return ParseBody();
+}
+
+void HttpConn::SendContinue() {
+    static const char CONTINUE[] = "HTTP/1.1 100 Continue\r\n\r\n";
+    if (m_tls) {
+        m_tls->Send(CONTINUE, sizeof(CONTINUE) - 1);
+    } else {
+        ::send(m_sockfd, CONTINUE, sizeof(CONTINUE) - 1, MSG_DONTWAIT | MSG_NOSIGNAL);
+    }
+}
+
+http::HTTP_CODE HttpConn::AbortBody(http::HTTP_CODE ret) {
+    m_bodySink = nullptr;
+    CloseUpload();
+    m_linger = false;
+    return ret;
+}
+
+/*
+ * 处理读缓冲区中[m_bodyStart, m_readIndex)的请求体，数据直接从读缓冲区交给sink，不拷贝。
+ * 处理完后把剩下的不完整部分(如半行块大小)移回m_bodyStart，头部指针(m_url等)保持有效，
+ * 所以无论请求体多大，占用的内存都只有读缓冲区。
+ */
+http::HTTP_CODE HttpConn::ParseBody() {
+    std::size_t pos = m_bodyStart;
+    bool more = true;
+    while (more && m_bodyState != http::BODY_STATE::DONE) {
+        switch (m_bodyState) {
+            case http::BODY_STATE::LENGTH:
+            case http::BODY_STATE::CHUNK_DATA: {
+                const std::size_t len = static_cast<std::size_t>(
+                    std::min<uint64_t>(m_readIndex - pos, m_bodyRemaining));
+                if (len == 0) {
+                    more = false;
+                    break;
+                }
+                const http::HTTP_CODE ret = m_bodySink(m_readBuffer + pos, len, false);
+                pos += len;
+                m_bodyRemaining -= len;
+                m_bodyReceived += len;
+                if (ret != http::HTTP_CODE::NO_REQUEST) {
+                    return AbortBody(ret);
+                }
+                if (m_bodyRemaining == 0) {
+                    m_bodyState = m_bodyState == http::BODY_STATE::LENGTH ?
+                        http::BODY_STATE::DONE : http::BODY_STATE::CHUNK_CRLF;
+                }
+                break;
+            }
+            case http::BODY_STATE::CHUNK_CRLF: {
+                if (m_readIndex - pos < 2) {
+                    more = false;
+                    break;
+                }
+                if (m_readBuffer[pos] != '\r' || m_readBuffer[pos + 1] != '\n') {
+                    LOG_WARN << "chunk data not followed by CRLF";
+                    return AbortBody(http::HTTP_CODE::BAD_REQUEST);
+                }
+                pos += 2;
+                m_bodyState = http::BODY_STATE::CHUNK_SIZE;
+                break;
+            }
+            case http::BODY_STATE::CHUNK_SIZE:
+            case http::BODY_STATE::TRAILER: {
+                const char* line = m_readBuffer + pos;
+                const char* end = static_cast<const char*>(std::memchr(line, '\n', m_readIndex - pos));
+                if (end == nullptr) {
+                    // 缓冲区已满仍放不下一行
+                    if (pos == m_bodyStart && m_readIndex + 1 >= m_readSize) {
+                        LOG_WARN << "chunk line too long";
+                        return AbortBody(http::HTTP_CODE::BAD_REQUEST);
+                    }
+                    more = false;
+                    break;
+                }
+                pos = static_cast<std::size_t>(end - m_readBuffer) + 1;
+                if (m_bodyState == http::BODY_STATE::TRAILER) {
+                    // 尾部头部直接忽略，空行结束
+                    if (end == line || (end == line + 1 && line[0] == '\r')) {
+                        m_bodyState = http::BODY_STATE::DONE;
+                    }
+                    break;
+                }
+                // 块大小为十六进制，后面可以跟;扩展
+                uint64_t size = 0;
+                const char* p = line;
+                for (; p < end && std::isxdigit(static_cast<unsigned char>(*p)); ++p) {
+                    if (size >> 60) {
+                        return AbortBody(http::HTTP_CODE::BAD_REQUEST);
+                    }
+                    const char c = static_cast<char>(std::tolower(static_cast<unsigned char>(*p)));
+                    size = size * 16 + static_cast<uint64_t>(c <= '9' ? c - '0' : c - 'a' + 10);
+                }
+                if (p == line || (p < end && *p != ';' && *p != '\r' && *p != ' ' && *p != '\t')) {
+                    LOG_WARN << "bad chunk size line";
+                    return AbortBody(http::HTTP_CODE::BAD_REQUEST);
+                }
+                if (size == 0) {
+                    m_bodyState = http::BODY_STATE::TRAILER;
+                } else if (m_bodyLimit != 0 && m_bodyReceived + size > m_bodyLimit) {
+                    return AbortBody(http::HTTP_CODE::PAYLOAD_TOO_LARGE);
+                } else {
+                    m_bodyRemaining = size;
+                    m_bodyState = http::BODY_STATE::CHUNK_DATA;
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    if (m_bodyState == http::BODY_STATE::DONE) {
+        m_requestEnd = pos;
+        return FinishBody();
+    }
+    const std::size_t rest = m_readIndex - pos;
+    std::memmove(m_readBuffer + m_bodyStart, m_readBuffer + pos, rest);
+    m_readIndex = m_bodyStart + rest;
+    m_readBuffer[m_readIndex] = '\0';
+    m_checkedIndex = m_readIndex;
+    if (m_uploadPipe[0] != -1 && rest == 0) {
+        return SpliceBody();
+    }
+    return http::HTTP_CODE::NO_REQUEST;
+}
+
+http::HTTP_CODE HttpConn::FinishBody() {
+    http::BodySink sink;
+    sink.swap(m_bodySink);
+    return sink(nullptr, 0, true);
+}
+
+/*
+ * socket -> 管道 -> 文件，数据留在内核中。每次最多搬运UPLOAD_STEP_BYTES，
+ * 之后返回NO_REQUEST重新注册EPOLLIN，让出工作线程，socket仍可读时下一个事件继续。
+ */
+http::HTTP_CODE HttpConn::SpliceBody() {
+    std::size_t moved = 0;
+    while (m_bodyRemaining > 0 && moved < UPLOAD_STEP_BYTES) {
+        const std::size_t want = static_cast<std::size_t>(
+            std::min<uint64_t>(m_bodyRemaining, UPLOAD_PIPE_SIZE));
+        const ssize_t in = splice(m_sockfd, nullptr, m_uploadPipe[1], nullptr, want,
+            SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (in == 0 || (in < 0 && errno != EAGAIN)) {
+            LOG_WARN << "upload aborted after " << m_bodyReceived << " bytes";
+            return AbortBody(http::HTTP_CODE::CLOSED_CONNECTION);
+        }
+        if (in < 0) {
+            break;
+        }
+        // 每轮都把管道排空，管道写端不会满
+        for (ssize_t left = in; left > 0; ) {
+            const ssize_t out = splice(m_uploadPipe[0], nullptr, m_upload.fd, nullptr,
+                static_cast<std::size_t>(left), SPLICE_F_MOVE);
+            if (out <= 0) {
+                LOG_ERROR << "splice to " << m_upload.path << " failed: " << std::strerror(errno);
+                return AbortBody(http::HTTP_CODE::INTERNAL_ERROR);
+            }
+            left -= out;
+        }
+        m_bodyRemaining -= static_cast<uint64_t>(in);
+        m_bodyReceived += static_cast<uint64_t>(in);
+        moved += static_cast<std::size_t>(in);
+    }
+    metrics::Inc(metrics::Counter::BYTES_READ, moved);
+    metrics::Inc(metrics::Counter::UPLOAD_SPLICED_BYTES, moved);
+    trace::Emit(trace::Event::READ, m_requestId, static_cast<int64_t>(moved));
+    if (m_bodyRemaining == 0) {
+        // 请求体没有经过读缓冲区，缓冲区中只有头部
+        m_bodyState = http::BODY_STATE::DONE;
+        m_requestEnd = m_readIndex;
+        return FinishBody();
+    }
+    return http::HTTP_CODE::NO_REQUEST;
+}
+
+http::HTTP_CODE HttpConn::ReceiveFile(http::UploadHandler handler) {
+    CloseUpload();
+    std::string path = m_uploadDir + "/upload-XXXXXX";
+    const int fd = mkostemp(&path[0], O_CLOEXEC);
+    if (fd < 0) {
+        LOG_ERROR << "create upload file in " << m_uploadDir << " failed: " << std::strerror(errno);
+        return http::HTTP_CODE::INTERNAL_ERROR;
+    }
+    m_upload.fd = fd;
+    m_upload.path = std::move(path);
+    m_upload.size = 0;
+    m_uploadHandler = std::move(handler);
+    // TLS的请求体要先解密，不能从socket直接splice
+    if (!m_chunked && m_contentLength != 0 && !m_tls) {
+        if (pipe2(m_uploadPipe, O_NONBLOCK | O_CLOEXEC) < 0) {
+            LOG_ERROR << "pipe2 failed: " << std::strerror(errno);
+            CloseUpload();
+            return http::HTTP_CODE::INTERNAL_ERROR;
+        }
+        fcntl(m_uploadPipe[1], F_SETPIPE_SZ, static_cast<int>(UPLOAD_PIPE_SIZE));
+    }
+    // 头部之后已经读进缓冲区的部分(以及分块编码的请求体)解码后直接写入
+    return StreamBody([this](const char* data, std::size_t len, bool last) {
+        if (last) {
+            return FinishUpload();
+        }
+        while (len > 0) {
+            const ssize_t n = ::write(m_upload.fd, data, len);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                LOG_ERROR << "write " << m_upload.path << " failed: " << std::strerror(errno);
+                return http::HTTP_CODE::INTERNAL_ERROR;
+            }
+            data += n;
+            len -= static_cast<std::size_t>(n);
+        }
+        return http::HTTP_CODE::NO_REQUEST;
+    });
+}
+
+http::HTTP_CODE HttpConn::FinishUpload() {
+    if (m_uploadPipe[0] != -1) {
+        close(m_uploadPipe[0]);
+        close(m_uploadPipe[1]);
+        m_uploadPipe[0] = m_uploadPipe[1] = -1;
+    }
+    m_upload.size = m_bodyReceived;
+    lseek(m_upload.fd, 0, SEEK_SET);
+    metrics::Inc(metrics::Counter::UPLOADS);
+    http::UploadHandler handler;
+    handler.swap(m_uploadHandler);
+    const http::HTTP_CODE ret = handler(m_upload);
+    CloseUpload();
+    return ret;
+}
+
+void HttpConn::CloseUpload() {
+    if (m_uploadPipe[0] != -1) {
+        close(m_uploadPipe[0]);
+        close(m_uploadPipe[1]);
+        m_uploadPipe[0] = m_uploadPipe[1] = -1;
+    }
+    if (m_upload.fd != -1) {
+        close(m_upload.fd);
+        unlink(m_upload.path.c_str());
+        m_upload.fd = -1;
+        m_upload.path.clear();
+    }
+    m_uploadHandler = nullptr;
+}
+
+http::HTTP_CODE HttpConn::StreamBody(http::BodySink sink) {
+    if (!HasBody()) {
+        return sink(nullptr, 0, true);
+    }
+    m_bodySink = std::move(sink);
     return http::HTTP_CODE::NO_REQUEST;
 }
 
 http::HTTP_CODE HttpConn::DoRequest() {
-    std::string fullPath = GetExecutableDir();
-    if (fullPath.empty()) {
+    m_site = &http::VirtualHosts::Instance().Find(m_host.data(), m_host.size());
+    metrics::Add(m_site->stats, metrics::SiteStat::REQUESTS);
+    m_pathLength = std::strcspn(m_url, "?");
+    if (m_router == nullptr) {
+        return ServeFile(m_url, m_pathLength);
+    }
+    http::Router::Match match;
+    switch (m_router->Find(m_method, m_url, m_pathLength, match)) {
+        case http::Router::Result::FOUND:
+            return (*match.handler)(*this, match.params);
+        case http::Router::Result::METHOD_NOT_ALLOWED:
+            m_allowed = match.allowed;
+            return http::HTTP_CODE::METHOD_NOT_ALLOWED;
+        default:
+            return http::HTTP_CODE::NO_RESOURCE;
+    }
+}
+
+http::HTTP_CODE HttpConn::Reply(std::string content, const char* contentType) {
+    m_dynamicContent = std::move(content);
+    m_contentType = contentType;
+    return http::HTTP_CODE::DYNAMIC_REQUEST;
+}
+
+http::HTTP_CODE HttpConn::Stream(http::Producer producer, const char* contentType) {
+    m_producer = std::move(producer);
+    m_contentType = contentType;
+    return http::HTTP_CODE::STREAM_REQUEST;
+}
+
+http::HTTP_CODE HttpConn::ProxyPass(http::Upstream* upstream) {
+    return http::Proxy::Instance().Prepare(*this, upstream);
+}
+
+http::HTTP_CODE HttpConn::AcceptWebSocket(http::WebSocketHandler handler) {
+    if (m_sockfd == -1) {
+        LOG_WARN << "websocket is not supported on HTTP/2 streams";
+        return http::HTTP_CODE::BAD_REQUEST;
+    }
+    std::string upgrade;
+    std::string connection;
+    std::string key;
+    std::string version;
+    if (m_method != http::HTTP_METHOD::GET || HasBody() ||
+        !GetHeader("upgrade", upgrade) || strcasecmp(upgrade.c_str(), "websocket") != 0 ||
+        !GetHeader("connection", connection) || !GetHeader("sec-websocket-key", key) ||
+        !GetHeader("sec-websocket-version", version) || version != "13" || key.size() != 24) {
+        return http::HTTP_CODE::BAD_REQUEST;
+    }
+    for (auto& ch : connection) {
+        ch = std::tolower(static_cast<unsigned char>(ch));
+    }
+    if (connection.find("upgrade") == std::string::npos) {
+        return http::HTTP_CODE::BAD_REQUEST;
+    }
+    m_ws = std::make_shared<http::WebSocket>(*this, std::move(handler), http::WebSocket::AcceptKey(key));
+    return http::HTTP_CODE::WEBSOCKET_REQUEST;
+}
+
+bool HttpConn::IsWebSocket() const {
+    return m_ws && m_ws->Started();
+}
+
+bool HttpConn::HandleWebSocket(uint32_t events, bool& dispatch) {
+    return m_ws->HandleEvent(events, dispatch);
+}
+
+void HttpConn::WebSocketDispatchFailed() {
+    m_ws->DispatchFailed();
+}
+
+// 头部行在读缓冲区中依次排列，每行之后是ParseLine()留下的"\0\0"
+bool HttpConn::GetHeader(const char* name, std::string& value) const {
+    if (m_headerStart == 0) {
+        return false;
+    }
+    const std::size_t nameLen = std::strlen(name);
+    const char* p = m_readBuffer + m_headerStart;
+    const char* end = m_readBuffer + m_checkedIndex;
+    while (p < end && *p != '\0') {
+        const std::size_t len = std::strlen(p);
+        if (len > nameLen && p[nameLen] == ':' && strncasecmp(p, name, nameLen) == 0) {
+            return HeaderValue(std::string(p, len), value);
+        }
+        p += len + 2;
+    }
+    return false;
+}
+
+std::shared_ptr<http::Deferred> HttpConn::Defer() {
+    m_deferred.reset(new http::Deferred(this));
+    return m_deferred;
+}
+
+void HttpConn::FinishDeferred(const std::shared_ptr<http::Deferred>& deferred) {
+    if (m_deferred != deferred) {
+        return;
+    }
+    m_deferred.reset();
+    metrics::Add(metrics::Gauge::DEFERRED_PENDING, -1);
+    m_dynamicContent = std::move(deferred->m_content);
+    m_contentType = deferred->m_contentType;
+    m_producer = std::move(deferred->m_producer);
+    if (!ProcessWrite(deferred->m_code)) {
+        CloseConn();
+        return;
+    }
+    ModFD(m_epollfd.load(), m_sockfd, EPOLLOUT);
+}
+
+http::HTTP_CODE HttpConn::ServeFile(const char* path, std::size_t len) {
+    if (EscapesRoot(path, len)) {
+        LOG_WARN << "rejecting path outside the document root: " << std::string(path, len);
+        return http::HTTP_CODE::FORBIDDEN_REQUEST;
+    }
+    const http::Site& site = GetSite();
+    // 默认站点打包进可执行文件的资源优先，命中时不访问文件系统
+    const bundle::Asset* asset = site.bundle ? bundle::Find(path, len) : nullptr;
+    if (asset != nullptr) {
+        metrics::Inc(metrics::Counter::BUNDLE_HITS);
+        return OpenAsset(asset);
+    }
+
+    if (site.root.empty()) {
         LOG_ERROR << "Can not get executable path!!!";
         return http::HTTP_CODE::BAD_REQUEST;
     }
-    fullPath += "/../resources";
-    fullPath += m_url;
+    std::string fullPath = site.root;
+    fullPath.append(path, len);
     m_realFile = fullPath;
     LOG_DEBUG << "fullPath: " << fullPath;
+    trace::Emit(trace::Event::FILE_OPEN_BEGIN, m_requestId);
+    http::HTTP_CODE ret = OpenFile();
+    trace::Emit(trace::Event::FILE_OPEN_END, m_requestId,
+        ret == http::HTTP_CODE::FILE_REQUEST ? m_fileStat.st_size : -1);
+    WEBSERVER_PROBE3(file_open, m_sockfd, static_cast<int>(ret), m_fileStat.st_size);
+    if (ret == http::HTTP_CODE::FILE_REQUEST && !m_range.empty()) {
+        ret = ParseRange();
+    }
+    return ret;
+}
+
+// 压缩变体与原文件的字节不同，校验值加上-gz后缀区分
+void HttpConn::MakeETag() {
+    char buf[64];
+    const int len = std::snprintf(buf, sizeof(buf), "\"%llx-%llx-%llx%s\"",
+        static_cast<unsigned long long>(m_fileStat.st_ino),
+        static_cast<unsigned long long>(m_fileStat.st_size),
+        static_cast<unsigned long long>(m_fileStat.st_mtim.tv_sec) * 1000000000ULL +
+            static_cast<unsigned long long>(m_fileStat.st_mtim.tv_nsec),
+        m_gzipBody ? "-gz" : "");
+    m_etag.assign(buf, static_cast<std::size_t>(len));
+}
+
+/*
+ * 用打包时记录的文件信息填充m_fileStat，条件请求、Range和校验头部沿用磁盘文件的处理，
+ * ETag也与同一文件走磁盘路径时相同。
+ */
+http::HTTP_CODE HttpConn::OpenAsset(const bundle::Asset* asset) {
+    m_fileStat = {};
+    m_fileStat.st_mode = S_IFREG | 0444;
+    m_fileStat.st_size = static_cast<off_t>(asset->identity.bodyLen);
+    m_fileStat.st_ino = static_cast<ino_t>(asset->ino);
+    m_fileStat.st_mtim.tv_sec = static_cast<time_t>(asset->mtimeNs / 1000000000ULL);
+    m_fileStat.st_mtim.tv_nsec = static_cast<long>(asset->mtimeNs % 1000000000ULL);
+    m_compressible = asset->gzip.body != nullptr;
+    const bool gzip = m_compressible && m_acceptGzip && m_range.empty() &&
+        GetSite().gzip->Enabled();
+    m_asset = gzip ? &asset->gzip : &asset->identity;
+    m_etag = m_asset->etag;
+    if (NotModified()) {
+        return http::HTTP_CODE::NOT_MODIFIED;
+    }
+    if (!m_range.empty()) {
+        return ParseRange();
+    }
+    return http::HTTP_CODE::FILE_REQUEST;
+}
+
+/*
+ * 解析(已转小写的)Accept-Encoding：gzip/x-gzip的q值优先，没有提到时看*。
+ * q=0表示明确拒绝。
+ */
+bool HttpConn::AcceptsGzip(const std::string& value) {
+    int gzip = -1;
+    int any = -1;
+    std::size_t pos = 0;
+    while (pos < value.size()) {
+        std::size_t end = value.find(',', pos);
+        if (end == std::string::npos) {
+            end = value.size();
+        }
+        const std::string item = value.substr(pos, end - pos);
+        pos = end + 1;
+        const std::size_t begin = item.find_first_not_of(" \t");
+        if (begin == std::string::npos) {
+            continue;
+        }
+        const std::size_t semi = item.find(';', begin);
+        std::string coding = item.substr(begin, semi == std::string::npos ? std::string::npos : semi - begin);
+        coding.erase(coding.find_last_not_of(" \t") + 1);
+        int accepted = 1;
+        if (semi != std::string::npos) {
+            const std::size_t q = item.find("q=", semi);
+            if (q != std::string::npos && std::strtod(item.c_str() + q + 2, nullptr) <= 0.0) {
+                accepted = 0;
+            }
+        }
+        if (coding == "gzip" || coding == "x-gzip") {
+            gzip = accepted;
+        } else if (coding == "*") {
+            any = accepted;
+        }
+    }
+    return gzip >= 0 ? gzip == 1 : any == 1;
+}
+
+/*
+ * If-None-Match存在时只看它(弱比较，W/前缀不影响匹配)，
+ * 否则文件修改时间不晚于If-Modified-Since时视为未修改。
+ */
+bool HttpConn::NotModified() const {
+    if (!m_ifNoneMatch.empty()) {
+        if (m_ifNoneMatch == "*") {
+            return true;
+        }
+        std::size_t pos = 0;
+        while (pos < m_ifNoneMatch.size()) {
+            std::size_t end = m_ifNoneMatch.find(',', pos);
+            if (end == std::string::npos) {
+                end = m_ifNoneMatch.size();
+            }
+            std::size_t begin = m_ifNoneMatch.find_first_not_of(" \t", pos);
+            if (begin < end && m_ifNoneMatch.compare(begin, 2, "W/") == 0) {
+                begin += 2;
+            }
+            std::size_t last = m_ifNoneMatch.find_last_not_of(" \t", end - 1);
+            if (begin < end && last != std::string::npos && last >= begin &&
+                m_ifNoneMatch.compare(begin, last - begin + 1, m_etag) == 0) {
+                return true;
+            }
+            pos = end + 1;
+        }
+        return false;
+    }
+    std::time_t since = 0;
+    return !m_ifModifiedSince.empty() && ParseHttpDate(m_ifModifiedSince.c_str(), since) &&
+        m_fileStat.st_mtime <= since;
+}
+
+const http::Site& HttpConn::GetSite() const {
+    return m_site != nullptr ? *m_site : http::VirtualHosts::Instance().Default();
+}
+
+const std::string* HttpConn::CacheControl() const {
+    const http::Site& site = GetSite();
+    for (const auto& rule : site.ownCacheRules ? site.cacheRules : m_cacheRules) {
+        if (std::strncmp(m_url, rule.first.c_str(), rule.first.size()) == 0) {
+            return &rule.second;
+        }
+    }
+    return nullptr;
+}
+
+/*
+ * 解析"Range: bytes=0-99,200-,-500"。语法错误、单位不是bytes、If-Range不匹配
+ * 或区间过多时忽略Range，返回整个文件；重叠或相邻的区间合并后按偏移排序。
+ */
+http::HTTP_CODE HttpConn::ParseRange() {
+    if (!m_ifRange.empty() && !IfRangeMatches()) {
+        return http::HTTP_CODE::FILE_REQUEST;
+    }
+    if (strncasecmp(m_range.c_str(), "bytes=", 6) != 0) {
+        return http::HTTP_CODE::FILE_REQUEST;
+    }
+    const uint64_t size = static_cast<uint64_t>(m_fileStat.st_size);
+    std::size_t specs = 0;
+    const char* p = m_range.c_str() + 6;
+    while (*p != '\0') {
+        while (*p == ' ' || *p == '\t' || *p == ',') {
+            ++p;
+        }
+        if (*p == '\0') {
+            break;
+        }
+        if (++specs > MAX_RANGES) {
+            m_ranges.clear();
+            return http::HTTP_CODE::FILE_REQUEST;
+        }
+        char* end = nullptr;
+        uint64_t first = 0;
+        uint64_t last = 0;
+        if (*p == '-') {
+            // 后缀区间：最后N个字节
+            if (!std::isdigit(static_cast<unsigned char>(p[1]))) {
+                m_ranges.clear();
+                return http::HTTP_CODE::FILE_REQUEST;
+            }
+            const uint64_t suffix = std::strtoull(p + 1, &end, 10);
+            p = end;
+            if (suffix == 0 || size == 0) {
+                continue;
+            }
+            first = suffix < size ? size - suffix : 0;
+            last = size - 1;
+        } else {
+            if (!std::isdigit(static_cast<unsigned char>(*p))) {
+                m_ranges.clear();
+                return http::HTTP_CODE::FILE_REQUEST;
+            }
+            first = std::strtoull(p, &end, 10);
+            p = end;
+            if (*p++ != '-') {
+                m_ranges.clear();
+                return http::HTTP_CODE::FILE_REQUEST;
+            }
+            if (std::isdigit(static_cast<unsigned char>(*p))) {
+                last = std::strtoull(p, &end, 10);
+                p = end;
+                if (last < first) {
+                    m_ranges.clear();
+                    return http::HTTP_CODE::FILE_REQUEST;
+                }
+            } else {
+                last = UINT64_MAX;
+            }
+            if (first >= size) {
+                continue;
+            }
+            last = std::min(last, size - 1);
+        }
+        while (*p == ' ' || *p == '\t') {
+            ++p;
+        }
+        if (*p != ',' && *p != '\0') {
+            m_ranges.clear();
+            return http::HTTP_CODE::FILE_REQUEST;
+        }
+        m_ranges.emplace_back(first, last);
+    }
+    if (specs == 0) {
+        return http::HTTP_CODE::FILE_REQUEST;
+    }
+    if (m_ranges.empty()) {
+        Unmap();
+        return http::HTTP_CODE::RANGE_NOT_SATISFIABLE;
+    }
+
+    std::sort(m_ranges.begin(), m_ranges.end());
+    std::size_t merged = 0;
+    for (std::size_t i = 1; i < m_ranges.size(); ++i) {
+        if (m_ranges[i].first <= m_ranges[merged].second + 1) {
+            m_ranges[merged].second = std::max(m_ranges[merged].second, m_ranges[i].second);
+        } else {
+            m_ranges[++merged] = m_ranges[i];
+        }
+    }
+    m_ranges.resize(merged + 1);
+    return http::HTTP_CODE::PARTIAL_REQUEST;
+}
+
+// If-Range为实体标签时需要强匹配，为日期时需要与文件修改时间完全一致
+bool HttpConn::IfRangeMatches() const {
+    if (m_ifRange[0] == '"' || m_ifRange.compare(0, 2, "W/") == 0) {
+        return m_ifRange == m_etag;
+    }
+    std::time_t date = 0;
+    return ParseHttpDate(m_ifRange.c_str(), date) && date == m_fileStat.st_mtime;
+}
+
+http::HTTP_CODE HttpConn::OpenFile() {
     if (stat(m_realFile.c_str(), &m_fileStat) < 0) {
         LOG_WARN << "No Resource";
         return http::HTTP_CODE::NO_RESOURCE;
@@ -255,6 +1257,22 @@ http::HTTP_CODE HttpConn::DoRequest() {
         return http::HTTP_CODE::BAD_REQUEST;
     }
 
+    // 压缩变体只在后台生成，这里只查表；带Range的请求始终按原文件处理
+    http::GzipCache& gzipCache = *GetSite().gzip;
+    m_compressible = gzipCache.Compressible(m_realFile, m_fileStat);
+    if (m_compressible && m_acceptGzip && m_range.empty()) {
+        m_gzipBody = gzipCache.Lookup(m_realFile, m_fileStat);
+    }
+
+    // 校验值只依赖stat的结果，条件请求命中时不必打开和映射文件
+    MakeETag();
+    if (NotModified()) {
+        return http::HTTP_CODE::NOT_MODIFIED;
+    }
+    if (m_gzipBody) {
+        return http::HTTP_CODE::FILE_REQUEST;
+    }
+
     const int fd = open(m_realFile.c_str(), O_RDONLY | O_CLOEXEC);
     if (fd < 0) {
         return http::HTTP_CODE::NO_RESOURCE;
@@ -271,14 +1289,13 @@ http::HTTP_CODE HttpConn::DoRequest() {
 }
 
 http::HTTP_CODE HttpConn::ProcessRead() {
-    http::LINE_STATUS lineStatus{http::LINE_STATUS::LINE_OK};
+    if (m_checkState == http::CHECK_STATE::CHECK_STATE_CONTENT) {
+        return ParseBody();
+    }
+
     http::HTTP_CODE ret{http::HTTP_CODE::NO_REQUEST};
     char* text{nullptr};
-
-    while (
-        ((m_checkState == http::CHECK_STATE::CHECK_STATE_CONTENT) &&
-        (lineStatus == http::LINE_STATUS::LINE_OK))
-        || ((lineStatus = ParseLine()) == http::LINE_STATUS::LINE_OK)) {
+    while (ParseLine() == http::LINE_STATUS::LINE_OK) {
         text = GetLine();
         m_startLine = m_checkedIndex;
         LOG_INFO << "got 1 http line: " << text;
@@ -289,6 +1306,9 @@ http::HTTP_CODE HttpConn::ProcessRead() {
                 if (ret == http::HTTP_CODE::BAD_REQUEST) {
                     return http::HTTP_CODE::BAD_REQUEST;
                 }
+                if (!AdmitRequest()) {
+                    return http::HTTP_CODE::REJECTED;
+                }
                 break;
             }
             case http::CHECK_STATE::CHECK_STATE_HEADER: {
@@ -296,18 +1316,13 @@ http::HTTP_CODE HttpConn::ProcessRead() {
                 if (ret == http::HTTP_CODE::BAD_REQUEST) {
                     return http::HTTP_CODE::BAD_REQUEST;
                 } else if (ret == http::HTTP_CODE::GET_REQUEST) {
+                    m_requestEnd = m_checkedIndex;
                     return DoRequest();
+                } else if (m_checkState == http::CHECK_STATE::CHECK_STATE_CONTENT) {
+                    return BeginBody();
                 }
                 break;
             }
-            case http::CHECK_STATE::CHECK_STATE_CONTENT: {
-                ret = ParseContent(text);
-                if (ret == http::HTTP_CODE::GET_REQUEST) {
-                    return DoRequest();
-                }
-                lineStatus = http::LINE_STATUS::LINE_OPEN;
-                break;
-            }
             default: {
                 return http::HTTP_CODE::INTERNAL_ERROR;
             }
@@ -317,69 +1332,223 @@ http::HTTP_CODE HttpConn::ProcessRead() {
     return ret;
 }
 
+http::HTTP_CODE HttpConn::ParseRequest(const char* data, std::size_t len) {
+    if (!AllocBuffers()) {
+        return http::HTTP_CODE::INTERNAL_ERROR;
+    }
+    init();
+    if (len >= m_readSize) {
+        len = m_readSize - 1;
+    }
+    std::memcpy(m_readBuffer, data, len);
+    m_readIndex = len;
+    m_readBuffer[m_readIndex] = '\0';
+    http::HTTP_CODE ret = ProcessRead();
+    Unmap();
+    return ret;
+}
+
 void HttpConn::Unmap() {
     if (m_fileAddress) {
         munmap(m_fileAddress, m_fileStat.st_size);
         m_fileAddress = nullptr;
     }
+    m_gzipBody.reset();
 }
 
 
-bool HttpConn::Write() {
+http::WRITE_RESULT HttpConn::Write() {
     int temp = 0;
+    m_writeQueued = false;
+    if (m_h2) {
+        const http::WRITE_RESULT ret = m_h2->Write(true);
+        m_writeQueued = ret == http::WRITE_RESULT::AGAIN;
+        return ret;
+    }
 
     // 待发送字节数为0，响应结束
     if (m_bytesToSend == 0) {
-        ModFD(m_epollfd.load(), m_sockfd, EPOLLIN);
-        init();
-        return true;
+        if (IsDraining()) {
+            return http::WRITE_RESULT::CLOSE;
+        }
+        return NextRequest();
     }
 
+    std::size_t budgetBytes = 0;
+    int budgetWrites = 0;
     while (true) {
-        temp = writev(m_sockfd, m_iv, m_ivCount);
+        const std::size_t ivCount = std::min<std::size_t>(m_iv.size() - m_ivIndex, IOV_MAX);
+        temp = Send(m_iv.data() + m_ivIndex, static_cast<int>(ivCount));
         if (temp <= -1) {
             if (errno == EAGAIN) {
+                metrics::Inc(metrics::Counter::WRITE_EAGAIN);
+                trace::Emit(trace::Event::WRITE_EAGAIN, m_requestId, m_bytesHaveSend);
+                WEBSERVER_PROBE3(write_eagain, m_sockfd, m_bytesHaveSend, m_bytesToSend);
                 ModFD(m_epollfd.load(), m_sockfd, EPOLLOUT);
-                return true;
+                return http::WRITE_RESULT::DONE;
             }
             Unmap();
-            return false;
+            return http::WRITE_RESULT::CLOSE;
         }
 
+        metrics::Inc(metrics::Counter::BYTES_WRITTEN, static_cast<uint64_t>(temp));
+        if (m_bytesHaveSend == 0) {
+            trace::Emit(trace::Event::FIRST_BYTE, m_requestId, temp);
+        }
         m_bytesHaveSend += temp;
         m_bytesToSend -= temp;
-        if (m_bytesHaveSend >= m_iv[0].iov_len) {
-            m_iv[0].iov_len = 0;
-            m_iv[1].iov_base = m_fileAddress + (m_bytesHaveSend - m_writeIndex);
-            m_iv[1].iov_len = m_bytesToSend;
-        } else {
-            m_iv[0].iov_base = m_iv[0].iov_base + temp;
-            m_iv[0].iov_len -= temp;
+        if (m_bytesToSend > 0) {
+            WEBSERVER_PROBE3(write_partial, m_sockfd, temp, m_bytesToSend);
+        }
+        AdvanceIov(static_cast<std::size_t>(temp));
+
+        // 分块响应：当前块写完后向producer要下一块
+        if (m_bytesToSend == 0 && m_producer && !NextChunk()) {
+            return http::WRITE_RESULT::CLOSE;
         }
 
         // 所有数据发送完毕
-        if (m_bytesToSend <= 0) {
+        if (m_bytesToSend == 0) {
             Unmap();
-            ModFD(m_epollfd.load(), m_sockfd, EPOLLIN);
-
-            if (m_linger) {
-                init();
-                return true;
+            if (m_requestStart != 0) {
+                metrics::Observe(metrics::Histogram::REQUEST_US,
+                    (GetMonotonicNanos() - m_requestStart) / 1000);
+            }
+            trace::Emit(trace::Event::LAST_BYTE, m_requestId, m_bytesHaveSend);
+            WEBSERVER_PROBE2(write_complete, m_sockfd, m_bytesHaveSend);
+            if (m_ws) {
+                // 101已经发出，之后的读写由WebSocket注册
+                return m_ws->Start() ? http::WRITE_RESULT::DONE : http::WRITE_RESULT::CLOSE;
+            }
+            // 排空期间即使响应前已决定保持连接也不再等下一个请求
+            if (m_linger && !IsDraining()) {
+                return NextRequest();
             } else {
-                return false;
+                return http::WRITE_RESULT::CLOSE;
             }
         }
+
+        // socket仍可写但本轮预算已用完，让出reactor，由调用方排到队尾稍后继续
+        budgetBytes += static_cast<std::size_t>(temp);
+        ++budgetWrites;
+        if ((m_writeBudgetBytes != 0 && budgetBytes >= m_writeBudgetBytes) ||
+            (m_writeBudgetWrites != 0 && budgetWrites >= m_writeBudgetWrites)) {
+            metrics::Inc(metrics::Counter::WRITE_YIELDS);
+            WEBSERVER_PROBE3(write_yield, m_sockfd, m_bytesHaveSend, m_bytesToSend);
+            m_writeQueued = true;
+            return http::WRITE_RESULT::AGAIN;
+        }
+    }
+}
+
+/*
+ * 客户端流水线发送时，下一个请求可能已经和当前请求一起读进缓冲区，把它移到开头保留下来。
+ * 这些字节不会再触发EPOLLIN(边沿触发)，此时不注册事件，由调用方直接交给线程池。
+ */
+http::WRITE_RESULT HttpConn::NextRequest() {
+    const std::size_t rest = m_requestEnd != 0 && m_requestEnd < m_readIndex ? m_readIndex - m_requestEnd : 0;
+    if (rest > 0) {
+        std::memmove(m_readBuffer, m_readBuffer + m_requestEnd, rest);
+    }
+    init(rest);
+    if (rest == 0) {
+        ModFD(m_epollfd.load(), m_sockfd, EPOLLIN);
+        m_idle = true;
+        return http::WRITE_RESULT::DONE;
+    }
+    m_requestStart = GetMonotonicNanos();
+    m_requestId = trace::Tracer::NextRequestId();
+    trace::Emit(trace::Event::REQUEST_BEGIN, m_requestId, m_sockfd);
+    return http::WRITE_RESULT::PIPELINED;
+}
+
+void HttpConn::AddIov(const void* base, std::size_t len) {
+    struct iovec iov{};
+    iov.iov_base = const_cast<void*>(base);
+    iov.iov_len = len;
+    m_iv.push_back(iov);
+    m_bytesToSend += len;
+}
+
+// 跳过已经写出的字节，写完的iovec不再交给writev
+void HttpConn::AdvanceIov(std::size_t bytes) {
+    while (bytes > 0 && m_ivIndex < m_iv.size()) {
+        struct iovec& iov = m_iv[m_ivIndex];
+        if (bytes < iov.iov_len) {
+            iov.iov_base = static_cast<char*>(iov.iov_base) + bytes;
+            iov.iov_len -= bytes;
+            return;
+        }
+        bytes -= iov.iov_len;
+        iov.iov_len = 0;
+        ++m_ivIndex;
+    }
+}
+
+ssize_t HttpConn::Recv(char* buffer, std::size_t len) {
+    if (m_tls) {
+        return m_tls->Read(buffer, len);
+    }
+    return ::recv(m_sockfd, buffer, len, 0);
+}
+
+ssize_t HttpConn::Send(const struct iovec* iov, int count) {
+    if (m_tls) {
+        return m_tls->Writev(iov, count);
+    }
+    return writev(m_sockfd, iov, count);
+}
+
+// 记录中剩下的明文已经离开socket，不会再触发EPOLLIN，需要在工作线程中接着读完
+bool HttpConn::ReadPending() {
+    if (!m_tls || m_tls->Pending() == 0) {
+        return false;
+    }
+    // 读到下一个记录时SSL_pending()反而会变大，以缓冲区中的字节数判断有没有读到
+    const std::size_t before = m_h2 ? m_h2->Buffered() : m_readIndex;
+    return Read() && (m_h2 ? m_h2->Buffered() : m_readIndex) > before;
+}
+
+/*
+ * 块大小的十六进制前缀写进数据前面预留的位置，数据后紧跟CRLF，整块只占一个iovec，
+ * 缓冲区在连接上复用，发送过程中不分配内存。producer结束时发送最后的空块。
+ */
+bool HttpConn::NextChunk() {
+    if (m_chunkBuffer.empty()) {
+        m_chunkBuffer.resize(CHUNK_PREFIX + m_chunkSize + 2);
+    }
+    char* data = m_chunkBuffer.data() + CHUNK_PREFIX;
+    const ssize_t len = m_producer(data, m_chunkSize);
+    m_iv.clear();
+    m_ivIndex = 0;
+    if (len < 0 || static_cast<std::size_t>(len) > m_chunkSize) {
+        LOG_WARN << "stream producer failed: " << len;
+        m_producer = nullptr;
+        return false;
+    }
+    if (len == 0) {
+        static const char LAST_CHUNK[] = "0\r\n\r\n";
+        m_producer = nullptr;
+        AddIov(LAST_CHUNK, sizeof(LAST_CHUNK) - 1);
+        return true;
     }
+    char prefix[CHUNK_PREFIX + 1];
+    const int prefixLen = std::snprintf(prefix, sizeof(prefix), "%zx\r\n", static_cast<std::size_t>(len));
+    std::memcpy(data - prefixLen, prefix, static_cast<std::size_t>(prefixLen));
+    data[len] = '\r';
+    data[len + 1] = '\n';
+    AddIov(data - prefixLen, static_cast<std::size_t>(prefixLen + len + 2));
+    return true;
 }
 
 bool HttpConn::AddResponse(const char * format, ...) {
-    if (m_writeIndex >= WRITE_BUFFER_SIZE) {
+    if (m_writeIndex >= m_writeSize) {
         return false;
     }
 
     va_list args;
     va_start(args, format);
-    const int remainSize = WRITE_BUFFER_SIZE - 1 - m_writeIndex;
+    const int remainSize = static_cast<int>(m_writeSize - 1 - m_writeIndex);
     auto len = vsnprintf(&m_writeBuffer[m_writeIndex], remainSize, format, args);
     if (len >= remainSize) {
         va_end(args); // 提前释放参数列表，避免资源泄漏
@@ -391,15 +1560,19 @@ bool HttpConn::AddResponse(const char * format, ...) {
 }
 
 bool HttpConn::AddStatusLine(int status, const char *title) {
-    return AddResponse("HTTP/1.1 %d %s\r\n", status, title);
+    if (!AddResponse("HTTP/1.1 %d %s\r\n", status, title)) {
+        return false;
+    }
+    // 站点配置的头部，如X-Frame-Options
+    return m_site == nullptr || m_site->headers.empty() || AddResponse("%s", m_site->headers.c_str());
 }
 
-bool HttpConn::AddContentLength(int contentLength) {
-    return AddResponse("Content-Length: %d\r\n", contentLength);
+bool HttpConn::AddContentLength(std::size_t contentLength) {
+    return AddResponse("Content-Length: %zu\r\n", contentLength);
 }
 
 bool HttpConn::AddContentType() {
-    return AddResponse("Content-Type:%s\r\n", "text/html");
+    return AddResponse("Content-Type:%s\r\n", m_contentType);
 }
 
 bool HttpConn::AddLinger() {
@@ -410,18 +1583,90 @@ bool HttpConn::AddBlankLine() {
     return AddResponse("%s", "\r\n");
 }
 
-bool HttpConn::AddHeader(int contentLength) {
-    AddContentLength(contentLength);
-    AddContentType();
-    AddLinger();
-    AddBlankLine();
+bool HttpConn::AddHeader(std::size_t contentLength) {
+    return AddContentLength(contentLength) && AddContentType() &&
+        AddLinger() && AddBlankLine();
 }
 
 bool HttpConn::AddContent(const char *content) {
     return AddResponse("%s", content);
 }
 
+const char* http::MethodName(HTTP_METHOD method) {
+    static const char* const NAMES[] = {
+        "GET", "POST", "HEAD", "PUT", "DELETE", "TRACE", "OPTIONS", "CONNECT"
+    };
+    return NAMES[static_cast<int>(method)];
+}
+
+int HttpConn::StatusOf(http::HTTP_CODE ret) {
+    switch (ret) {
+        case http::HTTP_CODE::FILE_REQUEST:
+        case http::HTTP_CODE::DYNAMIC_REQUEST:
+        case http::HTTP_CODE::STREAM_REQUEST:
+            return 200;
+        case http::HTTP_CODE::BAD_REQUEST:
+            return 400;
+        case http::HTTP_CODE::FORBIDDEN_REQUEST:
+            return 403;
+        case http::HTTP_CODE::NO_RESOURCE:
+            return 404;
+        case http::HTTP_CODE::PARTIAL_REQUEST:
+            return 206;
+        case http::HTTP_CODE::NOT_MODIFIED:
+            return 304;
+        case http::HTTP_CODE::RANGE_NOT_SATISFIABLE:
+            return 416;
+        case http::HTTP_CODE::METHOD_NOT_ALLOWED:
+            return 405;
+        case http::HTTP_CODE::PAYLOAD_TOO_LARGE:
+            return 413;
+        case http::HTTP_CODE::BAD_GATEWAY:
+            return 502;
+        case http::HTTP_CODE::GATEWAY_TIMEOUT:
+            return 504;
+        case http::HTTP_CODE::WEBSOCKET_REQUEST:
+            return 101;
+        default:
+            return 500;
+    }
+}
+
 bool HttpConn::ProcessWrite(http::HTTP_CODE ret) {
+    metrics::Registry::Instance().RecordStatus(StatusOf(ret));
+    if (!BuildResponse(ret)) {
+        return false;
+    }
+    if (m_method == http::HTTP_METHOD::HEAD) {
+        DropBody();
+    }
+    return true;
+}
+
+/*
+ * HEAD的响应头部与GET相同(包括Content-Length)，但不能带响应体，否则保持连接时对端会把它当作下一个响应。
+ * 头部可能跨越多个iovec(打包的资源)，错误页面的响应体也在m_writeBuffer中，按"\r\n\r\n"截断。
+ */
+void HttpConn::DropBody() {
+    m_producer = nullptr;
+    uint32_t last = 0;
+    std::size_t bytes = 0;
+    for (std::size_t i = 0; i < m_iv.size(); ++i) {
+        const char* base = static_cast<const char*>(m_iv[i].iov_base);
+        for (std::size_t j = 0; j < m_iv[i].iov_len; ++j) {
+            last = (last << 8) | static_cast<unsigned char>(base[j]);
+            if (last == 0x0D0A0D0A) {
+                m_iv[i].iov_len = j + 1;
+                m_iv.resize(i + 1);
+                m_bytesToSend = bytes + j + 1;
+                return;
+            }
+        }
+        bytes += m_iv[i].iov_len;
+    }
+}
+
+bool HttpConn::BuildResponse(http::HTTP_CODE ret) {
     switch (ret) {
         case http::HTTP_CODE::INTERNAL_ERROR:
             AddStatusLine(500, http::status::ERROR_500_TITLE);
@@ -455,33 +1700,281 @@ bool HttpConn::ProcessWrite(http::HTTP_CODE ret) {
                 return false;
             }
             break;
+        case http::HTTP_CODE::METHOD_NOT_ALLOWED:
+            AddStatusLine(405, http::status::ERROR_405_TITLE);
+            AddResponse("Allow: %s\r\n", http::Router::AllowHeader(m_allowed).c_str());
+            AddHeader(strlen(http::status::ERROR_405_FORM));
+            if (!AddContent(http::status::ERROR_405_FORM)) {
+                LOG_ERROR << "Add Content failed!!!";
+                return false;
+            }
+            break;
+        case http::HTTP_CODE::PAYLOAD_TOO_LARGE:
+            AddStatusLine(413, http::status::ERROR_413_TITLE);
+            AddHeader(strlen(http::status::ERROR_413_FORM));
+            if (!AddContent(http::status::ERROR_413_FORM)) {
+                LOG_ERROR << "Add Content failed!!!";
+                return false;
+            }
+            break;
+        case http::HTTP_CODE::BAD_GATEWAY:
+            AddStatusLine(502, http::status::ERROR_502_TITLE);
+            AddHeader(strlen(http::status::ERROR_502_FORM));
+            if (!AddContent(http::status::ERROR_502_FORM)) {
+                LOG_ERROR << "Add Content failed!!!";
+                return false;
+            }
+            break;
+        case http::HTTP_CODE::GATEWAY_TIMEOUT:
+            AddStatusLine(504, http::status::ERROR_504_TITLE);
+            AddHeader(strlen(http::status::ERROR_504_FORM));
+            if (!AddContent(http::status::ERROR_504_FORM)) {
+                LOG_ERROR << "Add Content failed!!!";
+                return false;
+            }
+            break;
+        case http::HTTP_CODE::WEBSOCKET_REQUEST:
+            // 101没有响应体
+            if (!AddStatusLine(101, http::status::SWITCHING_101_TITLE) ||
+                !AddResponse("Upgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: %s\r\n",
+                    m_ws->m_accept.c_str()) ||
+                !AddBlankLine()) {
+                return false;
+            }
+            break;
+        case http::HTTP_CODE::RANGE_NOT_SATISFIABLE:
+            AddStatusLine(416, http::status::ERROR_416_TITLE);
+            AddResponse("Content-Range: bytes */%llu\r\n",
+                static_cast<unsigned long long>(m_fileStat.st_size));
+            AddHeader(strlen(http::status::ERROR_416_FORM));
+            if (!AddContent(http::status::ERROR_416_FORM)) {
+                LOG_ERROR << "Add Content failed!!!";
+                return false;
+            }
+            break;
+        case http::HTTP_CODE::NOT_MODIFIED:
+            // 304没有响应体，也不带Content-Length
+            if (!AddStatusLine(304, http::status::NOT_MODIFIED_304_TITLE) ||
+                !AddValidators() || !AddLinger() || !AddBlankLine()) {
+                return false;
+            }
+            break;
         case http::HTTP_CODE::FILE_REQUEST:
+            if (m_asset != nullptr) {
+                return AddAsset();
+            }
             AddStatusLine(200, http::status::OK_200_TITLE);
+            AddResponse("Accept-Ranges: bytes\r\n");
+            AddValidators();
+            if (m_gzipBody) {
+                AddResponse("Content-Encoding: gzip\r\n");
+                AddHeader(m_gzipBody->size());
+                AddIov(m_writeBuffer, m_writeIndex);
+                AddIov(m_gzipBody->data(), m_gzipBody->size());
+                return true;
+            }
             AddHeader(m_fileStat.st_size);
-            m_iv[0].iov_base = m_writeBuffer.data();
-            m_iv[0].iov_len = m_writeIndex;
-            m_iv[1].iov_base = m_fileAddress;
-            m_iv[1].iov_len = m_fileStat.st_size;
-            m_ivCount = 2;
-            m_bytesToSend = m_writeIndex + m_fileStat.st_size;
+            AddIov(m_writeBuffer, m_writeIndex);
+            AddIov(m_fileAddress, m_fileStat.st_size);
+            return true;
+        case http::HTTP_CODE::PARTIAL_REQUEST:
+            return AddRanges();
+        case http::HTTP_CODE::DYNAMIC_REQUEST:
+            AddStatusLine(200, http::status::OK_200_TITLE);
+            AddHeader(m_dynamicContent.size());
+            AddIov(m_writeBuffer, m_writeIndex);
+            AddIov(m_dynamicContent.data(), m_dynamicContent.size());
+            return true;
+        case http::HTTP_CODE::STREAM_REQUEST:
+            // 长度未知，这里只写头部，响应体在Write()中逐块生成
+            if (!m_producer || !AddStatusLine(200, http::status::OK_200_TITLE) ||
+                !AddResponse("Transfer-Encoding: chunked\r\n") || !AddContentType() ||
+                !AddLinger() || !AddBlankLine()) {
+                return false;
+            }
+            AddIov(m_writeBuffer, m_writeIndex);
             return true;
         default:
             return false;
     }
-    m_iv[0].iov_base = m_writeBuffer.data();
-    m_iv[0].iov_len = m_writeIndex;
-    m_ivCount = 1;
-    m_bytesToSend = m_writeIndex;
+    AddIov(m_writeBuffer, m_writeIndex);
+    return true;
+}
+
+bool HttpConn::AddValidators() {
+    if (!AddResponse("ETag: %s\r\nLast-Modified: %s\r\n", m_etag.c_str(),
+            FormatHttpDate(m_fileStat.st_mtime).c_str())) {
+        return false;
+    }
+    if (m_compressible && !AddResponse("Vary: Accept-Encoding\r\n")) {
+        return false;
+    }
+    const std::string* cacheControl = CacheControl();
+    return cacheControl == nullptr ||
+        AddResponse("Cache-Control: %s\r\n", cacheControl->c_str());
+}
+
+bool HttpConn::AddAsset() {
+    const std::string* cacheControl = CacheControl();
+    if ((cacheControl != nullptr && !AddResponse("Cache-Control: %s\r\n", cacheControl->c_str())) ||
+        !AddLinger() || !AddBlankLine()) {
+        return false;
+    }
+    AddIov(m_asset->head, m_asset->headLen);
+    AddIov(m_writeBuffer, m_writeIndex);
+    AddIov(m_asset->body, m_asset->bodyLen);
+    return true;
+}
+
+/*
+ * 响应体直接指向文件映射区中的各个区间，不拷贝文件数据；
+ * 多个区间时各部分的头部先全部写进m_partHeaders，再按顺序和文件片段交错排进iovec。
+ */
+bool HttpConn::AddRanges() {
+    const unsigned long long size = static_cast<unsigned long long>(m_fileStat.st_size);
+    const char* body = m_asset != nullptr ? m_asset->body : m_fileAddress;
+    AddStatusLine(206, http::status::PARTIAL_206_TITLE);
+    AddResponse("Accept-Ranges: bytes\r\n");
+    AddValidators();
+    if (m_ranges.size() == 1) {
+        const auto& range = m_ranges.front();
+        AddResponse("Content-Range: bytes %llu-%llu/%llu\r\n",
+            static_cast<unsigned long long>(range.first),
+            static_cast<unsigned long long>(range.second), size);
+        if (!AddHeader(range.second - range.first + 1)) {
+            return false;
+        }
+        AddIov(m_writeBuffer, m_writeIndex);
+        AddIov(body + range.first, range.second - range.first + 1);
+        return true;
+    }
+
+    char boundary[32];
+    std::snprintf(boundary, sizeof(boundary), "ws%016llx",
+        static_cast<unsigned long long>(m_requestId * 0x9E3779B97F4A7C15ULL ^ m_fileStat.st_ino));
+    std::vector<std::size_t> partEnds;
+    partEnds.reserve(m_ranges.size() + 1);
+    std::size_t contentLength = 0;
+    for (const auto& range : m_ranges) {
+        m_partHeaders += "\r\n--";
+        m_partHeaders += boundary;
+        m_partHeaders += "\r\nContent-Type: ";
+        m_partHeaders += m_contentType;
+        m_partHeaders += "\r\nContent-Range: bytes " + std::to_string(range.first) + "-" +
+            std::to_string(range.second) + "/" + std::to_string(size) + "\r\n\r\n";
+        partEnds.push_back(m_partHeaders.size());
+        contentLength += range.second - range.first + 1;
+    }
+    m_partHeaders += "\r\n--";
+    m_partHeaders += boundary;
+    m_partHeaders += "--\r\n";
+    contentLength += m_partHeaders.size();
+
+    if (!AddContentLength(contentLength) ||
+        !AddResponse("Content-Type: multipart/byteranges; boundary=%s\r\n", boundary) ||
+        !AddLinger() || !AddBlankLine()) {
+        return false;
+    }
+    AddIov(m_writeBuffer, m_writeIndex);
+    std::size_t partStart = 0;
+    for (std::size_t i = 0; i < m_ranges.size(); ++i) {
+        AddIov(m_partHeaders.data() + partStart, partEnds[i] - partStart);
+        AddIov(body + m_ranges[i].first, m_ranges[i].second - m_ranges[i].first + 1);
+        partStart = partEnds[i];
+    }
+    AddIov(m_partHeaders.data() + partStart, m_partHeaders.size() - partStart);
     return true;
 }
 
 
 void HttpConn::Process() {
+    trace::Emit(trace::Event::DEQUEUE, m_requestId);
+    if (m_ws) {
+        // 已升级：reactor收到的完整消息交给onMessage
+        std::shared_ptr<http::WebSocket> ws = m_ws;
+        ws->Dispatch();
+        return;
+    }
+    if (!m_h2 && m_checkState == http::CHECK_STATE::CHECK_STATE_REQUESTLINE && m_checkedIndex == 0 &&
+        http::Http2Session::Enabled() &&
+        http::Http2Session::IsPreface(m_readBuffer, m_readIndex)) {
+        if (m_readIndex < http::Http2Session::PREFACE_LEN) {
+            ModFD(m_epollfd.load(), m_sockfd, EPOLLIN);
+            return;
+        }
+        // 连接前言之后的字节(SETTINGS等)转交给会话，之后不再走HTTP/1.1的解析
+        m_h2.reset(new http::Http2Session(*this));
+        m_h2->Feed(m_readBuffer + http::Http2Session::PREFACE_LEN,
+            m_readIndex - http::Http2Session::PREFACE_LEN);
+        m_readIndex = 0;
+        m_requestStart = 0;
+    }
+    if (m_h2) {
+        m_h2->Process();
+        while (ReadPending()) {
+            m_h2->Process();
+        }
+        if (m_h2->Write(false) == http::WRITE_RESULT::CLOSE) {
+            CloseConn();
+        }
+        return;
+    }
     http::HTTP_CODE readRet = ProcessRead();
+    while (readRet == http::HTTP_CODE::NO_REQUEST && ReadPending()) {
+        readRet = ProcessRead();
+    }
+    trace::Emit(trace::Event::PARSE, m_requestId, static_cast<int64_t>(readRet));
+    WEBSERVER_PROBE2(process_read, m_sockfd, static_cast<int>(readRet));
     if (readRet == http::HTTP_CODE::NO_REQUEST) {
         ModFD(m_epollfd.load(), m_sockfd, EPOLLIN);
         return;
     }
+    if (readRet == http::HTTP_CODE::CLOSED_CONNECTION) {
+        CloseConn();
+        return;
+    }
+    if (readRet == http::HTTP_CODE::REJECTED) {
+        Reject(m_rejectStatus);
+        return;
+    }
+    if (readRet == http::HTTP_CODE::DEFERRED_REQUEST && m_deferred) {
+        // 等待期间只监听对端关闭；重新注册后reactor可能随时关闭连接，先留一份引用
+        std::shared_ptr<http::Deferred> deferred = m_deferred;
+        metrics::Add(metrics::Gauge::DEFERRED_PENDING, 1);
+        ModFD(m_epollfd.load(), m_sockfd, 0);
+        deferred->Release();
+        return;
+    }
+    if (m_deferred) {
+        LOG_WARN << "handler called Defer() but returned " << static_cast<int>(readRet);
+        m_deferred.reset();
+    }
+    if (readRet == http::HTTP_CODE::PROXY_REQUEST && m_proxy) {
+        // 之后由reactor转发，只在需要时注册事件；同上，先留一份引用
+        std::shared_ptr<http::ProxyExchange> proxy = m_proxy;
+        ModFD(m_epollfd.load(), m_sockfd, 0);
+        http::Proxy::Instance().Submit(std::move(proxy));
+        return;
+    }
+    if (m_proxy) {
+        LOG_WARN << "handler called ProxyPass() but returned " << static_cast<int>(readRet);
+        m_proxy.reset();
+    }
+    if (readRet == http::HTTP_CODE::WEBSOCKET_REQUEST && m_ws) {
+        // 101写完之前不读取，头部之后已经读到的字节交给WebSocket
+        if (!ProcessWrite(readRet)) {
+            m_ws.reset();
+            CloseConn();
+            return;
+        }
+        m_ws->Accepted(m_readBuffer + m_checkedIndex, m_readIndex - m_checkedIndex);
+        ModFD(m_epollfd.load(), m_sockfd, EPOLLOUT);
+        return;
+    }
+    if (m_ws) {
+        LOG_WARN << "handler called AcceptWebSocket() but returned " << static_cast<int>(readRet);
+        m_ws.reset();
+    }
 
     bool writeRet = ProcessWrite(readRet);
     if (!writeRet) {
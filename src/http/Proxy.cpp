@@ -0,0 +1,1413 @@
+//
+// Created by asujy on 2026/10/19.
+//
+
+#include "http/Proxy.h"
+#include "log/Logger.h"
+#include "common-lib/Utils.h"
+#include "metrics/Metrics.h"
+#include "trace/Tracer.h"
+#include "tls/Tls.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace http {
+    constexpr std::size_t Proxy::MAX_HEAD_SIZE;
+    constexpr std::size_t Proxy::BUFFER_SIZE;
+    constexpr std::size_t Proxy::PIPE_SIZE;
+    constexpr std::size_t Proxy::STEP_BYTES;
+
+    struct Proxy::Server {
+        std::string name;           // 配置中的地址
+        std::string host;           // 请求没有Host时使用，也用于健康检查
+        sockaddr_storage addr{};
+        socklen_t addrLen{0};
+        bool tcp{true};
+        bool healthy{true};
+        std::vector<Peer*> idle;    // 空闲连接，最近放回的在后面
+        Peer* probe{nullptr};       // 正在进行的健康检查
+        uint64_t nextProbe{0};
+    };
+
+    struct Proxy::Peer {
+        int fd{-1};
+        Server* server{nullptr};
+        int pipe[2]{-1, -1};        // splice用的管道，第一次需要时创建，随连接复用
+        ProxyExchange* exchange{nullptr};  // 空闲时为nullptr
+        bool connecting{false};
+        bool probe{false};
+        uint64_t since{0};          // 放回连接池或开始探测的时间
+        std::string probeBuffer;
+    };
+
+    struct Upstream {
+        std::vector<std::unique_ptr<Proxy::Server>> servers;
+        std::size_t next{0};        // 轮流分配的下一个地址
+    };
+
+    struct ProxyExchange {
+        enum class STATE : int {
+            QUEUED = 0,     // 还没交给reactor
+            CONNECT,        // 等待上游连接建立
+            REQUEST,        // 发送请求头和请求体
+            RESPONSE_HEAD,  // 等待上游的响应头
+            RESPONSE_BODY   // 转发响应体
+        };
+
+        enum class BODY : int {
+            NONE = 0,
+            LENGTH,
+            CHUNKED,
+            UNTIL_CLOSE     // 没有长度的响应，上游关闭连接时结束
+        };
+
+        static constexpr std::size_t NOT_ACTIVE = static_cast<std::size_t>(-1);
+
+        HttpConn* conn{nullptr};
+        Upstream* upstream{nullptr};
+        Proxy::Peer* peer{nullptr};
+        std::size_t index{NOT_ACTIVE};  // 在Proxy::m_active中的位置
+        STATE state{STATE::QUEUED};
+        bool cancelled{false};
+        int clientEvents{0};            // 客户端socket上注册的事件，-1表示一次性事件已触发
+        bool waitingClient{false};      // 在等客户端(不计上游超时)
+        uint64_t connectStart{0};
+        uint64_t lastUpstream{0};       // 上游最近一次读写的时间
+        std::size_t attempts{0};
+        bool replayed{false};
+        bool idempotent{true};
+        bool reused{false};
+
+        std::string out;                // 请求头和已经读进客户端缓冲区的请求体
+        std::size_t outSent{0};
+        BODY requestBody{BODY::NONE};
+        uint64_t requestRemaining{0};
+        ChunkScanner requestChunks;
+        bool requestRead{true};         // 请求体已经全部从客户端读出
+        bool bodyRead{false};           // 从客户端socket读过请求体，不能再重发
+        bool clientReusable{true};
+
+        std::string in;                 // 上游的响应头
+        int status{0};
+        BODY responseBody{BODY::NONE};
+        uint64_t responseRemaining{0};
+        ChunkScanner responseChunks;
+        bool responseDone{false};
+        bool upstreamReusable{true};
+        bool keepAlive{false};          // 响应后保持客户端连接
+        std::string head;               // 改写后的响应头和跟在后面的部分响应体
+        std::size_t headSent{0};
+        bool responded{false};          // 已经向客户端写过数据，出错时只能关闭连接
+
+        std::vector<char> buffer;       // 不能splice时的转发缓冲区
+        std::size_t bufferOff{0};
+        std::size_t bufferLen{0};
+        std::size_t piped{0};           // 管道中还没写出的字节
+    };
+
+    namespace {
+        uint64_t MsToNanos(int ms) {
+            return static_cast<uint64_t>(ms) * 1000000ULL;
+        }
+
+        // line以name开头且紧跟':'，不区分大小写
+        bool HeaderIs(const char* line, std::size_t len, const char* name) {
+            const std::size_t nameLen = std::strlen(name);
+            return len > nameLen && line[nameLen] == ':' && strncasecmp(line, name, nameLen) == 0;
+        }
+
+        // 去掉首尾空白的头部值
+        std::string HeaderValueOf(const char* line, std::size_t len) {
+            const char* colon = static_cast<const char*>(std::memchr(line, ':', len));
+            if (colon == nullptr) {
+                return {};
+            }
+            const char* begin = colon + 1;
+            const char* end = line + len;
+            while (begin < end && (*begin == ' ' || *begin == '\t')) {
+                ++begin;
+            }
+            while (end > begin && (end[-1] == ' ' || end[-1] == '\t')) {
+                --end;
+            }
+            std::string value(begin, end);
+            for (auto& ch : value) {
+                ch = static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
+            }
+            return value;
+        }
+
+        bool ResolveAddress(const std::string& name, sockaddr_storage& addr, socklen_t& addrLen,
+                            bool& tcp, std::string& host) {
+            if (name.compare(0, 5, "unix:") == 0) {
+                const std::string path = name.substr(5);
+                sockaddr_un* un = reinterpret_cast<sockaddr_un*>(&addr);
+                if (path.empty() || path.size() >= sizeof(un->sun_path)) {
+                    return false;
+                }
+                std::memset(&addr, 0, sizeof(addr));
+                un->sun_family = AF_UNIX;
+                std::memcpy(un->sun_path, path.c_str(), path.size() + 1);
+                addrLen = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + path.size() + 1);
+                tcp = false;
+                host = "localhost";
+                return true;
+            }
+            const auto colon = name.rfind(':');
+            if (colon == std::string::npos || colon + 1 == name.size()) {
+                return false;
+            }
+            std::string node = name.substr(0, colon);
+            if (node.size() >= 2 && node.front() == '[' && node.back() == ']') {
+                node = node.substr(1, node.size() - 2);
+            }
+            struct addrinfo hints{};
+            hints.ai_family = AF_UNSPEC;
+            hints.ai_socktype = SOCK_STREAM;
+            hints.ai_flags = AI_NUMERICSERV;
+            struct addrinfo* result = nullptr;
+            const int ret = getaddrinfo(node.c_str(), name.c_str() + colon + 1, &hints, &result);
+            if (ret != 0 || result == nullptr) {
+                LOG_ERROR << "resolve upstream " << name << " failed: " << gai_strerror(ret);
+                return false;
+            }
+            std::memcpy(&addr, result->ai_addr, result->ai_addrlen);
+            addrLen = result->ai_addrlen;
+            freeaddrinfo(result);
+            tcp = true;
+            host = name;
+            return true;
+        }
+    }
+
+    void ChunkScanner::Reset() {
+        m_state = STATE::SIZE;
+        m_remaining = 0;
+        m_digits = 0;
+    }
+
+    std::size_t ChunkScanner::Feed(const char* data, std::size_t len) {
+        std::size_t i = 0;
+        while (i < len && m_state != STATE::DONE && m_state != STATE::BAD) {
+            const unsigned char c = static_cast<unsigned char>(data[i]);
+            switch (m_state) {
+                case STATE::SIZE:
+                    if (std::isxdigit(c)) {
+                        // 超过15位十六进制的块大小不合理
+                        if (++m_digits > 15) {
+                            m_state = STATE::BAD;
+                            break;
+                        }
+                        const int lower = std::tolower(c);
+                        m_remaining = m_remaining * 16 +
+                            static_cast<uint64_t>(lower <= '9' ? lower - '0' : lower - 'a' + 10);
+                        ++i;
+                    } else if (m_digits == 0) {
+                        m_state = STATE::BAD;
+                    } else {
+                        m_state = STATE::EXTENSION;
+                    }
+                    break;
+                case STATE::EXTENSION:
+                    // ;扩展和行尾的CR原样转发
+                    ++i;
+                    if (c == '\n') {
+                        m_digits = 0;
+                        m_state = m_remaining == 0 ? STATE::TRAILER_START : STATE::DATA;
+                    }
+                    break;
+                case STATE::DATA: {
+                    const std::size_t take = static_cast<std::size_t>(
+                        std::min<uint64_t>(len - i, m_remaining));
+                    i += take;
+                    m_remaining -= take;
+                    if (m_remaining == 0) {
+                        m_state = STATE::DATA_CR;
+                    }
+                    break;
+                }
+                case STATE::DATA_CR:
+                    m_state = c == '\r' ? STATE::DATA_LF : STATE::BAD;
+                    i += c == '\r' ? 1 : 0;
+                    break;
+                case STATE::DATA_LF:
+                    m_state = c == '\n' ? STATE::SIZE : STATE::BAD;
+                    i += c == '\n' ? 1 : 0;
+                    break;
+                case STATE::TRAILER_START:
+                    if (c == '\r') {
+                        ++i;
+                        m_state = STATE::LAST_LF;
+                    } else if (c == '\n') {
+                        ++i;
+                        m_state = STATE::DONE;
+                    } else {
+                        m_state = STATE::TRAILER;
+                    }
+                    break;
+                case STATE::TRAILER:
+                    ++i;
+                    if (c == '\n') {
+                        m_state = STATE::TRAILER_START;
+                    }
+                    break;
+                case STATE::LAST_LF:
+                    m_state = c == '\n' ? STATE::DONE : STATE::BAD;
+                    i += c == '\n' ? 1 : 0;
+                    break;
+                default:
+                    break;
+            }
+        }
+        return i;
+    }
+
+    Proxy::Proxy() = default;
+
+    Proxy::~Proxy() {
+        for (Peer* peer : m_peers) {
+            if (peer != nullptr) {
+                close(peer->fd);
+                if (peer->pipe[0] != -1) {
+                    close(peer->pipe[0]);
+                    close(peer->pipe[1]);
+                }
+                delete peer;
+            }
+        }
+        if (m_eventFd >= 0) {
+            close(m_eventFd);
+        }
+        if (m_timerFd >= 0) {
+            close(m_timerFd);
+        }
+    }
+
+    Upstream* Proxy::AddUpstream(const std::vector<std::string>& servers) {
+        std::unique_ptr<Upstream> upstream(new Upstream);
+        for (const auto& name : servers) {
+            std::unique_ptr<Server> server(new Server);
+            server->name = name;
+            if (!ResolveAddress(name, server->addr, server->addrLen, server->tcp, server->host)) {
+                LOG_ERROR << "invalid upstream address: " << name;
+                return nullptr;
+            }
+            upstream->servers.push_back(std::move(server));
+        }
+        if (upstream->servers.empty()) {
+            return nullptr;
+        }
+        m_upstreams.push_back(std::move(upstream));
+        return m_upstreams.back().get();
+    }
+
+    bool Proxy::Start(int epollfd) {
+        m_epollfd = epollfd;
+        m_eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        m_timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (m_eventFd < 0 || m_timerFd < 0) {
+            LOG_ERROR << "create proxy eventfd/timerfd failed: " << std::strerror(errno);
+            return false;
+        }
+        struct itimerspec spec{};
+        spec.it_interval.tv_nsec = TICK_MS * 1000000L;
+        spec.it_value = spec.it_interval;
+        if (timerfd_settime(m_timerFd, 0, &spec, nullptr) < 0) {
+            LOG_ERROR << "timerfd_settime failed: " << std::strerror(errno);
+            return false;
+        }
+        return true;
+    }
+
+    /*
+     * 在工作线程中调用，此时请求头已经解析完、请求体还没有消费。
+     * 请求头按读缓冲区中的原文转发(ParseLine把每行的CRLF换成了两个'\0')，去掉逐跳头部，
+     * 补上X-Forwarded-*；已经读进缓冲区的请求体一起放进out。
+     */
+    HTTP_CODE Proxy::Prepare(HttpConn& conn, Upstream* upstream) {
+        if (conn.m_sockfd == -1) {
+            LOG_WARN << "proxying is not supported on HTTP/2 streams";
+            return HTTP_CODE::BAD_GATEWAY;
+        }
+        std::shared_ptr<ProxyExchange> exchange = std::make_shared<ProxyExchange>();
+        ProxyExchange& ex = *exchange;
+        ex.conn = &conn;
+        ex.upstream = upstream;
+        ex.idempotent = conn.m_method != HTTP_METHOD::POST && conn.m_method != HTTP_METHOD::CONNECT;
+
+        std::string& out = ex.out;
+        out.reserve(conn.m_checkedIndex + 128);
+        out += MethodName(conn.m_method);
+        out += ' ';
+        out += conn.m_url;
+        out += " HTTP/1.1\r\n";
+        std::string forwardedFor;
+        bool hasHost = false;
+        int contentLengths = 0;
+        const char* p = conn.m_readBuffer + conn.m_headerStart;
+        const char* end = conn.m_readBuffer + conn.m_checkedIndex;
+        while (p < end && *p != '\0') {
+            const std::size_t len = std::strlen(p);
+            if (HeaderIs(p, len, "x-forwarded-for")) {
+                forwardedFor = HeaderValueOf(p, len);
+            } else if (HeaderIs(p, len, "content-length")) {
+                // 只转发解析时校验过的长度；多个Content-Length或与chunked同时出现时，
+                // 上游可能按另一个值分帧，造成请求走私
+                ++contentLengths;
+            } else if (!HeaderIs(p, len, "connection") && !HeaderIs(p, len, "keep-alive") &&
+                       !HeaderIs(p, len, "proxy-connection") && !HeaderIs(p, len, "te") &&
+                       !HeaderIs(p, len, "upgrade") && !HeaderIs(p, len, "expect") &&
+                       !HeaderIs(p, len, "x-forwarded-proto")) {
+                hasHost = hasHost || HeaderIs(p, len, "host");
+                out.append(p, len);
+                out += "\r\n";
+            }
+            p += len + 2;
+        }
+        if (contentLengths > 1) {
+            LOG_WARN << "refusing to proxy " << conn.m_url << " with " << contentLengths << " content-length headers";
+            conn.m_linger = false;
+            return HTTP_CODE::BAD_REQUEST;
+        }
+        if (contentLengths == 1 && !conn.m_chunked) {
+            out += "Content-Length: ";
+            out += std::to_string(conn.m_contentLength);
+            out += "\r\n";
+        }
+        if (!hasHost) {
+            out += "Host: ";
+            out += upstream->servers.front()->host;
+            out += "\r\n";
+        }
+        out += "X-Forwarded-For: ";
+        if (!forwardedFor.empty()) {
+            out += forwardedFor;
+            out += ", ";
+        }
+        out += conn.m_addr.Host();
+        out += conn.m_tls ? "\r\nX-Forwarded-Proto: https\r\n" : "\r\nX-Forwarded-Proto: http\r\n";
+        out += "Connection: keep-alive\r\n\r\n";
+
+        // 头部之后已经读进缓冲区的请求体
+        const char* body = conn.m_readBuffer + conn.m_checkedIndex;
+        const std::size_t buffered = conn.m_readIndex - conn.m_checkedIndex;
+        if (conn.m_chunked) {
+            ex.requestBody = ProxyExchange::BODY::CHUNKED;
+            const std::size_t used = ex.requestChunks.Feed(body, buffered);
+            if (ex.requestChunks.Bad()) {
+                conn.m_linger = false;
+                return HTTP_CODE::BAD_REQUEST;
+            }
+            out.append(body, used);
+            ex.requestRead = ex.requestChunks.Done();
+            // 请求体之后还有数据(流水线请求)，转发完这个请求后关闭连接
+            ex.clientReusable = used == buffered;
+        } else if (conn.m_contentLength != 0) {
+            ex.requestBody = ProxyExchange::BODY::LENGTH;
+            const std::size_t used = static_cast<std::size_t>(
+                std::min<uint64_t>(buffered, conn.m_contentLength));
+            out.append(body, used);
+            ex.requestRemaining = conn.m_contentLength - used;
+            ex.requestRead = ex.requestRemaining == 0;
+        }
+        conn.m_proxy = std::move(exchange);
+        return HTTP_CODE::PROXY_REQUEST;
+    }
+
+    void Proxy::Submit(std::shared_ptr<ProxyExchange> exchange) {
+        bool wasEmpty = false;
+        {
+            std::lock_guard<std::mutex> locker(m_mtx);
+            wasEmpty = m_queue.empty();
+            m_queue.push_back(std::move(exchange));
+        }
+        if (wasEmpty) {
+            const uint64_t one = 1;
+            ssize_t ret = write(m_eventFd, &one, sizeof(one));
+            (void)ret;
+        }
+    }
+
+    void Proxy::Drain() {
+        uint64_t count = 0;
+        ssize_t ret = read(m_eventFd, &count, sizeof(count));
+        (void)ret;
+        std::vector<std::shared_ptr<ProxyExchange>> ready;
+        {
+            std::lock_guard<std::mutex> locker(m_mtx);
+            ready.swap(m_queue);
+        }
+        for (const auto& exchange : ready) {
+            // 排队期间客户端已经断开
+            if (!exchange->cancelled) {
+                Begin(exchange);
+            }
+        }
+    }
+
+    void Proxy::Begin(const std::shared_ptr<ProxyExchange>& exchange) {
+        ProxyExchange& ex = *exchange;
+        ex.index = m_active.size();
+        m_active.push_back(exchange);
+        metrics::Inc(metrics::Counter::PROXY_REQUESTS);
+        if (!Connect(ex)) {
+            Fail(ex, HTTP_CODE::BAD_GATEWAY);
+            return;
+        }
+        Advance(ex);
+    }
+
+    Proxy::Server* Proxy::Pick(ProxyExchange& exchange) {
+        Upstream& upstream = *exchange.upstream;
+        const std::size_t count = upstream.servers.size();
+        // 每个地址最多试一次，复用的连接失效后可以多重发一次
+        if (exchange.attempts >= count + (exchange.replayed ? 1 : 0)) {
+            return nullptr;
+        }
+        for (std::size_t i = 0; i < count; ++i) {
+            Server* server = upstream.servers[upstream.next++ % count].get();
+            if (server->healthy) {
+                return server;
+            }
+        }
+        return nullptr;
+    }
+
+    bool Proxy::Connect(ProxyExchange& exchange) {
+        Server* server = nullptr;
+        while ((server = Pick(exchange)) != nullptr) {
+            ++exchange.attempts;
+            const uint64_t now = GetMonotonicNanos();
+            exchange.lastUpstream = now;
+            if (!server->idle.empty() && !exchange.replayed) {
+                Peer* peer = server->idle.back();
+                server->idle.pop_back();
+                metrics::Add(metrics::Gauge::PROXY_IDLE_CONNECTIONS, -1);
+                metrics::Inc(metrics::Counter::PROXY_REUSED);
+                peer->exchange = &exchange;
+                exchange.peer = peer;
+                exchange.reused = true;
+                exchange.state = ProxyExchange::STATE::REQUEST;
+                return true;
+            }
+            bool connected = false;
+            Peer* peer = OpenPeer(*server, connected);
+            if (peer == nullptr) {
+                MarkFailed(*server, "connect failed");
+                continue;
+            }
+            metrics::Inc(metrics::Counter::PROXY_CONNECTS);
+            peer->exchange = &exchange;
+            exchange.peer = peer;
+            exchange.reused = false;
+            exchange.connectStart = now;
+            exchange.state = connected ? ProxyExchange::STATE::REQUEST : ProxyExchange::STATE::CONNECT;
+            return true;
+        }
+        LOG_WARN << "no live upstream for " << exchange.conn->m_url;
+        return false;
+    }
+
+    Proxy::Peer* Proxy::OpenPeer(Server& server, bool& connected) {
+        const int fd = socket(server.addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            LOG_ERROR << "create upstream socket failed: " << std::strerror(errno);
+            return nullptr;
+        }
+        if (server.tcp) {
+            int nodelay = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+        }
+        const int ret = connect(fd, reinterpret_cast<const sockaddr*>(&server.addr), server.addrLen);
+        if (ret < 0 && errno != EINPROGRESS) {
+            LOG_WARN << "connect upstream " << server.name << " failed: " << std::strerror(errno);
+            close(fd);
+            return nullptr;
+        }
+        connected = ret == 0;
+        // 边沿触发，一直监听读写两个方向，只有读写返回EAGAIN后才等待事件
+        struct epoll_event event{};
+        event.data.fd = fd;
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        if (epoll_ctl(m_epollfd, EPOLL_CTL_ADD, fd, &event) < 0) {
+            LOG_ERROR << "add upstream socket to epoll failed: " << std::strerror(errno);
+            close(fd);
+            return nullptr;
+        }
+        Peer* peer = new Peer;
+        peer->fd = fd;
+        peer->server = &server;
+        peer->connecting = !connected;
+        if (static_cast<std::size_t>(fd) >= m_peers.size()) {
+            m_peers.resize(static_cast<std::size_t>(fd) + 1, nullptr);
+        }
+        m_peers[fd] = peer;
+        return peer;
+    }
+
+    void Proxy::ClosePeer(Peer* peer) {
+        epoll_ctl(m_epollfd, EPOLL_CTL_DEL, peer->fd, nullptr);
+        close(peer->fd);
+        if (peer->pipe[0] != -1) {
+            close(peer->pipe[0]);
+            close(peer->pipe[1]);
+        }
+        m_peers[peer->fd] = nullptr;
+        delete peer;
+    }
+
+    void Proxy::Release(Peer* peer, bool reusable) {
+        peer->exchange = nullptr;
+        Server& server = *peer->server;
+        if (!reusable || !server.healthy || server.idle.size() >= m_options.maxIdle) {
+            ClosePeer(peer);
+            return;
+        }
+        peer->since = GetMonotonicNanos();
+        server.idle.push_back(peer);
+        metrics::Add(metrics::Gauge::PROXY_IDLE_CONNECTIONS, 1);
+    }
+
+    void Proxy::MarkFailed(Server& server, const char* reason) {
+        // 没有健康检查时不摘除，否则之后再也不会恢复
+        if (m_options.healthInterval <= 0 || !server.healthy) {
+            return;
+        }
+        LOG_WARN << "upstream " << server.name << " marked down: " << reason;
+        server.healthy = false;
+        for (Peer* peer : server.idle) {
+            ClosePeer(peer);
+        }
+        metrics::Add(metrics::Gauge::PROXY_IDLE_CONNECTIONS, -static_cast<int64_t>(server.idle.size()));
+        server.idle.clear();
+    }
+
+    void Proxy::HandleEvent(int fd, uint32_t events) {
+        Peer* peer = m_peers[fd];
+        if (peer->probe) {
+            ProbeEvent(*peer, events);
+            return;
+        }
+        if (peer->exchange == nullptr) {
+            // 空闲连接上不应该有数据，可读说明上游关闭了连接；只有可写时是之前的ACK
+            if (!(events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))) {
+                return;
+            }
+            char c = 0;
+            if (!(events & (EPOLLHUP | EPOLLERR)) && recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) < 0 &&
+                errno == EAGAIN) {
+                return;
+            }
+            std::vector<Peer*>& idle = peer->server->idle;
+            idle.erase(std::remove(idle.begin(), idle.end(), peer), idle.end());
+            metrics::Add(metrics::Gauge::PROXY_IDLE_CONNECTIONS, -1);
+            ClosePeer(peer);
+            return;
+        }
+        ProxyExchange& ex = *peer->exchange;
+        if (ex.state == ProxyExchange::STATE::CONNECT) {
+            int err = 0;
+            socklen_t len = sizeof(err);
+            getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len);
+            if (err != 0) {
+                LOG_WARN << "connect upstream " << peer->server->name << " failed: " << std::strerror(err);
+                MarkFailed(*peer->server, std::strerror(err));
+                if (!Retry(ex, true)) {
+                    Fail(ex, HTTP_CODE::BAD_GATEWAY);
+                }
+                return;
+            }
+            if (!(events & EPOLLOUT)) {
+                return;
+            }
+            peer->connecting = false;
+            ex.state = ProxyExchange::STATE::REQUEST;
+        }
+        Advance(ex);
+    }
+
+    void Proxy::HandleClient(HttpConn& conn) {
+        if (!conn.m_proxy) {
+            return;
+        }
+        // 一次性事件已经触发，需要时重新注册
+        std::shared_ptr<ProxyExchange> exchange = conn.m_proxy;
+        exchange->clientEvents = -1;
+        if (exchange->state != ProxyExchange::STATE::QUEUED &&
+            exchange->state != ProxyExchange::STATE::CONNECT) {
+            Advance(*exchange);
+        } else {
+            ArmClient(*exchange, 0);
+        }
+    }
+
+    void Proxy::ArmClient(ProxyExchange& exchange, int events) {
+        if (exchange.clientEvents != events) {
+            ModFD(m_epollfd, exchange.conn->m_sockfd, events);
+            exchange.clientEvents = events;
+        }
+    }
+
+    /*
+     * 尽量向前推进：发送请求、读响应头、转发响应体，直到某一端返回EAGAIN。
+     * 上游没有等请求体发完就响应(如413)时，不再转发剩下的请求体，响应后关闭两端的连接。
+     * 调用后exchange可能已经被释放。
+     */
+    void Proxy::Advance(ProxyExchange& exchange) {
+        if (exchange.state == ProxyExchange::STATE::CONNECT) {
+            // 连接建立后由HandleEvent继续
+            ArmClient(exchange, 0);
+            return;
+        }
+        std::size_t moved = 0;
+        if (exchange.state == ProxyExchange::STATE::REQUEST) {
+            exchange.waitingClient = false;
+            const IO io = SendRequest(exchange, moved);
+            if (io == IO::DONE) {
+                exchange.state = ProxyExchange::STATE::RESPONSE_HEAD;
+            } else if (io == IO::CLIENT_GONE) {
+                Fail(exchange, HTTP_CODE::CLOSED_CONNECTION);
+                return;
+            } else if (io == IO::CLOSED || io == IO::FAILED) {
+                if (!Retry(exchange, false)) {
+                    Fail(exchange, HTTP_CODE::BAD_GATEWAY);
+                }
+                return;
+            }
+        }
+        if (exchange.state == ProxyExchange::STATE::REQUEST ||
+            exchange.state == ProxyExchange::STATE::RESPONSE_HEAD) {
+            const IO io = ReadHead(exchange);
+            if (io == IO::CLOSED) {
+                if (!Retry(exchange, false)) {
+                    Fail(exchange, HTTP_CODE::BAD_GATEWAY);
+                }
+                return;
+            } else if (io == IO::FAILED) {
+                Fail(exchange, HTTP_CODE::BAD_GATEWAY);
+                return;
+            } else if (io == IO::WAIT) {
+                if (!exchange.waitingClient) {
+                    ArmClient(exchange, 0);
+                }
+                return;
+            }
+            if (exchange.state == ProxyExchange::STATE::REQUEST) {
+                // 上游提前响应，丢掉还没转发的请求体，管道中的数据不能混进响应
+                Peer& peer = *exchange.peer;
+                exchange.upstreamReusable = false;
+                exchange.bufferLen = 0;
+                exchange.piped = 0;
+                if (peer.pipe[0] != -1) {
+                    close(peer.pipe[0]);
+                    close(peer.pipe[1]);
+                    peer.pipe[0] = peer.pipe[1] = -1;
+                }
+            }
+            exchange.state = ProxyExchange::STATE::RESPONSE_BODY;
+        }
+        exchange.waitingClient = false;
+        switch (SendResponse(exchange, moved)) {
+            case IO::DONE:
+                Finish(exchange);
+                return;
+            case IO::CLIENT_GONE:
+                Fail(exchange, HTTP_CODE::CLOSED_CONNECTION);
+                return;
+            case IO::FAILED:
+            case IO::CLOSED:
+                Fail(exchange, HTTP_CODE::BAD_GATEWAY);
+                return;
+            default:
+                break;
+        }
+        if (!exchange.waitingClient) {
+            ArmClient(exchange, 0);
+        }
+    }
+
+    Proxy::IO Proxy::SendRequest(ProxyExchange& exchange, std::size_t& moved) {
+        HttpConn& conn = *exchange.conn;
+        Peer& peer = *exchange.peer;
+        while (exchange.outSent < exchange.out.size()) {
+            const ssize_t n = send(peer.fd, exchange.out.data() + exchange.outSent,
+                exchange.out.size() - exchange.outSent, MSG_NOSIGNAL);
+            if (n < 0) {
+                return errno == EAGAIN ? IO::WAIT : IO::CLOSED;
+            }
+            exchange.outSent += static_cast<std::size_t>(n);
+            exchange.lastUpstream = GetMonotonicNanos();
+        }
+        if (exchange.requestBody == ProxyExchange::BODY::LENGTH && !conn.m_tls) {
+            const IO io = SpliceOut(exchange, conn.m_sockfd, peer.fd, false, exchange.requestRemaining, false, moved);
+            exchange.requestRead = exchange.requestRemaining == 0;
+            return io;
+        }
+        // TLS或分块编码：先解密/扫描，再从缓冲区写给上游
+        while (true) {
+            if (exchange.bufferLen > 0) {
+                const ssize_t n = send(peer.fd, exchange.buffer.data() + exchange.bufferOff,
+                    exchange.bufferLen, MSG_NOSIGNAL);
+                if (n < 0) {
+                    return errno == EAGAIN ? IO::WAIT : IO::FAILED;
+                }
+                exchange.bufferOff += static_cast<std::size_t>(n);
+                exchange.bufferLen -= static_cast<std::size_t>(n);
+                exchange.lastUpstream = GetMonotonicNanos();
+                continue;
+            }
+            if (exchange.requestRead) {
+                return IO::DONE;
+            }
+            if (moved >= STEP_BYTES) {
+                exchange.waitingClient = true;
+                ArmClient(exchange, EPOLLIN);
+                return IO::YIELD;
+            }
+            if (exchange.buffer.empty()) {
+                exchange.buffer.resize(BUFFER_SIZE);
+            }
+            const std::size_t want = exchange.requestBody == ProxyExchange::BODY::LENGTH ?
+                static_cast<std::size_t>(std::min<uint64_t>(exchange.requestRemaining, BUFFER_SIZE)) :
+                BUFFER_SIZE;
+            const ssize_t n = conn.Recv(exchange.buffer.data(), want);
+            if (n < 0 && errno == EAGAIN) {
+                exchange.waitingClient = true;
+                ArmClient(exchange, EPOLLIN);
+                return IO::WAIT;
+            }
+            if (n <= 0) {
+                return IO::CLIENT_GONE;
+            }
+            exchange.bodyRead = true;
+            metrics::Inc(metrics::Counter::BYTES_READ, static_cast<uint64_t>(n));
+            std::size_t used = static_cast<std::size_t>(n);
+            if (exchange.requestBody == ProxyExchange::BODY::CHUNKED) {
+                used = exchange.requestChunks.Feed(exchange.buffer.data(), used);
+                if (exchange.requestChunks.Bad()) {
+                    LOG_WARN << "bad chunked request body for " << conn.m_url;
+                    return IO::CLIENT_GONE;
+                }
+                exchange.requestRead = exchange.requestChunks.Done();
+                exchange.clientReusable = exchange.clientReusable && used == static_cast<std::size_t>(n);
+            } else {
+                exchange.requestRemaining -= used;
+                exchange.requestRead = exchange.requestRemaining == 0;
+            }
+            exchange.bufferOff = 0;
+            exchange.bufferLen = used;
+            moved += used;
+        }
+    }
+
+    /*
+     * from -> 管道 -> to。管道空了才从from读，所以读返回EAGAIN一定是from没有数据，
+     * 写返回EAGAIN一定是to写不下。toClient表示上游到客户端的方向。
+     */
+    Proxy::IO Proxy::SpliceOut(ProxyExchange& exchange, int from, int to, bool toClient,
+                               uint64_t& remaining, bool untilEof, std::size_t& moved) {
+        Peer& peer = *exchange.peer;
+        if (peer.pipe[0] == -1) {
+            if (pipe2(peer.pipe, O_NONBLOCK | O_CLOEXEC) < 0) {
+                LOG_ERROR << "pipe2 failed: " << std::strerror(errno);
+                peer.pipe[0] = peer.pipe[1] = -1;
+                return toClient ? IO::FAILED : IO::CLIENT_GONE;
+            }
+            fcntl(peer.pipe[1], F_SETPIPE_SZ, static_cast<int>(PIPE_SIZE));
+        }
+        while (true) {
+            if (exchange.piped > 0) {
+                const ssize_t n = splice(peer.pipe[0], nullptr, to, nullptr, exchange.piped,
+                    SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+                if (n < 0) {
+                    if (errno != EAGAIN) {
+                        return toClient ? IO::CLIENT_GONE : IO::FAILED;
+                    }
+                    if (toClient) {
+                        exchange.waitingClient = true;
+                        ArmClient(exchange, EPOLLOUT);
+                    }
+                    return IO::WAIT;
+                }
+                exchange.piped -= static_cast<std::size_t>(n);
+                metrics::Inc(metrics::Counter::PROXY_SPLICED_BYTES, static_cast<uint64_t>(n));
+                if (toClient) {
+                    exchange.responded = true;
+                    metrics::Inc(metrics::Counter::BYTES_WRITTEN, static_cast<uint64_t>(n));
+                } else {
+                    exchange.lastUpstream = GetMonotonicNanos();
+                }
+                continue;
+            }
+            if (!untilEof && remaining == 0) {
+                return IO::DONE;
+            }
+            if (moved >= STEP_BYTES) {
+                // 让出reactor，一次性事件重新注册后立即触发，下一轮继续
+                exchange.waitingClient = true;
+                ArmClient(exchange, toClient ? EPOLLOUT : EPOLLIN);
+                return IO::YIELD;
+            }
+            const std::size_t want = untilEof ? PIPE_SIZE :
+                static_cast<std::size_t>(std::min<uint64_t>(remaining, PIPE_SIZE));
+            const ssize_t n = splice(from, nullptr, peer.pipe[1], nullptr, want,
+                SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (n == 0) {
+                if (untilEof) {
+                    return IO::DONE;
+                }
+                return toClient ? IO::FAILED : IO::CLIENT_GONE;
+            }
+            if (n < 0) {
+                if (errno != EAGAIN) {
+                    return toClient ? IO::FAILED : IO::CLIENT_GONE;
+                }
+                if (!toClient) {
+                    exchange.waitingClient = true;
+                    ArmClient(exchange, EPOLLIN);
+                }
+                return IO::WAIT;
+            }
+            exchange.piped = static_cast<std::size_t>(n);
+            moved += static_cast<std::size_t>(n);
+            if (!untilEof) {
+                remaining -= static_cast<uint64_t>(n);
+            }
+            if (toClient) {
+                exchange.lastUpstream = GetMonotonicNanos();
+            } else {
+                exchange.bodyRead = true;
+                metrics::Inc(metrics::Counter::BYTES_READ, static_cast<uint64_t>(n));
+            }
+        }
+    }
+
+    Proxy::IO Proxy::ReadHead(ProxyExchange& exchange) {
+        std::string& in = exchange.in;
+        std::size_t searched = 0;
+        while (true) {
+            const std::size_t end = in.find("\r\n\r\n", searched);
+            if (end != std::string::npos) {
+                if (!ParseHead(exchange, end + 4)) {
+                    return IO::FAILED;
+                }
+                if (exchange.status != 0) {
+                    return IO::DONE;
+                }
+                // 1xx的临时响应已经丢弃，接着找真正的响应头
+                searched = 0;
+                continue;
+            }
+            searched = in.size() >= 3 ? in.size() - 3 : 0;
+            if (in.size() >= MAX_HEAD_SIZE) {
+                LOG_WARN << "upstream response head too large";
+                return IO::FAILED;
+            }
+            const std::size_t old = in.size();
+            in.resize(MAX_HEAD_SIZE);
+            const ssize_t n = recv(exchange.peer->fd, &in[old], MAX_HEAD_SIZE - old, 0);
+            in.resize(old + static_cast<std::size_t>(std::max<ssize_t>(n, 0)));
+            if (n < 0 && errno == EAGAIN) {
+                return IO::WAIT;
+            }
+            if (n <= 0) {
+                // 还没收到任何响应就断开，多半是上游关闭了池中的空闲连接
+                return old == 0 ? IO::CLOSED : IO::FAILED;
+            }
+            exchange.lastUpstream = GetMonotonicNanos();
+        }
+    }
+
+    /*
+     * 解析上游的响应头，生成发给客户端的响应头：状态行统一为HTTP/1.1，去掉逐跳头部，
+     * 按客户端的情况补上Connection。分块编码原样转发，所以保留Transfer-Encoding。
+     * 1xx响应被丢弃，此时status保持为0。
+     */
+    bool Proxy::ParseHead(ProxyExchange& exchange, std::size_t headLen) {
+        const std::string& in = exchange.in;
+        const std::size_t lineEnd = in.find("\r\n");
+        if (lineEnd < 12 || in.compare(0, 7, "HTTP/1.") != 0 || in[8] != ' ' ||
+            !std::isdigit(static_cast<unsigned char>(in[9])) ||
+            !std::isdigit(static_cast<unsigned char>(in[10])) ||
+            !std::isdigit(static_cast<unsigned char>(in[11]))) {
+            LOG_WARN << "bad upstream status line";
+            return false;
+        }
+        const int status = (in[9] - '0') * 100 + (in[10] - '0') * 10 + (in[11] - '0');
+        if (status / 100 == 1) {
+            if (status == 101) {
+                LOG_WARN << "protocol upgrade is not supported by the proxy";
+                return false;
+            }
+            exchange.in.erase(0, headLen);
+            return true;
+        }
+
+        bool close = in[7] == '0';  // HTTP/1.0默认不保持连接
+        bool chunked = false;
+        bool hasLength = false;
+        uint64_t length = 0;
+        std::vector<std::pair<std::size_t, std::size_t>> lines;  // 要转发的头部
+        std::size_t pos = lineEnd + 2;
+        while (pos + 2 <= headLen) {
+            const std::size_t next = in.find("\r\n", pos);
+            if (next == pos) {
+                break;
+            }
+            const char* line = in.data() + pos;
+            const std::size_t len = next - pos;
+            if (HeaderIs(line, len, "connection")) {
+                const std::string value = HeaderValueOf(line, len);
+                if (value.find("close") != std::string::npos) {
+                    close = true;
+                } else if (value.find("keep-alive") != std::string::npos) {
+                    close = false;
+                }
+            } else if (HeaderIs(line, len, "keep-alive") || HeaderIs(line, len, "proxy-connection")) {
+                // 逐跳头部不转发
+            } else if (HeaderIs(line, len, "transfer-encoding")) {
+                chunked = HeaderValueOf(line, len).find("chunked") != std::string::npos;
+                lines.emplace_back(pos, len);
+            } else if (HeaderIs(line, len, "content-length")) {
+                const std::string value = HeaderValueOf(line, len);
+                char* endp = nullptr;
+                errno = 0;
+                length = std::strtoull(value.c_str(), &endp, 10);
+                if (value.empty() || !std::isdigit(static_cast<unsigned char>(value[0])) ||
+                    *endp != '\0' || errno == ERANGE) {
+                    LOG_WARN << "bad upstream content-length: " << value;
+                    return false;
+                }
+                hasLength = true;
+                lines.emplace_back(pos, len);
+            } else {
+                lines.emplace_back(pos, len);
+            }
+            pos = next + 2;
+        }
+
+        using BODY = ProxyExchange::BODY;
+        const HttpConn& conn = *exchange.conn;
+        if (conn.m_method == HTTP_METHOD::HEAD || status == 204 || status == 304) {
+            exchange.responseBody = BODY::NONE;
+        } else if (chunked) {
+            exchange.responseBody = BODY::CHUNKED;
+        } else if (hasLength) {
+            exchange.responseBody = BODY::LENGTH;
+            exchange.responseRemaining = length;
+        } else {
+            // 只能以关闭连接表示结束，客户端连接也不能保持
+            exchange.responseBody = BODY::UNTIL_CLOSE;
+            close = true;
+            exchange.clientReusable = false;
+        }
+        exchange.status = status;
+        exchange.upstreamReusable = exchange.upstreamReusable && !close;
+        exchange.keepAlive = conn.m_linger && exchange.clientReusable &&
+            exchange.state != ProxyExchange::STATE::REQUEST;
+
+        std::string& head = exchange.head;
+        head.reserve(headLen + 64);
+        head.assign("HTTP/1.1");
+        head.append(in, 8, lineEnd + 2 - 8);
+        for (const auto& line : lines) {
+            // 同时有Content-Length和分块编码时以分块编码为准
+            if (chunked && HeaderIs(in.data() + line.first, line.second, "content-length")) {
+                continue;
+            }
+            head.append(in, line.first, line.second);
+            head += "\r\n";
+        }
+        head += exchange.keepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+
+        // 和响应头一起读到的响应体
+        const char* rest = in.data() + headLen;
+        const std::size_t restLen = in.size() - headLen;
+        std::size_t used = 0;
+        switch (exchange.responseBody) {
+            case BODY::LENGTH:
+                used = static_cast<std::size_t>(std::min<uint64_t>(restLen, exchange.responseRemaining));
+                exchange.responseRemaining -= used;
+                exchange.responseDone = exchange.responseRemaining == 0;
+                break;
+            case BODY::CHUNKED:
+                used = exchange.responseChunks.Feed(rest, restLen);
+                if (exchange.responseChunks.Bad()) {
+                    LOG_WARN << "bad chunked response from upstream";
+                    return false;
+                }
+                exchange.responseDone = exchange.responseChunks.Done();
+                break;
+            case BODY::UNTIL_CLOSE:
+                used = restLen;
+                break;
+            default:
+                exchange.responseDone = true;
+                break;
+        }
+        // 响应之后还有多余的数据，这个连接不能再用
+        if (used < restLen) {
+            exchange.upstreamReusable = false;
+        }
+        head.append(rest, used);
+        metrics::Registry::Instance().RecordStatus(status);
+        return true;
+    }
+
+    Proxy::IO Proxy::SendResponse(ProxyExchange& exchange, std::size_t& moved) {
+        HttpConn& conn = *exchange.conn;
+        while (exchange.headSent < exchange.head.size()) {
+            struct iovec iov{};
+            iov.iov_base = &exchange.head[exchange.headSent];
+            iov.iov_len = exchange.head.size() - exchange.headSent;
+            const ssize_t n = conn.Send(&iov, 1);
+            exchange.responded = true;
+            if (n < 0) {
+                if (errno != EAGAIN) {
+                    return IO::CLIENT_GONE;
+                }
+                exchange.waitingClient = true;
+                ArmClient(exchange, EPOLLOUT);
+                return IO::WAIT;
+            }
+            if (exchange.headSent == 0) {
+                trace::Emit(trace::Event::FIRST_BYTE, conn.m_requestId, n);
+            }
+            exchange.headSent += static_cast<std::size_t>(n);
+            metrics::Inc(metrics::Counter::BYTES_WRITTEN, static_cast<uint64_t>(n));
+        }
+        if (exchange.responseDone) {
+            return IO::DONE;
+        }
+
+        using BODY = ProxyExchange::BODY;
+        if (!conn.m_tls && (exchange.responseBody == BODY::LENGTH || exchange.responseBody == BODY::UNTIL_CLOSE)) {
+            const IO io = SpliceOut(exchange, exchange.peer->fd, conn.m_sockfd, true,
+                exchange.responseRemaining, exchange.responseBody == BODY::UNTIL_CLOSE, moved);
+            exchange.responseDone = io == IO::DONE;
+            return io;
+        }
+        while (true) {
+            if (exchange.bufferLen > 0) {
+                struct iovec iov{};
+                iov.iov_base = exchange.buffer.data() + exchange.bufferOff;
+                iov.iov_len = exchange.bufferLen;
+                const ssize_t n = conn.Send(&iov, 1);
+                exchange.responded = true;
+                if (n < 0) {
+                    if (errno != EAGAIN) {
+                        return IO::CLIENT_GONE;
+                    }
+                    exchange.waitingClient = true;
+                    ArmClient(exchange, EPOLLOUT);
+                    return IO::WAIT;
+                }
+                exchange.bufferOff += static_cast<std::size_t>(n);
+                exchange.bufferLen -= static_cast<std::size_t>(n);
+                metrics::Inc(metrics::Counter::BYTES_WRITTEN, static_cast<uint64_t>(n));
+                continue;
+            }
+            if (exchange.responseDone) {
+                return IO::DONE;
+            }
+            if (moved >= STEP_BYTES) {
+                exchange.waitingClient = true;
+                ArmClient(exchange, EPOLLOUT);
+                return IO::YIELD;
+            }
+            if (exchange.buffer.empty()) {
+                exchange.buffer.resize(BUFFER_SIZE);
+            }
+            const std::size_t want = exchange.responseBody == BODY::LENGTH ?
+                static_cast<std::size_t>(std::min<uint64_t>(exchange.responseRemaining, BUFFER_SIZE)) :
+                BUFFER_SIZE;
+            const ssize_t n = recv(exchange.peer->fd, exchange.buffer.data(), want, 0);
+            if (n < 0 && errno == EAGAIN) {
+                return IO::WAIT;
+            }
+            if (n == 0 && exchange.responseBody == BODY::UNTIL_CLOSE) {
+                exchange.responseDone = true;
+                continue;
+            }
+            if (n <= 0) {
+                LOG_WARN << "upstream closed in the middle of the response for " << conn.m_url;
+                return IO::FAILED;
+            }
+            exchange.lastUpstream = GetMonotonicNanos();
+            std::size_t used = static_cast<std::size_t>(n);
+            if (exchange.responseBody == BODY::CHUNKED) {
+                used = exchange.responseChunks.Feed(exchange.buffer.data(), used);
+                if (exchange.responseChunks.Bad()) {
+                    LOG_WARN << "bad chunked response from upstream";
+                    return IO::FAILED;
+                }
+                exchange.responseDone = exchange.responseChunks.Done();
+                if (used < static_cast<std::size_t>(n)) {
+                    exchange.upstreamReusable = false;
+                }
+            } else if (exchange.responseBody == BODY::LENGTH) {
+                exchange.responseRemaining -= used;
+                exchange.responseDone = exchange.responseRemaining == 0;
+            }
+            exchange.bufferOff = 0;
+            exchange.bufferLen = used;
+            moved += used;
+        }
+    }
+
+    /*
+     * 请求完整地保存在out中(没有从客户端socket读过请求体)且还没有向客户端写过数据时，
+     * 连接失败的请求可以换一个地址重试；复用的连接在响应前断开时只重发幂等的请求。
+     */
+    bool Proxy::Retry(ProxyExchange& exchange, bool serverFailed) {
+        if (exchange.responded || exchange.bodyRead ||
+            (!serverFailed && (!exchange.reused || !exchange.idempotent))) {
+            return false;
+        }
+        ClosePeer(exchange.peer);
+        exchange.peer = nullptr;
+        if (!serverFailed) {
+            exchange.replayed = true;
+        }
+        exchange.outSent = 0;
+        exchange.in.clear();
+        exchange.piped = 0;
+        if (!Connect(exchange)) {
+            return false;
+        }
+        metrics::Inc(metrics::Counter::PROXY_RETRIES);
+        Advance(exchange);
+        return true;
+    }
+
+    void Proxy::Finish(ProxyExchange& exchange) {
+        HttpConn& conn = *exchange.conn;
+        // 请求体没有转发完(上游提前响应)时连接上还有残留数据
+        const bool requestDone = exchange.requestRead && exchange.bufferLen == 0 && exchange.piped == 0;
+        Release(exchange.peer, exchange.upstreamReusable && requestDone);
+        exchange.peer = nullptr;
+        const bool keepAlive = exchange.keepAlive && requestDone && !HttpConn::IsDraining();
+        if (conn.m_requestStart != 0) {
+            metrics::Observe(metrics::Histogram::REQUEST_US, (GetMonotonicNanos() - conn.m_requestStart) / 1000);
+        }
+        trace::Emit(trace::Event::LAST_BYTE, conn.m_requestId, static_cast<int64_t>(exchange.headSent));
+        Detach(exchange);
+        if (keepAlive) {
+            conn.init();
+            conn.m_idle = true;
+            ModFD(m_epollfd, conn.m_sockfd, EPOLLIN);
+        } else {
+            conn.CloseConn();
+        }
+    }
+
+    // code为CLOSED_CONNECTION时直接关闭客户端连接，否则在还没有写过数据时回复502/504
+    void Proxy::Fail(ProxyExchange& exchange, HTTP_CODE code) {
+        HttpConn& conn = *exchange.conn;
+        if (exchange.peer != nullptr) {
+            ClosePeer(exchange.peer);
+            exchange.peer = nullptr;
+        }
+        const bool responded = exchange.responded;
+        const bool requestDone = exchange.requestRead && exchange.bufferLen == 0 && exchange.piped == 0;
+        Detach(exchange);
+        if (code == HTTP_CODE::CLOSED_CONNECTION) {
+            conn.CloseConn();
+            return;
+        }
+        metrics::Inc(metrics::Counter::PROXY_ERRORS);
+        if (responded) {
+            conn.CloseConn();
+            return;
+        }
+        if (!requestDone) {
+            conn.m_linger = false;
+        }
+        if (!conn.ProcessWrite(code)) {
+            conn.CloseConn();
+            return;
+        }
+        ModFD(m_epollfd, conn.m_sockfd, EPOLLOUT);
+    }
+
+    // 从m_active和客户端连接上摘下，之后exchange可能已经被释放
+    void Proxy::Detach(ProxyExchange& exchange) {
+        std::shared_ptr<ProxyExchange> self;
+        const std::size_t index = exchange.index;
+        if (index < m_active.size()) {
+            self = std::move(m_active[index]);
+            if (index + 1 != m_active.size()) {
+                m_active[index] = std::move(m_active.back());
+                m_active[index]->index = index;
+            }
+            m_active.pop_back();
+        }
+        exchange.index = ProxyExchange::NOT_ACTIVE;
+        exchange.conn->m_proxy.reset();
+    }
+
+    void Proxy::Cancel(ProxyExchange& exchange) {
+        exchange.cancelled = true;
+        if (exchange.peer != nullptr) {
+            // 响应没有转发完，连接上的数据已经不完整
+            ClosePeer(exchange.peer);
+            exchange.peer = nullptr;
+        }
+        const std::size_t index = exchange.index;
+        if (index < m_active.size()) {
+            if (index + 1 != m_active.size()) {
+                m_active[index] = std::move(m_active.back());
+                m_active[index]->index = index;
+            }
+            m_active.pop_back();
+        }
+        exchange.index = ProxyExchange::NOT_ACTIVE;
+    }
+
+    void Proxy::Tick() {
+        uint64_t expirations = 0;
+        ssize_t ret = read(m_timerFd, &expirations, sizeof(expirations));
+        (void)ret;
+        const uint64_t now = GetMonotonicNanos();
+
+        // 超时的请求：从后往前遍历，Fail()把最后一个元素换到当前位置，不会漏掉
+        for (std::size_t i = m_active.size(); i-- > 0; ) {
+            if (i >= m_active.size()) {
+                continue;
+            }
+            std::shared_ptr<ProxyExchange> exchange = m_active[i];
+            if (exchange->state == ProxyExchange::STATE::CONNECT) {
+                if (now - exchange->connectStart > MsToNanos(m_options.connectTimeoutMs)) {
+                    LOG_WARN << "connect upstream " << exchange->peer->server->name << " timed out";
+                    MarkFailed(*exchange->peer->server, "connect timed out");
+                    if (!Retry(*exchange, true)) {
+                        Fail(*exchange, HTTP_CODE::GATEWAY_TIMEOUT);
+                    }
+                }
+            } else if (!exchange->waitingClient &&
+                       now - exchange->lastUpstream > MsToNanos(m_options.readTimeoutMs)) {
+                LOG_WARN << "upstream " << exchange->peer->server->name << " timed out for "
+                    << exchange->conn->m_url;
+                Fail(*exchange, HTTP_CODE::GATEWAY_TIMEOUT);
+            }
+        }
+
+        const uint64_t idleTimeout = static_cast<uint64_t>(m_options.idleTimeout) * 1000000000ULL;
+        const uint64_t interval = static_cast<uint64_t>(m_options.healthInterval) * 1000000000ULL;
+        for (const auto& upstream : m_upstreams) {
+            for (const auto& server : upstream->servers) {
+                // 最早放回的连接在前面
+                std::size_t expired = 0;
+                while (expired < server->idle.size() && now - server->idle[expired]->since > idleTimeout) {
+                    ClosePeer(server->idle[expired]);
+                    ++expired;
+                }
+                if (expired > 0) {
+                    server->idle.erase(server->idle.begin(), server->idle.begin() + static_cast<std::ptrdiff_t>(expired));
+                    metrics::Add(metrics::Gauge::PROXY_IDLE_CONNECTIONS, -static_cast<int64_t>(expired));
+                }
+                if (interval == 0) {
+                    continue;
+                }
+                if (server->probe != nullptr && now - server->probe->since > interval) {
+                    EndProbe(*server, false);
+                }
+                if (server->probe == nullptr && now >= server->nextProbe) {
+                    server->nextProbe = now + interval;
+                    StartProbe(*server, now);
+                }
+            }
+        }
+    }
+
+    void Proxy::StartProbe(Server& server, uint64_t now) {
+        bool connected = false;
+        Peer* peer = OpenPeer(server, connected);
+        if (peer == nullptr) {
+            EndProbe(server, false);
+            return;
+        }
+        peer->probe = true;
+        peer->since = now;
+        server.probe = peer;
+        if (connected) {
+            ProbeEvent(*peer, EPOLLOUT);
+        }
+    }
+
+    // 只检查能否建立连接，或者发送GET health_path，2xx/3xx为健康
+    void Proxy::ProbeEvent(Peer& peer, uint32_t events) {
+        Server& server = *peer.server;
+        if (peer.connecting) {
+            int err = 0;
+            socklen_t len = sizeof(err);
+            getsockopt(peer.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+            if (err != 0) {
+                EndProbe(server, false);
+                return;
+            }
+            if (!(events & EPOLLOUT)) {
+                return;
+            }
+            peer.connecting = false;
+        }
+        if (m_options.healthPath.empty()) {
+            EndProbe(server, true);
+            return;
+        }
+        if (peer.probeBuffer.empty()) {
+            const std::string request = "GET " + m_options.healthPath + " HTTP/1.1\r\nHost: " + server.host +
+                "\r\nConnection: close\r\n\r\n";
+            // 请求很短，一次发不完就算失败
+            if (send(peer.fd, request.data(), request.size(), MSG_NOSIGNAL) !=
+                static_cast<ssize_t>(request.size())) {
+                EndProbe(server, false);
+                return;
+            }
+            peer.probeBuffer.assign(1, '\0');   // 标记已经发送
+            return;
+        }
+        char buffer[128];
+        const ssize_t n = recv(peer.fd, buffer, sizeof(buffer), 0);
+        if (n < 0 && errno == EAGAIN) {
+            return;
+        }
+        if (n > 0) {
+            peer.probeBuffer.append(buffer, static_cast<std::size_t>(n));
+        }
+        // 去掉开头的标记后是"HTTP/1.1 200"
+        if (peer.probeBuffer.size() < 13 && n > 0) {
+            return;
+        }
+        const bool healthy = peer.probeBuffer.size() >= 13 &&
+            peer.probeBuffer.compare(1, 7, "HTTP/1.") == 0 &&
+            (peer.probeBuffer[10] == '2' || peer.probeBuffer[10] == '3');
+        EndProbe(server, healthy);
+    }
+
+    void Proxy::EndProbe(Server& server, bool healthy) {
+        if (server.probe != nullptr) {
+            ClosePeer(server.probe);
+            server.probe = nullptr;
+        }
+        if (healthy && !server.healthy) {
+            LOG_INFO << "upstream " << server.name << " is up";
+        } else if (!healthy && server.healthy) {
+            MarkFailed(server, "health check failed");
+        }
+        server.healthy = healthy;
+    }
+}
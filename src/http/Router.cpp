@@ -0,0 +1,286 @@
+//
+// Created by asujy on 2026/10/19.
+//
+
+#include "http/Router.h"
+#include "log/Logger.h"
+
+#include <cstring>
+
+namespace http {
+    constexpr int RouteParams::MAX_PARAMS;
+    constexpr int Router::METHOD_NUM;
+    constexpr uint32_t Router::NO_NODE;
+
+    const RouteParams::Param* RouteParams::Find(const char* name) const {
+        const std::size_t nameLen = std::strlen(name);
+        for (int i = 0; i < count; ++i) {
+            if (params[i].nameLen == nameLen && std::memcmp(params[i].name, name, nameLen) == 0) {
+                return &params[i];
+            }
+        }
+        return nullptr;
+    }
+
+    std::string RouteParams::Get(const char* name) const {
+        const Param* param = Find(name);
+        return param == nullptr ? std::string() : std::string(param->value, param->len);
+    }
+
+    struct Router::BuildNode {
+        std::string label;      // 静态边
+        std::string name;       // 参数/通配节点的参数名
+        std::vector<std::unique_ptr<BuildNode>> children;
+        std::unique_ptr<BuildNode> param;
+        std::unique_ptr<BuildNode> wildcard;
+        uint32_t route{NO_NODE};
+    };
+
+    Router::Router() : m_root(new BuildNode) {}
+
+    Router::~Router() = default;
+
+    // 沿静态边插入label，与已有边只有部分公共前缀时把已有边拆成两段
+    Router::BuildNode* Router::InsertStatic(BuildNode* node, std::string label) {
+        while (!label.empty()) {
+            std::size_t k = 0;
+            while (k < node->children.size() && node->children[k]->label[0] != label[0]) {
+                ++k;
+            }
+            if (k == node->children.size()) {
+                std::unique_ptr<BuildNode> child(new BuildNode);
+                child->label = label;
+                node->children.push_back(std::move(child));
+                return node->children.back().get();
+            }
+            std::unique_ptr<BuildNode>& slot = node->children[k];
+            std::size_t common = 0;
+            while (common < label.size() && common < slot->label.size() &&
+                   label[common] == slot->label[common]) {
+                ++common;
+            }
+            if (common < slot->label.size()) {
+                std::unique_ptr<BuildNode> mid(new BuildNode);
+                mid->label = slot->label.substr(0, common);
+                slot->label.erase(0, common);
+                mid->children.push_back(std::move(slot));
+                slot = std::move(mid);
+            }
+            node = slot.get();
+            label.erase(0, common);
+        }
+        return node;
+    }
+
+    bool Router::Insert(const std::string& pattern, uint32_t& route) {
+        if (pattern.empty() || pattern[0] != '/') {
+            return false;
+        }
+        BuildNode* node = m_root.get();
+        int params = 0;
+        std::size_t i = 0;
+        while (i < pattern.size()) {
+            const char c = pattern[i];
+            if (c != ':' && c != '*') {
+                std::size_t j = pattern.find_first_of(":*", i);
+                if (j == std::string::npos) {
+                    j = pattern.size();
+                }
+                node = InsertStatic(node, pattern.substr(i, j - i));
+                i = j;
+                continue;
+            }
+            // 参数必须占据一个完整的路径段，通配只能在最后
+            std::size_t j = pattern.find('/', i + 1);
+            if (j == std::string::npos) {
+                j = pattern.size();
+            }
+            const std::string name = pattern.substr(i + 1, j - i - 1);
+            if (name.empty() || pattern[i - 1] != '/' || ++params > RouteParams::MAX_PARAMS ||
+                (c == '*' && j != pattern.size())) {
+                return false;
+            }
+            std::unique_ptr<BuildNode>& slot = c == ':' ? node->param : node->wildcard;
+            if (!slot) {
+                slot.reset(new BuildNode);
+                slot->name = name;
+            } else if (slot->name != name) {
+                // 同一位置的参数名不一致时，查找结果会随注册顺序变化
+                return false;
+            }
+            node = slot.get();
+            i = j;
+        }
+        if (node->route == NO_NODE) {
+            node->route = static_cast<uint32_t>(m_routes.size());
+            m_routes.emplace_back();
+        }
+        route = node->route;
+        return true;
+    }
+
+    bool Router::Add(HTTP_METHOD method, const std::string& pattern, Handler handler) {
+        const int m = static_cast<int>(method);
+        uint32_t route = NO_NODE;
+        if (m_compiled || m < 0 || m >= METHOD_NUM || !Insert(pattern, route)) {
+            LOG_ERROR << "invalid route " << MethodName(method) << " " << pattern;
+            return false;
+        }
+        Route& r = m_routes[route];
+        if (r.handlers[m]) {
+            LOG_ERROR << "duplicate route " << MethodName(method) << " " << pattern;
+            return false;
+        }
+        r.handlers[m] = std::move(handler);
+        r.allowed |= 1U << m;
+        return true;
+    }
+
+    bool Router::AddAny(const std::string& pattern, Handler handler) {
+        uint32_t route = NO_NODE;
+        if (m_compiled || !Insert(pattern, route)) {
+            LOG_ERROR << "invalid route " << pattern;
+            return false;
+        }
+        Route& r = m_routes[route];
+        if (r.any) {
+            LOG_ERROR << "duplicate route " << pattern;
+            return false;
+        }
+        r.any = std::move(handler);
+        r.allowed = (1U << METHOD_NUM) - 1;
+        return true;
+    }
+
+    // 静态子节点连续存放，先占好位置再逐个递归填充；递归会扩容m_nodes，只能按下标访问
+    void Router::Flatten(uint32_t index, const BuildNode& node) {
+        m_nodes[index].labelOff = static_cast<uint32_t>(m_pool.size());
+        m_nodes[index].labelLen = static_cast<uint32_t>(node.label.size());
+        m_pool += node.label;
+        m_nodes[index].nameOff = static_cast<uint32_t>(m_pool.size());
+        m_nodes[index].nameLen = static_cast<uint32_t>(node.name.size());
+        m_pool += node.name;
+        m_nodes[index].route = node.route;
+
+        const uint32_t first = static_cast<uint32_t>(m_nodes.size());
+        m_nodes[index].firstChild = first;
+        m_nodes[index].childNum = static_cast<uint32_t>(node.children.size());
+        m_nodes.resize(m_nodes.size() + node.children.size());
+        for (std::size_t k = 0; k < node.children.size(); ++k) {
+            Flatten(first + static_cast<uint32_t>(k), *node.children[k]);
+        }
+        if (node.param) {
+            const uint32_t child = static_cast<uint32_t>(m_nodes.size());
+            m_nodes[index].paramChild = child;
+            m_nodes.emplace_back();
+            Flatten(child, *node.param);
+        }
+        if (node.wildcard) {
+            const uint32_t child = static_cast<uint32_t>(m_nodes.size());
+            m_nodes[index].wildcardChild = child;
+            m_nodes.emplace_back();
+            Flatten(child, *node.wildcard);
+        }
+    }
+
+    void Router::Compile() {
+        if (m_compiled) {
+            return;
+        }
+        m_nodes.clear();
+        m_pool.clear();
+        m_nodes.emplace_back();
+        Flatten(0, *m_root);
+        m_nodes.shrink_to_fit();
+        m_pool.shrink_to_fit();
+        m_root.reset();
+        m_compiled = true;
+        LOG_INFO << "router compiled: " << m_routes.size() << " routes, " << m_nodes.size()
+            << " nodes, " << m_pool.size() << " label bytes";
+    }
+
+    // 调用时本节点的边已经匹配完，p指向剩余路径
+    bool Router::MatchNode(uint32_t index, const char* p, const char* end, Match& match,
+                           uint32_t& route) const {
+        const Node& node = m_nodes[index];
+        if (p == end && node.route != NO_NODE) {
+            route = node.route;
+            return true;
+        }
+        const char* pool = m_pool.data();
+        for (uint32_t k = 0; k < node.childNum && p != end; ++k) {
+            const uint32_t child = node.firstChild + k;
+            const Node& c = m_nodes[child];
+            if (pool[c.labelOff] != *p) {
+                continue;
+            }
+            if (static_cast<std::size_t>(end - p) >= c.labelLen &&
+                std::memcmp(p, pool + c.labelOff, c.labelLen) == 0 &&
+                MatchNode(child, p + c.labelLen, end, match, route)) {
+                return true;
+            }
+            // 首字节互不相同，不会再有其他静态子节点匹配
+            break;
+        }
+        RouteParams& params = match.params;
+        if (node.paramChild != NO_NODE && p != end && *p != '/' &&
+            params.count < RouteParams::MAX_PARAMS) {
+            const char* q = static_cast<const char*>(std::memchr(p, '/', end - p));
+            if (q == nullptr) {
+                q = end;
+            }
+            const Node& c = m_nodes[node.paramChild];
+            params.params[params.count++] = {pool + c.nameOff, c.nameLen, p,
+                                             static_cast<std::size_t>(q - p)};
+            if (MatchNode(node.paramChild, q, end, match, route)) {
+                return true;
+            }
+            --params.count;
+        }
+        if (node.wildcardChild != NO_NODE && params.count < RouteParams::MAX_PARAMS) {
+            const Node& c = m_nodes[node.wildcardChild];
+            if (c.route != NO_NODE) {
+                params.params[params.count++] = {pool + c.nameOff, c.nameLen, p,
+                                                 static_cast<std::size_t>(end - p)};
+                route = c.route;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    Router::Result Router::Find(HTTP_METHOD method, const char* path, std::size_t len,
+                                Match& match) const {
+        match.handler = nullptr;
+        match.allowed = 0;
+        match.params.count = 0;
+        uint32_t route = NO_NODE;
+        if (!m_compiled || !MatchNode(0, path, path + len, match, route)) {
+            return Result::NOT_FOUND;
+        }
+        const Route& r = m_routes[route];
+        const int m = static_cast<int>(method);
+        if (m >= 0 && m < METHOD_NUM && r.handlers[m]) {
+            match.handler = &r.handlers[m];
+        } else if (r.any) {
+            match.handler = &r.any;
+        } else {
+            match.allowed = r.allowed;
+            return Result::METHOD_NOT_ALLOWED;
+        }
+        return Result::FOUND;
+    }
+
+    std::string Router::AllowHeader(uint32_t allowed) {
+        std::string allow;
+        for (int m = 0; m < METHOD_NUM; ++m) {
+            if (allowed & (1U << m)) {
+                if (!allow.empty()) {
+                    allow += ", ";
+                }
+                allow += MethodName(static_cast<HTTP_METHOD>(m));
+            }
+        }
+        return allow;
+    }
+}
@@ -0,0 +1,192 @@
+//
+// Created by asujy on 2026/10/19.
+//
+
+#include "http/VirtualHost.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <strings.h>
+#include <sys/stat.h>
+
+#include "common-lib/Utils.h"
+#include "log/Logger.h"
+#include "metrics/Metrics.h"
+
+namespace {
+    constexpr uint64_t FNV_OFFSET = 0xCBF29CE484222325ULL;
+    constexpr uint64_t FNV_PRIME = 0x100000001B3ULL;
+    constexpr std::size_t MIN_TABLE_SIZE = 16;
+
+    std::string ToLower(const std::string& text) {
+        std::string lower = text;
+        for (auto& ch : lower) {
+            ch = static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
+        }
+        return lower;
+    }
+}
+
+namespace http {
+    std::vector<std::pair<std::string, std::string>> MakeCacheRules(
+        const std::vector<std::pair<std::string, int>>& rules) {
+        std::vector<std::pair<std::string, std::string>> result;
+        for (const auto& rule : rules) {
+            result.emplace_back(rule.first, "max-age=" + std::to_string(rule.second));
+        }
+        // 长前缀排在前面，查找时第一个匹配的就是最长前缀
+        std::stable_sort(result.begin(), result.end(),
+            [](const std::pair<std::string, std::string>& a, const std::pair<std::string, std::string>& b) {
+                return a.first.size() > b.first.size();
+            });
+        return result;
+    }
+
+    VirtualHosts::VirtualHosts() {
+        m_default.name = "default";
+        const std::string dir = GetExecutableDir();
+        if (!dir.empty()) {
+            m_default.root = dir + "/../resources";
+        }
+        m_default.bundle = true;
+        m_default.gzip = &GzipCache::Instance();
+    }
+
+    bool VirtualHosts::Configure(const std::vector<Options>& sites, const GzipCache::Options& gzip) {
+        if (sites.empty()) {
+            return true;
+        }
+        // 有虚拟主机时默认站点也按站点统计
+        m_default.stats = metrics::Registry::Instance().AddSite(m_default.name);
+        GzipCache::Options defaultGzip = gzip;
+        defaultGzip.site = m_default.stats;
+        GzipCache::Instance().Configure(defaultGzip);
+
+        std::vector<std::pair<std::string, const Site*>> names;
+        for (const auto& options : sites) {
+            std::unique_ptr<Site> site(new Site);
+            site->name = ToLower(options.name);
+            site->root = options.root;
+            while (site->root.size() > 1 && site->root.back() == '/') {
+                site->root.pop_back();
+            }
+            struct stat st{};
+            if (site->root.empty() || stat(site->root.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+                LOG_ERROR << "vhost " << options.name << ": root '" << options.root << "' is not a directory";
+                return false;
+            }
+            site->stats = metrics::Registry::Instance().AddSite(site->name);
+
+            GzipCache::Options cacheOptions = gzip;
+            cacheOptions.site = site->stats;
+            if (options.gzipCacheBytes != 0) {
+                cacheOptions.maxBytes = options.gzipCacheBytes;
+            }
+            m_caches.emplace_back(new GzipCache);
+            m_caches.back()->Configure(cacheOptions);
+            site->gzip = m_caches.back().get();
+
+            site->ownCacheRules = options.ownCacheRules;
+            site->cacheRules = MakeCacheRules(options.cacheRules);
+            for (const auto& header : options.headers) {
+                site->headers += header;
+                site->headers += "\r\n";
+            }
+
+            names.emplace_back(site->name, site.get());
+            for (const auto& alias : options.aliases) {
+                names.emplace_back(ToLower(alias), site.get());
+            }
+            LOG_INFO << "virtual host " << site->name << " -> " << options.root
+                << " (gzip cache " << cacheOptions.maxBytes << " bytes)";
+            m_sites.push_back(std::move(site));
+        }
+
+        // 槽位指向m_names中的字符串，先把名字全部放好再建表
+        m_names.clear();
+        m_names.reserve(names.size());
+        for (auto& name : names) {
+            while (!name.first.empty() && name.first.back() == '.') {
+                name.first.pop_back();
+            }
+            m_names.push_back(name.first);
+        }
+        std::size_t size = MIN_TABLE_SIZE;
+        while (size < names.size() * 2) {
+            size <<= 1;
+        }
+        m_table.assign(size, Slot());
+        m_mask = size - 1;
+        for (std::size_t i = 0; i < names.size(); ++i) {
+            if (m_names[i].empty() || !Insert(m_names[i], names[i].second)) {
+                LOG_ERROR << "vhost name '" << m_names[i] << "' is empty or used twice";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool VirtualHosts::Insert(const std::string& name, const Site* site) {
+        const uint64_t hash = Hash(name.data(), name.size());
+        std::size_t i = hash & m_mask;
+        for (; m_table[i].name != nullptr; i = (i + 1) & m_mask) {
+            if (m_table[i].hash == hash && *m_table[i].name == name) {
+                return false;
+            }
+        }
+        m_table[i].hash = hash;
+        m_table[i].name = &name;
+        m_table[i].site = site;
+        return true;
+    }
+
+    // 去掉结尾的空白、端口和表示根域的点；IPv6字面量保留方括号
+    std::size_t VirtualHosts::HostLength(const char* host, std::size_t len) {
+        while (len > 0 && (host[len - 1] == ' ' || host[len - 1] == '\t')) {
+            --len;
+        }
+        if (len > 0 && host[0] == '[') {
+            const char* close = static_cast<const char*>(std::memchr(host, ']', len));
+            return close == nullptr ? 0 : static_cast<std::size_t>(close - host) + 1;
+        }
+        const char* colon = static_cast<const char*>(std::memchr(host, ':', len));
+        if (colon != nullptr) {
+            len = static_cast<std::size_t>(colon - host);
+        }
+        while (len > 0 && host[len - 1] == '.') {
+            --len;
+        }
+        return len;
+    }
+
+    // FNV-1a，按小写计算
+    uint64_t VirtualHosts::Hash(const char* host, std::size_t len) {
+        uint64_t hash = FNV_OFFSET;
+        for (std::size_t i = 0; i < len; ++i) {
+            hash ^= static_cast<unsigned char>(std::tolower(static_cast<unsigned char>(host[i])));
+            hash *= FNV_PRIME;
+        }
+        return hash;
+    }
+
+    const Site& VirtualHosts::Find(const char* host, std::size_t len) const {
+        if (m_table.empty()) {
+            return m_default;
+        }
+        len = HostLength(host, len);
+        if (len == 0) {
+            return m_default;
+        }
+        const uint64_t hash = Hash(host, len);
+        // 负载不超过1/2，一定能遇到空槽位
+        for (std::size_t i = hash & m_mask; m_table[i].name != nullptr; i = (i + 1) & m_mask) {
+            const Slot& slot = m_table[i];
+            if (slot.hash == hash && slot.name->size() == len &&
+                strncasecmp(slot.name->data(), host, len) == 0) {
+                return *slot.site;
+            }
+        }
+        return m_default;
+    }
+}
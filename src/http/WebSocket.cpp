@@ -0,0 +1,578 @@
+//
+// Created by asujy on 2026/10/19.
+//
+
+#include "http/WebSocket.h"
+#include "log/Logger.h"
+#include "common-lib/Utils.h"
+#include "metrics/Metrics.h"
+#include "capture/Capture.h"
+
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace http {
+    constexpr std::size_t WebSocket::BUFFER_SIZE;
+    constexpr std::size_t WebSocket::MAX_IOV;
+    WebSocket::Options WebSocket::m_options;
+
+    namespace {
+        constexpr uint8_t OP_CONTINUATION = 0x0;
+        constexpr uint8_t OP_TEXT = 0x1;
+        constexpr uint8_t OP_BINARY = 0x2;
+        constexpr uint8_t OP_CLOSE = 0x8;
+        constexpr uint8_t OP_PING = 0x9;
+        constexpr uint8_t OP_PONG = 0xA;
+
+        std::string CloseCode(WebSocket::CLOSE_CODE code) {
+            const uint16_t value = static_cast<uint16_t>(code);
+            std::string payload(2, '\0');
+            payload[0] = static_cast<char>(value >> 8);
+            payload[1] = static_cast<char>(value & 0xFF);
+            return payload;
+        }
+    }
+
+    WebSocket::WebSocket(HttpConn& conn, WebSocketHandler handler, std::string accept)
+        : m_conn(conn), m_sockfd(conn.m_sockfd), m_addr(conn.m_addr), m_url(conn.m_url),
+          m_handler(std::move(handler)), m_accept(std::move(accept)) {
+    }
+
+    WebSocket::~WebSocket() = default;
+
+    std::string WebSocket::AcceptKey(const std::string& key) {
+        static const char GUID[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+        const std::string text = key + GUID;
+        unsigned char digest[SHA_DIGEST_LENGTH];
+        SHA1(reinterpret_cast<const unsigned char*>(text.data()), text.size(), digest);
+        unsigned char encoded[4 * ((SHA_DIGEST_LENGTH + 2) / 3) + 1];
+        const int len = EVP_EncodeBlock(encoded, digest, SHA_DIGEST_LENGTH);
+        return std::string(reinterpret_cast<const char*>(encoded), static_cast<std::size_t>(len));
+    }
+
+    WebSocket::Message WebSocket::MakeMessage(const char* data, std::size_t len, bool binary) {
+        return MakeFrame(binary ? OP_BINARY : OP_TEXT, data, len);
+    }
+
+    // 服务端的帧：FIN + 操作码，不加掩码，负载长度按7位/16位/64位编码
+    WebSocket::Message WebSocket::MakeFrame(uint8_t opcode, const char* data, std::size_t len) {
+        std::shared_ptr<std::string> frame = std::make_shared<std::string>();
+        frame->reserve(len + 10);
+        frame->push_back(static_cast<char>(0x80 | opcode));
+        if (len < 126) {
+            frame->push_back(static_cast<char>(len));
+        } else if (len <= 0xFFFF) {
+            frame->push_back(static_cast<char>(126));
+            frame->push_back(static_cast<char>(len >> 8));
+            frame->push_back(static_cast<char>(len & 0xFF));
+        } else {
+            frame->push_back(static_cast<char>(127));
+            for (int shift = 56; shift >= 0; shift -= 8) {
+                frame->push_back(static_cast<char>((static_cast<uint64_t>(len) >> shift) & 0xFF));
+            }
+        }
+        frame->append(data, len);
+        return frame;
+    }
+
+    /*
+     * 掩码按负载中的位置循环使用，offset为这段数据在帧负载中的起始位置。
+     * 先把旋转后的掩码铺满16字节，整块异或，剩下的按8字节和单字节处理。
+     */
+    void WebSocket::Unmask(char* data, std::size_t len, const uint8_t key[4], std::size_t offset) {
+        uint8_t pattern[16];
+        for (std::size_t i = 0; i < sizeof(pattern); ++i) {
+            pattern[i] = key[(offset + i) & 3];
+        }
+        std::size_t i = 0;
+#ifdef __SSE2__
+        const __m128i mask = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pattern));
+        for (; i + 16 <= len; i += 16) {
+            __m128i* p = reinterpret_cast<__m128i*>(data + i);
+            _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), mask));
+        }
+#endif
+        uint64_t mask64 = 0;
+        std::memcpy(&mask64, pattern, sizeof(mask64));
+        for (; i + 8 <= len; i += 8) {
+            uint64_t value = 0;
+            std::memcpy(&value, data + i, sizeof(value));
+            value ^= mask64;
+            std::memcpy(data + i, &value, sizeof(value));
+        }
+        for (; i < len; ++i) {
+            data[i] = static_cast<char>(data[i] ^ pattern[i & 3]);
+        }
+    }
+
+    bool WebSocket::Send(const Message& message) {
+        std::lock_guard<std::mutex> locker(m_mtx);
+        if (!EnqueueLocked(message, false)) {
+            return false;
+        }
+        ArmLocked();
+        return true;
+    }
+
+    void WebSocket::Close(CLOSE_CODE code) {
+        std::lock_guard<std::mutex> locker(m_mtx);
+        const std::string payload = CloseCode(code);
+        if (EnqueueLocked(MakeFrame(OP_CLOSE, payload.data(), payload.size()), true)) {
+            m_closing = true;
+            ArmLocked();
+        }
+    }
+
+    // control为true时不受队列上限限制(关闭帧)
+    bool WebSocket::EnqueueLocked(const Message& message, bool control) {
+        if (m_closed || m_closing || m_overflow || !message) {
+            return false;
+        }
+        if (!control && m_queue.size() >= m_options.queueLimit) {
+            if (m_options.slowPolicy == SLOW_POLICY::CLOSE) {
+                // 对端不可写时EPOLLOUT不会触发，shutdown让reactor收到EPOLLHUP后关闭连接
+                m_overflow = true;
+                metrics::Inc(metrics::Counter::WS_SLOW_CLOSED);
+                LOG_WARN << "websocket " << m_url << " closed: send queue overflow";
+                shutdown(m_sockfd, SHUT_RDWR);
+                return false;
+            }
+            metrics::Inc(metrics::Counter::WS_DROPPED);
+            m_queue.pop_front();
+        }
+        m_queue.push_back(message);
+        return true;
+    }
+
+    /*
+     * 按当前状态注册事件：没有暂停读取时监听EPOLLIN，有数据要发送时监听EPOLLOUT。
+     * kick时也注册EPOLLOUT(socket通常可写，会立即触发)，让reactor尽快处理缓冲区中已有的数据。
+     * 与上次注册的相同且还没有触发时不重复注册。
+     */
+    void WebSocket::ArmLocked(bool kick) {
+        if (!m_started || m_closed) {
+            return;
+        }
+        int events = 0;
+        if (!m_paused && !m_closing) {
+            events |= EPOLLIN;
+        }
+        if (kick || m_flushing || !m_queue.empty()) {
+            events |= EPOLLOUT;
+        }
+        if (events != m_armed) {
+            ModFD(HttpConn::m_epollfd.load(), m_sockfd, events);
+            m_armed = events;
+        }
+    }
+
+    void WebSocket::Accepted(const char* data, std::size_t len) {
+        m_in.resize(std::max(BUFFER_SIZE, len));
+        std::memcpy(m_in.data(), data, len);
+        m_inLen = len;
+        {
+            std::lock_guard<std::mutex> locker(m_mtx);
+            m_accepted = true;
+        }
+        metrics::Inc(metrics::Counter::WS_UPGRADES);
+        metrics::Add(metrics::Gauge::WS_CONNECTIONS, 1);
+        if (m_handler.onOpen) {
+            m_handler.onOpen(shared_from_this());
+        }
+    }
+
+    bool WebSocket::Start() {
+        std::lock_guard<std::mutex> locker(m_mtx);
+        if (m_closed) {
+            return false;
+        }
+        m_started = true;
+        ArmLocked(true);
+        return true;
+    }
+
+    bool WebSocket::HandleEvent(uint32_t, bool& dispatch) {
+        {
+            std::lock_guard<std::mutex> locker(m_mtx);
+            m_armed = -1;
+            if (m_overflow) {
+                return false;
+            }
+            m_readPaused = m_paused || m_closing;
+        }
+        if (!m_readPaused && !Read()) {
+            return false;
+        }
+        if (!Flush()) {
+            return false;
+        }
+        std::lock_guard<std::mutex> locker(m_mtx);
+        // 关闭帧已经写出
+        if (m_closing && !m_flushing && m_queue.empty()) {
+            return false;
+        }
+        if (!m_dispatching && !m_inbox.empty()) {
+            m_dispatching = true;
+            dispatch = true;
+        }
+        ArmLocked();
+        return true;
+    }
+
+    void WebSocket::DispatchFailed() {
+        std::lock_guard<std::mutex> locker(m_mtx);
+        m_dispatching = false;
+        ArmLocked(true);
+    }
+
+    void WebSocket::Dispatch() {
+        std::shared_ptr<WebSocket> self = shared_from_this();
+        while (true) {
+            std::pair<std::string, bool> message;
+            {
+                std::lock_guard<std::mutex> locker(m_mtx);
+                if (m_closed || m_inbox.empty()) {
+                    m_dispatching = false;
+                    return;
+                }
+                message = std::move(m_inbox.front());
+                m_inbox.pop_front();
+                m_inboxBytes -= message.first.size();
+                // 收件箱消化了一半后恢复读取
+                if (m_paused && m_inboxBytes <= m_options.maxMessage / 2) {
+                    m_paused = false;
+                    ArmLocked(true);
+                }
+            }
+            if (m_handler.onMessage) {
+                m_handler.onMessage(self, message.first, message.second);
+            }
+        }
+    }
+
+    void WebSocket::Shutdown() {
+        bool accepted = false;
+        {
+            std::lock_guard<std::mutex> locker(m_mtx);
+            if (m_closed) {
+                return;
+            }
+            m_closed = true;
+            accepted = m_accepted;
+            m_queue.clear();
+            m_inbox.clear();
+            m_inboxBytes = 0;
+        }
+        m_sending.clear();
+        m_iv.clear();
+        m_ivIndex = 0;
+        Broadcast::Instance().Remove(*this);
+        if (accepted) {
+            metrics::Add(metrics::Gauge::WS_CONNECTIONS, -1);
+            if (m_handler.onClose) {
+                m_handler.onClose(shared_from_this());
+            }
+        }
+    }
+
+    // 读到EAGAIN、暂停读取或收到关闭帧为止；对端关闭或出错时返回false
+    bool WebSocket::Read() {
+        while (true) {
+            std::size_t pos = 0;
+            Parse(pos);
+            // 不完整的帧头移到开头，负载已经边读边取走了
+            if (pos > 0) {
+                std::memmove(m_in.data(), m_in.data() + pos, m_inLen - pos);
+                m_inLen -= pos;
+            }
+            if (m_readPaused) {
+                return true;
+            }
+            const ssize_t n = m_conn.Recv(m_in.data() + m_inLen, m_in.size() - m_inLen);
+            if (n < 0) {
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            } else if (n == 0) {
+                return false;
+            }
+            capture::Emit(capture::RecordType::DATA, m_conn.m_captureId,
+                m_in.data() + m_inLen, static_cast<std::size_t>(n));
+            metrics::Inc(metrics::Counter::BYTES_READ, static_cast<uint64_t>(n));
+            m_inLen += static_cast<std::size_t>(n);
+        }
+    }
+
+    // 解析[pos, m_inLen)中的帧，负载去掩码后追加到消息或控制帧中
+    void WebSocket::Parse(std::size_t& pos) {
+        while (pos < m_inLen && !m_readPaused) {
+            if (!m_inFrame) {
+                const uint8_t* p = reinterpret_cast<const uint8_t*>(m_in.data()) + pos;
+                const std::size_t avail = m_inLen - pos;
+                if (avail < 2) {
+                    return;
+                }
+                uint64_t len = p[1] & 0x7F;
+                std::size_t headerLen = 2 + (len == 126 ? 2 : len == 127 ? 8 : 0) + ((p[1] & 0x80) ? 4 : 0);
+                if (avail < headerLen) {
+                    return;
+                }
+                if (len == 126) {
+                    len = (static_cast<uint64_t>(p[2]) << 8) | p[3];
+                } else if (len == 127) {
+                    len = 0;
+                    for (int i = 0; i < 8; ++i) {
+                        len = (len << 8) | p[2 + i];
+                    }
+                }
+                const uint8_t opcode = p[0] & 0x0F;
+                const bool fin = (p[0] & 0x80) != 0;
+                // 没有协商扩展，RSV位必须为0；客户端的帧必须加掩码
+                if ((p[0] & 0x70) != 0 || (p[1] & 0x80) == 0) {
+                    Fail(CLOSE_CODE::PROTOCOL_ERROR);
+                    return;
+                }
+                if (opcode >= OP_CLOSE) {
+                    if (!fin || len > 125 || (opcode != OP_CLOSE && opcode != OP_PING && opcode != OP_PONG)) {
+                        Fail(CLOSE_CODE::PROTOCOL_ERROR);
+                        return;
+                    }
+                    m_control.clear();
+                } else {
+                    if (opcode == OP_CONTINUATION ? !m_fragmented :
+                        (opcode != OP_TEXT && opcode != OP_BINARY) || m_fragmented) {
+                        Fail(CLOSE_CODE::PROTOCOL_ERROR);
+                        return;
+                    }
+                    if (len > m_options.maxMessage - m_message.size()) {
+                        Fail(CLOSE_CODE::TOO_BIG);
+                        return;
+                    }
+                    if (opcode != OP_CONTINUATION) {
+                        m_binary = opcode == OP_BINARY;
+                    }
+                    m_message.reserve(m_message.size() + static_cast<std::size_t>(len));
+                }
+                std::memcpy(m_mask, p + headerLen - 4, sizeof(m_mask));
+                m_opcode = opcode;
+                m_fin = fin;
+                m_frameRemaining = len;
+                m_frameOffset = 0;
+                m_inFrame = true;
+                pos += headerLen;
+            }
+            const std::size_t take = static_cast<std::size_t>(
+                std::min<uint64_t>(m_frameRemaining, m_inLen - pos));
+            char* data = m_in.data() + pos;
+            Unmask(data, take, m_mask, static_cast<std::size_t>(m_frameOffset));
+            (m_opcode >= OP_CLOSE ? m_control : m_message).append(data, take);
+            pos += take;
+            m_frameOffset += take;
+            m_frameRemaining -= take;
+            if (m_frameRemaining == 0) {
+                m_inFrame = false;
+                OnFrame();
+            }
+        }
+    }
+
+    void WebSocket::OnFrame() {
+        if (m_opcode == OP_PING) {
+            // 控制帧可以插在其他消息之间，排到还没开始发送的消息前面
+            std::lock_guard<std::mutex> locker(m_mtx);
+            if (!m_closing) {
+                m_queue.push_front(MakeFrame(OP_PONG, m_control.data(), m_control.size()));
+            }
+            return;
+        }
+        if (m_opcode == OP_PONG) {
+            return;
+        }
+        if (m_opcode == OP_CLOSE) {
+            // 回复同样的状态码，发送完后关闭连接
+            if (m_control.size() == 1) {
+                Fail(CLOSE_CODE::PROTOCOL_ERROR);
+                return;
+            }
+            std::lock_guard<std::mutex> locker(m_mtx);
+            if (!m_closing) {
+                m_queue.push_back(MakeFrame(OP_CLOSE, m_control.data(), std::min<std::size_t>(m_control.size(), 2)));
+                m_closing = true;
+            }
+            m_readPaused = true;
+            return;
+        }
+        if (!m_fin) {
+            m_fragmented = true;
+            return;
+        }
+        m_fragmented = false;
+        metrics::Inc(metrics::Counter::WS_MESSAGES_IN);
+        std::lock_guard<std::mutex> locker(m_mtx);
+        m_inboxBytes += m_message.size();
+        m_inbox.emplace_back(std::move(m_message), m_binary);
+        m_message.clear();
+        if (m_inboxBytes > m_options.maxMessage) {
+            m_paused = true;
+            m_readPaused = true;
+        }
+    }
+
+    // 协议错误：丢弃还没发送的消息，发送关闭帧后关闭连接
+    void WebSocket::Fail(CLOSE_CODE code) {
+        LOG_WARN << "websocket " << m_url << " protocol error, closing with " << static_cast<int>(code);
+        const std::string payload = CloseCode(code);
+        std::lock_guard<std::mutex> locker(m_mtx);
+        if (!m_closing) {
+            m_queue.clear();
+            m_queue.push_back(MakeFrame(OP_CLOSE, payload.data(), payload.size()));
+            m_closing = true;
+        }
+        m_readPaused = true;
+    }
+
+    /*
+     * 把发送队列中的消息一批(最多MAX_IOV条)取出，iovec直接指向各条消息的内存，用writev写出。
+     * 写预算与HTTP响应相同，用完后让出reactor，EPOLLOUT仍在注册中，下一轮继续。
+     */
+    bool WebSocket::Flush() {
+        std::size_t budgetBytes = 0;
+        int budgetWrites = 0;
+        while (true) {
+            if (m_ivIndex == m_iv.size()) {
+                m_sending.clear();
+                m_iv.clear();
+                m_ivIndex = 0;
+                {
+                    std::lock_guard<std::mutex> locker(m_mtx);
+                    while (!m_queue.empty() && m_sending.size() < MAX_IOV) {
+                        m_sending.push_back(std::move(m_queue.front()));
+                        m_queue.pop_front();
+                    }
+                    m_flushing = !m_sending.empty();
+                }
+                if (m_sending.empty()) {
+                    return true;
+                }
+                for (const auto& message : m_sending) {
+                    struct iovec iov{};
+                    iov.iov_base = const_cast<char*>(message->data());
+                    iov.iov_len = message->size();
+                    m_iv.push_back(iov);
+                }
+            }
+
+            const std::size_t count = std::min<std::size_t>(m_iv.size() - m_ivIndex, IOV_MAX);
+            const ssize_t n = m_conn.Send(m_iv.data() + m_ivIndex, static_cast<int>(count));
+            if (n < 0) {
+                if (errno == EAGAIN) {
+                    metrics::Inc(metrics::Counter::WRITE_EAGAIN);
+                    return true;
+                }
+                return false;
+            }
+            metrics::Inc(metrics::Counter::BYTES_WRITTEN, static_cast<uint64_t>(n));
+            for (std::size_t left = static_cast<std::size_t>(n); left > 0 && m_ivIndex < m_iv.size(); ) {
+                struct iovec& iov = m_iv[m_ivIndex];
+                if (left < iov.iov_len) {
+                    iov.iov_base = static_cast<char*>(iov.iov_base) + left;
+                    iov.iov_len -= left;
+                    break;
+                }
+                left -= iov.iov_len;
+                ++m_ivIndex;
+                metrics::Inc(metrics::Counter::WS_MESSAGES_OUT);
+            }
+
+            budgetBytes += static_cast<std::size_t>(n);
+            ++budgetWrites;
+            if ((HttpConn::m_writeBudgetBytes != 0 && budgetBytes >= HttpConn::m_writeBudgetBytes) ||
+                (HttpConn::m_writeBudgetWrites != 0 && budgetWrites >= HttpConn::m_writeBudgetWrites)) {
+                metrics::Inc(metrics::Counter::WRITE_YIELDS);
+                std::lock_guard<std::mutex> locker(m_mtx);
+                m_flushing = true;
+                return true;
+            }
+        }
+    }
+
+    void Broadcast::Subscribe(const std::string& topic, const std::shared_ptr<WebSocket>& ws) {
+        std::lock_guard<std::mutex> locker(m_mtx);
+        {
+            std::lock_guard<std::mutex> wsLocker(ws->m_mtx);
+            if (ws->m_closed) {
+                return;
+            }
+        }
+        if (std::find(ws->m_topics.begin(), ws->m_topics.end(), topic) != ws->m_topics.end()) {
+            return;
+        }
+        ws->m_topics.push_back(topic);
+        m_topics[topic].push_back(ws);
+    }
+
+    void Broadcast::Unsubscribe(const std::string& topic, const std::shared_ptr<WebSocket>& ws) {
+        std::lock_guard<std::mutex> locker(m_mtx);
+        auto it = std::find(ws->m_topics.begin(), ws->m_topics.end(), topic);
+        if (it == ws->m_topics.end()) {
+            return;
+        }
+        ws->m_topics.erase(it);
+        auto topicIt = m_topics.find(topic);
+        if (topicIt == m_topics.end()) {
+            return;
+        }
+        auto& subscribers = topicIt->second;
+        subscribers.erase(std::remove(subscribers.begin(), subscribers.end(), ws), subscribers.end());
+        if (subscribers.empty()) {
+            m_topics.erase(topicIt);
+        }
+    }
+
+    std::size_t Broadcast::Publish(const std::string& topic, const WebSocket::Message& message) {
+        std::lock_guard<std::mutex> locker(m_mtx);
+        auto it = m_topics.find(topic);
+        if (it == m_topics.end()) {
+            return 0;
+        }
+        // 每个订阅者只增加一次引用计数
+        std::size_t delivered = 0;
+        for (const auto& ws : it->second) {
+            if (ws->Send(message)) {
+                ++delivered;
+            }
+        }
+        return delivered;
+    }
+
+    std::size_t Broadcast::Subscribers(const std::string& topic) const {
+        std::lock_guard<std::mutex> locker(m_mtx);
+        auto it = m_topics.find(topic);
+        return it == m_topics.end() ? 0 : it->second.size();
+    }
+
+    void Broadcast::Remove(WebSocket& ws) {
+        std::lock_guard<std::mutex> locker(m_mtx);
+        for (const auto& topic : ws.m_topics) {
+            auto it = m_topics.find(topic);
+            if (it == m_topics.end()) {
+                continue;
+            }
+            auto& subscribers = it->second;
+            subscribers.erase(std::remove_if(subscribers.begin(), subscribers.end(),
+                [&ws](const std::shared_ptr<WebSocket>& s) { return s.get() == &ws; }), subscribers.end());
+            if (subscribers.empty()) {
+                m_topics.erase(it);
+            }
+        }
+        ws.m_topics.clear();
+    }
+}
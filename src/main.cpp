@@ -2,119 +2,766 @@
 // Created by asujy on 2025/12/28.
 //
 
+#include <algorithm>
 #include <iostream>
 #include <arpa/inet.h>
 #include <sys/epoll.h>
+#include <sys/stat.h>
 #include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <memory>
+#include <deque>
+#include <getopt.h>
+#include <new>
+#include <sched.h>
+#include <sys/wait.h>
+#include <vector>
 
 #include "log/Logger.h"
 #include "common-lib/Utils.h"
+#include "common-lib/Config.h"
+#include "common-lib/Numa.h"
+#include "common-lib/LoadShedder.h"
+#include "common-lib/RateLimiter.h"
+#include "common-lib/SocketAddress.h"
+#include "common-lib/Handoff.h"
 #include "http/HttpConn.h"
+#include "http/Router.h"
+#include "http/Deferred.h"
+#include "http/Http2Session.h"
+#include "http/Proxy.h"
+#include "http/WebSocket.h"
+#include "http/VirtualHost.h"
+#include "tls/Tls.h"
 #include "common-lib/ThreadPool.h"
+#include "metrics/Metrics.h"
+#include "trace/Tracer.h"
+#include "trace/Probes.h"
+#include "capture/Capture.h"
+#include "bundle/Bundle.h"
 
-constexpr int LISTEN_BACKLOG = 8;
-constexpr int MAX_EVENT_NUMBER = 10000; // 监听的最大的事件数量
 constexpr int EPOLL_INSTANCE_SIZE = 100; // useless
-constexpr int MAX_FD = 65535;
+constexpr int DRAIN_POLL_MS = 100;        // 排空期间epoll_wait的超时，用来检查截止时间
+constexpr unsigned long MAX_DELAY_MS = 60000; // delay_path允许的最长延迟
+
+namespace {
+    volatile sig_atomic_t g_traceDump = 0;    // SIGUSR1: 导出trace
+    volatile sig_atomic_t g_traceToggle = 0;  // SIGUSR2: 开关trace
+    volatile sig_atomic_t g_restart = 0;      // SIGHUP: 把监听socket交给新的进程后退出
+    volatile sig_atomic_t g_stop = 0;         // SIGTERM: 停止accept，现有连接处理完后退出
+
+    void TraceSignalHandler(int sig) {
+        if (sig == SIGUSR1) {
+            g_traceDump = 1;
+        } else if (sig == SIGUSR2) {
+            g_traceToggle = 1;
+        }
+    }
+
+    void LifecycleSignalHandler(int sig) {
+        if (sig == SIGHUP) {
+            g_restart = 1;
+        } else if (sig == SIGTERM) {
+            g_stop = 1;
+        }
+    }
+
+    void HandleTraceSignals() {
+        if (g_traceToggle) {
+            g_traceToggle = 0;
+            trace::Tracer::SetEnabled(!trace::Tracer::Enabled());
+            LOG_INFO << "tracing " << (trace::Tracer::Enabled() ? "enabled" : "disabled");
+        }
+        if (g_traceDump) {
+            g_traceDump = 0;
+            std::string file = "trace-" + std::to_string(getpid()) + "-" +
+                std::to_string(GetMonotonicNanos()) + ".json";
+            if (trace::Tracer::Instance().DumpToFile(file)) {
+                LOG_INFO << "trace dumped to " << file;
+            } else {
+                LOG_ERROR << "trace dump to " << file << " failed";
+            }
+        }
+    }
+}
+
+namespace {
+    // 内置的几个端点，其余路径都当作静态文件
+    bool BuildRouter(http::Router& router, const ServerConfig& config) {
+        bool ok = true;
+        if (!config.metricsPath.empty()) {
+            ok = router.Add(http::HTTP_METHOD::GET, config.metricsPath,
+                [](HttpConn& conn, const http::RouteParams&) {
+                    // 抓取时才汇总各分片的数据
+                    return conn.Reply(metrics::Registry::Instance().Render(), "text/plain; version=0.0.4");
+                }) && ok;
+        }
+        if (!config.tracePath.empty()) {
+            ok = router.Add(http::HTTP_METHOD::GET, config.tracePath,
+                [](HttpConn& conn, const http::RouteParams&) {
+                    // 环形缓冲区满时导出有几MB，以分块编码逐块写出
+                    std::shared_ptr<std::string> json =
+                        std::make_shared<std::string>(trace::Tracer::Instance().DumpJson());
+                    std::size_t offset = 0;
+                    return conn.Stream([json, offset](char* buf, std::size_t size) mutable {
+                        const std::size_t n = std::min(size, json->size() - offset);
+                        std::memcpy(buf, json->data() + offset, n);
+                        offset += n;
+                        return static_cast<ssize_t>(n);
+                    }, "application/json");
+                }) && ok;
+        }
+        if (!config.healthPath.empty()) {
+            // HEAD与GET共用处理函数，ProcessWrite只发送头部
+            const http::Router::Handler health = [](HttpConn& conn, const http::RouteParams&) {
+                return conn.Reply("ok\n", "text/plain");
+            };
+            ok = router.Add(http::HTTP_METHOD::GET, config.healthPath, health) && ok;
+            ok = router.Add(http::HTTP_METHOD::HEAD, config.healthPath, health) && ok;
+        }
+        if (!config.delayPath.empty()) {
+            // 工作线程不等待，到期后由定时线程完成响应；客户端提前断开时定时器被取消
+            ok = router.Add(http::HTTP_METHOD::GET, config.delayPath + ":ms",
+                [](HttpConn& conn, const http::RouteParams& params) {
+                    const std::string value = params.Get("ms");
+                    char* end = nullptr;
+                    const unsigned long ms = std::strtoul(value.c_str(), &end, 10);
+                    if (value.empty() || *end != '\0' || ms > MAX_DELAY_MS) {
+                        return http::HTTP_CODE::BAD_REQUEST;
+                    }
+                    http::DeferredTimer::Instance().After(ms, conn.Defer(), [ms](http::Deferred& deferred) {
+                        deferred.Reply(std::to_string(ms) + "\n", "text/plain");
+                    });
+                    return http::HTTP_CODE::DEFERRED_REQUEST;
+                }) && ok;
+        }
+        if (!config.wsPath.empty()) {
+            // 连接ws_path<topic>订阅该主题，收到的消息转发给该主题的所有订阅者
+            ok = router.Add(http::HTTP_METHOD::GET, config.wsPath + "*topic",
+                [](HttpConn& conn, const http::RouteParams& params) {
+                    const std::string topic = params.Get("topic");
+                    http::WebSocketHandler handler;
+                    handler.onOpen = [topic](const std::shared_ptr<http::WebSocket>& ws) {
+                        http::Broadcast::Instance().Subscribe(topic, ws);
+                    };
+                    handler.onMessage = [topic](const std::shared_ptr<http::WebSocket>&,
+                                                const std::string& message, bool binary) {
+                        http::Broadcast::Instance().Publish(topic, message.data(), message.size(), binary);
+                    };
+                    return conn.AcceptWebSocket(std::move(handler));
+                }) && ok;
+            // POST的请求体作为一条消息发布，响应为收到它的订阅者数
+            const std::size_t maxMessage = config.wsMaxMessage;
+            ok = router.Add(http::HTTP_METHOD::POST, config.wsPath + "*topic",
+                [maxMessage](HttpConn& conn, const http::RouteParams& params) {
+                    const std::string topic = params.Get("topic");
+                    std::shared_ptr<std::string> message = std::make_shared<std::string>();
+                    return conn.StreamBody([&conn, topic, message, maxMessage](const char* data, std::size_t len,
+                                                                             bool last) {
+                        if (message->size() + len > maxMessage) {
+                            return http::HTTP_CODE::PAYLOAD_TOO_LARGE;
+                        }
+                        message->append(data, len);
+                        if (!last) {
+                            return http::HTTP_CODE::NO_REQUEST;
+                        }
+                        const std::size_t delivered =
+                            http::Broadcast::Instance().Publish(topic, message->data(), message->size());
+                        return conn.Reply(std::to_string(delivered) + "\n", "text/plain");
+                    });
+                }) && ok;
+        }
+        if (!config.uploadPath.empty()) {
+            // 文件名只能是一个路径段，已存在的同名文件被覆盖
+            const std::string dir = config.uploadDir;
+            ok = router.Add(http::HTTP_METHOD::POST, config.uploadPath + "*name",
+                [dir](HttpConn& conn, const http::RouteParams& params) {
+                    const std::string name = params.Get("name");
+                    if (name.find('/') != std::string::npos || (!name.empty() && name[0] == '.')) {
+                        return http::HTTP_CODE::BAD_REQUEST;
+                    }
+                    return conn.ReceiveFile([&conn, dir, name](const http::UploadFile& upload) {
+                        if (!name.empty() && rename(upload.path.c_str(), (dir + "/" + name).c_str()) != 0) {
+                            LOG_ERROR << "keep upload " << name << " failed: " << std::strerror(errno);
+                            return http::HTTP_CODE::INTERNAL_ERROR;
+                        }
+                        return conn.Reply(std::to_string(upload.size) + "\n", "text/plain");
+                    });
+                }) && ok;
+        }
+        // 转发的前缀对所有方法生效，前缀为/时不再提供静态文件
+        bool proxyRoot = false;
+        for (const auto& rule : config.proxyRules) {
+            http::Upstream* upstream = http::Proxy::Instance().AddUpstream(rule.second);
+            if (upstream == nullptr) {
+                LOG_ERROR << "invalid proxy_pass upstream for " << rule.first;
+                return false;
+            }
+            proxyRoot = proxyRoot || rule.first == "/";
+            ok = router.AddAny(rule.first + "*path",
+                [upstream](HttpConn& conn, const http::RouteParams&) {
+                    return conn.ProxyPass(upstream);
+                }) && ok;
+        }
+        if (!proxyRoot) {
+            const http::Router::Handler file = [](HttpConn& conn, const http::RouteParams&) {
+                return conn.ServeFile(conn.GetUrl(), conn.GetPathLength());
+            };
+            ok = router.Add(http::HTTP_METHOD::GET, "/*path", file) && ok;
+            ok = router.Add(http::HTTP_METHOD::HEAD, "/*path", file) && ok;
+        }
+        router.Compile();
+        return ok;
+    }
+
+    // 一个监听地址，accept到的连接都交给同一个连接表
+    struct Listener {
+        std::string name;       // 配置中的地址，也是metrics中的listener标签
+        SocketAddress addr;
+        bool secure{false};     // 连接先完成TLS握手
+        int fd{-1};
+        int stats{-1};          // metrics中的下标
+    };
+
+    // 失败时返回-1
+    int Listen(const SocketAddress& addr, int backlog) {
+        int listenfd = socket(addr.Family(), SOCK_STREAM, 0);
+        if (listenfd == -1) {
+            LOG_ERROR << "socket failed!!!";
+            return -1;
+        }
+
+        int ret = 0;
+        if (addr.Family() == AF_UNIX) {
+            // 上次运行留下的socket文件，不是socket时让bind报错
+            struct stat st{};
+            if (addr.IsUnixPath() && lstat(addr.UnixPath(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+                unlink(addr.UnixPath());
+            }
+        } else {
+            // 设置端口复用
+            int reuse{1};
+            ret = setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+            if (ret == -1) {
+                LOG_ERROR << "setsockopt failed!!!";
+                close(listenfd);
+                return -1;
+            }
+        }
+        if (addr.Family() == AF_INET6) {
+            // 双栈：[::]同时接受IPv4，客户端地址为v4映射的IPv6地址
+            int v6only{0};
+            setsockopt(listenfd, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, sizeof(v6only));
+        }
+
+        ret = bind(listenfd, addr.Data(), addr.Length());
+        if (ret == -1) {
+            LOG_ERROR << "bind " << addr.ToString() << " failed: " << strerror(errno);
+            close(listenfd);
+            return -1;
+        }
+
+        ret = listen(listenfd, backlog);
+        if (ret == -1) {
+            LOG_ERROR << "listen failed";
+            close(listenfd);
+            return -1;
+        }
+        return listenfd;
+    }
+
+    // 限流和过载保护在解析请求行时按请求进行，这里只在队列已满时回复503
+    void Dispatch(HttpConn& conn, ThreadPool<HttpConn>& pool) {
+        trace::Emit(trace::Event::ENQUEUE, conn.GetRequestId());
+        if (!pool.Append(&conn)) {
+            metrics::Inc(metrics::Counter::SHED_REQUESTS);
+            conn.Reject();
+        }
+    }
+
+    void WriteConn(HttpConn& conn, int sockfd, std::deque<int>& writeQueue, ThreadPool<HttpConn>& pool) {
+        switch (conn.Write()) {
+            case http::WRITE_RESULT::AGAIN:
+                writeQueue.push_back(sockfd);
+                break;
+            case http::WRITE_RESULT::CLOSE:
+                conn.CloseConn();
+                break;
+            case http::WRITE_RESULT::PIPELINED:
+                Dispatch(conn, pool);
+                break;
+            default:
+                break;
+        }
+    }
+}
 
 int main(int argc, char* argv[]) {
-    if (argc <= 1) {
+    // 平滑重启时以同样的参数启动新的进程(getopt会重排argv)；可执行文件之后可能被替换，路径在启动时取得
+    const std::vector<std::string> args(argv, argv + argc);
+    const std::string exePath = GetExecutablePath();
+    ServerConfig config;
+    std::string configFile;
+    std::vector<std::string> overrides;
+    std::string error;
+    bool ok = true;
+    int opt = 0;
+    while ((opt = getopt(argc, argv, "f:o:C:")) != -1) {
+        if (opt == 'f') {
+            configFile = optarg;
+        } else if (opt == 'o') {
+            overrides.emplace_back(optarg);
+        } else if (opt == 'C') {
+            overrides.emplace_back(std::string("capture_file=") + optarg);
+        } else {
+            ok = false;
+        }
+    }
+    // 优先级：配置文件 < -o/-C < 位置参数
+    ok = ok && (configFile.empty() || config.Load(configFile, error));
+    for (std::size_t i = 0; ok && i < overrides.size(); ++i) {
+        ok = config.Override(overrides[i], error);
+    }
+    if (ok && argc - optind > 0) {
+        ok = config.Set("port", argv[optind], error);
+    }
+    if (ok && argc - optind > 1) {
+        // 传入空字符串可关闭metrics
+        config.metricsPath = argv[optind + 1];
+    }
+    if (!ok || (config.port == 0 && config.listen.empty())) {
+        if (!error.empty()) {
+            std::cerr << error << std::endl;
+        }
         std::string filename = "programe";
         if (argc > 0 && argv[0]) {
             filename = argv[0];
             filename = GetBasename(filename);
         }
-        std::cout << "Usage: " << filename << " port_number!" << std::endl;
+        std::cout << "Usage: " << filename << " [-f config_file] [-o key=value]... "
+            "[-C capture_file] [port_number [metrics_path]]!" << std::endl;
         std::exit(EXIT_FAILURE);
     }
 
-    Logger::Config("Web.log");
-    int port = std::atoi(argv[1]);
-    LOG_INFO << "WebServer port: " << port;
-
-    AddSignal(SIGPIPE, SIG_IGN);
-
-    int listenfd = socket(AF_INET, SOCK_STREAM, 0);
-    if (listenfd == -1) {
-        LOG_ERROR << "socket failed!!!";
+    Logger::Config(config.logFile);
+    LOG_INFO << "WebServer port: " << config.port;
+    LOG_INFO << "config: " << config.ToString();
+    http::Proxy::Options proxyOptions;
+    proxyOptions.connectTimeoutMs = config.proxyConnectTimeoutMs;
+    proxyOptions.readTimeoutMs = config.proxyReadTimeoutMs;
+    proxyOptions.idleTimeout = config.proxyIdleTimeout;
+    proxyOptions.maxIdle = static_cast<std::size_t>(config.proxyMaxIdle);
+    proxyOptions.healthInterval = config.proxyHealthInterval;
+    proxyOptions.healthPath = config.proxyHealthPath;
+    http::Proxy::Instance().Configure(proxyOptions);
+    http::WebSocket::Options wsOptions;
+    wsOptions.maxMessage = config.wsMaxMessage;
+    wsOptions.queueLimit = config.wsQueueLimit;
+    wsOptions.slowPolicy = config.wsSlowClose ? http::WebSocket::SLOW_POLICY::CLOSE : http::WebSocket::SLOW_POLICY::DROP;
+    http::WebSocket::Configure(wsOptions);
+    http::Router router;
+    if (!BuildRouter(router, config)) {
         std::exit(EXIT_FAILURE);
     }
-
-    // 设置端口复用
-    int reuse{1};
-    int ret = setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
-    if (ret == -1) {
-        LOG_ERROR << "setsockopt failed!!!";
+    HttpConn::SetRouter(&router);
+    HttpConn::SetCacheRules(config.cacheRules);
+    http::GzipCache::Options gzipOptions;
+    gzipOptions.enabled = config.gzip;
+    gzipOptions.maxBytes = config.gzipCacheBytes;
+    gzipOptions.level = config.gzipLevel;
+    gzipOptions.minSize = config.gzipMinSize;
+    gzipOptions.extensions = config.gzipTypes;
+    http::GzipCache::Instance().Configure(gzipOptions);
+    std::vector<http::VirtualHosts::Options> vhostOptions;
+    for (const auto& vhost : config.vhosts) {
+        http::VirtualHosts::Options options;
+        options.name = vhost.name;
+        options.aliases = vhost.aliases;
+        options.root = vhost.root;
+        options.gzipCacheBytes = vhost.gzipCacheBytes;
+        options.ownCacheRules = vhost.ownCacheRules;
+        options.cacheRules = vhost.cacheRules;
+        options.headers = vhost.headers;
+        vhostOptions.push_back(options);
+    }
+    if (!http::VirtualHosts::Instance().Configure(vhostOptions, gzipOptions)) {
         std::exit(EXIT_FAILURE);
     }
-
-    struct sockaddr_in address{};
-    address.sin_family = AF_INET;
-    address.sin_addr.s_addr = INADDR_ANY;
-    address.sin_port = htons(port);
-    ret = bind(listenfd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address));
-    if (ret == -1) {
-        LOG_ERROR << "bind failed";
+    if (bundle::Count() > 0) {
+        LOG_INFO << "serving " << bundle::Count() << " embedded assets before resources/";
+    }
+    if (!config.captureFile.empty() && !capture::Recorder::Instance().Start(config.captureFile)) {
         std::exit(EXIT_FAILURE);
     }
 
-    ret = listen(listenfd, LISTEN_BACKLOG);
-    if (ret == -1) {
-        LOG_ERROR << "listen failed";
+    // reactor先绑核，再按它所在的节点分配连接和缓冲区
+    PinCurrentThread(config.reactorCpu);
+    int node = -1;
+    if (config.numa) {
+        node = NumaNodeOfCpu(config.reactorCpu >= 0 ? config.reactorCpu : sched_getcpu());
+        for (int cpu : config.workerCpus) {
+            if (NumaNodeOfCpu(cpu) != node) {
+                LOG_WARN << "worker cpu " << cpu << " is not on numa node " << node
+                    << ", connection memory will be remote for it";
+            }
+        }
+        LOG_INFO << "allocating connections on numa node " << node;
+    }
+    NumaArena arena(node);
+    HttpConn::SetBuffers(config.readBufferSize, config.writeBufferSize, &arena);
+    HttpConn::SetStreaming(config.maxBodySize, config.chunkSize);
+    HttpConn::SetUpload(config.uploadDir, config.maxUploadSize);
+    http::Http2Session::Options h2Options;
+    h2Options.enabled = config.http2;
+    h2Options.maxStreams = config.h2MaxStreams;
+    http::Http2Session::Configure(h2Options);
+
+    AddSignal(SIGPIPE, SIG_IGN);
+    AddSignal(SIGUSR1, TraceSignalHandler);
+    AddSignal(SIGUSR2, TraceSignalHandler);
+    AddSignal(SIGHUP, LifecycleSignalHandler);
+    AddSignal(SIGTERM, LifecycleSignalHandler);
+
+    // port和tls_port监听0.0.0.0，listen和tls_listen中的地址另外监听
+    std::vector<Listener> listeners;
+    const auto addListener = [&listeners](const std::string& name, bool secure) {
+        Listener listener;
+        listener.name = name;
+        listener.secure = secure;
+        SocketAddress::Parse(name, listener.addr);
+        listeners.push_back(listener);
+    };
+    if (config.port > 0) {
+        addListener("0.0.0.0:" + std::to_string(config.port), false);
+    }
+    for (const auto& name : config.listen) {
+        addListener(name, false);
+    }
+    if (config.tlsPort > 0) {
+        addListener("0.0.0.0:" + std::to_string(config.tlsPort), true);
+    }
+    for (const auto& name : config.tlsListen) {
+        addListener(name, true);
+    }
+    // 在TLS端口上接受的连接先完成握手，之后和明文连接走同样的路径
+    bool anySecure = false;
+    for (const auto& listener : listeners) {
+        anySecure = anySecure || listener.secure;
+    }
+    if (anySecure) {
+        tls::Options tlsOptions;
+        tlsOptions.cert = config.tlsCert;
+        tlsOptions.key = config.tlsKey;
+        tlsOptions.sessionCacheSize = config.tlsSessionCache;
+        tlsOptions.sessionTimeout = config.tlsSessionTimeout;
+        tlsOptions.ktls = config.ktls;
+        if (config.http2) {
+            tlsOptions.alpn.push_back("h2");
+        }
+        tlsOptions.alpn.push_back("http/1.1");
+        if (!tls::Context::Instance().Configure(tlsOptions)) {
+            std::exit(EXIT_FAILURE);
+        }
+    }
+    // 由旧进程平滑重启时，同一地址的监听socket直接沿用，不再bind
+    handoff::Sockets inherited;
+    int handoffReady = -1;
+    if (!handoff::Receive(inherited, handoffReady)) {
         std::exit(EXIT_FAILURE);
     }
+    std::vector<int> listenerOf;  // 按fd索引的监听地址下标，不是监听socket时为-1
+    for (std::size_t i = 0; i < listeners.size(); ++i) {
+        Listener& listener = listeners[i];
+        bool reused = false;
+        for (auto& socket : inherited) {
+            if (socket.second != -1 && socket.first == listener.name) {
+                listener.fd = socket.second;
+                socket.second = -1;
+                reused = true;
+                break;
+            }
+        }
+        if (!reused) {
+            listener.fd = Listen(listener.addr, config.listenBacklog);
+        }
+        if (listener.fd == -1) {
+            std::exit(EXIT_FAILURE);
+        }
+        listener.stats = metrics::Registry::Instance().AddListener(listener.name);
+        if (static_cast<std::size_t>(listener.fd) >= listenerOf.size()) {
+            listenerOf.resize(listener.fd + 1, -1);
+        }
+        listenerOf[listener.fd] = static_cast<int>(i);
+        LOG_INFO << "WebServer listening on " << listener.name << (listener.secure ? " (tls)" : "")
+            << (reused ? " (inherited)" : "");
+    }
+    // 新配置中已经去掉的地址
+    for (const auto& socket : inherited) {
+        if (socket.second != -1) {
+            LOG_INFO << "closing inherited listener " << socket.first << ", no longer configured";
+            close(socket.second);
+        }
+    }
 
-    epoll_event events[MAX_EVENT_NUMBER];
+    std::vector<epoll_event> events(config.maxEvents);
     int epollfd = epoll_create(EPOLL_INSTANCE_SIZE);
-    AddFD(epollfd, listenfd, false);
+    for (const auto& listener : listeners) {
+        AddFD(epollfd, listener.fd, false);
+    }
+    // 延迟响应完成后通过eventfd唤醒reactor
+    const int completionFd = http::CompletionQueue::Instance().Fd();
+    AddFD(epollfd, completionFd, false);
+    // 反向代理的上游连接注册在同一个epoll中，另有唤醒用的eventfd和检查超时的timerfd
+    http::Proxy& proxy = http::Proxy::Instance();
+    int proxyFd = -1;
+    int proxyTimerFd = -1;
+    if (proxy.Enabled()) {
+        if (!proxy.Start(epollfd)) {
+            std::exit(EXIT_FAILURE);
+        }
+        proxyFd = proxy.Fd();
+        proxyTimerFd = proxy.TimerFd();
+        AddFD(epollfd, proxyFd, false);
+        AddFD(epollfd, proxyTimerFd, false);
+    }
     HttpConn::SetEpollFD(epollfd);
 
-    std::unique_ptr<ThreadPool<HttpConn>> pool(new ThreadPool<HttpConn>);
-    std::unique_ptr<HttpConn[]> users(new HttpConn[MAX_FD]);
+    std::unique_ptr<ThreadPool<HttpConn>> pool(
+        new ThreadPool<HttpConn>(config.threadNumber, config.maxRequests, config.workerCpus));
+    LoadShedder shedder(static_cast<uint64_t>(config.shedTargetMs) * 1000000ULL,
+        static_cast<uint64_t>(config.shedIntervalMs) * 1000000ULL, config.threadNumber);
+    if (config.loadShedding) {
+        pool->SetLoadShedder(&shedder);
+        HttpConn::SetLoadShedder(&shedder);
+    }
+    HttpConn::SetRetryAfter(config.retryAfter);
+    std::unique_ptr<RateLimiter> limiter;
+    if (config.clientConnRate > 0 || config.clientMaxConns > 0 || config.clientRequestRate > 0) {
+        RateLimiter::Options options;
+        options.connRate = static_cast<uint32_t>(config.clientConnRate);
+        options.connBurst = static_cast<uint32_t>(config.clientConnBurst);
+        options.maxConns = static_cast<uint32_t>(config.clientMaxConns);
+        options.requestRate = static_cast<uint32_t>(config.clientRequestRate);
+        options.requestBurst = static_cast<uint32_t>(config.clientRequestBurst);
+        options.entries = static_cast<std::size_t>(config.clientTableSize);
+        limiter.reset(new RateLimiter(options));
+        HttpConn::SetRateLimiter(limiter.get());
+    }
+    const int maxConnections = config.maxConnections > 0 && config.maxConnections < config.maxFd ?
+        config.maxConnections : config.maxFd;
+    // 连接槽位按fd索引，和缓冲区一样从arena分配
+    HttpConn* users = static_cast<HttpConn*>(
+        arena.Allocate(sizeof(HttpConn) * config.maxFd, alignof(HttpConn)));
+    if (users == nullptr) {
+        LOG_ERROR << "allocate connection table failed";
+        std::exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < config.maxFd; ++i) {
+        new (&users[i]) HttpConn;
+    }
+    HttpConn::SetWriteBudget(config.writeBudgetBytes, config.writeBudgetWrites);
+    std::deque<int> writeQueue;  // 写预算用完但socket仍可写的连接，轮转发送
+
+    int handoffChannel = -1;     // SIGHUP后与新进程之间的socket，新进程就绪时可读
+    pid_t handoffPid = -1;
+    bool handedOff = false;      // 监听socket已交给新进程，退出时不删除Unix域socket文件
+    bool draining = false;
+    uint64_t drainDeadline = 0;
+    // 停止accept并关闭空闲连接，之后等其余连接处理完。需在一轮事件处理完后调用，
+    // 本轮中监听socket的事件不能再落到连接表上
+    const auto startDrain = [&]() {
+        draining = true;
+        drainDeadline = GetMonotonicNanos() + static_cast<uint64_t>(config.drainTimeout) * 1000000000ULL;
+        for (auto& listener : listeners) {
+            listenerOf[listener.fd] = -1;
+            DelFD(epollfd, listener.fd);
+            listener.fd = -1;
+            if (!handedOff && listener.addr.IsUnixPath()) {
+                unlink(listener.addr.UnixPath());
+            }
+        }
+        HttpConn::SetDraining();
+        for (int i = 0; i < config.maxFd; ++i) {
+            users[i].Drain();
+        }
+        LOG_INFO << "stopped accepting, draining " << HttpConn::GetUserCount() << " connections for up to "
+            << config.drainTimeout << "s";
+    };
+    // 监听socket和连接表都已就绪，通知旧进程停止accept
+    handoff::Ready(handoffReady);
     while (true) {
-        int number = epoll_wait(epollfd, events, MAX_EVENT_NUMBER, -1);
+        // 还有待续写的连接时不阻塞，处理完新事件后继续发送；排空期间定时醒来检查截止时间
+        int number = epoll_wait(epollfd, events.data(), config.maxEvents,
+            !writeQueue.empty() ? 0 : (draining ? DRAIN_POLL_MS : -1));
         if ((number < 0) && (errno != EINTR)) {
             LOG_ERROR << "epoll_wait failed";
             break;
         }
+        HandleTraceSignals();
+        if (g_restart) {
+            g_restart = 0;
+            if (draining || handoffChannel != -1) {
+                LOG_WARN << "restart already in progress, ignoring SIGHUP";
+            } else {
+                handoff::Sockets sockets;
+                for (const auto& listener : listeners) {
+                    sockets.emplace_back(listener.name, listener.fd);
+                }
+                handoffChannel = handoff::Spawn(exePath, args, sockets, handoffPid);
+                if (handoffChannel != -1) {
+                    AddFD(epollfd, handoffChannel, false);
+                }
+            }
+        }
+        const uint64_t now = GetMonotonicNanos();  // 本轮事件共用，限流检查不再单独取时间
 
         for (int i = 0; i < number; ++i) {
             int sockfd = events[i].data.fd;
-            if (sockfd == listenfd) {
-                struct sockaddr_in clientAddress{};
-                socklen_t clientAddressLength = sizeof(clientAddress);
-                int connfd = accept(listenfd,
-                    reinterpret_cast<struct sockaddr*>(&clientAddress),
-                    &clientAddressLength);
+            const int listenerIndex = static_cast<std::size_t>(sockfd) < listenerOf.size() ? listenerOf[sockfd] : -1;
+            if (listenerIndex >= 0) {
+                const Listener& listener = listeners[listenerIndex];
+                // TLS端口上还没有握手，拒绝时不发送明文响应
+                const bool secure = listener.secure;
+                SocketAddress clientAddress;
+                int connfd = accept(sockfd, clientAddress.Data(), clientAddress.LengthPtr());
                 if (connfd == -1) {
                     LOG_ERROR << "accept failed!!!";
                     continue;
                 }
-                if (HttpConn::GetUserCount() >= MAX_FD) {
+                metrics::Inc(metrics::Counter::ACCEPTS);
+                metrics::Add(listener.stats, metrics::ListenerStat::ACCEPTS);
+                WEBSERVER_PROBE1(accept, connfd);
+                if (connfd >= config.maxFd || HttpConn::GetUserCount() >= maxConnections) {
+                    metrics::Inc(metrics::Counter::SHED_CONNECTIONS);
+                    metrics::Add(listener.stats, metrics::ListenerStat::REJECTED);
+                    if (!secure) {
+                        HttpConn::RejectSocket(connfd);
+                    }
                     close(connfd);
                     continue;
                 }
-                users[connfd].Init(connfd, clientAddress);
-                LOG_INFO<< "Client Address: "
-                    << inet_ntoa(clientAddress.sin_addr);
-                LOG_INFO << "Client Port: " << ntohs(clientAddress.sin_port);
+                bool limited = false;
+                if (limiter) {
+                    const RateLimiter::Verdict verdict = limiter->AdmitConnection(clientAddress, now);
+                    if (verdict == RateLimiter::Verdict::UNTRACKED) {
+                        metrics::Inc(metrics::Counter::RATE_LIMIT_UNTRACKED);
+                    } else if (verdict != RateLimiter::Verdict::ALLOW) {
+                        metrics::Inc(verdict == RateLimiter::Verdict::CONN_LIMIT ?
+                            metrics::Counter::RATE_LIMITED_CONN_LIMIT :
+                            metrics::Counter::RATE_LIMITED_CONN_RATE);
+                        metrics::Add(listener.stats, metrics::ListenerStat::REJECTED);
+                        if (!secure) {
+                            HttpConn::RejectSocket(connfd, 429);
+                        }
+                        close(connfd);
+                        continue;
+                    }
+                    limited = verdict == RateLimiter::Verdict::ALLOW;
+                }
+                users[connfd].Init(connfd, clientAddress, listener.stats, limited);
+                if (secure && !users[connfd].StartTls()) {
+                    users[connfd].CloseConn();
+                    continue;
+                }
+                LOG_INFO << "Client Address: " << clientAddress.ToString() << " on " << listener.name;
+            } else if (sockfd == handoffChannel) {
+                // 新进程就绪时写一个字节；启动失败时读到EOF，继续由本进程服务
+                char ready = 0;
+                const bool started = read(handoffChannel, &ready, 1) == 1;
+                DelFD(epollfd, handoffChannel);
+                handoffChannel = -1;
+                if (started) {
+                    LOG_INFO << "new process " << handoffPid << " is ready, handing off listeners";
+                    handedOff = true;
+                } else {
+                    // 新进程关闭channel只会发生在退出时，这里等待不会阻塞多久
+                    int status = 0;
+                    waitpid(handoffPid, &status, 0);
+                    LOG_ERROR << "new process " << handoffPid << " failed to start (exit status "
+                        << (WIFEXITED(status) ? WEXITSTATUS(status) : -1) << "), keep serving";
+                }
+            } else if (sockfd == completionFd) {
+                http::CompletionQueue::Instance().Drain();
+            } else if (sockfd == proxyFd) {
+                proxy.Drain();
+            } else if (sockfd == proxyTimerFd) {
+                proxy.Tick();
+            } else if (proxy.Owns(sockfd)) {
+                proxy.HandleEvent(sockfd, events[i].events);
             } else if (events[i].events & (EPOLLRDHUP | EPOLLHUP |EPOLLERR)) {
                 users[sockfd].CloseConn();
+            } else if (users[sockfd].IsHandshaking()) {
+                // 握手在reactor中推进，完成后重新注册EPOLLIN等待请求
+                if (!users[sockfd].Handshake()) {
+                    users[sockfd].CloseConn();
+                }
+            } else if (users[sockfd].IsProxying()) {
+                // 转发期间客户端的读写都由Proxy处理，不经过线程池
+                proxy.HandleClient(users[sockfd]);
+            } else if (users[sockfd].IsWebSocket()) {
+                // 帧的读写在reactor中完成，只有收到的完整消息交给线程池
+                bool dispatch = false;
+                if (!users[sockfd].HandleWebSocket(events[i].events, dispatch)) {
+                    users[sockfd].CloseConn();
+                } else if (dispatch && !pool->Append(&users[sockfd])) {
+                    users[sockfd].WebSocketDispatchFailed();
+                }
             } else if (events[i].events & EPOLLIN) {
                 if (users[sockfd].Read()) {
-                    pool->Append(&users[sockfd]);
+                    Dispatch(users[sockfd], *pool);
                 } else {
                     users[sockfd].CloseConn();
                 }
             } else if (events[i].events & EPOLLOUT) {
-                if (!users[sockfd].Write()) {
-                    users[sockfd].CloseConn();
-                }
+                WriteConn(users[sockfd], sockfd, writeQueue, *pool);
+            }
+        }
+
+        // 每个排队的连接本轮只写一份预算，新排入的留到下一轮
+        for (std::size_t n = writeQueue.size(); n > 0; --n) {
+            const int sockfd = writeQueue.front();
+            writeQueue.pop_front();
+            // 排队期间连接可能已关闭，fd甚至已被新连接复用
+            if (users[sockfd].IsWriteQueued()) {
+                WriteConn(users[sockfd], sockfd, writeQueue, *pool);
             }
         }
+
+        if (!draining && (handedOff || g_stop)) {
+            startDrain();
+        }
+        if (draining && (HttpConn::GetUserCount() == 0 || GetMonotonicNanos() >= drainDeadline)) {
+            break;
+        }
+    }
+    capture::Recorder::Instance().Stop();
+    if (draining) {
+        const int remaining = HttpConn::GetUserCount();
+        if (remaining > 0) {
+            // 工作线程可能还在处理这些连接，不再等它们，也不析构它们引用的对象
+            LOG_WARN << "drain timeout, exiting with " << remaining << " connections open";
+            Logger::Stream().FlushAll();
+            std::_Exit(EXIT_SUCCESS);
+        }
+        LOG_INFO << "all connections drained, exiting";
     }
+    // 先等工作线程退出，之后才能释放连接表
+    pool.reset();
     close(epollfd);
-    close(listenfd);
+    for (const auto& listener : listeners) {
+        if (listener.fd == -1) {
+            continue;
+        }
+        close(listener.fd);
+        if (listener.addr.IsUnixPath()) {
+            unlink(listener.addr.UnixPath());
+        }
+    }
+    for (int i = 0; i < config.maxFd; ++i) {
+        users[i].~HttpConn();
+    }
     return 0;
 }
\ No newline at end of file
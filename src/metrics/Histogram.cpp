@@ -0,0 +1,68 @@
+//
+// Created by asujy on 2026/10/19.
+//
+
+#include "metrics/Histogram.h"
+
+#include <algorithm>
+#include <sstream>
+
+namespace metrics {
+    void LatencyHistogram::Merge(const LatencyHistogram& other) {
+        if (other.m_count == 0) {
+            return;
+        }
+        for (std::size_t i = 0; i < m_buckets.size(); ++i) {
+            m_buckets[i] += other.m_buckets[i];
+        }
+        m_min = (m_count == 0) ? other.m_min : std::min(m_min, other.m_min);
+        m_max = std::max(m_max, other.m_max);
+        m_count += other.m_count;
+        m_sum += other.m_sum;
+    }
+
+    void LatencyHistogram::Reset() {
+        std::fill(m_buckets.begin(), m_buckets.end(), 0);
+        m_count = 0;
+        m_sum = 0;
+        m_min = 0;
+        m_max = 0;
+    }
+
+    uint64_t LatencyHistogram::Percentile(double p) const {
+        if (m_count == 0) {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(p / 100.0 * m_count + 0.5);
+        if (rank == 0) {
+            rank = 1;
+        }
+        uint64_t seen = 0;
+        for (std::size_t i = 0; i < m_buckets.size(); ++i) {
+            seen += m_buckets[i];
+            if (seen >= rank) {
+                return std::min(Registry::BucketUpperBound(static_cast<int>(i)), m_max);
+            }
+        }
+        return m_max;
+    }
+
+    std::string LatencyHistogram::BucketsJson() const {
+        std::ostringstream oss;
+        oss << '[';
+        bool first = true;
+        for (std::size_t i = 0; i < m_buckets.size(); ++i) {
+            if (m_buckets[i] == 0) {
+                continue;
+            }
+            if (!first) {
+                oss << ',';
+            }
+            first = false;
+            oss << '[' << Registry::BucketUpperBound(static_cast<int>(i)) << ','
+                << m_buckets[i] << ']';
+        }
+        oss << ']';
+        return oss.str();
+    }
+}
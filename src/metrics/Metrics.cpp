@@ -0,0 +1,223 @@
+//
+// Created by asujy on 2026/10/19.
+//
+
+#include "metrics/Metrics.h"
+
+#include <sstream>
+
+namespace metrics {
+    constexpr int Registry::SHARD_NUM;
+    constexpr int Registry::BUCKET_NUM;
+    constexpr int Registry::STATUS_NUM;
+    constexpr int Registry::MAX_LISTENERS;
+    constexpr int Registry::MAX_SITES;
+
+    const int Registry::STATUS_CODES[Registry::STATUS_NUM - 1] = {
+        200, 206, 304, 400, 403, 404, 405, 413, 416, 429, 500, 503
+    };
+
+    namespace {
+        struct MetricDesc {
+            const char* name;
+            const char* help;
+        };
+
+        const MetricDesc g_counterDesc[static_cast<int>(Counter::COUNTER_NUM)] = {
+            {"webserver_accepts_total", "Accepted connections."},
+            {"webserver_bytes_read_total", "Bytes read from client sockets."},
+            {"webserver_bytes_written_total", "Bytes written to client sockets."},
+            {"webserver_cache_hits_total", "Content cache hits."},
+            {"webserver_cache_misses_total", "Content cache misses."},
+            {"webserver_write_eagain_total", "Response writes stalled on EAGAIN."},
+            {"webserver_write_yields_total", "Response writes paused because the per-wakeup write budget ran out."},
+            {"webserver_pool_rejected_total", "Requests dropped because the pool queue was full."},
+            {"webserver_capture_dropped_total", "Capture records dropped because the ring buffer was full."},
+            {"webserver_shed_requests_total", "Requests answered with 503 by admission control."},
+            {"webserver_shed_connections_total", "Connections answered with 503 because the connection limit was reached."},
+            {"webserver_rate_limited_conn_rate_total", "Connections rejected because the client opened connections too fast."},
+            {"webserver_rate_limited_conn_limit_total", "Connections rejected because the client had too many open connections."},
+            {"webserver_rate_limited_requests_total", "Requests rejected because the client sent requests too fast."},
+            {"webserver_rate_limit_untracked_total", "Connections or requests let through untracked because every rate-limit entry in their set had open connections."},
+            {"webserver_bundle_hits_total", "Requests served from resources embedded in the binary."},
+            {"webserver_deferred_cancelled_total", "Deferred responses cancelled because the client disconnected."},
+            {"webserver_uploads_total", "Uploads received completely into a temporary file."},
+            {"webserver_upload_spliced_bytes_total", "Upload bytes moved from the socket to disk with splice."},
+            {"webserver_h2_sessions_total", "Connections that switched to HTTP/2."},
+            {"webserver_h2_streams_total", "Requests received on HTTP/2 streams."},
+            {"webserver_tls_handshakes_total", "Completed TLS handshakes."},
+            {"webserver_tls_resumed_total", "TLS handshakes that resumed a session."},
+            {"webserver_tls_handshake_failures_total", "Failed TLS handshakes."},
+            {"webserver_ktls_send_total", "TLS connections with kernel TLS transmit offload."},
+            {"webserver_proxy_requests_total", "Requests forwarded to an upstream."},
+            {"webserver_proxy_connects_total", "New connections opened to upstreams."},
+            {"webserver_proxy_reused_total", "Proxied requests sent on a pooled keep-alive connection."},
+            {"webserver_proxy_retries_total", "Proxied requests retried on another upstream or connection."},
+            {"webserver_proxy_errors_total", "Proxied requests that ended with 502/504 or were cut short."},
+            {"webserver_proxy_spliced_bytes_total", "Bytes relayed between client and upstream with splice."},
+            {"webserver_ws_upgrades_total", "Connections upgraded to WebSocket."},
+            {"webserver_ws_messages_in_total", "WebSocket messages received."},
+            {"webserver_ws_messages_out_total", "WebSocket frames written."},
+            {"webserver_ws_dropped_total", "WebSocket messages dropped because a send queue was full."},
+            {"webserver_ws_slow_closed_total", "WebSocket connections closed because a send queue overflowed."},
+        };
+
+        const MetricDesc g_gaugeDesc[static_cast<int>(Gauge::GAUGE_NUM)] = {
+            {"webserver_active_connections", "Currently open client connections."},
+            {"webserver_pool_queue_depth", "Requests waiting in the thread pool queue."},
+            {"webserver_gzip_cache_bytes", "Bytes held by the compressed-variant cache."},
+            {"webserver_deferred_pending", "Deferred responses waiting for their handler to complete."},
+            {"webserver_proxy_idle_connections", "Idle keep-alive connections pooled per upstream."},
+            {"webserver_ws_connections", "Open WebSocket connections."},
+        };
+
+        const MetricDesc g_histogramDesc[static_cast<int>(Histogram::HISTOGRAM_NUM)] = {
+            {"webserver_pool_wait_microseconds", "Time requests spend queued before a worker picks them up."},
+            {"webserver_request_microseconds", "Time from the first request byte to the last response byte."},
+        };
+
+        const MetricDesc g_listenerDesc[static_cast<int>(ListenerStat::LISTENER_STAT_NUM)] = {
+            {"webserver_listener_accepts_total", "Accepted connections, by listening address."},
+            {"webserver_listener_rejected_total", "Connections refused by the connection or rate limits, by listening address."},
+            {"webserver_listener_connections", "Currently open client connections, by listening address."},
+        };
+
+        const MetricDesc g_siteDesc[static_cast<int>(SiteStat::SITE_STAT_NUM)] = {
+            {"webserver_site_requests_total", "Requests dispatched, by virtual host."},
+            {"webserver_site_cache_hits_total", "Gzip variant cache hits, by virtual host."},
+            {"webserver_site_cache_misses_total", "Gzip variant cache misses, by virtual host."},
+            {"webserver_site_gzip_cache_bytes", "Bytes held by the gzip variant cache, by virtual host."},
+        };
+
+        void WriteHeader(std::ostringstream& oss, const MetricDesc& desc, const char* type) {
+            oss << "# HELP " << desc.name << ' ' << desc.help << '\n';
+            oss << "# TYPE " << desc.name << ' ' << type << '\n';
+        }
+    }
+
+    void Registry::RecordStatus(int status) {
+        int slot = STATUS_NUM - 1;
+        for (int i = 0; i < STATUS_NUM - 1; ++i) {
+            if (STATUS_CODES[i] == status) {
+                slot = i;
+                break;
+            }
+        }
+        LocalShard().statuses[slot].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    int Registry::AddListener(const std::string& name) {
+        if (m_listenerCount == MAX_LISTENERS) {
+            return -1;
+        }
+        m_listeners[m_listenerCount].name = name;
+        return m_listenerCount++;
+    }
+
+    int Registry::AddSite(const std::string& name) {
+        if (m_siteCount == MAX_SITES) {
+            return -1;
+        }
+        m_sites[m_siteCount] = name;
+        return m_siteCount++;
+    }
+
+    uint64_t Registry::BucketUpperBound(int index) {
+        if (index < SUB_BUCKETS) {
+            return static_cast<uint64_t>(index);
+        }
+        const int exp = index / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+        const uint64_t sub = static_cast<uint64_t>(index % SUB_BUCKETS);
+        const int shift = exp - SUB_BUCKET_BITS;
+        const uint64_t lower = (static_cast<uint64_t>(SUB_BUCKETS) + sub) << shift;
+        return lower + ((1ULL << shift) - 1);
+    }
+
+    uint64_t Registry::SumCounter(int index) const {
+        uint64_t sum = 0;
+        for (const auto& shard : m_shards) {
+            sum += shard.counters[index].load(std::memory_order_relaxed);
+        }
+        return sum;
+    }
+
+    std::string Registry::Render() const {
+        std::ostringstream oss;
+
+        for (int i = 0; i < static_cast<int>(Counter::COUNTER_NUM); ++i) {
+            WriteHeader(oss, g_counterDesc[i], "counter");
+            oss << g_counterDesc[i].name << ' ' << SumCounter(i) << '\n';
+        }
+
+        for (int i = 0; i < static_cast<int>(Gauge::GAUGE_NUM); ++i) {
+            int64_t sum = 0;
+            for (const auto& shard : m_shards) {
+                sum += shard.gauges[i].load(std::memory_order_relaxed);
+            }
+            WriteHeader(oss, g_gaugeDesc[i], "gauge");
+            oss << g_gaugeDesc[i].name << ' ' << sum << '\n';
+        }
+
+        const MetricDesc requestsDesc{"webserver_requests_total", "Responses sent, by status code."};
+        WriteHeader(oss, requestsDesc, "counter");
+        for (int i = 0; i < STATUS_NUM; ++i) {
+            uint64_t sum = 0;
+            for (const auto& shard : m_shards) {
+                sum += shard.statuses[i].load(std::memory_order_relaxed);
+            }
+            oss << requestsDesc.name << "{code=\"";
+            if (i < STATUS_NUM - 1) {
+                oss << STATUS_CODES[i];
+            } else {
+                oss << "other";
+            }
+            oss << "\"} " << sum << '\n';
+        }
+
+        for (int s = 0; m_listenerCount > 0 && s < static_cast<int>(ListenerStat::LISTENER_STAT_NUM); ++s) {
+            WriteHeader(oss, g_listenerDesc[s], s == static_cast<int>(ListenerStat::CONNECTIONS) ? "gauge" : "counter");
+            for (int i = 0; i < m_listenerCount; ++i) {
+                oss << g_listenerDesc[s].name << "{listener=\"" << m_listeners[i].name << "\"} "
+                    << m_listeners[i].values[s].load(std::memory_order_relaxed) << '\n';
+            }
+        }
+
+        for (int s = 0; m_siteCount > 0 && s < static_cast<int>(SiteStat::SITE_STAT_NUM); ++s) {
+            WriteHeader(oss, g_siteDesc[s], s == static_cast<int>(SiteStat::CACHE_BYTES) ? "gauge" : "counter");
+            for (int i = 0; i < m_siteCount; ++i) {
+                int64_t sum = 0;
+                for (const auto& shard : m_shards) {
+                    sum += shard.sites[i][s].load(std::memory_order_relaxed);
+                }
+                oss << g_siteDesc[s].name << "{site=\"" << m_sites[i] << "\"} " << sum << '\n';
+            }
+        }
+
+        // 只输出非空的桶，le取桶的上界，计数是累积值
+        for (int h = 0; h < static_cast<int>(Histogram::HISTOGRAM_NUM); ++h) {
+            const char* name = g_histogramDesc[h].name;
+            WriteHeader(oss, g_histogramDesc[h], "histogram");
+            uint64_t cumulative = 0;
+            uint64_t sum = 0;
+            for (const auto& shard : m_shards) {
+                sum += shard.sums[h].load(std::memory_order_relaxed);
+            }
+            for (int b = 0; b < BUCKET_NUM; ++b) {
+                uint64_t count = 0;
+                for (const auto& shard : m_shards) {
+                    count += shard.buckets[h][b].load(std::memory_order_relaxed);
+                }
+                if (count == 0) {
+                    continue;
+                }
+                cumulative += count;
+                oss << name << "_bucket{le=\"" << BucketUpperBound(b) << "\"} "
+                    << cumulative << '\n';
+            }
+            oss << name << "_bucket{le=\"+Inf\"} " << cumulative << '\n';
+            oss << name << "_sum " << sum << '\n';
+            oss << name << "_count " << cumulative << '\n';
+        }
+        return oss.str();
+    }
+}
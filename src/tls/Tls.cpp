@@ -0,0 +1,249 @@
+//
+// Created by asujy on 2026/10/19.
+//
+
+#include "tls/Tls.h"
+#include "log/Logger.h"
+#include "metrics/Metrics.h"
+
+#include <openssl/err.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+
+namespace tls {
+    namespace {
+        std::string LastError() {
+            char buffer[256];
+            ERR_error_string_n(ERR_get_error(), buffer, sizeof(buffer));
+            return buffer;
+        }
+    }
+
+    constexpr std::size_t Connection::RECORD_SIZE;
+
+    Context::~Context() {
+        SSL_CTX_free(m_ctx);
+    }
+
+    bool Context::Configure(const Options& options) {
+        SSL_CTX* ctx = SSL_CTX_new(TLS_server_method());
+        if (ctx == nullptr) {
+            LOG_ERROR << "SSL_CTX_new failed: " << LastError();
+            return false;
+        }
+        SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+        // 对端不发close_notify直接断开时按正常关闭处理
+        uint64_t flags = SSL_OP_NO_RENEGOTIATION | SSL_OP_CIPHER_SERVER_PREFERENCE | SSL_OP_IGNORE_UNEXPECTED_EOF;
+#ifdef SSL_OP_ENABLE_KTLS
+        if (options.ktls) {
+            flags |= SSL_OP_ENABLE_KTLS;
+        }
+#else
+        if (options.ktls) {
+            LOG_WARN << "OpenSSL was built without kTLS support, encrypting in user space";
+        }
+#endif
+        SSL_CTX_set_options(ctx, flags);
+        // 空闲连接不保留读写缓冲区
+        SSL_CTX_set_mode(ctx, SSL_MODE_RELEASE_BUFFERS);
+
+        if (SSL_CTX_use_certificate_chain_file(ctx, options.cert.c_str()) != 1 ||
+            SSL_CTX_use_PrivateKey_file(ctx, options.key.c_str(), SSL_FILETYPE_PEM) != 1 ||
+            SSL_CTX_check_private_key(ctx) != 1) {
+            LOG_ERROR << "load tls certificate " << options.cert << " / " << options.key
+                << " failed: " << LastError();
+            SSL_CTX_free(ctx);
+            return false;
+        }
+
+        // 会话票据默认开启，票据密钥属于这个SSL_CTX；服务端缓存用于只带会话ID的客户端
+        static const unsigned char SESSION_ID_CONTEXT[] = "webserver";
+        SSL_CTX_set_session_id_context(ctx, SESSION_ID_CONTEXT, sizeof(SESSION_ID_CONTEXT) - 1);
+        if (options.sessionCacheSize > 0) {
+            SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+            SSL_CTX_sess_set_cache_size(ctx, options.sessionCacheSize);
+        } else {
+            SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+        }
+        SSL_CTX_set_timeout(ctx, options.sessionTimeout);
+
+        m_alpn.clear();
+        for (const auto& protocol : options.alpn) {
+            if (!protocol.empty() && protocol.size() < 256) {
+                m_alpn.push_back(static_cast<char>(protocol.size()));
+                m_alpn += protocol;
+            }
+        }
+        if (!m_alpn.empty()) {
+            SSL_CTX_set_alpn_select_cb(ctx, SelectAlpn, this);
+        }
+
+        SSL_CTX_free(m_ctx);
+        m_ctx = ctx;
+        return true;
+    }
+
+    int Context::SelectAlpn(SSL*, const unsigned char** out, unsigned char* outLen,
+                            const unsigned char* in, unsigned int inLen, void* arg) {
+        const Context* context = static_cast<const Context*>(arg);
+        unsigned char* selected = nullptr;
+        // 按服务端的优先级选择，没有共同的协议时不协商ALPN
+        if (SSL_select_next_proto(&selected, outLen,
+                reinterpret_cast<const unsigned char*>(context->m_alpn.data()),
+                static_cast<unsigned int>(context->m_alpn.size()), in, inLen) != OPENSSL_NPN_NEGOTIATED) {
+            return SSL_TLSEXT_ERR_NOACK;
+        }
+        *out = selected;
+        return SSL_TLSEXT_ERR_OK;
+    }
+
+    Connection::Connection(int fd) : m_fd(fd) {
+        SSL_CTX* ctx = Context::Instance().Get();
+        if (ctx == nullptr) {
+            return;
+        }
+        m_ssl = SSL_new(ctx);
+        if (m_ssl == nullptr || SSL_set_fd(m_ssl, fd) != 1) {
+            LOG_ERROR << "create tls connection failed: " << LastError();
+            SSL_free(m_ssl);
+            m_ssl = nullptr;
+            return;
+        }
+        SSL_set_accept_state(m_ssl);
+    }
+
+    Connection::~Connection() {
+        SSL_free(m_ssl);
+    }
+
+    HANDSHAKE Connection::Handshake() {
+        ERR_clear_error();
+        const int ret = SSL_do_handshake(m_ssl);
+        if (ret == 1) {
+            m_established = true;
+            metrics::Inc(metrics::Counter::TLS_HANDSHAKES);
+            if (SSL_session_reused(m_ssl)) {
+                metrics::Inc(metrics::Counter::TLS_RESUMED);
+            }
+#ifdef SSL_OP_ENABLE_KTLS
+            m_ktlsSend = BIO_get_ktls_send(SSL_get_wbio(m_ssl)) != 0;
+            if (m_ktlsSend) {
+                metrics::Inc(metrics::Counter::KTLS_SEND);
+            }
+#endif
+            return HANDSHAKE::DONE;
+        }
+        switch (SSL_get_error(m_ssl, ret)) {
+            case SSL_ERROR_WANT_READ:
+                return HANDSHAKE::WANT_READ;
+            case SSL_ERROR_WANT_WRITE:
+                return HANDSHAKE::WANT_WRITE;
+            default:
+                metrics::Inc(metrics::Counter::TLS_HANDSHAKE_FAILURES);
+                LOG_DEBUG << "tls handshake failed: " << LastError();
+                return HANDSHAKE::FAILED;
+        }
+    }
+
+    ssize_t Connection::Read(char* buffer, std::size_t len) {
+        ERR_clear_error();
+        const int n = SSL_read(m_ssl, buffer, static_cast<int>(std::min<std::size_t>(len, INT_MAX)));
+        if (n > 0) {
+            return n;
+        }
+        if (SSL_get_error(m_ssl, n) == SSL_ERROR_ZERO_RETURN) {
+            return 0;
+        }
+        return Fail(n);
+    }
+
+    ssize_t Connection::Writev(const struct iovec* iov, int count) {
+        if (m_pending > 0) {
+            const ssize_t n = Flush();
+            if (n < 0 || !m_pendingOwn) {
+                return n;
+            }
+            // Send()的数据已经写出，接着写调用方的数据
+        }
+        if (m_ktlsSend) {
+            return ::writev(m_fd, iov, count);
+        }
+        // 凑满一个记录再加密，避免响应头和响应体各占一个记录
+        m_record.resize(RECORD_SIZE);
+        std::size_t len = 0;
+        for (int i = 0; i < count && len < RECORD_SIZE; ++i) {
+            const std::size_t take = std::min(iov[i].iov_len, RECORD_SIZE - len);
+            std::memcpy(m_record.data() + len, iov[i].iov_base, take);
+            len += take;
+        }
+        if (len == 0) {
+            return 0;
+        }
+        m_pending = len;
+        m_pendingOwn = false;
+        return Flush();
+    }
+
+    bool Connection::Send(const char* data, std::size_t len) {
+        if (m_pending > 0 || len > RECORD_SIZE) {
+            return false;
+        }
+        m_record.resize(RECORD_SIZE);
+        std::memcpy(m_record.data(), data, len);
+        m_pending = len;
+        m_pendingOwn = true;
+        // EAGAIN时留到下一次Writev先发出
+        return Flush() > 0 || errno == EAGAIN;
+    }
+
+    std::size_t Connection::Pending() const {
+        return static_cast<std::size_t>(SSL_pending(m_ssl));
+    }
+
+    std::string Connection::Alpn() const {
+        const unsigned char* data = nullptr;
+        unsigned int len = 0;
+        SSL_get0_alpn_selected(m_ssl, &data, &len);
+        return data == nullptr ? std::string() : std::string(reinterpret_cast<const char*>(data), len);
+    }
+
+    void Connection::Shutdown() {
+        if (m_established) {
+            ERR_clear_error();
+            SSL_shutdown(m_ssl);
+        }
+    }
+
+    // 写出m_record中待发送的明文，失败时保留以便原样重试
+    ssize_t Connection::Flush() {
+        ERR_clear_error();
+        const int n = SSL_write(m_ssl, m_record.data(), static_cast<int>(m_pending));
+        if (n <= 0) {
+            return Fail(n);
+        }
+        m_pending = 0;
+        return n;
+    }
+
+    ssize_t Connection::Fail(int ret) {
+        switch (SSL_get_error(m_ssl, ret)) {
+            case SSL_ERROR_WANT_READ:
+            case SSL_ERROR_WANT_WRITE:
+                errno = EAGAIN;
+                break;
+            case SSL_ERROR_SYSCALL:
+                if (errno == 0) {
+                    errno = ECONNRESET;
+                }
+                break;
+            default:
+                LOG_DEBUG << "tls error: " << LastError();
+                errno = EPROTO;
+                break;
+        }
+        return -1;
+    }
+}
@@ -0,0 +1,110 @@
+//
+// Created by asujy on 2026/10/19.
+//
+
+#include "trace/Tracer.h"
+#include "common-lib/Utils.h"
+
+#include <fstream>
+#include <sstream>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace trace {
+    constexpr uint64_t Ring::CAPACITY;
+
+    std::atomic<bool> Tracer::m_enabled{false};
+    std::atomic<uint64_t> Tracer::m_nextRequestId{1};
+
+    namespace {
+        struct EventDesc {
+            const char* name;
+            char phase;   // b/e: 异步span的开始和结束，i: 瞬时事件
+        };
+
+        const EventDesc g_eventDesc[static_cast<int>(Event::EVENT_NUM)] = {
+            {"request", 'b'},
+            {"read", 'i'},
+            {"queue", 'b'},
+            {"queue", 'e'},
+            {"parse", 'i'},
+            {"file_open", 'b'},
+            {"file_open", 'e'},
+            {"first_byte", 'i'},
+            {"write_eagain", 'i'},
+            {"request", 'e'},
+        };
+    }
+
+    void Ring::Snapshot(std::vector<Record>& out) const {
+        const uint64_t head = m_head.load(std::memory_order_acquire);
+        const uint64_t begin = (head > CAPACITY) ? head - CAPACITY : 0;
+        for (uint64_t i = begin; i < head; ++i) {
+            out.push_back(m_records[i & (CAPACITY - 1)]);
+        }
+    }
+
+    Ring& Tracer::LocalRing() {
+        static thread_local Ring* ring = nullptr;
+        if (ring == nullptr) {
+            std::lock_guard<std::mutex> locker(m_mtx);
+            m_rings.emplace_back(new Ring(syscall(SYS_gettid)));
+            ring = m_rings.back().get();
+        }
+        return *ring;
+    }
+
+    void Tracer::Add(Event event, uint64_t requestId, int64_t arg) {
+        Record record{};
+        record.ts = GetMonotonicNanos();
+        record.requestId = requestId;
+        record.arg = arg;
+        record.event = event;
+        LocalRing().Push(record);
+    }
+
+    std::string Tracer::DumpJson() {
+        std::ostringstream oss;
+        oss << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+        bool first = true;
+        std::vector<Record> records;
+        std::lock_guard<std::mutex> locker(m_mtx);
+        for (const auto& ring : m_rings) {
+            records.clear();
+            ring->Snapshot(records);
+            for (const auto& record : records) {
+                const int index = static_cast<int>(record.event);
+                if (index < 0 || index >= static_cast<int>(Event::EVENT_NUM)) {
+                    continue;
+                }
+                const EventDesc& desc = g_eventDesc[index];
+                if (!first) {
+                    oss << ',';
+                }
+                first = false;
+                oss << "{\"name\":\"" << desc.name << "\",\"cat\":\"http\",\"ph\":\""
+                    << desc.phase << "\",\"ts\":" << record.ts / 1000 << '.'
+                    << (record.ts % 1000) / 100 << (record.ts % 100) / 10 << record.ts % 10
+                    << ",\"pid\":" << getpid() << ",\"tid\":" << ring->Tid();
+                if (desc.phase == 'i') {
+                    oss << ",\"s\":\"t\"";
+                } else {
+                    oss << ",\"id\":" << record.requestId;
+                }
+                oss << ",\"args\":{\"request\":" << record.requestId
+                    << ",\"arg\":" << record.arg << "}}";
+            }
+        }
+        oss << "]}\n";
+        return oss.str();
+    }
+
+    bool Tracer::DumpToFile(const std::string& file) {
+        std::ofstream ofs(file, std::ios::out | std::ios::trunc);
+        if (!ofs.is_open()) {
+            return false;
+        }
+        ofs << DumpJson();
+        return ofs.good();
+    }
+}